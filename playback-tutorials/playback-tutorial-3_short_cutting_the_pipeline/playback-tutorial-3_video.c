@@ -1,35 +1,68 @@
 #include <gst/gst.h>
 #include <gst/video/video.h>
+#include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <math.h>
 
-#define WIDTH 640
-#define HEIGHT 480
-#define FRAMERATE 30
-#define CHUNK_SIZE (WIDTH * HEIGHT * 4)  /* RGBA format, 4 bytes per pixel */
+#include "synth_frame.h"
+
+/*
+ * appsrc 合成视频源，也用作整条 pipeline 的吞吐测试数据源
+ *
+ * - 帧由 synth_frame.h 生成（查找表 + SIMD + 按行条带多线程），1080p / 4K 也能跑到 60 fps 以上
+ * - 生成和推送在单独的线程里，不再占用主循环（原来是 g_idle_add）；need-data / enough-data 控制启停
+ * - buffer 从 GstBufferPool 取，4K 每帧 33MB 不再反复分配
+ *
+ * 用法：
+ *   ./playback-tutorial-3_video [--size WxH] [--fps N] [--threads N] [--pattern N] [--sink "DESC"]
+ *     --sink "fakesink sync=false"：不显示，测 appsrc → videoconvert → sink 的整体吞吐
+ *     --pattern：0 彩条 / 1 圆形 / 2 等离子 / 3 移动线，默认 -1 每 100 帧轮换
+ *   ./playback-tutorial-3_video --bench [frames] [--size WxH] [--threads N]
+ *     不建 pipeline，只比较原始逐像素实现和新生成器的速度（以及两者的最大差值）
+ */
+
+#define DEFAULT_WIDTH 640
+#define DEFAULT_HEIGHT 480
+#define DEFAULT_FRAMERATE 30
 
 /* Structure to contain all our information */
 typedef struct _CustomData {
     GstElement *pipeline;
     GstElement *app_source;
-    GstElement *video_convert;
-    GstElement *video_sink;
+
+    gint width;
+    gint height;
+    gint framerate;
+    gint fixed_pattern;      /* >= 0: 固定图案；-1: 每 100 帧轮换 */
 
     guint64 num_frames;      /* Number of frames generated so far */
     gint pattern_type;       /* Pattern type for animation */
-    guint sourceid;          /* To control the GSource */
+
+    SynthFrame *synth;       /* 帧生成器 */
+    GstBufferPool *pool;     /* 输出 buffer 池 */
+
+    GThread *feeder;         /* 生成 + 推送线程 */
+    GMutex lock;
+    GCond cond;
+    gboolean feeding;        /* need-data 后为 TRUE，enough-data 后为 FALSE */
+    gboolean quit;
+
+    gint64 stats_start_us;   /* 吞吐统计 */
+    guint64 stats_frames;
+    gint64 stats_render_us;
 
     GMainLoop *main_loop;    /* GLib's Main Loop */
 } CustomData;
 
-/* Generate a simple animated pattern */
-static void generate_frame(guint8 *data, guint64 frame_count, gint pattern_type) {
+/* 原始实现：逐像素 double sin / sqrt，仅用于 --bench 对比 */
+static void generate_frame_reference(guint8 *data, gint width, gint height, guint64 frame_count, gint pattern_type) {
     int x, y;
     guint8 r, g, b;
 
-    for (y = 0; y < HEIGHT; y++) {
-        for (x = 0; x < WIDTH; x++) {
-            int offset = (y * WIDTH + x) * 4;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            int offset = (y * width + x) * 4;
 
             switch (pattern_type) {
                 case 0:  /* Moving color bars */
@@ -40,8 +73,8 @@ static void generate_frame(guint8 *data, guint64 frame_count, gint pattern_type)
 
                 case 1:  /* Circular pattern */
                     {
-                        int center_x = WIDTH / 2;
-                        int center_y = HEIGHT / 2;
+                        int center_x = width / 2;
+                        int center_y = height / 2;
                         int dx = x - center_x;
                         int dy = y - center_y;
                         float dist = sqrt(dx * dx + dy * dy);
@@ -72,32 +105,45 @@ static void generate_frame(guint8 *data, guint64 frame_count, gint pattern_type)
     }
 }
 
-/* This method is called by the idle GSource to push video frames */
+static GstCaps *make_video_caps(CustomData *data) {
+    return gst_caps_new_simple("video/x-raw",
+        "format", G_TYPE_STRING, "RGBA",
+        "width", G_TYPE_INT, data->width,
+        "height", G_TYPE_INT, data->height,
+        "framerate", GST_TYPE_FRACTION, data->framerate, 1,
+        NULL);
+}
+
+/* 生成一帧并推送；返回 FALSE 表示下游不再接收（flushing / EOS / 错误） */
 static gboolean push_data(CustomData *data) {
-    GstBuffer *buffer;
+    GstBuffer *buffer = NULL;
     GstFlowReturn ret;
     GstMapInfo map;
-    guint8 *raw_data;
+    gint64 t0;
 
-    /* Create a new buffer */
-    buffer = gst_buffer_new_and_alloc(CHUNK_SIZE);
+    /* 从池里取 buffer（下游释放后自动回到池中） */
+    ret = gst_buffer_pool_acquire_buffer(data->pool, &buffer, NULL);
+    if (ret != GST_FLOW_OK) {
+        g_print("Acquire buffer returned %d, stopping\n", ret);
+        return FALSE;
+    }
 
     /* Set timestamp and duration */
-    GST_BUFFER_TIMESTAMP(buffer) = gst_util_uint64_scale(data->num_frames, GST_SECOND, FRAMERATE);
-    GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale(1, GST_SECOND, FRAMERATE);
+    GST_BUFFER_TIMESTAMP(buffer) = gst_util_uint64_scale(data->num_frames, GST_SECOND, data->framerate);
+    GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale(1, GST_SECOND, data->framerate);
 
     /* Generate video frame */
+    t0 = g_get_monotonic_time();
     gst_buffer_map(buffer, &map, GST_MAP_WRITE);
-    raw_data = (guint8 *)map.data;
-
-    generate_frame(raw_data, data->num_frames, data->pattern_type);
-
+    synth_frame_render(data->synth, map.data, data->width * 4, data->num_frames, data->pattern_type);
     gst_buffer_unmap(buffer, &map);
+    data->stats_render_us += g_get_monotonic_time() - t0;
+
     data->num_frames++;
 
     /* Change pattern every 100 frames for variety */
-    if (data->num_frames % 100 == 0) {
-        data->pattern_type = (data->pattern_type + 1) % 3;
+    if (data->fixed_pattern < 0 && data->num_frames % 100 == 0) {
+        data->pattern_type = (data->pattern_type + 1) % SYNTH_PATTERN_COUNT;
     }
 
     /* Push the buffer */
@@ -109,24 +155,63 @@ static gboolean push_data(CustomData *data) {
         return FALSE;
     }
 
+    /* 每 2 秒打印一次吞吐：推送帧率和单帧生成耗时 */
+    data->stats_frames++;
+    gint64 now = g_get_monotonic_time();
+    if (data->stats_start_us == 0) {
+        data->stats_start_us = now;
+    } else if (now - data->stats_start_us >= 2 * G_USEC_PER_SEC) {
+        g_print("[synth] %dx%d %.1f fps, render %.2f ms/frame (%s, %d threads)\n",
+                data->width, data->height,
+                data->stats_frames * 1e6 / (now - data->stats_start_us),
+                data->stats_render_us / 1000.0 / data->stats_frames,
+                synth_frame_simd_name(), synth_frame_threads(data->synth));
+        data->stats_start_us = now;
+        data->stats_frames = 0;
+        data->stats_render_us = 0;
+    }
+
     return TRUE;
 }
 
+/* 生成 + 推送线程：feeding 为 TRUE 时连续推；appsrc block=TRUE，队列满时在 push 里等 */
+static gpointer feeder_thread(gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+
+    for (;;) {
+        g_mutex_lock(&data->lock);
+        while (!data->feeding && !data->quit)
+            g_cond_wait(&data->cond, &data->lock);
+        gboolean quit = data->quit;
+        g_mutex_unlock(&data->lock);
+
+        if (quit || !push_data(data))
+            break;
+    }
+
+    g_print("Feeder thread exited\n");
+    return NULL;
+}
+
 /* This signal callback triggers when appsrc needs data */
 static void start_feed(GstElement *source, guint size, CustomData *data) {
-    if (data->sourceid == 0) {
+    g_mutex_lock(&data->lock);
+    if (!data->feeding) {
         g_print("Start feeding video data\n");
-        data->sourceid = g_idle_add((GSourceFunc)push_data, data);
+        data->feeding = TRUE;
+        g_cond_signal(&data->cond);
     }
+    g_mutex_unlock(&data->lock);
 }
 
 /* This callback triggers when appsrc has enough data */
 static void stop_feed(GstElement *source, CustomData *data) {
-    if (data->sourceid != 0) {
+    g_mutex_lock(&data->lock);
+    if (data->feeding) {
         g_print("Stop feeding video data\n");
-        g_source_remove(data->sourceid);
-        data->sourceid = 0;
+        data->feeding = FALSE;
     }
+    g_mutex_unlock(&data->lock);
 }
 
 /* Error callback */
@@ -151,12 +236,7 @@ static void source_setup(GstElement *pipeline, GstElement *source, CustomData *d
     data->app_source = source;
 
     /* Configure video caps for appsrc */
-    video_caps = gst_caps_new_simple("video/x-raw",
-        "format", G_TYPE_STRING, "RGBA",
-        "width", G_TYPE_INT, WIDTH,
-        "height", G_TYPE_INT, HEIGHT,
-        "framerate", GST_TYPE_FRACTION, FRAMERATE, 1,
-        NULL);
+    video_caps = make_video_caps(data);
 
     g_object_set(source,
         "caps", video_caps,
@@ -175,34 +255,140 @@ static void eos_cb(GstBus *bus, GstMessage *msg, CustomData *data) {
     g_main_loop_quit(data->main_loop);
 }
 
+/* 输出 buffer 池：RGBA 紧凑排列（stride = width * 4） */
+static GstBufferPool *create_buffer_pool(CustomData *data) {
+    GstBufferPool *pool = gst_buffer_pool_new();
+    GstStructure *config = gst_buffer_pool_get_config(pool);
+    GstCaps *caps = make_video_caps(data);
+
+    gst_buffer_pool_config_set_params(config, caps, (guint)data->width * data->height * 4, 4, 0);
+    gst_caps_unref(caps);
+    if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE)) {
+        g_printerr("Failed to activate buffer pool\n");
+        gst_object_unref(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/* --bench：原始实现 vs 新生成器，每种图案各跑 frames 帧 */
+static int run_bench(gint width, gint height, gint threads, gint frames) {
+    gsize size = (gsize)width * height * 4;
+    guint8 *ref = g_malloc(size);
+    guint8 *out = g_malloc(size);
+    SynthFrame *synth = synth_frame_new(width, height, threads);
+    gint ref_frames = MAX(1, MIN(frames, 20)); /* 原始实现太慢，少跑几帧 */
+    gint pattern;
+
+    g_print("\n===== Frame generator benchmark: %dx%d RGBA, %s, %d threads =====\n",
+            width, height, synth_frame_simd_name(), synth_frame_threads(synth));
+    g_print("%-8s %14s %14s %10s %10s\n", "pattern", "reference fps", "synth fps", "speedup", "max diff");
+
+    for (pattern = 0; pattern < SYNTH_PATTERN_COUNT; pattern++) {
+        gint i, max_diff = 0;
+        gint64 t0;
+        double ref_fps, synth_fps;
+
+        /* 先各跑一帧，排除首次缺页 */
+        generate_frame_reference(ref, width, height, 0, pattern);
+        synth_frame_render(synth, out, width * 4, 0, pattern);
+
+        t0 = g_get_monotonic_time();
+        for (i = 0; i < ref_frames; i++)
+            generate_frame_reference(ref, width, height, i, pattern);
+        ref_fps = ref_frames * 1e6 / MAX(1, g_get_monotonic_time() - t0);
+
+        t0 = g_get_monotonic_time();
+        for (i = 0; i < frames; i++)
+            synth_frame_render(synth, out, width * 4, i, pattern);
+        synth_fps = frames * 1e6 / MAX(1, g_get_monotonic_time() - t0);
+
+        /* 同一帧号比较输出 */
+        generate_frame_reference(ref, width, height, frames - 1, pattern);
+        synth_frame_render(synth, out, width * 4, frames - 1, pattern);
+        for (gsize k = 0; k < size; k++)
+            max_diff = MAX(max_diff, abs((int)ref[k] - (int)out[k]));
+
+        g_print("%-8d %14.1f %14.1f %9.1fx %10d\n", pattern, ref_fps, synth_fps, synth_fps / ref_fps, max_diff);
+    }
+
+    synth_frame_free(synth);
+    g_free(ref);
+    g_free(out);
+    return 0;
+}
+
+static gboolean parse_size(const char *arg, gint *width, gint *height) {
+    return sscanf(arg, "%dx%d", width, height) == 2 && *width > 0 && *height > 0;
+}
+
 int main(int argc, char *argv[]) {
     CustomData data;
     GstBus *bus;
+    gint threads = 0;
+    gint bench_frames = 0;
+    const gchar *sink_desc = "videoconvert ! autovideosink sync=false"; // sync=false for real-time generation
+    gchar *launch;
+    int i;
 
     /* Initialize custom data structure */
     memset(&data, 0, sizeof(data));
     data.pattern_type = 0;
+    data.width = DEFAULT_WIDTH;
+    data.height = DEFAULT_HEIGHT;
+    data.framerate = DEFAULT_FRAMERATE;
+    data.fixed_pattern = -1;
 
     /* Initialize GStreamer */
     gst_init(&argc, &argv);
 
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+            if (!parse_size(argv[++i], &data.width, &data.height)) {
+                g_printerr("Invalid size %s (expected WxH)\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--fps") && i + 1 < argc) {
+            data.framerate = MAX(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]); /* 0 = CPU 核数 */
+        } else if (!strcmp(argv[i], "--pattern") && i + 1 < argc) {
+            data.fixed_pattern = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--sink") && i + 1 < argc) {
+            sink_desc = argv[++i];
+        } else if (!strcmp(argv[i], "--bench")) {
+            bench_frames = (i + 1 < argc && g_ascii_isdigit(argv[i + 1][0])) ? MAX(1, atoi(argv[++i])) : 300;
+        } else {
+            g_printerr("Usage: %s [--size WxH] [--fps N] [--threads N] [--pattern 0-3] [--sink \"DESC\"]\n"
+                       "       %s --bench [frames] [--size WxH] [--threads N]\n", argv[0], argv[0]);
+            return -1;
+        }
+    }
+
+    if (bench_frames > 0)
+        return run_bench(data.width, data.height, threads, bench_frames);
+
+    if (data.fixed_pattern >= 0)
+        data.pattern_type = data.fixed_pattern;
+
+    data.synth = synth_frame_new(data.width, data.height, threads);
+    g_mutex_init(&data.lock);
+    g_cond_init(&data.cond);
+
     /* Create a custom pipeline for video */
-    data.pipeline = gst_parse_launch(
-        "appsrc name=video_source ! "
-        "videoconvert ! "
-        "autovideosink sync=false",  // sync=false for real-time generation
-        NULL);
+    launch = g_strdup_printf("appsrc name=video_source ! %s", sink_desc);
+    data.pipeline = gst_parse_launch(launch, NULL);
+    g_free(launch);
+    if (!data.pipeline) {
+        g_printerr("Failed to create pipeline with sink \"%s\"\n", sink_desc);
+        return -1;
+    }
 
     /* Get the appsrc element */
     data.app_source = gst_bin_get_by_name(GST_BIN(data.pipeline), "video_source");
 
     /* Configure appsrc */
-    GstCaps *video_caps = gst_caps_new_simple("video/x-raw",
-        "format", G_TYPE_STRING, "RGBA",
-        "width", G_TYPE_INT, WIDTH,
-        "height", G_TYPE_INT, HEIGHT,
-        "framerate", GST_TYPE_FRACTION, FRAMERATE, 1,
-        NULL);
+    GstCaps *video_caps = make_video_caps(&data);
 
     g_object_set(data.app_source,
         "caps", video_caps,
@@ -214,6 +400,13 @@ int main(int argc, char *argv[]) {
     g_signal_connect(data.app_source, "enough-data", G_CALLBACK(stop_feed), &data);
     gst_caps_unref(video_caps);
 
+    data.pool = create_buffer_pool(&data);
+    if (!data.pool) {
+        gst_object_unref(data.app_source);
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+
     /* Set up bus monitoring */
     bus = gst_element_get_bus(data.pipeline);
     gst_bus_add_signal_watch(bus);
@@ -221,23 +414,38 @@ int main(int argc, char *argv[]) {
     g_signal_connect(G_OBJECT(bus), "message::eos", (GCallback)eos_cb, &data);
     gst_object_unref(bus);
 
+    data.feeder = g_thread_new("synth-feeder", feeder_thread, &data);
+
     /* Start playing */
     gst_element_set_state(data.pipeline, GST_STATE_PLAYING);
 
     /* Create and run main loop */
     data.main_loop = g_main_loop_new(NULL, FALSE);
-    g_print("Video generation started. Press Ctrl+C to stop.\n");
+    g_print("Video generation started (%dx%d@%d, %s, %d threads). Press Ctrl+C to stop.\n",
+            data.width, data.height, data.framerate, synth_frame_simd_name(), synth_frame_threads(data.synth));
     g_main_loop_run(data.main_loop);
 
-    /* Cleanup */
+    /* Cleanup：先让推送线程退出（appsrc 进入 flushing 后阻塞中的 push 会返回），再释放 */
+    g_mutex_lock(&data.lock);
+    data.quit = TRUE;
+    g_cond_signal(&data.cond);
+    g_mutex_unlock(&data.lock);
+
     gst_element_set_state(data.pipeline, GST_STATE_NULL);
+    g_thread_join(data.feeder);
+
+    gst_buffer_pool_set_active(data.pool, FALSE);
+    gst_object_unref(data.pool);
     if (data.app_source) {
         gst_object_unref(data.app_source);
     }
     gst_object_unref(data.pipeline);
     g_main_loop_unref(data.main_loop);
+    synth_frame_free(data.synth);
+    g_mutex_clear(&data.lock);
+    g_cond_clear(&data.cond);
 
     return 0;
 }
 
-//gcc playback-tutorial-3_video.c -o playback-tutorial-3_video -lm `pkg-config --cflags --libs gstreamer-1.0`
+//gcc -O2 playback-tutorial-3_video.c -o playback-tutorial-3_video -lm `pkg-config --cflags --libs gstreamer-1.0`
@@ -0,0 +1,529 @@
+#pragma once
+
+/*
+ * 多路帧批处理（给推理运行时用）
+ *
+ * TensorPool
+ *   - 预先分配若干块连续、64 字节对齐的张量内存，每块能放 max_batch 帧（NCHW 或 NHWC，uint8 或 float32）
+ *   - acquire() 借出一块，返回的 shared_ptr 析构时自动归还；池子用完返回空指针，
+ *     调用者丢掉这一批，内存占用始终有上限
+ *
+ * BatchCollector
+ *   - push() 在各路 appsink 线程里调用，每路只保留最新一帧（旧帧还没进批就被覆盖的计入 replaced）
+ *   - 收集线程：第一帧到达后开一个时间窗（window_ms），N 路都到齐或者窗口超时就出一批
+ *   - 组批：每帧缩放到统一分辨率后写进张量的第 i 个槽位；NV12 / I420 先缩放 Y / UV 平面再做
+ *     YUV → BGR（yuv2bgr.h），转换量只有目标尺寸那么大，不用先整帧转 BGR
+ *   - 每批带上每帧的源 ID、PTS、帧龄，回调在收集线程里执行，推理慢了只会让池子借空、丢批，
+ *     不会阻塞 appsink
+ */
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "frame_handle.h"
+
+enum class TensorLayout
+{
+    NCHW,
+    NHWC
+};
+
+enum class TensorType
+{
+    U8,
+    F32
+};
+
+/* 单帧的张量形状；F32 时值为 pixel * scale + bias（默认归一化到 0..1） */
+struct TensorShape
+{
+    int width = 640;
+    int height = 640;
+    TensorLayout layout = TensorLayout::NCHW;
+    TensorType type = TensorType::F32;
+    bool rgb = true; // 通道顺序：true 为 RGB，false 为 BGR
+    float scale = 1.0f / 255.0f;
+    float bias = 0.0f;
+
+    size_t element_size() const { return type == TensorType::F32 ? sizeof(float) : 1; }
+    size_t frame_bytes() const { return (size_t)width * height * 3 * element_size(); }
+};
+
+static inline const char *tensor_layout_name(TensorLayout layout)
+{
+    return layout == TensorLayout::NCHW ? "NCHW" : "NHWC";
+}
+
+static inline const char *tensor_type_name(TensorType type)
+{
+    return type == TensorType::F32 ? "f32" : "u8";
+}
+
+/* 批内每一帧的来源信息，和张量槽位一一对应 */
+struct BatchEntry
+{
+    int source_id = -1;
+    GstClockTime pts = GST_CLOCK_TIME_NONE;
+    gint64 created_us = 0; // appsink 交付时刻
+    gint64 age_us = 0;     // 组批完成时的帧龄
+};
+
+class TensorBatch
+{
+public:
+    TensorBatch(const TensorShape &shape, int max_batch)
+        : shape_(shape), max_batch_(max_batch)
+    {
+        bytes_ = (shape.frame_bytes() * max_batch + 63) & ~(size_t)63;
+        data_ = static_cast<guint8 *>(aligned_alloc(64, bytes_));
+        entries.reserve(max_batch);
+    }
+
+    ~TensorBatch() { free(data_); }
+
+    TensorBatch(const TensorBatch &) = delete;
+    TensorBatch &operator=(const TensorBatch &) = delete;
+
+    const TensorShape &shape() const { return shape_; }
+    int max_batch() const { return max_batch_; }
+    int size() const { return (int)entries.size(); }
+
+    /* 整块连续内存，前 size() 个槽位有效 */
+    void *data() { return data_; }
+    const void *data() const { return data_; }
+    size_t bytes() const { return shape_.frame_bytes() * entries.size(); }
+
+    guint8 *slot(int index) { return data_ + shape_.frame_bytes() * index; }
+
+    std::vector<BatchEntry> entries;
+    gint64 assemble_us = 0; // 组批耗时
+
+private:
+    TensorShape shape_;
+    int max_batch_ = 0;
+    size_t bytes_ = 0;
+    guint8 *data_ = nullptr;
+};
+
+class TensorPool
+{
+public:
+    TensorPool(const TensorShape &shape, int max_batch, int buffers)
+        : state_(std::make_shared<State>())
+    {
+        for (int i = 0; i < buffers; i++)
+            state_->free.push_back(new TensorBatch(shape, max_batch));
+        state_->total = buffers;
+    }
+
+    /* 借出一块；池子空了返回 nullptr。shared_ptr 析构时归还，池子先销毁也没关系 */
+    std::shared_ptr<TensorBatch> acquire()
+    {
+        std::shared_ptr<State> state = state_;
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->free.empty())
+            return nullptr;
+
+        TensorBatch *batch = state->free.back();
+        state->free.pop_back();
+        batch->entries.clear();
+        batch->assemble_us = 0;
+
+        return std::shared_ptr<TensorBatch>(batch, [state](TensorBatch *b) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->free.push_back(b);
+        });
+    }
+
+    int available() const
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return (int)state_->free.size();
+    }
+
+    int total() const { return state_->total; }
+
+private:
+    struct State
+    {
+        std::mutex mutex;
+        std::vector<TensorBatch *> free;
+        int total = 0;
+
+        ~State()
+        {
+            for (TensorBatch *b : free)
+                delete b;
+        }
+    };
+
+    std::shared_ptr<State> state_;
+};
+
+class BatchCollector
+{
+public:
+    struct Options
+    {
+        int sources = 1;
+        TensorShape shape;
+        int window_ms = 20;   // 第一帧到达后最多再等多久
+        int max_age_ms = 500; // 比这更旧的帧不进批（某路卡住时不拿旧画面凑数）
+        int pool_size = 3;
+        bool resize_yuv = true; // false：先整帧 bgr() 再缩放（对照用）
+    };
+
+    using Callback = std::function<void(std::shared_ptr<TensorBatch>)>;
+
+    struct Stats
+    {
+        std::atomic<guint64> batches{0};
+        std::atomic<guint64> frames{0};
+        std::atomic<guint64> pushed{0};
+        std::atomic<guint64> replaced{0};   // 进批之前就被新帧覆盖
+        std::atomic<guint64> stale{0};      // 超过 max_age_ms 被跳过
+        std::atomic<guint64> timeouts{0};   // 窗口超时、没等齐 N 路就出批
+        std::atomic<guint64> pool_drops{0}; // 张量池借空，整批丢弃
+        std::atomic<guint64> assemble_us{0};
+        std::atomic<guint64> assemble_us_max{0};
+    };
+
+    BatchCollector(const Options &options, Callback callback)
+        : options_(options), callback_(std::move(callback)),
+          pool_(options.shape, options.sources, options.pool_size),
+          latest_(options.sources), fresh_(options.sources, false), scratch_(options.sources)
+    {
+    }
+
+    ~BatchCollector() { stop(); }
+
+    void start()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (running_)
+                return;
+            running_ = true;
+        }
+        thread_ = std::thread(&BatchCollector::run, this);
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_)
+                return;
+            running_ = false;
+        }
+        cond_.notify_all();
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    /* appsink 线程调用：只换掉该路的最新帧，持锁时间只有几次指针赋值 */
+    void push(int source, FrameHandle frame)
+    {
+        if (source < 0 || source >= options_.sources || !frame.valid())
+            return;
+
+        stats_.pushed.fetch_add(1, std::memory_order_relaxed);
+        bool notify = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (fresh_[source])
+                stats_.replaced.fetch_add(1, std::memory_order_relaxed);
+            else
+            {
+                if (fresh_count_ == 0)
+                    window_start_us_ = g_get_monotonic_time();
+                fresh_[source] = true;
+                fresh_count_++;
+                notify = fresh_count_ == 1 || fresh_count_ == options_.sources;
+            }
+            latest_[source] = std::move(frame);
+        }
+        if (notify)
+            cond_.notify_one();
+    }
+
+    /* 把 frames 缩放写进 batch 的槽位 0..n-1，填好 entries；收集线程和 benchmark 共用 */
+    bool assemble(const std::vector<std::pair<int, FrameHandle>> &frames, TensorBatch &batch)
+    {
+        gint64 begin = g_get_monotonic_time();
+        int n = std::min((int)frames.size(), batch.max_batch());
+        if ((int)scratch_.size() < n)
+            scratch_.resize(n);
+
+        batch.entries.assign(n, BatchEntry());
+        std::vector<char> ok(n, 0);
+
+        // 每帧一个任务，各用各的临时缓冲，互不共享
+        cv::parallel_for_(cv::Range(0, n), [&](const cv::Range &range) {
+            for (int i = range.start; i < range.end; i++)
+                ok[i] = fill_slot(frames[i].second, batch.slot(i), scratch_[i]);
+        });
+
+        // 失败的帧（不支持的格式）从批里挪掉，保持槽位连续
+        int out = 0;
+        gint64 end = g_get_monotonic_time();
+        for (int i = 0; i < n; i++)
+        {
+            if (!ok[i])
+                continue;
+            if (out != i)
+                memcpy(batch.slot(out), batch.slot(i), options_.shape.frame_bytes());
+
+            BatchEntry &e = batch.entries[out++];
+            e.source_id = frames[i].first;
+            e.pts = frames[i].second.pts();
+            e.created_us = frames[i].second.created_us();
+            e.age_us = end - e.created_us;
+        }
+        batch.entries.resize(out);
+        batch.assemble_us = end - begin;
+        return out > 0;
+    }
+
+    const Stats &stats() const { return stats_; }
+    const Options &options() const { return options_; }
+    TensorPool &pool() { return pool_; }
+
+    void report(const char *tag) const
+    {
+        guint64 batches = stats_.batches.load();
+        g_print("[%s] batches %" G_GUINT64_FORMAT ", frames/batch %.2f, assemble avg %.2f ms max %.2f ms, "
+                "replaced %" G_GUINT64_FORMAT ", stale %" G_GUINT64_FORMAT ", timeouts %" G_GUINT64_FORMAT
+                ", pool drops %" G_GUINT64_FORMAT "\n",
+                tag, batches, batches ? (double)stats_.frames.load() / batches : 0.0,
+                batches ? stats_.assemble_us.load() / 1000.0 / batches : 0.0, stats_.assemble_us_max.load() / 1000.0,
+                stats_.replaced.load(), stats_.stale.load(), stats_.timeouts.load(), stats_.pool_drops.load());
+    }
+
+private:
+    /* 每个槽位的临时缓冲，复用以免每帧分配 */
+    struct Scratch
+    {
+        cv::Mat y, u, v, uv;
+        cv::Mat bgr;
+        cv::Mat rgb;
+        std::vector<cv::Mat> planes;
+    };
+
+    /* 缩放到目标尺寸的 BGR；NV12 / I420 先缩放平面再转换 */
+    bool resize_bgr(const FrameHandle &frame, cv::Mat &dst, Scratch &s) const
+    {
+        const TensorShape &shape = options_.shape;
+        cv::Size size(shape.width, shape.height);
+
+        if (frame.is_yuv() && options_.resize_yuv && !(shape.width & 1) && !(shape.height & 1))
+        {
+            const GstVideoInfo &info = frame.info();
+            YuvView view = yuv_view(info, frame.data());
+            cv::Size half(shape.width / 2, shape.height / 2);
+            int cw = (view.width + 1) / 2, ch = (view.height + 1) / 2;
+
+            if (view.width != shape.width || view.height != shape.height)
+            {
+                cv::resize(frame.luma(), s.y, size, 0, 0, cv::INTER_LINEAR);
+                if (view.nv12)
+                {
+                    cv::Mat uv(ch, cw, CV_8UC2, const_cast<guint8 *>(view.u), view.uv_stride);
+                    cv::resize(uv, s.uv, half, 0, 0, cv::INTER_LINEAR);
+                    view.u = s.uv.data;
+                    view.v = s.uv.data + 1;
+                    view.uv_stride = (int)s.uv.step;
+                }
+                else
+                {
+                    cv::Mat u(ch, cw, CV_8UC1, const_cast<guint8 *>(view.u), view.uv_stride);
+                    cv::Mat v(ch, cw, CV_8UC1, const_cast<guint8 *>(view.v), view.uv_stride);
+                    cv::resize(u, s.u, half, 0, 0, cv::INTER_LINEAR);
+                    cv::resize(v, s.v, half, 0, 0, cv::INTER_LINEAR);
+                    view.u = s.u.data;
+                    view.v = s.v.data;
+                    view.uv_stride = (int)s.u.step;
+                }
+                view.y = s.y.data;
+                view.y_stride = (int)s.y.step;
+                view.width = shape.width;
+                view.height = shape.height;
+            }
+
+            dst.create(size, CV_8UC3);
+            yuv_to_bgr(view, dst.data, (int)dst.step);
+            return true;
+        }
+
+        const cv::Mat &bgr = frame.bgr();
+        if (bgr.empty())
+            return false;
+        if (bgr.cols == shape.width && bgr.rows == shape.height)
+            bgr.copyTo(dst);
+        else
+            cv::resize(bgr, dst, size, 0, 0, cv::INTER_LINEAR);
+        return true;
+    }
+
+    /* 写一个张量槽位；NHWC u8 BGR 时直接缩放进槽位，其余经过一次 BGR 临时图 */
+    bool fill_slot(const FrameHandle &frame, guint8 *slot, Scratch &s) const
+    {
+        const TensorShape &shape = options_.shape;
+        int w = shape.width, h = shape.height;
+
+        if (shape.layout == TensorLayout::NHWC && shape.type == TensorType::U8)
+        {
+            // 尺寸类型一致时 create / resize 不会重新分配，结果直接落在槽位里
+            cv::Mat view(h, w, CV_8UC3, slot);
+            if (!shape.rgb)
+                return resize_bgr(frame, view, s);
+            if (!resize_bgr(frame, s.bgr, s))
+                return false;
+            cv::cvtColor(s.bgr, view, cv::COLOR_BGR2RGB);
+            return true;
+        }
+
+        if (!resize_bgr(frame, s.bgr, s))
+            return false;
+
+        if (shape.layout == TensorLayout::NHWC)
+        {
+            cv::Mat view(h, w, CV_32FC3, slot);
+            if (shape.rgb)
+            {
+                cv::cvtColor(s.bgr, s.rgb, cv::COLOR_BGR2RGB);
+                s.rgb.convertTo(view, CV_32F, shape.scale, shape.bias);
+            }
+            else
+                s.bgr.convertTo(view, CV_32F, shape.scale, shape.bias);
+            return true;
+        }
+
+        // NCHW：按通道拆成三个平面，RGB 时 B / R 对调
+        size_t plane_bytes = (size_t)w * h * shape.element_size();
+        if (shape.type == TensorType::U8)
+        {
+            // split 的输出直接指向槽位里的平面，不再拷贝
+            std::vector<cv::Mat> planes(3);
+            for (int c = 0; c < 3; c++)
+                planes[c] = cv::Mat(h, w, CV_8UC1, slot + plane_bytes * (shape.rgb ? 2 - c : c));
+            cv::split(s.bgr, planes);
+            return true;
+        }
+
+        cv::split(s.bgr, s.planes);
+        for (int c = 0; c < 3; c++)
+        {
+            cv::Mat view(h, w, CV_32FC1, slot + plane_bytes * (shape.rgb ? 2 - c : c));
+            s.planes[c].convertTo(view, CV_32F, shape.scale, shape.bias);
+        }
+        return true;
+    }
+
+    void run()
+    {
+        std::vector<std::pair<int, FrameHandle>> frames;
+        frames.reserve(options_.sources);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_)
+        {
+            cond_.wait(lock, [this]() { return !running_ || fresh_count_ > 0; });
+            if (!running_)
+                break;
+
+            // 时间窗：等齐 N 路，或者从第一帧起超过 window_ms
+            gint64 deadline = window_start_us_ + (gint64)options_.window_ms * 1000;
+            while (running_ && fresh_count_ < options_.sources)
+            {
+                gint64 left = deadline - g_get_monotonic_time();
+                if (left <= 0)
+                    break;
+                cond_.wait_for(lock, std::chrono::microseconds(left));
+            }
+            if (!running_)
+                break;
+
+            if (fresh_count_ < options_.sources)
+                stats_.timeouts.fetch_add(1, std::memory_order_relaxed);
+
+            gint64 now = g_get_monotonic_time();
+            frames.clear();
+            for (int i = 0; i < options_.sources; i++)
+            {
+                if (!fresh_[i])
+                    continue;
+                fresh_[i] = false;
+                FrameHandle frame = std::move(latest_[i]);
+                latest_[i].reset();
+                if (now - frame.created_us() > (gint64)options_.max_age_ms * 1000)
+                {
+                    stats_.stale.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                frames.emplace_back(i, std::move(frame));
+            }
+            fresh_count_ = 0;
+
+            // 组批和回调都不持锁，appsink 可以继续 push 下一轮
+            lock.unlock();
+            if (!frames.empty())
+                emit(frames);
+            frames.clear(); // 尽早释放帧句柄，buffer 回到解码器的池子
+            lock.lock();
+        }
+    }
+
+    void emit(const std::vector<std::pair<int, FrameHandle>> &frames)
+    {
+        std::shared_ptr<TensorBatch> batch = pool_.acquire();
+        if (!batch)
+        {
+            stats_.pool_drops.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        if (!assemble(frames, *batch))
+            return;
+
+        guint64 us = batch->assemble_us;
+        stats_.batches.fetch_add(1, std::memory_order_relaxed);
+        stats_.frames.fetch_add(batch->size(), std::memory_order_relaxed);
+        stats_.assemble_us.fetch_add(us, std::memory_order_relaxed);
+        if (us > stats_.assemble_us_max.load(std::memory_order_relaxed))
+            stats_.assemble_us_max.store(us, std::memory_order_relaxed);
+
+        if (callback_)
+            callback_(std::move(batch));
+    }
+
+    Options options_;
+    Callback callback_;
+    TensorPool pool_;
+    Stats stats_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<FrameHandle> latest_;
+    std::vector<bool> fresh_;
+    int fresh_count_ = 0;
+    gint64 window_start_us_ = 0;
+    bool running_ = false;
+    std::thread thread_;
+
+    std::vector<Scratch> scratch_; // 仅收集线程（或 benchmark 调用者）使用
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+/*
+ * 推流自适应码率（AIMD）
+ *
+ * BitrateController
+ *   - 观测：编码后 queue 的 current-level-time（上行发不出去时先在这里堆积）、
+ *     queue overrun（leaky 丢帧）、sink 的 QoS 消息（迟到的 buffer）
+ *   - 每 interval_ms 决策一次：
+ *       水位 > high_level、有丢帧或 QoS → 码率乘以 decrease（乘性减），之后冷却 hold_ticks 个周期
+ *       水位 < low_level 连续 increase_after 个周期 → 码率加 step（加性增），不超过 max
+ *   - 码率已经在下限还拥塞：抬高 qp-min（每次 +2，最多到 qp-max）；恢复后先把 qp-min 降回来再加码率
+ *   - 运行时改码率由 encoder_set_bitrate() 按编码器映射；x265enc 不支持运行时修改，只能调 QP
+ *
+ * LinkThrottle
+ *   - 在 pad 上按令牌桶节流（kbps），模拟受限的上行链路：发不出去的数据阻塞在 sink 线程，
+ *     上游 queue 水位随之上涨，和真实的 TCP 推流拥塞表现一致，不需要 tc / root 权限
+ */
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+#include "encoder_backend.h"
+
+class BitrateController
+{
+public:
+    struct Options
+    {
+        int min_kbps = 300;
+        int max_kbps = 4000;
+        GstClockTime high_level = 150 * GST_MSECOND; // 超过即降码率
+        GstClockTime low_level = 40 * GST_MSECOND;   // 低于才允许升码率
+        double decrease = 0.7;
+        int step_kbps = 0;        // 0 = max 的 5%
+        int increase_after = 4;   // 连续几个周期水位低才加码率
+        int hold_ticks = 2;       // 降码率后的冷却，等队列里的旧码率数据发完
+        int interval_ms = 500;
+    };
+
+    struct Stats
+    {
+        std::atomic<guint64> drops{0};
+        std::atomic<guint64> qos{0};
+        guint64 decreases = 0;
+        guint64 increases = 0;
+        guint64 qp_raises = 0;
+        guint64 ticks = 0;
+        guint64 level_sum_ms = 0;
+        guint64 level_max_ms = 0;
+        int kbps = 0;
+        int qp_min = 0;
+    };
+
+    BitrateController(GstElement *enc, const EncoderBackend *backend, GstElement *queue,
+                      const EncoderSettings &settings, const Options &options)
+        : enc_(enc), backend_(backend), queue_(queue), settings_(settings), options_(options)
+    {
+        if (options_.step_kbps <= 0)
+            options_.step_kbps = std::max(50, options_.max_kbps / 20);
+        kbps_ = std::min(options_.max_kbps, std::max(options_.min_kbps, settings.bitrate_kbps));
+        qp_min_ = settings.qp_min;
+        stats_.kbps = kbps_;
+        stats_.qp_min = qp_min_;
+    }
+
+    ~BitrateController() { stop(); }
+
+    /* 连接 overrun 信号并启动主循环定时器 */
+    void start()
+    {
+        // queue 在 silent=TRUE 时不发 overrun 信号（推流分支默认是 silent），这里必须打开
+        g_object_set(queue_, "silent", FALSE, NULL);
+        overrun_id_ = g_signal_connect(queue_, "overrun", G_CALLBACK(overrun_cb), this);
+        timer_id_ = g_timeout_add(options_.interval_ms, tick_cb, this);
+    }
+
+    void stop()
+    {
+        if (timer_id_)
+            g_source_remove(timer_id_);
+        if (overrun_id_)
+            g_signal_handler_disconnect(queue_, overrun_id_);
+        timer_id_ = 0;
+        overrun_id_ = 0;
+    }
+
+    /* bus 上来自本分支 sink 的 QoS 消息（任意线程） */
+    void on_qos() { stats_.qos.fetch_add(1, std::memory_order_relaxed); }
+
+    const Stats &stats() const { return stats_; }
+    int kbps() const { return kbps_; }
+
+    void print_stats(const char *tag) const
+    {
+        g_print("[abr %s] %d kbps, qp-min %d, level avg %.0f ms max %" G_GUINT64_FORMAT " ms, drops %" G_GUINT64_FORMAT
+                ", qos %" G_GUINT64_FORMAT ", down %" G_GUINT64_FORMAT " up %" G_GUINT64_FORMAT " qp+ %" G_GUINT64_FORMAT "\n",
+                tag, kbps_, qp_min_, stats_.ticks ? (double)stats_.level_sum_ms / stats_.ticks : 0.0,
+                stats_.level_max_ms, stats_.drops.load(), stats_.qos.load(), stats_.decreases, stats_.increases,
+                stats_.qp_raises);
+    }
+
+    /* 一次决策，定时器里调用；benchmark 也可以直接调 */
+    void tick()
+    {
+        guint64 level_ns = 0;
+        g_object_get(queue_, "current-level-time", &level_ns, NULL);
+        guint64 level_ms = level_ns / GST_MSECOND;
+
+        guint64 drops = stats_.drops.load(std::memory_order_relaxed);
+        guint64 qos = stats_.qos.load(std::memory_order_relaxed);
+        bool congested = level_ns > options_.high_level || drops > last_drops_ || qos > last_qos_;
+        last_drops_ = drops;
+        last_qos_ = qos;
+
+        stats_.ticks++;
+        stats_.level_sum_ms += level_ms;
+        stats_.level_max_ms = std::max(stats_.level_max_ms, level_ms);
+
+        if (hold_ > 0)
+        {
+            hold_--;
+            return;
+        }
+
+        if (congested)
+        {
+            calm_ticks_ = 0;
+            hold_ = options_.hold_ticks;
+
+            if (kbps_ > options_.min_kbps)
+            {
+                kbps_ = std::max(options_.min_kbps, (int)(kbps_ * options_.decrease));
+                apply_bitrate();
+                stats_.decreases++;
+            }
+            else if (qp_min_ + 2 <= settings_.qp_max)
+            {
+                qp_min_ += 2;
+                encoder_set_qp_min(enc_, *backend_, qp_min_);
+                stats_.qp_raises++;
+            }
+            return;
+        }
+
+        if (level_ns >= options_.low_level || ++calm_ticks_ < options_.increase_after)
+            return;
+        calm_ticks_ = 0;
+
+        // 恢复顺序和降级相反：先把 QP 放回去，再加码率
+        if (qp_min_ > settings_.qp_min)
+        {
+            qp_min_ = std::max(settings_.qp_min, qp_min_ - 2);
+            encoder_set_qp_min(enc_, *backend_, qp_min_);
+        }
+        else if (kbps_ < options_.max_kbps)
+        {
+            kbps_ = std::min(options_.max_kbps, kbps_ + options_.step_kbps);
+            apply_bitrate();
+            stats_.increases++;
+        }
+    }
+
+private:
+    void apply_bitrate()
+    {
+        encoder_set_bitrate(enc_, *backend_, kbps_, kbps_ * 9 / 8, kbps_ * 7 / 8);
+        stats_.kbps = kbps_;
+        stats_.qp_min = qp_min_;
+    }
+
+    static void overrun_cb(GstElement *queue, gpointer user_data)
+    {
+        static_cast<BitrateController *>(user_data)->stats_.drops.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static gboolean tick_cb(gpointer user_data)
+    {
+        static_cast<BitrateController *>(user_data)->tick();
+        return TRUE;
+    }
+
+    GstElement *enc_;
+    const EncoderBackend *backend_;
+    GstElement *queue_;
+    EncoderSettings settings_;
+    Options options_;
+    Stats stats_;
+
+    int kbps_ = 0;
+    int qp_min_ = 0;
+    int calm_ticks_ = 0;
+    int hold_ = 0;
+    guint64 last_drops_ = 0;
+    guint64 last_qos_ = 0;
+
+    guint timer_id_ = 0;
+    gulong overrun_id_ = 0;
+};
+
+class LinkThrottle
+{
+public:
+    explicit LinkThrottle(int kbps) : kbps_(std::max(1, kbps)) {}
+
+    void attach(GstPad *pad)
+    {
+        gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                          probe_cb, this, nullptr);
+    }
+
+    int kbps() const { return kbps_; }
+
+private:
+    static GstPadProbeReturn probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        LinkThrottle *self = static_cast<LinkThrottle *>(user_data);
+        gsize bytes = 0;
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER)
+            bytes = gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+        else if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+            bytes = gst_buffer_list_calculate_size(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+
+        self->consume(bytes);
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* 令牌桶：上一个包发完的时刻 + 本包在 kbps 下的发送时间；空闲时最多攒 100ms 的突发 */
+    void consume(gsize bytes)
+    {
+        gint64 now = g_get_monotonic_time();
+        next_free_us_ = std::max(next_free_us_, now - 100000);
+        if (next_free_us_ > now)
+            g_usleep(next_free_us_ - now);
+        next_free_us_ += (gint64)(bytes * 8 * 1000 / kbps_);
+    }
+
+    int kbps_;
+    gint64 next_free_us_ = 0;
+};
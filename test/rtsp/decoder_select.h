@@ -0,0 +1,555 @@
+#pragma once
+
+/*
+ * 视频解码器自动选择
+ *
+ * DecoderSelector（进程内单例）
+ *   - 第一次使用时扫描一次 registry，按编码（H.264 / H.265 / VP8 / VP9）列出所有视频解码器
+ *   - 排序：硬件解码优先，其次按 GStreamer rank；进不了 READY 的（没有设备节点 / 驱动）判为不可用，
+ *     所以在没有 GPU 的 x86 机器上会自然回落到 avdec_* 等软件解码器
+ *   - 可选微基准：用软件编码器生成一小段码流，逐个解码到 fakesink，按实测 fps 重新排序
+ *   - 扫描 / 基准结果按编码缓存，重连和多路流直接复用
+ *
+ * DecodeFpsMeter
+ *   - 在解码器 src pad 上计数，周期性报告实际达到的解码帧率
+ */
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class VideoCodec
+{
+    H264,
+    H265,
+    VP8,
+    VP9,
+    Unknown
+};
+
+/* RTP caps 的 encoding-name → VideoCodec */
+static inline VideoCodec video_codec_from_encoding(const gchar *encoding)
+{
+    if (!encoding)
+        return VideoCodec::Unknown;
+    if (g_str_has_prefix(encoding, "H264") || g_str_has_prefix(encoding, "AVC"))
+        return VideoCodec::H264;
+    if (g_str_has_prefix(encoding, "H265") || g_str_has_prefix(encoding, "HEVC"))
+        return VideoCodec::H265;
+    if (g_str_has_prefix(encoding, "VP8"))
+        return VideoCodec::VP8;
+    if (g_str_has_prefix(encoding, "VP9"))
+        return VideoCodec::VP9;
+    return VideoCodec::Unknown;
+}
+
+static inline const char *video_codec_name(VideoCodec codec)
+{
+    switch (codec)
+    {
+    case VideoCodec::H264: return "H.264";
+    case VideoCodec::H265: return "H.265";
+    case VideoCodec::VP8:  return "VP8";
+    case VideoCodec::VP9:  return "VP9";
+    default:               return "unknown";
+    }
+}
+
+/* 解码器 sink 端的编码 caps */
+static inline const char *video_codec_caps(VideoCodec codec)
+{
+    switch (codec)
+    {
+    case VideoCodec::H264: return "video/x-h264";
+    case VideoCodec::H265: return "video/x-h265";
+    case VideoCodec::VP8:  return "video/x-vp8";
+    case VideoCodec::VP9:  return "video/x-vp9";
+    default:               return nullptr;
+    }
+}
+
+/* ---------------------------------------------------------
+ * 生成测试码流：videotestsrc → encoder → [parser] → appsink，
+ * 编码后的 sample 依次放进 clip（调用者负责 unref）。
+ * encoder 是 gst-launch 语法的元素描述，例如 "x264enc bframes=2"；
+ * 编码器插件不存在时返回 false
+ * --------------------------------------------------------- */
+static inline bool encode_test_clip(const char *encoder, const char *parser, int frames,
+                                    int width, int height, int fps, std::vector<GstSample *> &clip)
+{
+    gchar *factory = g_strndup(encoder, strcspn(encoder, " "));
+    bool found = gst_registry_check_feature_version(gst_registry_get(), factory, 1, 0, 0);
+    g_free(factory);
+    if (!found)
+        return false;
+
+    gchar *desc = g_strdup_printf(
+        "videotestsrc num-buffers=%d pattern=ball ! "
+        "video/x-raw,format=I420,width=%d,height=%d,framerate=%d/1 ! %s%s%s ! "
+        "appsink name=sink sync=false",
+        frames, width, height, fps, encoder,
+        parser ? " ! " : "", parser ? parser : "");
+
+    GError *err = nullptr;
+    GstElement *pipeline = gst_parse_launch(desc, &err);
+    g_free(desc);
+    if (!pipeline)
+    {
+        g_printerr("Test clip encoder pipeline failed: %s\n", err ? err->message : "unknown");
+        g_clear_error(&err);
+        return false;
+    }
+
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    size_t before = clip.size();
+    GstSample *sample;
+    while ((sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink), 5 * GST_SECOND)))
+        clip.push_back(sample);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+
+    return clip.size() > before;
+}
+
+struct DecoderCandidate
+{
+    std::string factory;
+    bool hardware = false;
+    guint rank = 0;
+    bool usable = false;     // 能否进入 READY 状态
+    double bench_fps = -1.0; // < 0 表示没有测过，0 表示测试失败
+};
+
+class DecoderSelector
+{
+public:
+    static DecoderSelector &instance()
+    {
+        static DecoderSelector selector;
+        return selector;
+    }
+
+    /* 强制优先使用某个解码器（工厂名），创建失败时仍按排序回落 */
+    void set_forced(const std::string &factory)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        forced_ = factory;
+    }
+
+    /* 开启后，每种编码第一次 make() 时先跑一次微基准（会阻塞调用线程几秒），结果缓存 */
+    void set_benchmark(bool enable, int frames = 90, int width = 1280, int height = 720)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bench_enabled_ = enable;
+        bench_frames_ = frames;
+        bench_width_ = width;
+        bench_height_ = height;
+    }
+
+    /* 按排序依次尝试创建，返回第一个成功的解码器；chosen 返回所选候选的信息 */
+    GstElement *make(VideoCodec codec, const gchar *name, DecoderCandidate *chosen = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        probe_locked();
+
+        if (bench_enabled_ && !benched_[codec])
+            benchmark_locked(codec);
+
+        std::vector<DecoderCandidate> &list = table_[codec];
+
+        if (!forced_.empty())
+        {
+            GstElement *dec = gst_element_factory_make(forced_.c_str(), name);
+            if (dec)
+            {
+                if (chosen)
+                {
+                    auto it = std::find_if(list.begin(), list.end(),
+                                           [&](const DecoderCandidate &c) { return c.factory == forced_; });
+                    if (it != list.end())
+                        *chosen = *it;
+                    else
+                    {
+                        *chosen = DecoderCandidate();
+                        chosen->factory = forced_;
+                    }
+                }
+                return dec;
+            }
+            g_printerr("Forced decoder '%s' not available, falling back to auto selection\n", forced_.c_str());
+        }
+
+        for (const auto &c : list)
+        {
+            if (!c.usable || c.bench_fps == 0.0)
+                continue;
+
+            GstElement *dec = gst_element_factory_make(c.factory.c_str(), name);
+            if (!dec)
+                continue;
+
+            if (chosen)
+                *chosen = c;
+            return dec;
+        }
+
+        g_printerr("No usable %s decoder found\n", video_codec_name(codec));
+        return nullptr;
+    }
+
+    std::vector<DecoderCandidate> candidates(VideoCodec codec)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        probe_locked();
+        return table_[codec];
+    }
+
+    /* 立即对某种编码跑一次微基准（已经跑过则直接返回缓存） */
+    void benchmark(VideoCodec codec)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        probe_locked();
+        if (!benched_[codec])
+            benchmark_locked(codec);
+    }
+
+    void print_table(VideoCodec codec)
+    {
+        std::vector<DecoderCandidate> list = candidates(codec);
+
+        g_print("%s decoders (%zu):\n", video_codec_name(codec), list.size());
+        for (const auto &c : list)
+        {
+            if (c.bench_fps >= 0.0)
+                g_print("  %-24s %-8s rank %-4u %-10s %8.1f fps\n", c.factory.c_str(),
+                        c.hardware ? "hardware" : "software", c.rank,
+                        c.usable ? "usable" : "unusable", c.bench_fps);
+            else
+                g_print("  %-24s %-8s rank %-4u %-10s %8s\n", c.factory.c_str(),
+                        c.hardware ? "hardware" : "software", c.rank,
+                        c.usable ? "usable" : "unusable", "-");
+        }
+    }
+
+private:
+    DecoderSelector() = default;
+
+    std::mutex mutex_;
+    bool probed_ = false;
+    std::map<VideoCodec, std::vector<DecoderCandidate>> table_;
+    std::map<VideoCodec, bool> benched_;
+
+    std::string forced_;
+    bool bench_enabled_ = false;
+    int bench_frames_ = 90;
+    int bench_width_ = 1280;
+    int bench_height_ = 720;
+
+    /* klass 带 "Hardware" 的是硬件解码；部分 BSP 插件（mpp / v4l2 等）不标，按名字补充 */
+    static bool is_hardware(GstElementFactory *factory)
+    {
+        const gchar *klass = gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS);
+        if (klass && strstr(klass, "Hardware"))
+            return true;
+
+        static const char *hw_prefixes[] = {"mpp", "v4l2", "nv", "va", "msdk", "qsv",
+                                            "d3d11", "d3d12", "vtdec", "omx", "amc", "imx"};
+        const gchar *name = gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory));
+        for (const char *prefix : hw_prefixes)
+            if (g_str_has_prefix(name, prefix))
+                return true;
+        return false;
+    }
+
+    /* sink 模板（排除 ANY）能否接收该编码 */
+    static bool accepts(GstElementFactory *factory, GstCaps *codec_caps)
+    {
+        const GList *templates = gst_element_factory_get_static_pad_templates(factory);
+        for (const GList *l = templates; l; l = l->next)
+        {
+            GstStaticPadTemplate *tmpl = (GstStaticPadTemplate *)l->data;
+            if (tmpl->direction != GST_PAD_SINK)
+                continue;
+
+            GstCaps *caps = gst_static_caps_get(&tmpl->static_caps);
+            bool ok = !gst_caps_is_any(caps) && gst_caps_can_intersect(caps, codec_caps);
+            gst_caps_unref(caps);
+            if (ok)
+                return true;
+        }
+        return false;
+    }
+
+    /* 能进入 READY 才算可用：v4l2 / va / nv 等在没有设备或驱动时会在这里失败 */
+    static bool try_ready(const std::string &factory)
+    {
+        GstElement *dec = gst_element_factory_make(factory.c_str(), nullptr);
+        if (!dec)
+            return false;
+
+        gst_object_ref_sink(dec);
+        bool ok = gst_element_set_state(dec, GST_STATE_READY) != GST_STATE_CHANGE_FAILURE;
+        gst_element_set_state(dec, GST_STATE_NULL);
+        gst_object_unref(dec);
+        return ok;
+    }
+
+    void probe_locked()
+    {
+        if (probed_)
+            return;
+        probed_ = true;
+
+        GList *factories = gst_element_factory_list_get_elements(
+            GST_ELEMENT_FACTORY_TYPE_DECODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO, GST_RANK_NONE);
+
+        const VideoCodec codecs[] = {VideoCodec::H264, VideoCodec::H265, VideoCodec::VP8, VideoCodec::VP9};
+        for (VideoCodec codec : codecs)
+        {
+            GstCaps *codec_caps = gst_caps_from_string(video_codec_caps(codec));
+            std::vector<DecoderCandidate> &list = table_[codec];
+
+            for (GList *l = factories; l; l = l->next)
+            {
+                GstElementFactory *factory = GST_ELEMENT_FACTORY(l->data);
+                if (!accepts(factory, codec_caps))
+                    continue;
+
+                DecoderCandidate c;
+                c.factory = gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory));
+                c.hardware = is_hardware(factory);
+                c.rank = gst_plugin_feature_get_rank(GST_PLUGIN_FEATURE(factory));
+                c.usable = try_ready(c.factory);
+                list.push_back(c);
+            }
+
+            gst_caps_unref(codec_caps);
+
+            std::stable_sort(list.begin(), list.end(), [](const DecoderCandidate &a, const DecoderCandidate &b) {
+                if (a.usable != b.usable)
+                    return a.usable;
+                if (a.hardware != b.hardware)
+                    return a.hardware;
+                if (a.rank != b.rank)
+                    return a.rank > b.rank;
+                return a.factory < b.factory;
+            });
+        }
+
+        gst_plugin_feature_list_free(factories);
+    }
+
+    /* ---------------------------------------------------------
+     * 微基准：先用软件编码器生成测试码流，再逐个解码器 appsrc → [parse] → dec → fakesink
+     * --------------------------------------------------------- */
+    static const char *bench_parser(VideoCodec codec)
+    {
+        switch (codec)
+        {
+        case VideoCodec::H264: return "h264parse";
+        case VideoCodec::H265: return "h265parse";
+        default:               return nullptr;
+        }
+    }
+
+    static std::vector<const char *> bench_encoders(VideoCodec codec)
+    {
+        switch (codec)
+        {
+        case VideoCodec::H264:
+            return {"x264enc speed-preset=ultrafast tune=zerolatency key-int-max=30", "openh264enc"};
+        case VideoCodec::H265:
+            return {"x265enc speed-preset=ultrafast tune=zerolatency key-int-max=30"};
+        case VideoCodec::VP8:
+            return {"vp8enc deadline=1 keyframe-max-dist=30"};
+        case VideoCodec::VP9:
+            return {"vp9enc deadline=1 cpu-used=8 keyframe-max-dist=30"};
+        default:
+            return {};
+        }
+    }
+
+    bool encode_clip_locked(VideoCodec codec, std::vector<GstSample *> &clip)
+    {
+        for (const char *enc : bench_encoders(codec))
+            if (encode_test_clip(enc, bench_parser(codec), bench_frames_, bench_width_, bench_height_, 30, clip))
+                return true;
+        return false;
+    }
+
+    static GstPadProbeReturn count_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        static_cast<std::atomic<guint64> *>(user_data)->fetch_add(1, std::memory_order_relaxed);
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* 返回实测 fps，失败返回 0 */
+    static double decode_clip(VideoCodec codec, const std::string &factory, const std::vector<GstSample *> &clip)
+    {
+        const char *parser = bench_parser(codec);
+
+        GstElement *pipeline = gst_pipeline_new("decoder-bench");
+        GstElement *src = gst_element_factory_make("appsrc", nullptr);
+        GstElement *parse = parser ? gst_element_factory_make(parser, nullptr) : nullptr;
+        GstElement *dec = gst_element_factory_make(factory.c_str(), nullptr);
+        GstElement *sink = gst_element_factory_make("fakesink", nullptr);
+
+        if (!pipeline || !src || !dec || !sink || (parser && !parse))
+        {
+            if (pipeline) gst_object_unref(pipeline);
+            if (src) gst_object_unref(src);
+            if (parse) gst_object_unref(parse);
+            if (dec) gst_object_unref(dec);
+            if (sink) gst_object_unref(sink);
+            return 0.0;
+        }
+
+        g_object_set(src, "caps", gst_sample_get_caps(clip[0]), "format", GST_FORMAT_TIME,
+                     "block", TRUE, NULL);
+        g_object_set(sink, "sync", FALSE, NULL);
+
+        gst_bin_add_many(GST_BIN(pipeline), src, dec, sink, NULL);
+        bool linked;
+        if (parse)
+        {
+            gst_bin_add(GST_BIN(pipeline), parse);
+            linked = gst_element_link_many(src, parse, dec, sink, NULL);
+        }
+        else
+            linked = gst_element_link_many(src, dec, sink, NULL);
+
+        std::atomic<guint64> decoded{0};
+        GstPad *pad = gst_element_get_static_pad(dec, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, count_probe_cb, &decoded, nullptr);
+        gst_object_unref(pad);
+
+        double fps = 0.0;
+        if (linked && gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE)
+        {
+            gint64 t0 = g_get_monotonic_time();
+
+            for (GstSample *sample : clip)
+                if (gst_app_src_push_sample(GST_APP_SRC(src), sample) != GST_FLOW_OK)
+                    break;
+            gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+            GstBus *bus = gst_element_get_bus(pipeline);
+            GstMessage *msg = gst_bus_timed_pop_filtered(bus, 30 * GST_SECOND,
+                                                         (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+            double seconds = (g_get_monotonic_time() - t0) / 1e6;
+
+            if (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS && seconds > 0.0)
+                fps = decoded.load() / seconds;
+
+            if (msg)
+                gst_message_unref(msg);
+            gst_object_unref(bus);
+        }
+
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+        return fps;
+    }
+
+    void benchmark_locked(VideoCodec codec)
+    {
+        benched_[codec] = true;
+
+        std::vector<GstSample *> clip;
+        if (!encode_clip_locked(codec, clip))
+        {
+            g_print("No %s encoder available for decoder benchmark, keeping rank order\n",
+                    video_codec_name(codec));
+            return;
+        }
+
+        g_print("Benchmarking %s decoders (%d frames %dx%d)...\n", video_codec_name(codec),
+                (int)clip.size(), bench_width_, bench_height_);
+
+        std::vector<DecoderCandidate> &list = table_[codec];
+        for (auto &c : list)
+        {
+            if (!c.usable)
+                continue;
+            c.bench_fps = decode_clip(codec, c.factory, clip);
+            g_print("  %-24s %-8s %8.1f fps\n", c.factory.c_str(),
+                    c.hardware ? "hardware" : "software", c.bench_fps);
+        }
+
+        for (GstSample *sample : clip)
+            gst_sample_unref(sample);
+
+        // 测过的按实测 fps 排序，失败的（0 fps）排到后面
+        std::stable_sort(list.begin(), list.end(), [](const DecoderCandidate &a, const DecoderCandidate &b) {
+            if (a.usable != b.usable)
+                return a.usable;
+            return a.bench_fps > b.bench_fps;
+        });
+    }
+};
+
+/* ---------------------------------------------------------
+ * 实际解码帧率统计：挂在解码器 src pad 上
+ * --------------------------------------------------------- */
+class DecodeFpsMeter
+{
+public:
+    /* 每次新建解码器后调用，计数清零 */
+    void attach(GstElement *dec, const DecoderCandidate &info)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        label_ = info.factory + (info.hardware ? " (hardware)" : " (software)");
+        frames_ = 0;
+        last_frames_ = 0;
+        last_us_ = g_get_monotonic_time();
+
+        GstPad *pad = gst_element_get_static_pad(dec, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, count_cb, this, nullptr);
+        gst_object_unref(pad);
+    }
+
+    /* 打印上次调用以来的平均解码帧率；还没有解码器时不输出 */
+    void report()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (label_.empty())
+            return;
+
+        gint64 now = g_get_monotonic_time();
+        guint64 frames = frames_.load(std::memory_order_relaxed);
+        double seconds = (now - last_us_) / 1e6;
+        if (seconds <= 0.0)
+            return;
+
+        g_print("Decoder %s: %.1f fps (%" G_GUINT64_FORMAT " frames total)\n",
+                label_.c_str(), (frames - last_frames_) / seconds, frames);
+
+        last_frames_ = frames;
+        last_us_ = now;
+    }
+
+private:
+    std::mutex mutex_;
+    std::string label_;
+    std::atomic<guint64> frames_{0};
+    guint64 last_frames_ = 0;
+    gint64 last_us_ = 0;
+
+    static GstPadProbeReturn count_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        static_cast<DecodeFpsMeter *>(user_data)->frames_.fetch_add(1, std::memory_order_relaxed);
+        return GST_PAD_PROBE_OK;
+    }
+};
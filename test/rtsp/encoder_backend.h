@@ -0,0 +1,231 @@
+#pragma once
+
+/*
+ * 可替换的编码器后端
+ *
+ * - 统一的码控参数（CBR 码率 / 上下限、GOP、QP 范围、低延迟），按编码器映射到各自的属性：
+ *     mpph265enc   RK3588 硬编，rc-mode / bps / gop / qp-*（原来 push-rtsp 里的那组参数）
+ *     x264enc      pass=cbr + vbv，tune=zerolatency、ultrafast、sliced-threads，无 B 帧
+ *     x265enc      tune=zerolatency、ultrafast，vbv / qp 走 option-string
+ *     openh264enc  rate-control=bitrate，complexity=low，usage-type=camera
+ * - 编码器运行时选择（--encoder NAME，auto 按上面的顺序取第一个可用的），x86 上没有 mpp 也能跑
+ * - 属性按名字检查后再设置，插件版本不同缺某个属性时只打印一行提示，不会触发 GLib 警告
+ */
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/* 码控参数，单位：kbps / 帧 */
+struct EncoderSettings
+{
+    int bitrate_kbps = 4000;
+    int max_kbps = 4500;
+    int min_kbps = 3500;
+    int gop = 50;
+    int qp_init = 28;
+    int qp_min = 22;
+    int qp_max = 38;
+    int fps = 25;         // x264 / x265 的 vbv 按帧率换算
+    bool low_latency = true;
+    int threads = 0;      // 0 = 编码器自己决定
+};
+
+struct EncoderBackend
+{
+    const char *factory;
+    const char *parser;    // 编码后的 parser
+    const char *payloader; // udp:// 输出用的 RTP 封包
+    bool h265;
+};
+
+static inline const std::vector<EncoderBackend> &encoder_backends()
+{
+    static const std::vector<EncoderBackend> backends = {
+        {"mpph265enc", "h265parse", "rtph265pay", true},
+        {"x264enc", "h264parse", "rtph264pay", false},
+        {"openh264enc", "h264parse", "rtph264pay", false},
+        {"x265enc", "h265parse", "rtph265pay", true},
+    };
+    return backends;
+}
+
+static inline const EncoderBackend *find_encoder_backend(const std::string &factory)
+{
+    for (const EncoderBackend &b : encoder_backends())
+        if (factory == b.factory)
+            return &b;
+    return nullptr;
+}
+
+static inline bool encoder_available(const char *factory)
+{
+    GstElementFactory *f = gst_element_factory_find(factory);
+    if (!f)
+        return false;
+    gst_object_unref(f);
+    return true;
+}
+
+/* 属性存在才设置；数值用 GValue 转换，枚举 / flags 用字符串（nick）设置 */
+static inline void encoder_set(GstElement *enc, const char *name, const char *value)
+{
+    if (!g_object_class_find_property(G_OBJECT_GET_CLASS(enc), name))
+    {
+        g_print("  %s has no property '%s', skipped\n", GST_OBJECT_NAME(enc), name);
+        return;
+    }
+    gst_util_set_object_arg(G_OBJECT(enc), name, value);
+}
+
+static inline void encoder_set(GstElement *enc, const char *name, int value)
+{
+    gchar buf[32];
+    g_snprintf(buf, sizeof(buf), "%d", value);
+    encoder_set(enc, name, buf);
+}
+
+/* 把统一的码控参数映射到具体编码器 */
+static inline void configure_encoder(GstElement *enc, const EncoderBackend &backend, const EncoderSettings &s)
+{
+    std::string factory = backend.factory;
+    int vbv_ms = s.low_latency ? 1000 / std::max(1, s.fps) * 2 : 1000; // 低延迟：约两帧的 VBV
+
+    if (factory == "mpph265enc")
+    {
+        encoder_set(enc, "rc-mode", 1); // CBR
+        encoder_set(enc, "bps", s.bitrate_kbps * 1000);
+        encoder_set(enc, "bps-max", s.max_kbps * 1000);
+        encoder_set(enc, "bps-min", s.min_kbps * 1000);
+        encoder_set(enc, "gop", s.gop);
+        encoder_set(enc, "header-mode", 1); // SPS/PPS 每个 IDR
+        encoder_set(enc, "qp-init", s.qp_init);
+        encoder_set(enc, "qp-min", s.qp_min);
+        encoder_set(enc, "qp-max", s.qp_max);
+        encoder_set(enc, "qos", "true");
+        encoder_set(enc, "max-reenc", 1);
+    }
+    else if (factory == "x264enc")
+    {
+        encoder_set(enc, "pass", "cbr");
+        encoder_set(enc, "bitrate", s.bitrate_kbps);
+        encoder_set(enc, "vbv-buf-capacity", vbv_ms);
+        encoder_set(enc, "key-int-max", s.gop);
+        encoder_set(enc, "qp-min", s.qp_min);
+        encoder_set(enc, "qp-max", s.qp_max);
+        encoder_set(enc, "bframes", 0);
+        if (s.threads > 0)
+            encoder_set(enc, "threads", s.threads);
+        if (s.low_latency)
+        {
+            encoder_set(enc, "tune", "zerolatency");   // 关掉 lookahead / B 帧 / mbtree
+            encoder_set(enc, "speed-preset", "ultrafast");
+            encoder_set(enc, "sliced-threads", "true"); // 帧内切片并行，不额外缓存帧
+        }
+        else
+            encoder_set(enc, "speed-preset", "veryfast");
+    }
+    else if (factory == "x265enc")
+    {
+        encoder_set(enc, "bitrate", s.bitrate_kbps);
+        encoder_set(enc, "key-int-max", s.gop);
+        if (s.low_latency)
+        {
+            encoder_set(enc, "tune", "zerolatency");
+            encoder_set(enc, "speed-preset", "ultrafast");
+        }
+        else
+            encoder_set(enc, "speed-preset", "veryfast");
+
+        // x265enc 没有 vbv / qp 属性，走 x265 自己的参数串（冒号分隔）
+        gchar *opts = g_strdup_printf("vbv-maxrate=%d:vbv-bufsize=%d:qpmin=%d:qpmax=%d:bframes=0:repeat-headers=1",
+                                      s.max_kbps, s.bitrate_kbps * vbv_ms / 1000, s.qp_min, s.qp_max);
+        std::string options = opts;
+        g_free(opts);
+        if (s.threads > 0)
+            options += ":pools=" + std::to_string(s.threads);
+        encoder_set(enc, "option-string", options.c_str());
+    }
+    else if (factory == "openh264enc")
+    {
+        encoder_set(enc, "rate-control", "bitrate");
+        encoder_set(enc, "bitrate", s.bitrate_kbps * 1000);
+        encoder_set(enc, "max-bitrate", s.max_kbps * 1000);
+        encoder_set(enc, "gop-size", s.gop);
+        encoder_set(enc, "qp-min", s.qp_min);
+        encoder_set(enc, "qp-max", s.qp_max);
+        encoder_set(enc, "usage-type", "camera");
+        if (s.threads > 0)
+            encoder_set(enc, "multi-thread", s.threads);
+        if (s.low_latency)
+            encoder_set(enc, "complexity", "low");
+    }
+}
+
+/* 运行时改码率（PLAYING 状态下）：mpp / x264 / openh264 会在下一帧重新配置码控；
+ * x265enc 只在初始化时读 bitrate，运行中修改无效，返回 false */
+static inline bool encoder_set_bitrate(GstElement *enc, const EncoderBackend &backend, int kbps, int max_kbps, int min_kbps)
+{
+    std::string factory = backend.factory;
+    if (factory == "mpph265enc")
+    {
+        // 先放宽上下限再改目标，避免中间状态 bps 不在 [min, max] 内
+        encoder_set(enc, "bps-min", std::min(min_kbps, kbps) * 1000);
+        encoder_set(enc, "bps-max", std::max(max_kbps, kbps) * 1000);
+        encoder_set(enc, "bps", kbps * 1000);
+        return true;
+    }
+    if (factory == "x264enc")
+    {
+        encoder_set(enc, "bitrate", kbps);
+        return true;
+    }
+    if (factory == "openh264enc")
+    {
+        encoder_set(enc, "max-bitrate", std::max(max_kbps, kbps) * 1000);
+        encoder_set(enc, "bitrate", kbps * 1000);
+        return true;
+    }
+    return false;
+}
+
+/* 运行时调整最小 QP：码率已经降到下限还拥塞时，抬高 qp-min 直接压低画质换码率 */
+static inline bool encoder_set_qp_min(GstElement *enc, const EncoderBackend &backend, int qp_min)
+{
+    std::string factory = backend.factory;
+    if (factory != "mpph265enc" && factory != "x264enc" && factory != "openh264enc")
+        return false;
+    encoder_set(enc, "qp-min", qp_min);
+    return true;
+}
+
+/* 创建并配置编码器；name 为 "auto" 时按 encoder_backends() 的顺序取第一个可用的。
+ * 失败返回 nullptr，backend 返回实际使用的后端 */
+static inline GstElement *make_encoder(const std::string &name, const EncoderSettings &settings,
+                                       const EncoderBackend **backend, const gchar *element_name = nullptr)
+{
+    for (const EncoderBackend &b : encoder_backends())
+    {
+        if (name != "auto" && name != b.factory)
+            continue;
+
+        GstElement *enc = gst_element_factory_make(b.factory, element_name);
+        if (!enc)
+        {
+            if (name != "auto")
+                g_printerr("Encoder %s not available\n", b.factory);
+            continue;
+        }
+
+        configure_encoder(enc, b, settings);
+        if (backend)
+            *backend = &b;
+        return enc;
+    }
+
+    if (name != "auto" && !find_encoder_backend(name))
+        g_printerr("Unknown encoder %s (mpph265enc / x264enc / x265enc / openh264enc / auto)\n", name.c_str());
+    return nullptr;
+}
@@ -0,0 +1,403 @@
+#pragma once
+
+/*
+ * 事件录像（压缩域预录，不转码）
+ *
+ * 挂在 parser 的 src pad 上，把最近 pre_seconds 秒的 H.264 / H.265 access unit（只持有 GstBuffer 引用，
+ * 不拷贝数据）放进内存环形缓冲，按关键帧建索引：
+ *   - 淘汰以 GOP 为单位，缓冲区开头永远是关键帧，触发时可以直接从这里开始写文件
+ *   - 超过 max_bytes 时也按 GOP 淘汰，每路摄像头的内存有上限
+ *
+ * trigger()：新建一个写文件的 pipeline  appsrc → parse → mp4mux / matroskamux → filesink，
+ * 先把环里的预录内容推进去，之后的 AU 由流线程直接推送，直到事件结束（最后一次 trigger 之后 post_seconds 秒，
+ * 或 end_event()）。时间戳统一减去事件第一帧的 DTS，文件从 0 开始。
+ * 再次 trigger 只延长当前事件。结束时 appsrc 发 EOS，交给一个常驻的收尾线程（按队列依次处理）等 muxer 写完索引
+ * 再销毁，不阻塞流线程，长时间运行也不会每个事件留下一个线程。
+ *
+ * 参数集：源 parser 设置 config-interval=-1，每个关键帧前都带 SPS/PPS（VPS），
+ * 所以从环里任何一个关键帧开始写出来的文件都能独立解码。
+ */
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "decoder_select.h" // VideoCodec
+
+class EventRecorder
+{
+public:
+    struct Options
+    {
+        guint pre_seconds = 10;               // 预录时长
+        guint post_seconds = 10;              // 最后一次触发之后继续录的时长
+        gsize max_bytes = 64 * 1024 * 1024;   // 环形缓冲上限（每路）
+        std::string dir = ".";
+        std::string container = "mkv";        // mkv / mp4
+    };
+
+    explicit EventRecorder(const Options &options) : options_(options) {}
+
+    ~EventRecorder()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finish_event_locked();
+            clear_locked();
+            if (caps_)
+                gst_caps_unref(caps_);
+            caps_ = nullptr;
+        }
+        {
+            // 收尾线程处理完队列里剩下的 writer 再退出
+            std::lock_guard<std::mutex> lock(finalize_mutex_);
+            finalize_stop_ = true;
+        }
+        finalize_cond_.notify_one();
+        if (finalizer_.joinable())
+            finalizer_.join();
+    }
+
+    /* 挂到 parser 的 src pad 上；codec 只支持 H.264 / H.265 */
+    bool attach(GstElement *parse, VideoCodec codec)
+    {
+        if (codec != VideoCodec::H264 && codec != VideoCodec::H265)
+        {
+            g_print("[event] %s is not supported, event recording disabled\n", video_codec_name(codec));
+            return false;
+        }
+
+        codec_ = codec;
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(parse), "config-interval"))
+            g_object_set(parse, "config-interval", -1, NULL);
+
+        GstPad *pad = gst_element_get_static_pad(parse, "src");
+        gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                          probe_cb, this, nullptr);
+        gst_object_unref(pad);
+
+        g_print("[event] pre-record %u s, post-record %u s, max %" G_GSIZE_FORMAT " MB, %s -> %s\n",
+                options_.pre_seconds, options_.post_seconds, options_.max_bytes >> 20,
+                options_.container.c_str(), options_.dir.c_str());
+        return true;
+    }
+
+    /* 触发（或延长）一次事件，主线程调用 */
+    void trigger()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!GST_CLOCK_TIME_IS_VALID(last_ts_))
+        {
+            g_print("[event] no data yet, trigger ignored\n");
+            return;
+        }
+
+        end_ts_ = last_ts_ + options_.post_seconds * GST_SECOND;
+        if (writer_)
+        {
+            g_print("[event] extended %s\n", path_.c_str());
+            return;
+        }
+
+        if (keyframes_.empty())
+        {
+            g_print("[event] no keyframe buffered yet, trigger ignored\n");
+            return;
+        }
+
+        if (!start_writer_locked())
+            return;
+
+        // 预录：从环里第一个关键帧开始，之后的 AU 由 probe 接着推
+        GstClockTime first = ts_of(entries_.front().buffer);
+        base_ts_ = first;
+        for (const Entry &e : entries_)
+            push_locked(e.buffer);
+
+        g_print("[event] recording %s: pre-roll %.1f s, %zu AUs, %.1f MB\n", path_.c_str(),
+                (double)(last_ts_ - first) / GST_SECOND, entries_.size(), bytes_ / 1048576.0);
+    }
+
+    /* 立即结束当前事件 */
+    void end_event()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finish_event_locked();
+    }
+
+    gsize buffered_bytes()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+private:
+    struct Entry
+    {
+        GstBuffer *buffer;
+        gsize size;
+    };
+
+    Options options_;
+    VideoCodec codec_ = VideoCodec::Unknown;
+
+    std::mutex mutex_;
+    std::deque<Entry> entries_;
+    std::deque<guint64> keyframes_;  // 关键帧在 entries_ 中的序号（绝对序号）
+    guint64 first_seq_ = 0;          // entries_.front() 的序号
+    gsize bytes_ = 0;
+    GstCaps *caps_ = nullptr;
+    GstClockTime last_ts_ = GST_CLOCK_TIME_NONE;
+
+    // 当前事件
+    GstElement *writer_ = nullptr;
+    GstElement *appsrc_ = nullptr;
+    std::string path_;
+    GstClockTime base_ts_ = 0;
+    GstClockTime end_ts_ = GST_CLOCK_TIME_NONE;
+    guint64 event_aus_ = 0;
+    guint event_index_ = 0;
+
+    // 收尾线程：等已结束事件的 EOS 写完再销毁 writer
+    struct PendingWriter
+    {
+        GstElement *writer;
+        std::string path;
+    };
+    std::thread finalizer_;
+    std::mutex finalize_mutex_;
+    std::condition_variable finalize_cond_;
+    std::deque<PendingWriter> finalize_queue_;
+    bool finalize_stop_ = false;
+
+    static GstClockTime ts_of(GstBuffer *buffer)
+    {
+        return GST_BUFFER_DTS_OR_PTS(buffer);
+    }
+
+    void clear_locked()
+    {
+        for (Entry &e : entries_)
+            gst_buffer_unref(e.buffer);
+        entries_.clear();
+        keyframes_.clear();
+        first_seq_ = 0;
+        bytes_ = 0;
+    }
+
+    /* 淘汰最老的一个 GOP */
+    void drop_gop_locked()
+    {
+        guint64 next_key = keyframes_.size() >= 2 ? keyframes_[1] : first_seq_ + entries_.size();
+        while (first_seq_ < next_key && !entries_.empty())
+        {
+            bytes_ -= entries_.front().size;
+            gst_buffer_unref(entries_.front().buffer);
+            entries_.pop_front();
+            first_seq_++;
+        }
+        if (!keyframes_.empty())
+            keyframes_.pop_front();
+    }
+
+    void store_locked(GstBuffer *buffer)
+    {
+        bool key = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+        // 第一个关键帧之前的数据解不出来，不存
+        if (entries_.empty() && !key)
+            return;
+
+        if (key)
+            keyframes_.push_back(first_seq_ + entries_.size());
+
+        gsize size = gst_buffer_get_size(buffer);
+        entries_.push_back({gst_buffer_ref(buffer), size});
+        bytes_ += size;
+
+        // 第二个 GOP 的开头已经覆盖 pre_seconds 时，最老的 GOP 就用不到了
+        GstClockTime window = options_.pre_seconds * GST_SECOND;
+        while (keyframes_.size() >= 2)
+        {
+            GstClockTime second_key = ts_of(entries_[keyframes_[1] - first_seq_].buffer);
+            if (GST_CLOCK_TIME_IS_VALID(second_key) && last_ts_ >= second_key && last_ts_ - second_key >= window)
+                drop_gop_locked();
+            else if (bytes_ > options_.max_bytes)
+                drop_gop_locked();
+            else
+                break;
+        }
+
+        // 一个 GOP 就超过上限（关键帧间隔太长）：整个丢掉，等下一个关键帧
+        if (bytes_ > options_.max_bytes)
+            clear_locked();
+    }
+
+    bool start_writer_locked()
+    {
+        bool mp4 = options_.container == "mp4";
+        GDateTime *now = g_date_time_new_now_local();
+        gchar *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+        gchar *name = g_strdup_printf("event-%s-%u.%s", stamp, event_index_++, mp4 ? "mp4" : "mkv");
+        gchar *path = g_build_filename(options_.dir.c_str(), name, NULL);
+        path_ = path;
+        g_free(path);
+        g_free(name);
+        g_free(stamp);
+        g_date_time_unref(now);
+
+        writer_ = gst_pipeline_new("event-writer");
+        appsrc_ = gst_element_factory_make("appsrc", nullptr);
+        GstElement *parse = gst_element_factory_make(codec_ == VideoCodec::H264 ? "h264parse" : "h265parse", nullptr);
+        GstElement *mux = gst_element_factory_make(mp4 ? "mp4mux" : "matroskamux", nullptr);
+        GstElement *sink = gst_element_factory_make("filesink", nullptr);
+
+        if (!writer_ || !appsrc_ || !parse || !mux || !sink)
+        {
+            g_printerr("[event] Failed to create writer elements\n");
+            if (appsrc_) gst_object_unref(appsrc_);
+            if (parse) gst_object_unref(parse);
+            if (mux) gst_object_unref(mux);
+            if (sink) gst_object_unref(sink);
+            if (writer_) gst_object_unref(writer_);
+            writer_ = appsrc_ = nullptr;
+            return false;
+        }
+
+        // 不按时钟推送；写文件比实时快得多，队列不设上限，不会阻塞流线程
+        g_object_set(appsrc_, "format", GST_FORMAT_TIME, "is-live", FALSE, "block", FALSE,
+                     "max-bytes", (guint64)0, "caps", caps_, NULL);
+        g_object_set(sink, "location", path_.c_str(), "sync", FALSE, NULL);
+
+        gst_bin_add_many(GST_BIN(writer_), appsrc_, parse, mux, sink, NULL);
+        if (!gst_element_link_many(appsrc_, parse, mux, sink, NULL) ||
+            gst_element_set_state(writer_, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+        {
+            g_printerr("[event] Failed to start writer for %s\n", path_.c_str());
+            gst_element_set_state(writer_, GST_STATE_NULL);
+            gst_object_unref(writer_);
+            writer_ = appsrc_ = nullptr;
+            return false;
+        }
+
+        event_aus_ = 0;
+        return true;
+    }
+
+    /* 推到写文件的 appsrc：共享内存的浅拷贝，时间戳减去事件起点 */
+    void push_locked(GstBuffer *buffer)
+    {
+        GstBuffer *out = gst_buffer_copy(buffer);
+        if (GST_BUFFER_PTS_IS_VALID(out))
+            GST_BUFFER_PTS(out) = GST_BUFFER_PTS(out) > base_ts_ ? GST_BUFFER_PTS(out) - base_ts_ : 0;
+        if (GST_BUFFER_DTS_IS_VALID(out))
+            GST_BUFFER_DTS(out) = GST_BUFFER_DTS(out) > base_ts_ ? GST_BUFFER_DTS(out) - base_ts_ : 0;
+
+        gst_app_src_push_buffer(GST_APP_SRC(appsrc_), out); // 接管 out
+        event_aus_++;
+    }
+
+    /* 发 EOS，交给单独的线程等 muxer 收尾 */
+    void finish_event_locked()
+    {
+        if (!writer_)
+            return;
+
+        gst_app_src_end_of_stream(GST_APP_SRC(appsrc_));
+        g_print("[event] finishing %s (%" G_GUINT64_FORMAT " AUs)\n", path_.c_str(), event_aus_);
+
+        {
+            std::lock_guard<std::mutex> lock(finalize_mutex_);
+            finalize_queue_.push_back({writer_, path_});
+            if (!finalizer_.joinable())
+                finalizer_ = std::thread(&EventRecorder::finalize_loop, this);
+        }
+        finalize_cond_.notify_one();
+
+        writer_ = appsrc_ = nullptr;
+        end_ts_ = GST_CLOCK_TIME_NONE;
+    }
+
+    /* 常驻收尾线程：依次等每个 writer 的 EOS（最多 10 s），然后置 NULL 释放 */
+    void finalize_loop()
+    {
+        for (;;)
+        {
+            PendingWriter pending;
+            {
+                std::unique_lock<std::mutex> lock(finalize_mutex_);
+                finalize_cond_.wait(lock, [this]() { return finalize_stop_ || !finalize_queue_.empty(); });
+                if (finalize_queue_.empty())
+                    return; // 只有 stop 且队列已空才退出
+                pending = finalize_queue_.front();
+                finalize_queue_.pop_front();
+            }
+
+            GstBus *bus = gst_element_get_bus(pending.writer);
+            GstMessage *msg = gst_bus_timed_pop_filtered(bus, 10 * GST_SECOND,
+                                                         (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+            if (!msg)
+                g_printerr("[event] Timed out finalizing %s\n", pending.path.c_str());
+            else if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+                g_printerr("[event] Error while writing %s\n", pending.path.c_str());
+            else
+                g_print("[event] saved %s\n", pending.path.c_str());
+            if (msg)
+                gst_message_unref(msg);
+            gst_object_unref(bus);
+
+            gst_element_set_state(pending.writer, GST_STATE_NULL);
+            gst_object_unref(pending.writer);
+        }
+    }
+
+    static GstPadProbeReturn probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        EventRecorder *self = static_cast<EventRecorder *>(user_data);
+        std::lock_guard<std::mutex> lock(self->mutex_);
+
+        if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+        {
+            GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+            if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS)
+            {
+                GstCaps *caps = nullptr;
+                gst_event_parse_caps(event, &caps);
+                gst_caps_replace(&self->caps_, caps);
+                if (self->appsrc_)
+                    gst_app_src_set_caps(GST_APP_SRC(self->appsrc_), caps);
+            }
+            else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+            {
+                // 时间轴不连续了，旧数据不能再和新数据拼在一起
+                self->finish_event_locked();
+                self->clear_locked();
+                self->last_ts_ = GST_CLOCK_TIME_NONE;
+            }
+            return GST_PAD_PROBE_OK;
+        }
+
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        GstClockTime ts = ts_of(buffer);
+        if (GST_CLOCK_TIME_IS_VALID(ts))
+            self->last_ts_ = ts;
+
+        self->store_locked(buffer);
+
+        if (self->writer_)
+        {
+            if (GST_CLOCK_TIME_IS_VALID(ts) && ts > self->end_ts_)
+                self->finish_event_locked();
+            else
+                self->push_locked(buffer);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+/*
+ * 零拷贝帧句柄 + 无锁 SPSC 环形队列
+ *
+ * FrameHandle
+ *   - 持有 GstSample 的引用，并在整个生命周期内保持 buffer 的只读映射
+ *   - mat() 是直接指向 GStreamer 内存的 cv::Mat 视图（不拷贝像素）
+ *   - bgr() 按需得到 BGR 图像：BGR 格式直接返回视图；NV12 / I420 在第一次调用时
+ *     用 SIMD 转换（yuv2bgr.h）并缓存，只有真正要用的帧才付出转换开销
+ *   - 拷贝句柄只增加引用计数；最后一个句柄析构时才 unmap + unref，
+ *     buffer 随之回到上游的 buffer pool
+ *
+ * SpscRing<T>
+ *   - 单生产者 / 单消费者、容量固定（2 的幂）的无锁环形队列
+ *   - 队列满时 try_push 直接返回 false，生产者（appsink 回调）永远不会被阻塞
+ */
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+#include "yuv2bgr.h"
+
+/* 按 GstVideoInfo（平面偏移、行跨度、色彩矩阵、range）构造 YUV 视图 */
+static inline YuvView yuv_view(const GstVideoInfo &info, const guint8 *data)
+{
+    YuvView view;
+    view.width = GST_VIDEO_INFO_WIDTH(&info);
+    view.height = GST_VIDEO_INFO_HEIGHT(&info);
+    view.nv12 = GST_VIDEO_INFO_FORMAT(&info) == GST_VIDEO_FORMAT_NV12;
+    view.y = data + GST_VIDEO_INFO_PLANE_OFFSET(&info, 0);
+    view.y_stride = GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+    view.u = data + GST_VIDEO_INFO_PLANE_OFFSET(&info, 1);
+    view.uv_stride = GST_VIDEO_INFO_PLANE_STRIDE(&info, 1);
+    view.v = view.nv12 ? view.u + 1 : data + GST_VIDEO_INFO_PLANE_OFFSET(&info, 2);
+
+    const GstVideoColorimetry &color = GST_VIDEO_INFO_COLORIMETRY(&info);
+    view.coeffs = yuv_coeffs(color.matrix == GST_VIDEO_COLOR_MATRIX_BT709 ? YuvMatrix::BT709 : YuvMatrix::BT601,
+                             color.range == GST_VIDEO_COLOR_RANGE_0_255);
+    return view;
+}
+
+class FrameHandle
+{
+public:
+    FrameHandle() = default;
+
+    /* 接管 sample 的一个引用；映射失败时返回无效句柄 */
+    static FrameHandle from_sample(GstSample *sample)
+    {
+        FrameHandle handle;
+        if (!sample)
+            return handle;
+
+        auto impl = std::make_shared<Impl>();
+        impl->sample = sample;
+        impl->created_us = g_get_monotonic_time();
+
+        GstBuffer *buffer = gst_sample_get_buffer(sample);
+        GstCaps *caps = gst_sample_get_caps(sample);
+
+        if (!buffer || !caps || !gst_video_info_from_caps(&impl->info, caps))
+            return handle; // impl 析构时释放 sample
+
+        if (!gst_buffer_map(buffer, &impl->map, GST_MAP_READ))
+            return handle;
+        impl->buffer = buffer;
+
+        // 硬件解码器常带 GstVideoMeta，实际的平面偏移 / 行跨度以 meta 为准
+        GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+        if (meta)
+        {
+            for (guint i = 0; i < meta->n_planes && i < GST_VIDEO_MAX_PLANES; i++)
+            {
+                GST_VIDEO_INFO_PLANE_OFFSET(&impl->info, i) = meta->offset[i];
+                GST_VIDEO_INFO_PLANE_STRIDE(&impl->info, i) = meta->stride[i];
+            }
+        }
+
+        int width = GST_VIDEO_INFO_WIDTH(&impl->info);
+        int height = GST_VIDEO_INFO_HEIGHT(&impl->info);
+        size_t stride = GST_VIDEO_INFO_PLANE_STRIDE(&impl->info, 0);
+
+        // 按行跨度（stride）构造视图，兼容每行有填充的情况
+        switch (GST_VIDEO_INFO_FORMAT(&impl->info))
+        {
+        case GST_VIDEO_FORMAT_BGR:
+            impl->mat = cv::Mat(height, width, CV_8UC3, impl->map.data, stride);
+            break;
+        case GST_VIDEO_FORMAT_BGRx:
+        case GST_VIDEO_FORMAT_BGRA:
+            impl->mat = cv::Mat(height, width, CV_8UC4, impl->map.data, stride);
+            break;
+        case GST_VIDEO_FORMAT_GRAY8:
+            impl->mat = cv::Mat(height, width, CV_8UC1, impl->map.data, stride);
+            break;
+        case GST_VIDEO_FORMAT_NV12:
+        case GST_VIDEO_FORMAT_I420:
+            // mat() 为空，通过 bgr() 按需转换，或 luma() 直接拿 Y 平面
+            break;
+        default:
+            // 其他格式不提供 Mat 视图，仍可通过 sample() / data() 访问原始内存
+            break;
+        }
+
+        handle.impl_ = std::move(impl);
+        return handle;
+    }
+
+    bool valid() const { return impl_ && impl_->buffer; }
+    void reset() { impl_.reset(); }
+
+    /* 指向 GStreamer 内存的只读视图，句柄存活期间有效；不要写入 */
+    const cv::Mat &mat() const { return impl_->mat; }
+
+    /* BGR 图像；YUV 格式第一次调用时转换并缓存在句柄里，之后直接返回。
+     * 不支持的格式返回空 Mat */
+    const cv::Mat &bgr() const
+    {
+        std::call_once(impl_->bgr_once, [this]() { impl_->convert_bgr(); });
+        return impl_->bgr;
+    }
+
+    /* NV12 / I420 的 Y 平面视图（灰度分析可直接用，不需要转换） */
+    cv::Mat luma() const
+    {
+        if (!is_yuv())
+            return cv::Mat();
+        return cv::Mat(height(), width(), CV_8UC1, impl_->map.data + GST_VIDEO_INFO_PLANE_OFFSET(&impl_->info, 0),
+                       GST_VIDEO_INFO_PLANE_STRIDE(&impl_->info, 0));
+    }
+
+    bool is_yuv() const
+    {
+        GstVideoFormat format = GST_VIDEO_INFO_FORMAT(&impl_->info);
+        return format == GST_VIDEO_FORMAT_NV12 || format == GST_VIDEO_FORMAT_I420;
+    }
+
+    GstSample *sample() const { return impl_ ? impl_->sample : nullptr; }
+    const GstVideoInfo &info() const { return impl_->info; }
+    const guint8 *data() const { return impl_->map.data; }
+    gsize size() const { return impl_->map.size; }
+
+    int width() const { return GST_VIDEO_INFO_WIDTH(&impl_->info); }
+    int height() const { return GST_VIDEO_INFO_HEIGHT(&impl_->info); }
+    GstClockTime pts() const { return impl_ && impl_->buffer ? GST_BUFFER_PTS(impl_->buffer) : GST_CLOCK_TIME_NONE; }
+
+    /* 句柄创建时刻（单调时钟，微秒），用于计算交付延迟 / 帧龄 */
+    gint64 created_us() const { return impl_ ? impl_->created_us : 0; }
+
+    long use_count() const { return impl_.use_count(); }
+
+private:
+    struct Impl
+    {
+        GstSample *sample = nullptr;
+        GstBuffer *buffer = nullptr; // 非空表示已映射
+        GstMapInfo map;
+        GstVideoInfo info;
+        cv::Mat mat;
+        cv::Mat bgr;
+        std::once_flag bgr_once;
+        gint64 created_us = 0;
+
+        ~Impl()
+        {
+            mat.release();
+            bgr.release();
+            if (buffer)
+                gst_buffer_unmap(buffer, &map);
+            if (sample)
+                gst_sample_unref(sample);
+        }
+
+        void convert_bgr()
+        {
+            switch (GST_VIDEO_INFO_FORMAT(&info))
+            {
+            case GST_VIDEO_FORMAT_BGR:
+                bgr = mat;
+                return;
+            case GST_VIDEO_FORMAT_BGRx:
+            case GST_VIDEO_FORMAT_BGRA:
+                cv::cvtColor(mat, bgr, cv::COLOR_BGRA2BGR);
+                return;
+            case GST_VIDEO_FORMAT_GRAY8:
+                cv::cvtColor(mat, bgr, cv::COLOR_GRAY2BGR);
+                return;
+            case GST_VIDEO_FORMAT_NV12:
+            case GST_VIDEO_FORMAT_I420:
+                break;
+            default:
+                return;
+            }
+
+            YuvView view = yuv_view(info, map.data);
+            bgr.create(view.height, view.width, CV_8UC3);
+
+            // 按偶数行切块并行（色度两行共用一行），小图不值得切
+            int bands = std::max(1, std::min(cv::getNumThreads(), view.height / 64));
+            int rows = ((view.height + bands - 1) / bands + 1) & ~1;
+            cv::Mat &out = bgr;
+            cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range &range) {
+                for (int i = range.start; i < range.end; i++)
+                    yuv_to_bgr(view, out.data, (int)out.step, i * rows, std::min(view.height, (i + 1) * rows));
+            });
+        }
+    };
+
+    std::shared_ptr<Impl> impl_;
+};
+
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity)
+    {
+        size_t cap = 2;
+        while (cap < capacity)
+            cap <<= 1;
+        slots_.resize(cap);
+        mask_ = cap - 1;
+    }
+
+    size_t capacity() const { return slots_.size(); }
+
+    /* 仅生产者线程调用 */
+    bool try_push(T &&item)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        if (head - tail == slots_.size())
+            return false; // 满
+
+        slots_[head & mask_] = std::move(item);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* 仅消费者线程调用；取出后槽位清空，句柄引用立即转移给调用者 */
+    bool try_pop(T &out)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        if (head == tail)
+            return false; // 空
+
+        out = std::move(slots_[tail & mask_]);
+        slots_[tail & mask_] = T();
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* 近似值，仅用于统计 */
+    size_t size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> slots_;
+    size_t mask_ = 0;
+
+    // 生产者 / 消费者索引分开放在不同的 cache line，避免伪共享
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
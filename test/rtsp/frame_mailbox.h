@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+ * "最新帧" 信箱：无锁三缓冲，单生产者（appsink 线程）/ 单消费者（渲染线程）
+ *
+ * - 三个槽位：生产者独占 back，消费者独占 front，中间的 middle 用一个原子变量交换
+ *   （低两位是槽位下标，DIRTY 位表示 middle 里有消费者还没取的新帧）
+ * - publish() 永远不阻塞：写 back → 和 middle 交换；如果换回来的旧 middle 还没被取走，
+ *   就是被覆盖的帧，生产者当场释放它（FrameHandle 析构 → buffer 马上回到解码器的池子）
+ * - take() 永远拿到最新的一帧；没有新帧时返回 false，不会重复拿到同一帧
+ * - 和 SpscRing 相比：队列里不会积压旧帧，渲染慢时也最多只多占一个 buffer
+ */
+
+#include <glib.h>
+
+#include <atomic>
+#include <utility>
+
+template <typename T>
+class FrameMailbox
+{
+public:
+    /* 仅生产者线程调用 */
+    void publish(T &&item)
+    {
+        slots_[back_] = std::move(item);
+        unsigned prev = middle_.exchange(back_ | DIRTY, std::memory_order_acq_rel);
+        back_ = prev & INDEX_MASK;
+
+        published_.fetch_add(1, std::memory_order_relaxed);
+        if (prev & DIRTY)
+        {
+            // 消费者没来得及取，旧帧作废并立即释放
+            overwritten_.fetch_add(1, std::memory_order_relaxed);
+            slots_[back_] = T();
+        }
+    }
+
+    /* 仅消费者线程调用；取出后槽位清空，引用转移给调用者 */
+    bool take(T &out)
+    {
+        if (!(middle_.load(std::memory_order_acquire) & DIRTY))
+            return false;
+
+        unsigned prev = middle_.exchange(front_, std::memory_order_acq_rel);
+        front_ = prev & INDEX_MASK;
+        out = std::move(slots_[front_]);
+        slots_[front_] = T();
+
+        taken_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /* 统计（近似值，任意线程读） */
+    guint64 published() const { return published_.load(std::memory_order_relaxed); }
+    guint64 taken() const { return taken_.load(std::memory_order_relaxed); }
+    guint64 overwritten() const { return overwritten_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr unsigned INDEX_MASK = 3;
+    static constexpr unsigned DIRTY = 4;
+
+    T slots_[3];
+
+    // 生产者 / 消费者各自的下标只有本线程访问；middle 放在单独的 cache line
+    alignas(64) unsigned back_ = 0;
+    alignas(64) unsigned front_ = 1;
+    alignas(64) std::atomic<unsigned> middle_{2};
+
+    alignas(64) std::atomic<guint64> published_{0};
+    std::atomic<guint64> taken_{0};
+    std::atomic<guint64> overwritten_{0};
+};
+
+/* 按周期打印信箱的生产 / 消费速率和覆盖丢帧 */
+class MailboxRateMeter
+{
+public:
+    template <typename T>
+    void report(const char *tag, const FrameMailbox<T> &mailbox)
+    {
+        gint64 now = g_get_monotonic_time();
+        guint64 published = mailbox.published(), taken = mailbox.taken(), overwritten = mailbox.overwritten();
+
+        if (last_us_ > 0 && now > last_us_)
+        {
+            double wall = (now - last_us_) / 1e6;
+            guint64 produced = published - last_published_;
+            guint64 dropped = overwritten - last_overwritten_;
+            g_print("[%s] producer %.1f fps, consumer %.1f fps, overwritten %" G_GUINT64_FORMAT " (%.1f%%), total %" G_GUINT64_FORMAT "\n",
+                    tag, produced / wall, (taken - last_taken_) / wall, dropped,
+                    produced ? dropped * 100.0 / produced : 0.0, overwritten);
+        }
+
+        last_us_ = now;
+        last_published_ = published;
+        last_taken_ = taken;
+        last_overwritten_ = overwritten;
+    }
+
+private:
+    gint64 last_us_ = 0;
+    guint64 last_published_ = 0;
+    guint64 last_taken_ = 0;
+    guint64 last_overwritten_ = 0;
+};
@@ -0,0 +1,249 @@
+#pragma once
+
+/*
+ * 解码前跳帧（分析类消费者只需要 N fps 时用）
+ *
+ * 挂在 parser 的 src pad 上（VP8 / VP9 没有 parser，挂在 depay 的 src pad），
+ * 在码流进入解码器之前丢帧，解码器根本看不到这些帧，省下的是解码本身的 CPU：
+ *
+ *   target_fps > 0   按目标帧率丢"非参考帧"——丢掉后不影响其他帧解码
+ *                    H.264：该帧所有 VCL NAL 的 nal_ref_idc == 0
+ *                    H.265：所有 VCL NAL 都是 sub-layer non-reference 类型（< 16 的偶数，
+ *                           TRAIL_N / TSA_N / STSA_N / RADL_N / RASL_N …），
+ *                           摄像头码流一般只有 TemporalId 0，这类帧可以安全丢弃
+ *                    参考帧无论如何都要送解码，所以 IPPP 结构的流（P 帧全是参考帧）
+ *                    在这个模式下丢不掉什么，需要配合 keyframes_only
+ *   keyframes_only   丢掉所有带 GST_BUFFER_FLAG_DELTA_UNIT 的帧，只解关键帧；
+ *                    同时设置 target_fps 时关键帧也按目标帧率抽取（关键帧可独立解码）
+ *
+ * 仅在流线程里调用 process()，统计用原子变量，主线程可随时读取
+ */
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "decoder_select.h" // VideoCodec
+
+class FrameSkipper
+{
+public:
+    struct Stats
+    {
+        std::atomic<guint64> frames_in{0};
+        std::atomic<guint64> frames_passed{0};
+        std::atomic<guint64> dropped_nonref{0}; // 按帧率丢掉的非参考帧
+        std::atomic<guint64> dropped_delta{0};  // keyframes_only 丢掉的非关键帧
+        std::atomic<guint64> dropped_key{0};    // keyframes_only + target_fps 抽掉的关键帧
+    };
+
+    void configure(VideoCodec codec, double target_fps, bool keyframes_only)
+    {
+        codec_ = codec;
+        keyframes_only_ = keyframes_only;
+        interval_ = target_fps > 0 ? (GstClockTime)(GST_SECOND / target_fps) : 0;
+        next_due_ = GST_CLOCK_TIME_NONE;
+        nal_length_size_ = 0;
+    }
+
+    bool enabled() const { return interval_ > 0 || keyframes_only_; }
+
+    const Stats &stats() const { return stats_; }
+
+    /* 挂到 parser（或 depay）的 src pad 上 */
+    void attach(GstPad *pad)
+    {
+        gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                          probe_cb, this, nullptr);
+    }
+
+    /* 返回 true 表示丢弃该帧 */
+    bool process(GstBuffer *buffer)
+    {
+        stats_.frames_in.fetch_add(1, std::memory_order_relaxed);
+
+        GstClockTime ts = GST_BUFFER_DTS_OR_PTS(buffer);
+        bool delta = GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+        if (keyframes_only_)
+        {
+            if (delta)
+            {
+                stats_.dropped_delta.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            if (interval_ > 0 && !due(ts))
+            {
+                stats_.dropped_key.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        else if (interval_ > 0 && delta && !due(ts) && is_non_reference(buffer))
+        {
+            stats_.dropped_nonref.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        advance(ts);
+        stats_.frames_passed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+private:
+    VideoCodec codec_ = VideoCodec::Unknown;
+    bool keyframes_only_ = false;
+    GstClockTime interval_ = 0;
+    GstClockTime next_due_ = GST_CLOCK_TIME_NONE;
+    guint nal_length_size_ = 0; // 0 = byte-stream（起始码），否则 avc / hvc1 的长度前缀字节数
+
+    Stats stats_;
+
+    bool due(GstClockTime ts) const
+    {
+        return !GST_CLOCK_TIME_IS_VALID(ts) || !GST_CLOCK_TIME_IS_VALID(next_due_) || ts >= next_due_;
+    }
+
+    void advance(GstClockTime ts)
+    {
+        if (interval_ == 0 || !GST_CLOCK_TIME_IS_VALID(ts))
+            return;
+
+        // 落后超过一个间隔（比如断流后）直接从当前帧重新起算，避免一口气全放行
+        if (!GST_CLOCK_TIME_IS_VALID(next_due_) || ts >= next_due_ + interval_ || ts + 2 * GST_SECOND < next_due_)
+            next_due_ = ts + interval_;
+        else if (ts >= next_due_)
+            next_due_ += interval_;
+    }
+
+    /* 从 caps 里拿 NAL 长度前缀：avc 的 codec_data[4]、hvc1 的 codec_data[21] 低 2 位 + 1 */
+    void update_format(GstCaps *caps)
+    {
+        nal_length_size_ = 0;
+        if (!caps || gst_caps_get_size(caps) == 0)
+            return;
+
+        GstStructure *st = gst_caps_get_structure(caps, 0);
+        const gchar *format = gst_structure_get_string(st, "stream-format");
+        if (!format || g_str_equal(format, "byte-stream"))
+            return;
+
+        nal_length_size_ = 4;
+        const GValue *value = gst_structure_get_value(st, "codec_data");
+        if (!value || !GST_VALUE_HOLDS_BUFFER(value))
+            return;
+
+        GstBuffer *codec_data = gst_value_get_buffer(value);
+        GstMapInfo map;
+        if (!gst_buffer_map(codec_data, &map, GST_MAP_READ))
+            return;
+
+        if (codec_ == VideoCodec::H264 && map.size > 4)
+            nal_length_size_ = (map.data[4] & 0x03) + 1;
+        else if (codec_ == VideoCodec::H265 && map.size > 21)
+            nal_length_size_ = (map.data[21] & 0x03) + 1;
+
+        gst_buffer_unmap(codec_data, &map);
+    }
+
+    /* 这一帧里有没有 VCL NAL 是参考图像；没有 VCL（只有参数集等）按参考帧处理 */
+    bool is_non_reference(GstBuffer *buffer) const
+    {
+        if (codec_ != VideoCodec::H264 && codec_ != VideoCodec::H265)
+            return false;
+
+        GstMapInfo map;
+        if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+            return false;
+
+        bool has_vcl = false;
+        bool referenced = false;
+        const guint8 *p = map.data;
+        const guint8 *end = map.data + map.size;
+
+        while (p < end && !referenced)
+        {
+            const guint8 *nal;
+            size_t nal_size;
+
+            if (nal_length_size_ > 0)
+            {
+                if ((size_t)(end - p) < nal_length_size_)
+                    break;
+                size_t len = 0;
+                for (guint i = 0; i < nal_length_size_; i++)
+                    len = (len << 8) | p[i];
+                nal = p + nal_length_size_;
+                nal_size = std::min(len, (size_t)(end - nal));
+                p = nal + nal_size;
+            }
+            else
+            {
+                // 找起始码 00 00 01
+                while (p + 3 <= end && !(p[0] == 0 && p[1] == 0 && p[2] == 1))
+                    p++;
+                if (p + 3 > end)
+                    break;
+                nal = p + 3;
+                const guint8 *next = nal;
+                while (next + 3 <= end && !(next[0] == 0 && next[1] == 0 && next[2] == 1))
+                    next++;
+                if (next + 3 > end)
+                    next = end;
+                nal_size = next - nal;
+                p = next;
+            }
+
+            if (nal_size == 0)
+                continue;
+
+            if (codec_ == VideoCodec::H264)
+            {
+                guint type = nal[0] & 0x1f;
+                if (type >= 1 && type <= 5)
+                {
+                    has_vcl = true;
+                    if ((nal[0] >> 5) & 0x03)
+                        referenced = true;
+                }
+            }
+            else
+            {
+                guint type = (nal[0] >> 1) & 0x3f;
+                if (type < 32)
+                {
+                    has_vcl = true;
+                    if (type >= 16 || (type & 1))
+                        referenced = true;
+                }
+            }
+        }
+
+        gst_buffer_unmap(buffer, &map);
+        return has_vcl && !referenced;
+    }
+
+    static GstPadProbeReturn probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        FrameSkipper *self = static_cast<FrameSkipper *>(user_data);
+
+        if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+        {
+            GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+            if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS)
+            {
+                GstCaps *caps = nullptr;
+                gst_event_parse_caps(event, &caps);
+                self->update_format(caps);
+            }
+            else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP || GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT)
+                self->next_due_ = GST_CLOCK_TIME_NONE;
+            return GST_PAD_PROBE_OK;
+        }
+
+        if (!self->enabled())
+            return GST_PAD_PROBE_OK;
+
+        return self->process(GST_PAD_PROBE_INFO_BUFFER(info)) ? GST_PAD_PROBE_DROP : GST_PAD_PROBE_OK;
+    }
+};
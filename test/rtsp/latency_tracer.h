@@ -0,0 +1,274 @@
+#pragma once
+
+/*
+ * 单路流分阶段延迟统计（pad probe）
+ *
+ * 以 PTS 为键，记录同一帧经过各个打点位置的单调时钟时间：
+ *   SRC     rtspsrc 的 src pad（同一帧的第一个 RTP 包）
+ *   DEPAY   depay 的 src pad（完整的一帧码流）
+ *   DECODE  解码器的 src pad
+ *   SINK    on_new_sample（交给应用）
+ *
+ * 另外在 SRC 处用 pipeline 时钟估算 jitterbuffer 的停留时间：
+ *   running_time(now) - PTS，live 流的 PTS 约等于包到达的 running time
+ *
+ * 每个统计周期输出各阶段 p50 / p95 / p99（毫秒）和各阶段丢帧数；
+ * 超过 2 秒还没走到下一阶段的帧记为在该阶段之后丢失
+ * （例如 queue leaky / appsink drop 丢的帧记在 "decode" 之后）
+ *
+ * 可选写 JSON Lines 文件：每个周期追加一行，便于画图对比不同的
+ * latency / queue max-size-buffers / appsink max-buffers 设置
+ */
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class LatencyTracer
+{
+public:
+    enum Stage
+    {
+        STAGE_SRC = 0,
+        STAGE_DEPAY,
+        STAGE_DECODE,
+        STAGE_SINK,
+        STAGE_COUNT
+    };
+
+    ~LatencyTracer()
+    {
+        if (json_)
+            fclose(json_);
+    }
+
+    /* pipeline 用于取时钟估算 jitterbuffer 停留时间，可以为空 */
+    void set_pipeline(GstElement *pipeline) { pipeline_ = pipeline; }
+
+    bool open_json(const std::string &path)
+    {
+        json_ = fopen(path.c_str(), "a");
+        if (!json_)
+            g_printerr("Failed to open latency stats file %s\n", path.c_str());
+        return json_ != nullptr;
+    }
+
+    /* 在某个 pad 上挂 buffer probe，经过即打点 */
+    void attach(GstPad *pad, Stage stage)
+    {
+        ProbeData *probe = new ProbeData{this, stage};
+        gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                          probe_cb, probe, [](gpointer p) { delete static_cast<ProbeData *>(p); });
+    }
+
+    /* 不方便挂 probe 的位置（appsink 回调）直接打点 */
+    void mark(Stage stage, GstClockTime pts)
+    {
+        if (!GST_CLOCK_TIME_IS_VALID(pts))
+            return;
+
+        gint64 now = g_get_monotonic_time();
+        gint64 jitter_us = -1;
+        if (stage == STAGE_SRC)
+            jitter_us = jitterbuffer_hold_us(pts);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = pending_.find(pts);
+        if (it == pending_.end())
+        {
+            // 只从 SRC 开始跟踪；中途出现的帧（比如启动时已在路上的）忽略
+            if (stage != STAGE_SRC)
+                return;
+
+            // 长时间没有 report 时也不让 pending 表无限增长
+            if (pending_.size() > 4096)
+                expire_locked(now - 2 * G_USEC_PER_SEC);
+
+            Pending p;
+            p.t[STAGE_SRC] = now;
+            p.last = STAGE_SRC;
+            pending_.emplace(pts, p);
+
+            if (jitter_us >= 0)
+                jitter_us_.push_back(jitter_us);
+            return;
+        }
+
+        Pending &p = it->second;
+        if (stage <= p.last)
+            return; // SRC 阶段同一帧的后续 RTP 包
+
+        // 与上一个打到的阶段相比（正常情况下就是前一阶段）
+        stage_us_[stage].push_back(now - p.t[p.last]);
+        p.t[stage] = now;
+        p.last = stage;
+
+        if (stage == STAGE_SINK)
+        {
+            total_us_.push_back(now - p.t[STAGE_SRC]);
+            pending_.erase(it);
+        }
+    }
+
+    /* 输出本周期统计并清零；interval_s 仅用于计算帧率 */
+    void report(double interval_s)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        expire_locked(g_get_monotonic_time() - 2 * G_USEC_PER_SEC);
+
+        size_t frames = total_us_.size();
+        Summary jitter = summarize(jitter_us_);
+        Summary depay = summarize(stage_us_[STAGE_DEPAY]);
+        Summary decode = summarize(stage_us_[STAGE_DECODE]);
+        Summary sink = summarize(stage_us_[STAGE_SINK]);
+        Summary total = summarize(total_us_);
+
+        g_print("[latency] %.1f fps | jitterbuf %s | depay %s | decode %s | to-app %s | src->app %s | "
+                "drops depay %" G_GUINT64_FORMAT " decode %" G_GUINT64_FORMAT " app %" G_GUINT64_FORMAT "\n",
+                interval_s > 0 ? frames / interval_s : 0.0,
+                jitter.str().c_str(), depay.str().c_str(), decode.str().c_str(),
+                sink.str().c_str(), total.str().c_str(),
+                drops_[STAGE_SRC], drops_[STAGE_DEPAY], drops_[STAGE_DECODE]);
+
+        if (json_)
+        {
+            fprintf(json_,
+                    "{\"time_us\":%" G_GINT64_FORMAT ",\"frames\":%zu,\"fps\":%.2f,"
+                    "\"jitterbuffer\":%s,\"depay\":%s,\"decode\":%s,\"to_app\":%s,\"src_to_app\":%s,"
+                    "\"drops\":{\"depay\":%" G_GUINT64_FORMAT ",\"decode\":%" G_GUINT64_FORMAT
+                    ",\"app\":%" G_GUINT64_FORMAT "},\"pending\":%zu}\n",
+                    g_get_real_time(), frames, interval_s > 0 ? frames / interval_s : 0.0,
+                    jitter.json().c_str(), depay.json().c_str(), decode.json().c_str(),
+                    sink.json().c_str(), total.json().c_str(),
+                    drops_[STAGE_SRC], drops_[STAGE_DEPAY], drops_[STAGE_DECODE], pending_.size());
+            fflush(json_);
+        }
+
+        jitter_us_.clear();
+        total_us_.clear();
+        for (auto &v : stage_us_)
+            v.clear();
+        for (auto &d : drops_)
+            d = 0;
+    }
+
+private:
+    struct ProbeData
+    {
+        LatencyTracer *tracer;
+        Stage stage;
+    };
+
+    struct Pending
+    {
+        gint64 t[STAGE_COUNT] = {0, 0, 0, 0};
+        int last = STAGE_SRC;
+    };
+
+    struct Summary
+    {
+        size_t count = 0;
+        double p50 = 0, p95 = 0, p99 = 0; // 毫秒
+
+        std::string str() const
+        {
+            if (!count)
+                return "-";
+            gchar *s = g_strdup_printf("%.1f/%.1f/%.1f", p50, p95, p99);
+            std::string out(s);
+            g_free(s);
+            return out;
+        }
+
+        std::string json() const
+        {
+            gchar *s = g_strdup_printf("{\"count\":%zu,\"p50_ms\":%.3f,\"p95_ms\":%.3f,\"p99_ms\":%.3f}",
+                                       count, p50, p95, p99);
+            std::string out(s);
+            g_free(s);
+            return out;
+        }
+    };
+
+    GstElement *pipeline_ = nullptr;
+    FILE *json_ = nullptr;
+
+    std::mutex mutex_;
+    std::unordered_map<GstClockTime, Pending> pending_;
+    std::vector<gint64> jitter_us_;
+    std::vector<gint64> stage_us_[STAGE_COUNT]; // 与前一阶段的差值，STAGE_SRC 不用
+    std::vector<gint64> total_us_;
+    guint64 drops_[STAGE_COUNT] = {0, 0, 0, 0}; // 到达该阶段后就没有下文的帧数
+
+    static Summary summarize(std::vector<gint64> &v)
+    {
+        Summary s;
+        s.count = v.size();
+        if (v.empty())
+            return s;
+
+        std::sort(v.begin(), v.end());
+        s.p50 = v[v.size() * 50 / 100] / 1000.0;
+        s.p95 = v[v.size() * 95 / 100] / 1000.0;
+        s.p99 = v[v.size() * 99 / 100] / 1000.0;
+        return s;
+    }
+
+    void expire_locked(gint64 deadline)
+    {
+        for (auto it = pending_.begin(); it != pending_.end();)
+        {
+            if (it->second.t[it->second.last] < deadline)
+            {
+                drops_[it->second.last]++;
+                it = pending_.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    gint64 jitterbuffer_hold_us(GstClockTime pts)
+    {
+        if (!pipeline_)
+            return -1;
+
+        GstClock *clock = gst_element_get_clock(pipeline_);
+        if (!clock)
+            return -1;
+
+        GstClockTime now = gst_clock_get_time(clock);
+        GstClockTime base = gst_element_get_base_time(pipeline_);
+        gst_object_unref(clock);
+
+        if (now < base || now - base < pts)
+            return -1;
+        return (gint64)((now - base - pts) / GST_USECOND);
+    }
+
+    static GstPadProbeReturn probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        ProbeData *probe = static_cast<ProbeData *>(user_data);
+
+        GstBuffer *buffer = nullptr;
+        if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+            buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+        {
+            GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+            if (gst_buffer_list_length(list) > 0)
+                buffer = gst_buffer_list_get(list, 0);
+        }
+
+        if (buffer)
+            probe->tracer->mark(probe->stage, GST_BUFFER_PTS(buffer));
+
+        return GST_PAD_PROBE_OK;
+    }
+};
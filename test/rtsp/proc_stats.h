@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+ * 进程资源统计（仅 Linux）
+ * - CPU 时间（user / sys），按单核 100% 计算占用率
+ * - 常驻内存 VmRSS、线程数（/proc/self/status）
+ * - 主动 / 被动上下文切换次数
+ * 各个 benchmark 共用，只依赖 glib
+ */
+
+#include <glib.h>
+#include <sys/resource.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+struct ProcSample
+{
+    gint64 wall_us = 0;    // 单调时钟
+    double cpu_s = 0.0;    // user + sys
+    long vol_cs = 0;       // 主动上下文切换
+    long invol_cs = 0;     // 被动上下文切换
+};
+
+static inline ProcSample proc_sample_now()
+{
+    ProcSample s;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    s.wall_us = g_get_monotonic_time();
+    s.cpu_s = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+              ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    s.vol_cs = ru.ru_nvcsw;
+    s.invol_cs = ru.ru_nivcsw;
+    return s;
+}
+
+/* 两次采样之间的 CPU 占用率，100.0 = 占满一个核 */
+static inline double proc_cpu_percent(const ProcSample &a, const ProcSample &b)
+{
+    double wall = (b.wall_us - a.wall_us) / 1e6;
+    if (wall <= 0.0)
+        return 0.0;
+    return (b.cpu_s - a.cpu_s) / wall * 100.0;
+}
+
+/* 读取 /proc/self/status 中的某个数值字段，例如 "VmRSS:" / "Threads:" */
+static inline long proc_status_field(const char *key)
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (!fp)
+        return -1;
+
+    char line[256];
+    long value = -1;
+    size_t key_len = strlen(key);
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (strncmp(line, key, key_len) == 0)
+        {
+            value = strtol(line + key_len, nullptr, 10);
+            break;
+        }
+    }
+
+    fclose(fp);
+    return value;
+}
+
+static inline long proc_rss_kb()
+{
+    return proc_status_field("VmRSS:");
+}
+
+static inline long proc_thread_count()
+{
+    return proc_status_field("Threads:");
+}
@@ -1,182 +1,1917 @@
 #include <gst/gst.h>
 #include <gst/app/gstappsrc.h>
 #include <gst/rtsp/rtsp.h>
+#include <gst/video/video.h>
 
 #include <opencv2/opencv.hpp>
 
 #include <iostream>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <unordered_set>
 #include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "encoder_backend.h"
+#include "bitrate_controller.h"
+#include "proc_stats.h"
+
+/* 每帧分配 / 拷贝计数，用来对比 buffer pool 和逐帧 new + memcpy（转换线程可能有多个） */
+struct PushStats
+{
+    std::atomic<guint64> frames{0};
+    std::atomic<guint64> allocations{0};   // 新分配的 GstBuffer 数
+    std::atomic<guint64> copies{0};        // 整帧 memcpy 次数
+    std::atomic<guint64> bytes_copied{0};
+    std::atomic<guint64> resized{0};       // 尺寸和 caps 不一致、先 resize 的帧
+    std::atomic<gint64> fill_us{0};        // cvtColor + 填充 buffer 的累计耗时
+};
+
+/* ---------------------------------------------------------
+ * 有界阻塞队列，连接推流流水线的各个阶段
+ * - push 在队列满时阻塞（反压上一阶段），pop 在队列空时阻塞
+ * - close() 之后 push 失败，pop 取完剩余元素后返回 false
+ * - 记录每次入队时的队列长度，用于统计平均 / 最大占用
+ * --------------------------------------------------------- */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this]() { return closed_ || items_.size() < capacity_; });
+        if (closed_)
+            return false;
+
+        items_.push_back(std::move(item));
+        occupancy_sum_ += items_.size();
+        occupancy_samples_++;
+        occupancy_max_ = std::max(occupancy_max_, items_.size());
+
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+        if (items_.empty())
+            return false;
+
+        item = std::move(items_.front());
+        items_.pop_front();
+
+        lock.unlock();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    void occupancy(double &avg, size_t &max)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        avg = occupancy_samples_ ? (double)occupancy_sum_ / occupancy_samples_ : 0.0;
+        max = occupancy_max_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    size_t capacity_;
+    bool closed_ = false;
+
+    guint64 occupancy_sum_ = 0;
+    guint64 occupancy_samples_ = 0;
+    size_t occupancy_max_ = 0;
+};
+
+/* 单个流水线阶段的计数：处理帧数 + 实际工作耗时（不含等队列的时间） */
+struct StageStats
+{
+    std::atomic<guint64> frames{0};
+    std::atomic<gint64> busy_us{0};
+};
+
+/* 读取阶段 → 转换阶段
+ * src_pts / src_duration：--pts source 时源文件时间轴映射后的相对时间（从 0 开始、单调），
+ * 推送阶段再加上首帧的 running time；fixed 模式下为 NONE */
+struct RawFrame
+{
+    guint64 seq = 0;
+    cv::Mat bgr;
+    GstClockTime src_pts = GST_CLOCK_TIME_NONE;
+    GstClockTime src_duration = GST_CLOCK_TIME_NONE;
+};
+
+/* 转换阶段 → 推送阶段（多个转换线程时可能乱序，推送阶段按 seq 重排） */
+struct ReadyFrame
+{
+    guint64 seq = 0;
+    GstBuffer *buffer = nullptr;
+    GstClockTime src_pts = GST_CLOCK_TIME_NONE;
+    GstClockTime src_duration = GST_CLOCK_TIME_NONE;
+};
+
+/* ---------------------------------------------------------
+ * 源时间轴 → 单调的相对时间
+ * - 输入是 CAP_PROP_POS_MSEC（FFmpeg 后端取自解码帧的 best-effort PTS，即 demuxer 时间戳）
+ * - 输出 = 源时间 - 首帧源时间 + offset；VFR 的帧间隔原样保留
+ * - 时间戳倒退 / 重复（--loop 回到文件开头、码流本身的时间戳错误）或者向前跳得离谱时视为不连续：
+ *   调整 offset，让这一帧紧接在上一帧之后（间隔取上一帧的间隔），输出永远严格递增
+ * - 读不到时间戳（< 0）时按上一帧间隔外推
+ * --------------------------------------------------------- */
+class SourceTimeline
+{
+public:
+    explicit SourceTimeline(GstClockTime nominal_duration)
+        : last_duration_(nominal_duration) {}
+
+    GstClockTime map(double pos_msec)
+    {
+        gint64 out;
+        if (!(pos_msec >= 0.0))
+        {
+            out = has_last_ ? last_out_ + last_duration_ : 0;
+            missing_++;
+        }
+        else
+        {
+            gint64 ts = (gint64)(pos_msec * GST_MSECOND);
+            if (!has_last_)
+                base_ = ts;
+
+            out = ts - base_ + offset_;
+            if (has_last_ && (out <= last_out_ || out - last_out_ > MAX_GAP))
+            {
+                gint64 expected = last_out_ + last_duration_;
+                offset_ += expected - out;
+                out = expected;
+                discontinuities_++;
+            }
+        }
+
+        if (has_last_)
+            last_duration_ = out - last_out_;
+        last_out_ = out;
+        has_last_ = true;
+        return (GstClockTime)out;
+    }
+
+    /* 最后一帧没有下一帧可参考，沿用上一个间隔 */
+    GstClockTime last_duration() const { return last_duration_; }
+    guint64 discontinuities() const { return discontinuities_; }
+    guint64 missing() const { return missing_; }
+
+private:
+    static constexpr gint64 MAX_GAP = 10 * GST_SECOND;
+
+    gint64 base_ = 0;
+    gint64 offset_ = 0;
+    gint64 last_out_ = 0;
+    gint64 last_duration_;
+    bool has_last_ = false;
+    guint64 discontinuities_ = 0;
+    guint64 missing_ = 0;
+};
+
+/* ---------------------------------------------------------
+ * 推帧节拍器
+ * - 按 pipeline 的 GstClock 等到每一帧的目标 running time 再推（gst_clock_id_wait），
+ *   不再用 g_usleep 估算，也不会因为处理耗时累计变慢
+ * - PTS = 首帧 running time + n * 帧间隔，严格单调
+ * - 统计推送时刻相对目标时刻的偏差（drift）和帧间隔抖动（jitter）
+ * - max_throughput: 不等待，完全由下游（编码器）反压决定速度，用于离线转码 benchmark
+ * --------------------------------------------------------- */
+class FramePacer
+{
+public:
+    void configure(double fps, bool max_throughput)
+    {
+        if (!(fps > 0.0) || std::isnan(fps))
+            fps = 25.0;
+
+        gst_util_double_to_fraction(fps, &fps_n_, &fps_d_);
+        frame_duration_ = gst_util_uint64_scale_int(GST_SECOND, fps_d_, fps_n_);
+        max_throughput_ = max_throughput;
+    }
+
+    /* 等 pipeline 进入 PLAYING 并拿到时钟（live 源需要等 sink 连接上） */
+    bool start(GstElement *pipeline)
+    {
+        pipeline_ = pipeline;
+        start_us_ = g_get_monotonic_time();
+
+        if (max_throughput_)
+            return true;
+
+        GstState state = GST_STATE_NULL;
+        gst_element_get_state(pipeline, &state, nullptr, 10 * GST_SECOND);
+        if (state != GST_STATE_PLAYING)
+        {
+            g_printerr("Pacer: pipeline not PLAYING, cannot pace on clock\n");
+            return false;
+        }
+
+        clock_ = gst_element_get_clock(pipeline);
+        if (!clock_)
+        {
+            g_printerr("Pacer: pipeline has no clock\n");
+            return false;
+        }
+
+        base_time_ = gst_element_get_base_time(pipeline);
+        return true;
+    }
+
+    /* 首帧的 running time；首帧对齐到当前 running time，避免一上来就判定为迟到 */
+    GstClockTime origin()
+    {
+        if (!GST_CLOCK_TIME_IS_VALID(origin_))
+            origin_ = clock_ ? gst_clock_get_time(clock_) - base_time_ : 0;
+        return origin_;
+    }
+
+    /* 第 n 帧的 PTS（running time），固定帧率 */
+    GstClockTime pts(guint64 n)
+    {
+        return origin() + gst_util_uint64_scale(n, GST_SECOND * fps_d_, fps_n_);
+    }
+
+    GstClockTime frame_duration() const { return frame_duration_; }
+    gint fps_n() const { return fps_n_; }
+    gint fps_d() const { return fps_d_; }
+
+    /* 等到 running_time 再返回；被 stop() 打断时返回 false */
+    bool wait(GstClockTime running_time)
+    {
+        frames_++;
+
+        if (max_throughput_ || !clock_)
+            return !stopped_;
+
+        GstClockID id = gst_clock_new_single_shot_id(clock_, base_time_ + running_time);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_)
+            {
+                gst_clock_id_unref(id);
+                return false;
+            }
+            pending_ = id;
+        }
+
+        GstClockTimeDiff jitter = 0;
+        GstClockReturn ret = gst_clock_id_wait(id, &jitter);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = nullptr;
+        }
+        gst_clock_id_unref(id);
+
+        if (ret == GST_CLOCK_UNSCHEDULED)
+            return false;
+
+        if (ret == GST_CLOCK_EARLY)
+            late_frames_++;  // 到达时已经晚于目标时刻（上游读 / 转换太慢）
+
+        // drift: 实际放行时刻 - 目标时刻
+        GstClockTime now = gst_clock_get_time(clock_) - base_time_;
+        double drift_ms = ((gint64)now - (gint64)running_time) / 1e6;
+        drift_sum_ += drift_ms;
+        drift_max_ = std::max(drift_max_, drift_ms);
+
+        // jitter: 相邻两次放行间隔与目标间隔之差（VFR 时目标间隔逐帧不同）
+        if (GST_CLOCK_TIME_IS_VALID(last_release_))
+        {
+            double interval_err = ((gint64)(now - last_release_) - (gint64)(running_time - last_target_)) / 1e6;
+            jitter_sq_sum_ += interval_err * interval_err;
+            jitter_samples_++;
+        }
+        last_release_ = now;
+        last_target_ = running_time;
+        paced_frames_++;
+
+        return true;
+    }
+
+    /* 唤醒正在等待的推帧线程（任意线程可调用） */
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+        if (pending_)
+            gst_clock_id_unschedule(pending_);
+    }
+
+    void print_stats() const
+    {
+        double elapsed = (g_get_monotonic_time() - start_us_) / 1e6;
+
+        if (max_throughput_ || paced_frames_ == 0)
+        {
+            g_print("[pacer] max-throughput: %" G_GUINT64_FORMAT " frames, %.1f fps\n",
+                    frames_, elapsed > 0 ? frames_ / elapsed : 0.0);
+            return;
+        }
+
+        g_print("[pacer] target %.3f fps, actual %.3f fps, drift avg %.2f ms max %.2f ms, "
+                "jitter %.2f ms (rms), late frames %" G_GUINT64_FORMAT "\n",
+                (double)fps_n_ / fps_d_, elapsed > 0 ? frames_ / elapsed : 0.0,
+                drift_sum_ / paced_frames_, drift_max_,
+                jitter_samples_ ? std::sqrt(jitter_sq_sum_ / jitter_samples_) : 0.0,
+                late_frames_);
+    }
+
+    ~FramePacer()
+    {
+        if (clock_)
+            gst_object_unref(clock_);
+    }
+
+private:
+    GstElement *pipeline_ = nullptr;
+    GstClock *clock_ = nullptr;
+    GstClockTime base_time_ = 0;
+    GstClockTime origin_ = GST_CLOCK_TIME_NONE;
+    GstClockTime frame_duration_ = 0;
+    gint fps_n_ = 25;
+    gint fps_d_ = 1;
+    bool max_throughput_ = false;
+
+    std::mutex mutex_;
+    GstClockID pending_ = nullptr;
+    bool stopped_ = false;
+
+    gint64 start_us_ = 0;
+    guint64 frames_ = 0;
+    guint64 paced_frames_ = 0;
+    guint64 late_frames_ = 0;
+    double drift_sum_ = 0.0;
+    double drift_max_ = 0.0;
+    double jitter_sq_sum_ = 0.0;
+    guint64 jitter_samples_ = 0;
+    GstClockTime last_release_ = GST_CLOCK_TIME_NONE;
+    GstClockTime last_target_ = GST_CLOCK_TIME_NONE;
+};
+
+/* ---------------------------------------------------------
+ * PTS 校验：appsrc src pad 上的 probe，看的是真正送进编码器的 buffer
+ * - 单调性：PTS 必须严格递增
+ * - 连续性：PTS[n] + DURATION[n] 应等于 PTS[n+1]，差超过 1ms 记为 gap / overlap
+ * - 漂移：(PTS - 首帧 PTS) - (到达时的 running time - 首帧到达时的 running time)，
+ *   按时钟推帧时应在几毫秒内波动；再对 (小时, 漂移) 做最小二乘，斜率即每小时累计漂移，
+ *   长时间推流（--loop 跑几个小时）时看它是否为 0
+ * --------------------------------------------------------- */
+class PtsValidator
+{
+public:
+    void attach(GstElement *pipeline, GstPad *pad)
+    {
+        pipeline_ = pipeline;
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, probe_cb, this, nullptr);
+    }
+
+    void print_stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (frames_ == 0)
+            return;
+
+        g_print("[pts] frames %" G_GUINT64_FORMAT ", non-monotonic %" G_GUINT64_FORMAT ", gaps %" G_GUINT64_FORMAT
+                ", overlaps %" G_GUINT64_FORMAT ", no duration %" G_GUINT64_FORMAT,
+                frames_, non_monotonic_, gaps_, overlaps_, no_duration_);
+        if (drift_samples_ > 1)
+        {
+            double n = (double)drift_samples_;
+            double denom = n * sum_tt_ - sum_t_ * sum_t_;
+            double slope = denom > 0 ? (n * sum_td_ - sum_t_ * sum_d_) / denom : 0.0;
+            g_print(", drift now %.2f ms [%.2f, %.2f], %.3f ms/hour over %.2f h",
+                    drift_now_, drift_min_, drift_max_, slope, last_hours_);
+        }
+        g_print("\n");
+    }
+
+    ~PtsValidator()
+    {
+        if (clock_)
+            gst_object_unref(clock_);
+    }
+
+private:
+    static GstPadProbeReturn probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        PtsValidator *self = static_cast<PtsValidator *>(user_data);
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (buffer)
+            self->check(GST_BUFFER_PTS(buffer), GST_BUFFER_DURATION(buffer));
+        return GST_PAD_PROBE_OK;
+    }
+
+    void check(GstClockTime pts, GstClockTime duration)
+    {
+        if (!clock_)
+            clock_ = gst_element_get_clock(pipeline_);
+        GstClockTime now = clock_ ? gst_clock_get_time(clock_) - gst_element_get_base_time(pipeline_)
+                                  : GST_CLOCK_TIME_NONE;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        frames_++;
+        if (!GST_CLOCK_TIME_IS_VALID(duration))
+            no_duration_++;
+
+        if (GST_CLOCK_TIME_IS_VALID(last_pts_) && GST_CLOCK_TIME_IS_VALID(pts))
+        {
+            if (pts <= last_pts_)
+                non_monotonic_++;
+            else if (GST_CLOCK_TIME_IS_VALID(last_duration_))
+            {
+                gint64 delta = (gint64)pts - (gint64)(last_pts_ + last_duration_);
+                if (delta > (gint64)GST_MSECOND)
+                    gaps_++;
+                else if (delta < -(gint64)GST_MSECOND)
+                    overlaps_++;
+            }
+        }
+        last_pts_ = pts;
+        last_duration_ = duration;
+
+        if (!GST_CLOCK_TIME_IS_VALID(pts) || !GST_CLOCK_TIME_IS_VALID(now))
+            return;
+
+        if (!GST_CLOCK_TIME_IS_VALID(first_pts_))
+        {
+            first_pts_ = pts;
+            first_now_ = now;
+        }
+
+        double drift = (((gint64)pts - (gint64)first_pts_) - ((gint64)now - (gint64)first_now_)) / 1e6;
+        double hours = (now - first_now_) / 3600e9;
+        drift_now_ = drift;
+        drift_min_ = drift_samples_ ? std::min(drift_min_, drift) : drift;
+        drift_max_ = drift_samples_ ? std::max(drift_max_, drift) : drift;
+        last_hours_ = hours;
+
+        drift_samples_++;
+        sum_t_ += hours;
+        sum_d_ += drift;
+        sum_tt_ += hours * hours;
+        sum_td_ += hours * drift;
+    }
+
+    GstElement *pipeline_ = nullptr;
+    GstClock *clock_ = nullptr;
+
+    std::mutex mutex_;
+    guint64 frames_ = 0;
+    guint64 non_monotonic_ = 0;
+    guint64 gaps_ = 0;
+    guint64 overlaps_ = 0;
+    guint64 no_duration_ = 0;
+    GstClockTime last_pts_ = GST_CLOCK_TIME_NONE;
+    GstClockTime last_duration_ = GST_CLOCK_TIME_NONE;
+
+    GstClockTime first_pts_ = GST_CLOCK_TIME_NONE;
+    GstClockTime first_now_ = GST_CLOCK_TIME_NONE;
+    double drift_now_ = 0.0, drift_min_ = 0.0, drift_max_ = 0.0, last_hours_ = 0.0;
+    guint64 drift_samples_ = 0;
+    double sum_t_ = 0.0, sum_d_ = 0.0, sum_tt_ = 0.0, sum_td_ = 0.0;
+};
 
 struct PushContext
 {
-    GstElement *pipeline;
-    GstElement *appsrc;
-    GMainLoop *loop;
-    cv::VideoCapture *cap;
+    GstElement *pipeline;
+    GstElement *appsrc;
+    GMainLoop *loop;
+    cv::VideoCapture *cap;
+
+    GstVideoInfo info;         // appsrc 的 I420 格式
+    bool use_pool = true;      // false: 旧的逐帧分配 + memcpy 路径
+    PushStats stats;
+
+    FramePacer pacer;
+    PtsValidator validator;
+
+    bool pts_source = false;   // true: PTS 取自源文件（VFR 保持原样）；false: 按帧率生成
+    bool loop_input = false;   // 文件读完后回到开头继续推（长时间稳定性测试）
+    guint64 loops = 0;
+    guint64 discontinuities = 0;
+
+    int convert_threads = 2;   // cvtColor 阶段的线程数
+    size_t queue_depth = 8;    // 阶段之间队列的容量（帧）
+    StageStats read_stage;
+    StageStats convert_stage;
+    StageStats push_stage;
+    gint64 start_us = 0;
+
+    std::atomic<bool> eos_sent{false};     // appsrc 已经发过 EOS（文件推完）
+    std::atomic<bool> eos_received{false}; // bus 上已经收到 pipeline 的 EOS
+    std::atomic<bool> failed{false};       // 出过错，退出时不再排空
+};
+
+static std::atomic<bool> running{true};
+static std::thread worker;
+
+/* ---------------- 信号处理（安全） ---------------- */
+void handle_signal(int)
+{
+    g_print("\r\nSignal received, exiting...\n");
+    running.store(false);
+}
+
+/* ---------------- Bus 回调 ---------------- */
+static void bus_error_cb(GstBus *, GstMessage *msg, gpointer data)
+{
+    GError *err = nullptr;
+    gchar *dbg = nullptr;
+
+    gst_message_parse_error(msg, &err, &dbg);
+    g_printerr("ERROR: %s\n", err->message);
+    g_printerr("DEBUG: %s\n", dbg ? dbg : "none");
+
+    g_clear_error(&err);
+    g_free(dbg);
+
+    auto *ctx = static_cast<PushContext *>(data);
+    ctx->failed.store(true);
+    g_main_loop_quit(ctx->loop);
+}
+
+static void bus_eos_cb(GstBus *, GstMessage *, gpointer data)
+{
+    auto *ctx = static_cast<PushContext *>(data);
+    g_print("EOS received\n");
+    ctx->eos_received.store(true);
+    g_main_loop_quit(ctx->loop);
+}
+
+/* ---------------------------------------------------------
+ * 退出排空（代替原来固定的 g_usleep(4s)）
+ * - appsrc 发 EOS：编码器吐出缓存的帧，parser / sink 收尾（写文件时最后一个分片是完整的）
+ * - 主循环已经退出，直接在 bus 上同步等 pipeline 的 EOS（所有 sink 都收到才会发），
+ *   最多等 timeout_ms；期间出错或超时就不再等，直接拆
+ * - 文件推完时推帧线程已经发过 EOS，这里只等它走完，不重复发
+ * 返回结果描述，用于打印
+ * --------------------------------------------------------- */
+static const char *drain_pipeline(PushContext *ctx, guint timeout_ms)
+{
+    if (ctx->failed.load())
+        return "skipped (error)";
+    if (ctx->eos_received.load())
+        return "eos";
+
+    GstBus *bus = gst_element_get_bus(ctx->pipeline);
+    gst_bus_remove_signal_watch(bus); // 之后的消息不再经主循环分发，下面同步取
+
+    if (!ctx->eos_sent.exchange(true))
+        gst_app_src_end_of_stream(GST_APP_SRC(ctx->appsrc));
+
+    const char *result = "timeout";
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, (GstClockTime)timeout_ms * GST_MSECOND,
+                                                 (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    if (msg)
+    {
+        if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS)
+            result = "eos";
+        else
+        {
+            GError *err = nullptr;
+            gst_message_parse_error(msg, &err, nullptr);
+            g_printerr("ERROR while draining: %s\n", err ? err->message : "unknown");
+            g_clear_error(&err);
+            result = "error";
+        }
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+    return result;
+}
+
+static void state_changed_cb(GstBus *bus, GstMessage *msg, gpointer data)
+{
+    auto *ctx = static_cast<PushContext *>(data);
+
+    GstState old_state, new_state, pending_state;
+    gst_message_parse_state_changed(msg, &old_state, &new_state, &pending_state); // 打印多个消息
+    // if (GST_MESSAGE_SRC(msg) == GST_OBJECT(data->pipeline))
+    // {
+    // g_print("Pipeline state changed from %s to %s\n",
+    // gst_state_get_name(old_state), gst_state_get_name(new_state));
+    // }
+    const gchar *src_name = GST_OBJECT_NAME(msg->src);
+    const gchar *pipeline_name = GST_OBJECT_NAME(ctx->pipeline);
+    // // 打印消息来源（是Pipeline本身，还是子元素如rtspsrc）
+    // g_print("[State Change] Source: %s | Old: %s | New: %s | Pending: %s\n",
+    // src_name,
+    // gst_element_state_get_name(old_state),
+    // gst_element_state_get_name(new_state),
+    // gst_element_state_get_name(pending_state));
+
+    // 只关注Pipeline自身的“最终状态变更”（过滤子元素和过渡消息）
+    if (g_strcmp0(src_name, pipeline_name) == 0 && old_state != new_state)
+    {
+        g_print("Pipeline state changed from %s to %s\n",
+                gst_element_state_get_name(old_state),
+                gst_element_state_get_name(new_state));
+    }
+}
+
+/* OpenCV 的 COLOR_BGR2YUV_I420 输出是紧凑排列（Y / U / V 连续、无行填充），
+ * 只有 GStreamer 的 I420 布局与之一致时才能让 cvtColor 直接写进 buffer */
+static bool i420_layout_is_packed(const GstVideoInfo *info)
+{
+    int w = GST_VIDEO_INFO_WIDTH(info);
+    int h = GST_VIDEO_INFO_HEIGHT(info);
+
+    return (w % 2 == 0) && (h % 2 == 0) &&
+           GST_VIDEO_INFO_PLANE_STRIDE(info, 0) == w &&
+           GST_VIDEO_INFO_PLANE_STRIDE(info, 1) == w / 2 &&
+           GST_VIDEO_INFO_PLANE_STRIDE(info, 2) == w / 2 &&
+           GST_VIDEO_INFO_PLANE_OFFSET(info, 1) == (gsize)w * h &&
+           GST_VIDEO_INFO_PLANE_OFFSET(info, 2) == (gsize)w * h * 5 / 4;
+}
+
+static GstBufferPool *create_frame_pool(const GstVideoInfo *info)
+{
+    GstCaps *caps = gst_video_info_to_caps(info);
+    GstBufferPool *pool = gst_buffer_pool_new();
+
+    GstStructure *config = gst_buffer_pool_get_config(pool);
+    // 预分配 4 块，max=0 表示下游持有较多时允许继续增长（会体现在 allocations 计数里）
+    gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(info), 4, 0);
+    gst_caps_unref(caps);
+
+    if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE))
+    {
+        gst_object_unref(pool);
+        return nullptr;
+    }
+
+    return pool;
+}
+
+/* 从 pool 取一块 buffer，cvtColor 直接写进映射后的内存，省掉一次整帧拷贝 */
+struct PoolTracker
+{
+    GstBufferPool *pool = nullptr;
+    std::mutex mutex;
+    std::unordered_set<GstBuffer *> seen; // pool 复用的是同一个 GstBuffer 对象，第一次见到的指针即一次真实分配
+};
+
+static GstBuffer *fill_pooled_buffer(PushContext *ctx, PoolTracker &tracker, const cv::Mat &frame_bgr)
+{
+    GstBuffer *buffer = nullptr;
+    if (gst_buffer_pool_acquire_buffer(tracker.pool, &buffer, nullptr) != GST_FLOW_OK)
+        return nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(tracker.mutex);
+        if (tracker.seen.insert(buffer).second)
+            ctx->stats.allocations++;
+    }
+
+    const int width = GST_VIDEO_INFO_WIDTH(&ctx->info);
+    const int height = GST_VIDEO_INFO_HEIGHT(&ctx->info);
+
+    // pool 的 buffer 按 caps 尺寸分配，cvtColor 必须原地写进去：
+    // 帧尺寸不一致（源中途变分辨率等）时先缩放到 caps 尺寸并计数，不能按重分配后的 Mat 大小拷贝
+    const cv::Mat *src = &frame_bgr;
+    static thread_local cv::Mat scaled;
+    if (frame_bgr.cols != width || frame_bgr.rows != height)
+    {
+        cv::resize(frame_bgr, scaled, cv::Size(width, height));
+        src = &scaled;
+        ctx->stats.resized++;
+    }
+
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+    {
+        g_printerr("map pooled buffer failed\n");
+        gst_buffer_unref(buffer);
+        return nullptr;
+    }
+
+    cv::Mat dst(height * 3 / 2, width, CV_8UC1, map.data);
+    cv::cvtColor(*src, dst, cv::COLOR_BGR2YUV_I420);
+    bool in_place = dst.data == map.data;
+    gst_buffer_unmap(buffer, &map);
+
+    // 尺寸已经对齐，不会走到这里；万一重分配了，丢掉这帧而不是往 buffer 里拷不同大小的数据
+    if (!in_place)
+    {
+        g_printerr("cvtColor reallocated the pooled frame, dropping it\n");
+        gst_buffer_unref(buffer);
+        return nullptr;
+    }
+    return buffer;
+}
+
+/* 旧路径：cvtColor 到独立的 Mat，再 new 一块 buffer 整帧 memcpy */
+static GstBuffer *fill_copied_buffer(PushContext *ctx, const cv::Mat &frame_bgr, cv::Mat &frame_yuv)
+{
+    cv::cvtColor(frame_bgr, frame_yuv, cv::COLOR_BGR2YUV_I420);
+
+    const guint size = frame_yuv.total() * frame_yuv.elemSize();
+    GstBuffer *buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+    ctx->stats.allocations++;
+
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    memcpy(map.data, frame_yuv.data, size);
+    gst_buffer_unmap(buffer, &map);
+
+    ctx->stats.copies++;
+    ctx->stats.bytes_copied += size;
+
+    return buffer;
+}
+
+static void print_push_stats(const PushContext *ctx)
+{
+    const PushStats &st = ctx->stats;
+    guint64 frames = st.frames.load();
+    if (frames == 0)
+        return;
+
+    g_print("[push stats] %dx%d %s: frames %" G_GUINT64_FORMAT
+            ", allocations %" G_GUINT64_FORMAT " (%.3f/frame)"
+            ", copies %.3f/frame (%.0f bytes/frame)"
+            ", resized %" G_GUINT64_FORMAT
+            ", fill %.0f us/frame\n",
+            GST_VIDEO_INFO_WIDTH(&ctx->info), GST_VIDEO_INFO_HEIGHT(&ctx->info),
+            ctx->use_pool ? "pool" : "copy",
+            frames, st.allocations.load(), (double)st.allocations.load() / frames,
+            (double)st.copies.load() / frames, (double)st.bytes_copied.load() / frames,
+            st.resized.load(), (double)st.fill_us.load() / frames);
+}
+
+static void print_stage_line(const char *name, const StageStats &st, int threads, double wall)
+{
+    guint64 frames = st.frames.load();
+    double busy = st.busy_us.load() / 1e6;
+
+    // busy fps = 该阶段单线程满负荷时的处理能力；wall fps = 实际产出速率
+    g_print("  %-8s threads %d, %" G_GUINT64_FORMAT " frames, %.1f fps (wall), %.1f fps/thread (busy), busy %.0f%%\n",
+            name, threads, frames,
+            wall > 0 ? frames / wall : 0.0,
+            busy > 0 ? frames / busy * threads : 0.0,
+            wall > 0 ? busy / (wall * threads) * 100.0 : 0.0);
+}
+
+static void print_pipeline_stats(PushContext *ctx, BoundedQueue<RawFrame> &raw_q, BoundedQueue<ReadyFrame> &ready_q)
+{
+    double wall = (g_get_monotonic_time() - ctx->start_us) / 1e6;
+    double raw_avg, ready_avg;
+    size_t raw_max, ready_max;
+    raw_q.occupancy(raw_avg, raw_max);
+    ready_q.occupancy(ready_avg, ready_max);
+
+    g_print("[pipeline] %.1f s elapsed\n", wall);
+    print_stage_line("read", ctx->read_stage, 1, wall);
+    print_stage_line("convert", ctx->convert_stage, ctx->convert_threads, wall);
+    print_stage_line("push", ctx->push_stage, 1, wall);
+    g_print("  queue read->convert: avg %.2f / max %zu (cap %zu), convert->push: avg %.2f / max %zu (cap %zu)\n",
+            raw_avg, raw_max, raw_q.capacity(), ready_avg, ready_max, ready_q.capacity());
+}
+
+/* ---------------- 读取阶段：VideoCapture 解码文件 ----------------
+ * --pts source 时每帧的时长要等下一帧的时间戳才知道，所以读取阶段滞后一帧入队 */
+static void read_stage_thread(PushContext *ctx, BoundedQueue<RawFrame> *out)
+{
+    guint64 seq = 0;
+    guint64 frames_in_pass = 0;
+    SourceTimeline timeline(ctx->pacer.frame_duration());
+    RawFrame pending;
+    bool has_pending = false;
+
+    while (running.load())
+    {
+        RawFrame frame;
+
+        gint64 t0 = g_get_monotonic_time();
+        bool ok = ctx->cap->read(frame.bgr); // frame 每次都是新的 Mat，入队后不会被下一帧覆盖
+        if (ok && ctx->pts_source)
+            frame.src_pts = timeline.map(ctx->cap->get(cv::CAP_PROP_POS_MSEC));
+        ctx->read_stage.busy_us += g_get_monotonic_time() - t0;
+
+        if (!ok)
+        {
+            // 回到开头继续读；时间戳倒退由 SourceTimeline 接上，推出去的 PTS 仍然连续
+            if (ctx->loop_input && frames_in_pass > 0 && ctx->cap->set(cv::CAP_PROP_POS_FRAMES, 0))
+            {
+                ctx->loops++;
+                frames_in_pass = 0;
+                continue;
+            }
+            g_print("File EOS\n");
+            break;
+        }
+
+        ctx->read_stage.frames++;
+        frames_in_pass++;
+
+        if (has_pending)
+        {
+            if (ctx->pts_source)
+                pending.src_duration = frame.src_pts - pending.src_pts;
+            pending.seq = seq++;
+            if (!out->push(std::move(pending)))
+            {
+                has_pending = false;
+                break;
+            }
+        }
+        pending = std::move(frame);
+        has_pending = true;
+    }
+
+    // 最后一帧：时长沿用上一帧的间隔
+    if (has_pending && running.load())
+    {
+        if (ctx->pts_source)
+            pending.src_duration = timeline.last_duration();
+        pending.seq = seq++;
+        out->push(std::move(pending));
+    }
+
+    ctx->discontinuities = timeline.discontinuities();
+    if (timeline.missing() > 0)
+        g_print("%" G_GUINT64_FORMAT " frames had no source timestamp, extrapolated\n", timeline.missing());
+
+    out->close();
+}
+
+/* ---------------- 转换阶段：BGR → I420 写入 GstBuffer（可多线程） ---------------- */
+static void convert_stage_thread(PushContext *ctx, PoolTracker *tracker,
+                          BoundedQueue<RawFrame> *in, BoundedQueue<ReadyFrame> *out,
+                          std::atomic<int> *alive)
+{
+    cv::Mat frame_yuv; // 仅 copy 路径使用，每个线程一份
+    RawFrame raw;
+
+    while (in->pop(raw))
+    {
+        gint64 t0 = g_get_monotonic_time();
+
+        GstBuffer *buffer = ctx->use_pool
+                                ? fill_pooled_buffer(ctx, *tracker, raw.bgr)
+                                : fill_copied_buffer(ctx, raw.bgr, frame_yuv);
+        raw.bgr.release();
+
+        gint64 cost = g_get_monotonic_time() - t0;
+        ctx->stats.fill_us += cost;
+        ctx->convert_stage.busy_us += cost;
+
+        if (!buffer)
+        {
+            g_printerr("fill buffer failed\n");
+            break;
+        }
+
+        ctx->stats.frames++;
+        ctx->convert_stage.frames++;
+
+        if (!out->push(ReadyFrame{raw.seq, buffer, raw.src_pts, raw.src_duration}))
+        {
+            gst_buffer_unref(buffer);
+            break;
+        }
+    }
+
+    // 最后一个退出的转换线程负责关闭下游队列
+    if (alive->fetch_sub(1) == 1)
+        out->close();
+}
+
+/* ---------------------------------------------------------
+ * 推帧线程
+ * read（VideoCapture 解码）→ convert（cvtColor，N 线程）→ push（打时间戳、按时钟推 appsrc）
+ * 三个阶段通过有界队列连接，文件解码、颜色转换和编码器可以在多核上并行
+ * --------------------------------------------------------- */
+void push_thread(PushContext *ctx)
+{
+    PoolTracker tracker;
+
+    if (ctx->use_pool)
+    {
+        if (!i420_layout_is_packed(&ctx->info))
+            g_print("I420 layout has padding, fall back to copy path\n");
+        else if (!(tracker.pool = create_frame_pool(&ctx->info)))
+            g_printerr("Create buffer pool failed, fall back to copy path\n");
+
+        ctx->use_pool = (tracker.pool != nullptr);
+    }
+
+    FramePacer &pacer = ctx->pacer;
+    guint64 n = 0;
+    bool eos = false;
+
+    if (!pacer.start(ctx->pipeline))
+        running.store(false);
+
+    BoundedQueue<RawFrame> raw_q(ctx->queue_depth);
+    BoundedQueue<ReadyFrame> ready_q(ctx->queue_depth);
+    std::atomic<int> convert_alive{ctx->convert_threads};
+
+    ctx->start_us = g_get_monotonic_time();
+
+    std::thread reader(read_stage_thread, ctx, &raw_q);
+    std::vector<std::thread> converters;
+    for (int i = 0; i < ctx->convert_threads; i++)
+        converters.emplace_back(convert_stage_thread, ctx, &tracker, &raw_q, &ready_q, &convert_alive);
+
+    // 多个转换线程的输出按 seq 重排后再推
+    std::map<guint64, ReadyFrame> reorder;
+    ReadyFrame ready;
+
+    while (running.load())
+    {
+        auto it = reorder.find(n);
+        if (it == reorder.end())
+        {
+            if (!ready_q.pop(ready))
+            {
+                eos = true; // 上游全部结束且队列已取空
+                break;
+            }
+            reorder.emplace(ready.seq, ready);
+            continue;
+        }
+
+        ReadyFrame frame = it->second;
+        GstBuffer *buffer = frame.buffer;
+        reorder.erase(it);
+
+        gint64 t0 = g_get_monotonic_time();
+
+        // === 时间戳 ===
+        // source：首帧 running time + 源文件的相对时间，VFR 的真实间隔和时长原样交给编码器
+        // fixed： 按帧序号和帧率生成，严格单调、间隔恒定
+        GstClockTime pts, duration;
+        if (ctx->pts_source && GST_CLOCK_TIME_IS_VALID(frame.src_pts))
+        {
+            pts = pacer.origin() + frame.src_pts;
+            duration = frame.src_duration;
+        }
+        else
+        {
+            pts = pacer.pts(n);
+            duration = pacer.frame_duration();
+        }
+        n++;
+
+        // 原始视频没有解码顺序，DTS 留空，由编码器输出时自己生成
+        GST_BUFFER_PTS(buffer) = pts;
+        GST_BUFFER_DTS(buffer) = GST_CLOCK_TIME_NONE;
+        GST_BUFFER_DURATION(buffer) = duration;
+
+        // 在 pipeline 时钟上等到该帧的 running time 再推（等待时间不计入 push 阶段耗时）
+        gint64 wait_start = g_get_monotonic_time();
+        if (!pacer.wait(pts))
+        {
+            gst_buffer_unref(buffer);
+            break;
+        }
+        gint64 wait_us = g_get_monotonic_time() - wait_start;
+
+        GstFlowReturn ret =
+            gst_app_src_push_buffer(GST_APP_SRC(ctx->appsrc), buffer);
+
+        // push_buffer 无论成功与否都会接管 buffer，这里不能再 unref（否则 pool 里的 buffer 会被重复释放）
+        if (ret != GST_FLOW_OK)
+        {
+            g_printerr("push_buffer failed: %d\n", ret);
+            break;
+        }
+
+        ctx->push_stage.busy_us += g_get_monotonic_time() - t0 - wait_us;
+        ctx->push_stage.frames++;
+
+        if (n % 250 == 0)
+        {
+            print_push_stats(ctx);
+            pacer.print_stats();
+            ctx->validator.print_stats();
+            print_pipeline_stats(ctx, raw_q, ready_q);
+        }
+    }
+
+    if (eos && !ctx->eos_sent.exchange(true))
+        gst_app_src_end_of_stream(GST_APP_SRC(ctx->appsrc));
+
+    // 停止上游阶段并回收还没推出去的帧
+    running.store(false);
+    raw_q.close();
+    ready_q.close();
+
+    reader.join();
+    for (auto &t : converters)
+        t.join();
+
+    while (ready_q.pop(ready))
+        gst_buffer_unref(ready.buffer);
+    for (auto &kv : reorder)
+        gst_buffer_unref(kv.second.buffer);
+
+    print_push_stats(ctx);
+    pacer.print_stats();
+    ctx->validator.print_stats();
+    print_pipeline_stats(ctx, raw_q, ready_q);
+    if (ctx->loop_input || ctx->pts_source)
+        g_print("[source] pts %s, loops %" G_GUINT64_FORMAT ", timestamp discontinuities %" G_GUINT64_FORMAT "\n",
+                ctx->pts_source ? "source" : "fixed", ctx->loops, ctx->discontinuities);
+
+    if (tracker.pool)
+    {
+        // 已推出去的 buffer 还被下游持有，unref 后由 pool 自行回收
+        gst_buffer_pool_set_active(tracker.pool, FALSE);
+        gst_object_unref(tracker.pool);
+    }
+
+    ctx->cap->release();
+    g_main_loop_quit(ctx->loop);
+
+    g_print("Push thread exited\n");
+}
+
+/* ---------------------------------------------------------
+ * 输出分支：[queue] → encoder → parser → queue → [rtph26xpay] → sink
+ * target："fakesink" / udp://host:port（裸 RTP）/ rtsp://...（rtspclientsink）
+ * own_thread：编码器前面加一个 queue，编码跑在自己的线程里（多路输出时互不拖累）
+ * throttle_kbps > 0：queue 之后按该速率节流，模拟受限上行（测试自适应码率用）
+ * --------------------------------------------------------- */
+struct OutputBranch
+{
+    std::string target;
+    int throttle_kbps = 0;
+
+    const EncoderBackend *backend = nullptr;
+    GstElement *enc = nullptr;
+    GstElement *queue = nullptr; // 编码后的 500ms leaky queue，自适应码率看它的水位
+    GstElement *sink = nullptr;
+    std::shared_ptr<LinkThrottle> throttle;
+    EncoderSettings settings;
+    int width = 0;
+    int height = 0;
+    int bitrate_kbps = 0;
+};
+
+static bool add_output_branch(GstElement *pipeline, GstElement *upstream, const std::string &encoder_name,
+                              const EncoderSettings &settings, bool max_throughput, bool own_thread,
+                              OutputBranch &out)
+{
+    const std::string &target = out.target;
+    bool to_fakesink = (target == "fakesink");
+    bool to_udp = g_str_has_prefix(target.c_str(), "udp://");
+
+    GstElement *enc = make_encoder(encoder_name, settings, &out.backend);
+    if (!enc)
+    {
+        g_printerr("No usable encoder (%s)\n", encoder_name.c_str());
+        return false;
+    }
+
+    GstElement *enc_queue = own_thread ? gst_element_factory_make("queue", nullptr) : nullptr;
+    GstElement *parse = gst_element_factory_make(out.backend->parser, nullptr);
+    GstElement *queue = gst_element_factory_make("queue", nullptr);
+    GstElement *pay = to_udp ? gst_element_factory_make(out.backend->payloader, nullptr) : nullptr;
+    GstElement *sink = gst_element_factory_make(to_fakesink ? "fakesink" : to_udp ? "udpsink" : "rtspclientsink", nullptr);
+
+    if (!parse || !queue || !sink || (to_udp && !pay) || (own_thread && !enc_queue))
+    {
+        g_printerr("Create element failed\n");
+        return false;
+    }
+
+    /* ---------- 编码器前的 queue：编码线程，编码跟不上时丢旧的原始帧，不反压其他分支 ---------- */
+    if (enc_queue)
+        g_object_set(enc_queue,
+                     "max-size-buffers", 3,
+                     "max-size-time", 0,
+                     "max-size-bytes", 0,
+                     "leaky", max_throughput ? 0 : 2, // 离线转码不丢帧
+                     "silent", TRUE,
+                     NULL);
+
+    /* ---------- h264parse / h265parse ---------- */
+    g_object_set(parse,
+                 "config-interval", -1,  // 每个 IDR 注入 VPS/SPS/PPS
+                 NULL);
+
+    /* ---------- queue ---------- */
+    g_object_set(queue,
+                 "max-size-time", 500 * GST_MSECOND,
+                 "max-size-buffers", 0,
+                 "max-size-bytes", 0,
+                 "leaky",  2, // downstream（更适合推流）
+                 "silent", TRUE,
+                 NULL);
+
+    /* ---------- sink ---------- */
+    if (to_fakesink)
+    {
+        g_object_set(sink, "sync", !max_throughput, NULL);
+    }
+    else if (to_udp)
+    {
+        // udp://host:port，裸 RTP，每个 IDR 前带参数集，接收端随时可以加入
+        std::string host = target.substr(6);
+        int port = 5600;
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos)
+        {
+            port = atoi(host.c_str() + colon + 1);
+            host.resize(colon);
+        }
+        g_object_set(pay, "config-interval", -1, NULL);
+        g_object_set(sink, "host", host.c_str(), "port", port, "sync", FALSE, NULL);
+    }
+    else
+    {
+        g_object_set(sink,
+                     "location", target.c_str(),
+                     "protocols", GST_RTSP_LOWER_TRANS_TCP,
+                     "latency", 300,              // 200~500ms
+                     "tcp-timeout", 5 * 1000000,     // 5s
+                     "retry", 5,
+                     "do-rtsp-keep-alive", TRUE,
+                     NULL);
+    }
+
+    std::vector<GstElement *> chain;
+    if (enc_queue)
+        chain.push_back(enc_queue);
+    chain.insert(chain.end(), {enc, parse, queue});
+    if (pay)
+        chain.push_back(pay);
+    chain.push_back(sink);
+
+    GstElement *prev = upstream;
+    for (GstElement *e : chain)
+    {
+        gst_bin_add(GST_BIN(pipeline), e);
+        if (!gst_element_link(prev, e))
+        {
+            g_printerr("Link %s -> %s failed\n", GST_OBJECT_NAME(prev), GST_OBJECT_NAME(e));
+            return false;
+        }
+        prev = e;
+    }
+
+    if (out.throttle_kbps > 0)
+    {
+        out.throttle = std::make_shared<LinkThrottle>(out.throttle_kbps);
+        GstPad *pad = gst_element_get_static_pad(queue, "src");
+        out.throttle->attach(pad);
+        gst_object_unref(pad);
+    }
+
+    out.enc = enc;
+    out.queue = queue;
+    out.sink = sink;
+    out.settings = settings;
+    out.bitrate_kbps = settings.bitrate_kbps;
+    return true;
+}
+
+/* ---------------------------------------------------------
+ * 多码率阶梯（ABR ladder）：--ladder 1080,720,360 或 1080:4000,720:2500,360:800
+ *
+ *   appsrc(I420) → tee ─ queue → enc → ... → <target>_1080p
+ *                      └ queue → videoscale → 720p → tee ─ queue → enc → ... → <target>_720p
+ *                                                         └ queue → videoscale → 360p → ... → <target>_360p
+ *
+ * - BGR → I420 只在转换阶段做一次，所有档位共用
+ * - 按分辨率从高到低级联缩放：360p 从 720p 缩，而不是每档都从原图缩，缩放的像素量更少
+ * - 每档编码前有自己的 queue（独立编码线程），慢的档位只丢自己的帧
+ * - 没写码率时按像素比例估算：base * (h / 源高)^1.5（1080→4000，720→~2200，360→~770）
+ * - 输出：rtsp 地址后缀 _<h>p；udp 端口每档 +2；fakesink 不变
+ * --------------------------------------------------------- */
+struct Rendition
+{
+    int width = 0;
+    int height = 0;
+    int bitrate_kbps = 0;
 };
 
-static std::atomic<bool> running{true};
-static std::thread worker;
+static std::vector<Rendition> parse_ladder(const std::string &spec, int src_width, int src_height, int base_kbps)
+{
+    std::vector<Rendition> ladder;
+    gchar **parts = g_strsplit(spec.c_str(), ",", -1);
+    for (gchar **p = parts; *p; p++)
+    {
+        Rendition r;
+        int kbps = 0;
+        if (sscanf(*p, "%d:%d", &r.height, &kbps) < 1 || r.height <= 0)
+            continue;
+
+        r.height = std::min(r.height, src_height) & ~1; // 不放大
+        r.width = (int)std::lround((double)src_width * r.height / src_height) & ~1;
+        r.bitrate_kbps = kbps > 0 ? kbps
+                                  : std::max(200, (int)(base_kbps * std::pow((double)r.height / src_height, 1.5)));
+        ladder.push_back(r);
+    }
+    g_strfreev(parts);
 
-/* ---------------- 信号处理（安全） ---------------- */
-void handle_signal(int)
+    std::sort(ladder.begin(), ladder.end(), [](const Rendition &a, const Rendition &b) { return a.height > b.height; });
+    ladder.erase(std::unique(ladder.begin(), ladder.end(),
+                             [](const Rendition &a, const Rendition &b) { return a.height == b.height; }),
+                 ladder.end());
+    return ladder;
+}
+
+static std::string rendition_target(const std::string &target, const Rendition &r, int index)
 {
-    g_print("\r\nSignal received, exiting...\n");
-    running.store(false);
+    if (target == "fakesink")
+        return target;
+
+    if (g_str_has_prefix(target.c_str(), "udp://"))
+    {
+        size_t colon = target.rfind(':');
+        int port = colon != std::string::npos && colon > 5 ? atoi(target.c_str() + colon + 1) : 5600;
+        std::string host = colon != std::string::npos && colon > 5 ? target.substr(0, colon) : target;
+        return host + ":" + std::to_string(port + index * 2);
+    }
+
+    return target + "_" + std::to_string(r.height) + "p";
 }
 
-/* ---------------- Bus 回调 ---------------- */
-static void bus_error_cb(GstBus *, GstMessage *msg, gpointer data)
+static bool build_ladder(GstElement *pipeline, GstElement *appsrc, const std::vector<Rendition> &ladder,
+                         int src_height, const std::string &target, const std::string &encoder_name,
+                         const EncoderSettings &base, bool max_throughput, int throttle_kbps,
+                         std::vector<OutputBranch> &outputs)
 {
-    GError *err = nullptr;
-    gchar *dbg = nullptr;
+    GstElement *tee = gst_element_factory_make("tee", "src_tee");
+    gst_bin_add(GST_BIN(pipeline), tee);
+    gst_element_link(appsrc, tee);
 
-    gst_message_parse_error(msg, &err, &dbg);
-    g_printerr("ERROR: %s\n", err->message);
-    g_printerr("DEBUG: %s\n", dbg ? dbg : "none");
+    GstElement *prev_tee = tee;
+    int prev_height = src_height;
 
-    g_clear_error(&err);
-    g_free(dbg);
+    for (size_t i = 0; i < ladder.size(); i++)
+    {
+        const Rendition &r = ladder[i];
+        GstElement *branch_src = prev_tee;
 
-    auto *ctx = static_cast<PushContext *>(data);
-    g_main_loop_quit(ctx->loop);
+        if (r.height != prev_height)
+        {
+            // 缩放也在自己的线程里，和上一档的编码并行
+            GstElement *queue = gst_element_factory_make("queue", nullptr);
+            GstElement *scale = gst_element_factory_make("videoscale", nullptr);
+            GstElement *filter = gst_element_factory_make("capsfilter", nullptr);
+            GstElement *scaled_tee = gst_element_factory_make("tee", nullptr);
+            if (!queue || !scale || !filter || !scaled_tee)
+            {
+                g_printerr("Create scaler failed\n");
+                return false;
+            }
+
+            g_object_set(queue, "max-size-buffers", 3, "max-size-time", 0, "max-size-bytes", 0,
+                         "leaky", max_throughput ? 0 : 2, "silent", TRUE, NULL);
+            GstCaps *caps = gst_caps_new_simple("video/x-raw",
+                                                "format", G_TYPE_STRING, "I420",
+                                                "width", G_TYPE_INT, r.width,
+                                                "height", G_TYPE_INT, r.height,
+                                                NULL);
+            g_object_set(filter, "caps", caps, NULL);
+            gst_caps_unref(caps);
+
+            gst_bin_add_many(GST_BIN(pipeline), queue, scale, filter, scaled_tee, NULL);
+            if (!gst_element_link_many(prev_tee, queue, scale, filter, scaled_tee, NULL))
+            {
+                g_printerr("Link scaler %dp failed\n", r.height);
+                return false;
+            }
+
+            branch_src = scaled_tee;
+            prev_tee = scaled_tee;
+            prev_height = r.height;
+        }
+
+        EncoderSettings settings = base;
+        settings.bitrate_kbps = r.bitrate_kbps;
+        settings.max_kbps = r.bitrate_kbps * 9 / 8;
+        settings.min_kbps = r.bitrate_kbps * 7 / 8;
+
+        OutputBranch out;
+        out.target = rendition_target(target, r, (int)i);
+        out.throttle_kbps = throttle_kbps;
+        out.width = r.width;
+        out.height = r.height;
+        if (!add_output_branch(pipeline, branch_src, encoder_name, settings, max_throughput, true, out))
+            return false;
+        outputs.push_back(out);
+    }
+
+    return true;
 }
 
-static void bus_eos_cb(GstBus *, GstMessage *, gpointer data)
+/* ---------------------------------------------------------
+ * 编码器 benchmark：videotestsrc(live) → encoder → parser → RTP pay → udpsink(127.0.0.1)
+ * - 编码延迟：encoder sink pad 进、src pad 出，按 PTS 配对（前 1 秒预热不计）
+ * - 码率精度：按 PTS 每秒一个桶统计编码输出字节，给出平均码率和单秒最大偏差
+ * - CPU：整个进程（videotestsrc + 编码 + 封包）
+ * 每个可用的后端用同一组码控参数跑一遍，x86 上没有 mpp 也能对比 x264 / x265 / openh264
+ * --------------------------------------------------------- */
+struct EncodeProbe
 {
-    auto *ctx = static_cast<PushContext *>(data);
-    g_print("EOS received\n");
-    g_main_loop_quit(ctx->loop);
+    std::mutex mutex;
+    std::map<GstClockTime, gint64> in_flight; // PTS → 进编码器的时刻
+    std::vector<gint64> latency_us;
+    std::vector<guint64> bytes_per_second;    // 按 PTS 秒数分桶
+    guint64 frames = 0;
+};
+
+static GstPadProbeReturn encode_in_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    EncodeProbe *probe = static_cast<EncodeProbe *>(user_data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (buffer && GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        std::lock_guard<std::mutex> lock(probe->mutex);
+        probe->in_flight[GST_BUFFER_PTS(buffer)] = g_get_monotonic_time();
+    }
+    return GST_PAD_PROBE_OK;
 }
 
-static void state_changed_cb(GstBus *bus, GstMessage *msg, gpointer data)
+static GstPadProbeReturn encode_out_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
-    auto *ctx = static_cast<PushContext *>(data);
+    EncodeProbe *probe = static_cast<EncodeProbe *>(user_data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!buffer || !GST_BUFFER_PTS_IS_VALID(buffer))
+        return GST_PAD_PROBE_OK;
 
-    GstState old_state, new_state, pending_state;
-    gst_message_parse_state_changed(msg, &old_state, &new_state, &pending_state); // 打印多个消息
-    // if (GST_MESSAGE_SRC(msg) == GST_OBJECT(data->pipeline))
-    // {
-    // g_print("Pipeline state changed from %s to %s\n",
-    // gst_state_get_name(old_state), gst_state_get_name(new_state));
-    // }
-    const gchar *src_name = GST_OBJECT_NAME(msg->src);
-    const gchar *pipeline_name = GST_OBJECT_NAME(ctx->pipeline);
-    // // 打印消息来源（是Pipeline本身，还是子元素如rtspsrc）
-    // g_print("[State Change] Source: %s | Old: %s | New: %s | Pending: %s\n",
-    // src_name,
-    // gst_element_state_get_name(old_state),
-    // gst_element_state_get_name(new_state),
-    // gst_element_state_get_name(pending_state));
+    gint64 now = g_get_monotonic_time();
+    GstClockTime pts = GST_BUFFER_PTS(buffer);
 
-    // 只关注Pipeline自身的“最终状态变更”（过滤子元素和过渡消息）
-    if (g_strcmp0(src_name, pipeline_name) == 0 && old_state != new_state)
+    std::lock_guard<std::mutex> lock(probe->mutex);
+    probe->frames++;
+
+    size_t second = pts / GST_SECOND;
+    if (probe->bytes_per_second.size() <= second)
+        probe->bytes_per_second.resize(second + 1, 0);
+    probe->bytes_per_second[second] += gst_buffer_get_size(buffer);
+
+    auto it = probe->in_flight.find(pts);
+    if (it != probe->in_flight.end())
     {
-        g_print("Pipeline state changed from %s to %s\n",
-                gst_element_state_get_name(old_state),
-                gst_element_state_get_name(new_state));
+        if (pts >= GST_SECOND)
+            probe->latency_us.push_back(now - it->second);
+        probe->in_flight.erase(probe->in_flight.begin(), ++it);
     }
+    return GST_PAD_PROBE_OK;
 }
 
-/* ---------------- 推帧线程 ---------------- */
-void push_thread(PushContext *ctx)
+static void run_encoder_bench(const EncoderBackend &backend, const EncoderSettings &settings,
+                              int width, int height, int seconds)
 {
-    cv::Mat frame_bgr;
-    cv::Mat frame_yuv;
+    gchar *desc = g_strdup_printf("videotestsrc is-live=true pattern=smpte horizontal-speed=8 ! "
+                                  "video/x-raw,format=I420,width=%d,height=%d,framerate=%d/1",
+                                  width, height, settings.fps);
+    GError *err = nullptr;
+    GstElement *src = gst_parse_bin_from_description(desc, TRUE, &err);
+    g_free(desc);
 
-    int i = 0;
+    const EncoderBackend *chosen = nullptr;
+    GstElement *pipeline = gst_pipeline_new("encoder-bench");
+    GstElement *enc = make_encoder(backend.factory, settings, &chosen);
+    GstElement *parse = gst_element_factory_make(backend.parser, nullptr);
+    GstElement *pay = gst_element_factory_make(backend.payloader, nullptr);
+    GstElement *sink = gst_element_factory_make("udpsink", nullptr);
 
-    GstClockTime target_frame_duration = gst_util_uint64_scale_int(1, GST_SECOND, 25); // 25fps
+    if (!src || !enc || !parse || !pay || !sink)
+    {
+        g_print("%-12s failed to create pipeline%s%s\n", backend.factory, err ? ": " : "", err ? err->message : "");
+        g_clear_error(&err);
+        for (GstElement *e : {src, enc, parse, pay, sink})
+            if (e)
+                gst_object_unref(e);
+        gst_object_unref(pipeline);
+        return;
+    }
 
-    using steady = std::chrono::steady_clock;
+    g_object_set(pay, "config-interval", -1, NULL);
+    g_object_set(sink, "host", "127.0.0.1", "port", 5600, "sync", FALSE, "async", FALSE, NULL);
 
-    while (running.load())
+    gst_bin_add_many(GST_BIN(pipeline), src, enc, parse, pay, sink, NULL);
+    gst_element_link_many(src, enc, parse, pay, sink, NULL);
+
+    EncodeProbe probe;
+    GstPad *enc_sink = gst_element_get_static_pad(enc, "sink");
+    GstPad *enc_src = gst_element_get_static_pad(enc, "src");
+    gst_pad_add_probe(enc_sink, GST_PAD_PROBE_TYPE_BUFFER, encode_in_cb, &probe, nullptr);
+    gst_pad_add_probe(enc_src, GST_PAD_PROBE_TYPE_BUFFER, encode_out_cb, &probe, nullptr);
+    gst_object_unref(enc_sink);
+    gst_object_unref(enc_src);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    ProcSample begin = proc_sample_now();
+    g_usleep((gulong)seconds * G_USEC_PER_SEC);
+    ProcSample end = proc_sample_now();
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    std::lock_guard<std::mutex> lock(probe.mutex);
+    std::vector<gint64> &lat = probe.latency_us;
+    std::sort(lat.begin(), lat.end());
+
+    // 码率：去掉第 0 秒（预热）和最后一个不完整的桶
+    double kbps_sum = 0.0, worst_dev = 0.0;
+    int full_seconds = 0;
+    for (size_t i = 1; i + 1 < probe.bytes_per_second.size(); i++)
+    {
+        double kbps = probe.bytes_per_second[i] * 8 / 1000.0;
+        kbps_sum += kbps;
+        worst_dev = std::max(worst_dev, std::fabs(kbps - settings.bitrate_kbps) / settings.bitrate_kbps * 100.0);
+        full_seconds++;
+    }
+    double avg_kbps = full_seconds ? kbps_sum / full_seconds : 0.0;
+    double wall = (end.wall_us - begin.wall_us) / 1e6;
+    size_t n = lat.size();
+
+    g_print("%-12s %7.1f %8.1f %8.1f %8.1f %9.0f %+8.1f%% %9.1f%% %7.1f%%\n", backend.factory,
+            wall > 0 ? probe.frames / wall : 0.0,
+            n ? lat[n / 2] / 1000.0 : 0.0, n ? lat[n * 95 / 100] / 1000.0 : 0.0, n ? lat[n - 1] / 1000.0 : 0.0,
+            avg_kbps, (avg_kbps - settings.bitrate_kbps) / settings.bitrate_kbps * 100.0, worst_dev,
+            proc_cpu_percent(begin, end));
+}
+
+static int run_encoder_benchmark(const EncoderSettings &settings, int width, int height, int seconds)
+{
+    gst_init(nullptr, nullptr);
+
+    g_print("\n===== Encoder benchmark: %dx%d@%d, CBR %d kbps, GOP %d, %s, %d s per encoder -> udpsink 127.0.0.1:5600 =====\n",
+            width, height, settings.fps, settings.bitrate_kbps, settings.gop,
+            settings.low_latency ? "low latency" : "default latency", seconds);
+    g_print("%-12s %7s %8s %8s %8s %9s %9s %10s %8s\n", "encoder", "fps", "p50 ms", "p95 ms", "max ms",
+            "kbps", "error", "worst 1s", "cpu");
+
+    for (const EncoderBackend &b : encoder_backends())
     {
-        if (!ctx->cap->read(frame_bgr))
+        if (!encoder_available(b.factory))
         {
-            g_print("File EOS\n");
-            gst_app_src_end_of_stream(GST_APP_SRC(ctx->appsrc));
-            break;
+            g_print("%-12s not installed\n", b.factory);
+            continue;
         }
+        run_encoder_bench(b, settings, width, height, seconds);
+    }
+    return 0;
+}
 
-        cv::cvtColor(frame_bgr, frame_yuv, cv::COLOR_BGR2YUV_I420);
+/* ---------------------------------------------------------
+ * 自适应码率的 bus / 定时器回调：QoS 消息按来源归到对应输出分支的控制器
+ * --------------------------------------------------------- */
+struct AbrContext
+{
+    std::vector<OutputBranch> *outputs;
+    std::vector<std::unique_ptr<BitrateController>> *controllers;
+};
 
-        const guint size = frame_yuv.total() * frame_yuv.elemSize();
-        GstBuffer *buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+static void abr_qos_cb(GstBus *, GstMessage *msg, gpointer data)
+{
+    AbrContext *ctx = static_cast<AbrContext *>(data);
+    for (size_t i = 0; i < ctx->controllers->size(); i++)
+    {
+        GstElement *sink = (*ctx->outputs)[i].sink;
+        // rtspclientsink 是 bin，QoS 可能来自内部元素
+        if (GST_MESSAGE_SRC(msg) == GST_OBJECT(sink) || gst_object_has_as_ancestor(GST_MESSAGE_SRC(msg), GST_OBJECT(sink)))
+            (*ctx->controllers)[i]->on_qos();
+    }
+}
 
-        // === 单调系统时间 ===
-        static const auto t0 = steady::now();
-        static steady::time_point last_tp = t0;
+static gboolean abr_report_cb(gpointer data)
+{
+    AbrContext *ctx = static_cast<AbrContext *>(data);
+    for (size_t i = 0; i < ctx->controllers->size(); i++)
+    {
+        std::string tag = std::to_string((*ctx->outputs)[i].height) + "p";
+        (*ctx->controllers)[i]->print_stats(tag.c_str());
+    }
+    return TRUE;
+}
 
-        static GstClockTime last_pts = 0;
+/* ---------------------------------------------------------
+ * 自适应码率 benchmark：live videotestsrc → encoder → parse → queue(500ms leaky) → 节流 → fakesink
+ * 同样的上行限速下分别跑固定码率和 --abr，对比：
+ * - 丢帧：queue overrun 次数（原来是静默丢弃）
+ * - 延迟：编码输出 → 出链路（sink）的时间，p50 / p95 / max / 标准差
+ * - 实际发送码率和最终码率
+ * --------------------------------------------------------- */
+struct AbrProbe
+{
+    std::mutex mutex;
+    std::map<GstClockTime, gint64> sent;  // 编码输出的 PTS → 时刻
+    std::vector<gint64> latency_us;
+    guint64 bytes = 0;
+    std::atomic<guint64> overruns{0};
+    std::atomic<guint64> queue_in{0};  // 进 / 出 leaky queue 的 buffer 数，差值减去残留即丢弃数
+    std::atomic<guint64> queue_out{0};
+};
 
-        auto now = steady::now();
-        GstClockTime pts = std::chrono::duration_cast<std::chrono::nanoseconds>(now - t0).count();
+static GstPadProbeReturn abr_count_cb(GstPad *, GstPadProbeInfo *, gpointer user_data)
+{
+    static_cast<std::atomic<guint64> *>(user_data)->fetch_add(1, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
 
-        GstClockTime frame_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_tp).count();
+static GstPadProbeReturn abr_enc_out_cb(GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+    AbrProbe *probe = static_cast<AbrProbe *>(user_data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (buffer && GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        std::lock_guard<std::mutex> lock(probe->mutex);
+        probe->sent[GST_BUFFER_PTS(buffer)] = g_get_monotonic_time();
+    }
+    return GST_PAD_PROBE_OK;
+}
 
-        if (pts <= last_pts)
-            pts = last_pts + 1;
+static GstPadProbeReturn abr_sink_in_cb(GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+    AbrProbe *probe = static_cast<AbrProbe *>(user_data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!buffer || !GST_BUFFER_PTS_IS_VALID(buffer))
+        return GST_PAD_PROBE_OK;
+
+    std::lock_guard<std::mutex> lock(probe->mutex);
+    probe->bytes += gst_buffer_get_size(buffer);
+    auto it = probe->sent.find(GST_BUFFER_PTS(buffer));
+    if (it != probe->sent.end())
+    {
+        probe->latency_us.push_back(g_get_monotonic_time() - it->second);
+        probe->sent.erase(probe->sent.begin(), ++it); // 更早的要么已送达，要么被 leaky queue 丢了
+    }
+    return GST_PAD_PROBE_OK;
+}
 
-        last_pts = pts;
-        last_tp  = now;
+static void abr_overrun_cb(GstElement *, gpointer user_data)
+{
+    static_cast<AbrProbe *>(user_data)->overruns.fetch_add(1, std::memory_order_relaxed);
+}
 
-        GST_BUFFER_PTS(buffer) = pts;
-        GST_BUFFER_DTS(buffer) = pts;
+static void run_abr_mode(bool abr, const std::string &encoder_name, int bitrate_kbps, int throttle_kbps, int seconds)
+{
+    EncoderSettings settings;
+    settings.bitrate_kbps = bitrate_kbps;
+    settings.max_kbps = bitrate_kbps * 9 / 8;
+    settings.min_kbps = bitrate_kbps * 7 / 8;
+    settings.gop = settings.fps * 2;
 
-        if (pts < target_frame_duration / 2)
-        {
-            g_print("\r\n12 \t %d \n", i++);
-            GST_BUFFER_DURATION(buffer) = target_frame_duration;
-        }
-        else{
-            GST_BUFFER_DURATION(buffer) = frame_duration;
-        }
+    GError *err = nullptr;
+    gchar *desc = g_strdup_printf("videotestsrc is-live=true pattern=smpte horizontal-speed=8 ! "
+                                  "video/x-raw,format=I420,width=1280,height=720,framerate=%d/1",
+                                  settings.fps);
+    GstElement *src = gst_parse_bin_from_description(desc, TRUE, &err);
+    g_free(desc);
+    if (!src)
+    {
+        g_printerr("Source failed: %s\n", err ? err->message : "unknown");
+        g_clear_error(&err);
+        return;
+    }
 
-        // === 填充数据 ===
-        GstMapInfo map;
-        gst_buffer_map(buffer, &map, GST_MAP_WRITE);
-        memcpy(map.data, frame_yuv.data, size);
-        gst_buffer_unmap(buffer, &map);
+    GstElement *pipeline = gst_pipeline_new("abr-bench");
+    gst_bin_add(GST_BIN(pipeline), src);
 
-        GstFlowReturn ret =
-            gst_app_src_push_buffer(GST_APP_SRC(ctx->appsrc), buffer);
+    OutputBranch out;
+    out.target = "fakesink";
+    out.throttle_kbps = throttle_kbps;
+    if (!add_output_branch(pipeline, src, encoder_name, settings, false, false, out))
+    {
+        gst_object_unref(pipeline);
+        return;
+    }
 
-        if (ret != GST_FLOW_OK)
+    AbrProbe probe;
+    g_object_set(out.queue, "silent", FALSE, NULL); // silent 时 queue 不发 overrun
+    g_signal_connect(out.queue, "overrun", G_CALLBACK(abr_overrun_cb), &probe);
+    GstPad *queue_sink = gst_element_get_static_pad(out.queue, "sink");
+    GstPad *queue_src = gst_element_get_static_pad(out.queue, "src");
+    gst_pad_add_probe(queue_sink, GST_PAD_PROBE_TYPE_BUFFER, abr_count_cb, &probe.queue_in, nullptr);
+    gst_pad_add_probe(queue_src, GST_PAD_PROBE_TYPE_BUFFER, abr_count_cb, &probe.queue_out, nullptr);
+    gst_object_unref(queue_sink);
+    gst_object_unref(queue_src);
+    GstPad *enc_src = gst_element_get_static_pad(out.enc, "src");
+    GstPad *sink_pad = gst_element_get_static_pad(out.sink, "sink");
+    gst_pad_add_probe(enc_src, GST_PAD_PROBE_TYPE_BUFFER, abr_enc_out_cb, &probe, nullptr);
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, abr_sink_in_cb, &probe, nullptr);
+    gst_object_unref(enc_src);
+    gst_object_unref(sink_pad);
+
+    std::unique_ptr<BitrateController> controller;
+    if (abr)
+    {
+        BitrateController::Options options;
+        options.max_kbps = bitrate_kbps;
+        options.min_kbps = std::max(100, bitrate_kbps / 10);
+        controller.reset(new BitrateController(out.enc, out.backend, out.queue, settings, options));
+    }
+
+    GMainLoop *loop = g_main_loop_new(nullptr, FALSE);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    gst_bus_add_signal_watch(bus);
+    std::vector<OutputBranch> outputs{out};
+    std::vector<std::unique_ptr<BitrateController>> controllers;
+    if (controller)
+        controllers.push_back(std::move(controller));
+    AbrContext abr_ctx{&outputs, &controllers};
+    g_signal_connect(bus, "message::qos", G_CALLBACK(abr_qos_cb), &abr_ctx);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    for (auto &c : controllers)
+        c->start();
+    g_timeout_add_seconds(seconds, [](gpointer data) -> gboolean {
+        g_main_loop_quit(static_cast<GMainLoop *>(data));
+        return FALSE;
+    }, loop);
+    g_main_loop_run(loop);
+
+    for (auto &c : controllers)
+        c->stop();
+    // 停止前取 queue 里残留的 buffer 数（进 - 出 - 残留 = leaky 丢掉的；运行中读取，误差在一两帧内）
+    guint level_buffers = 0;
+    guint64 queue_out = probe.queue_out.load();
+    g_object_get(out.queue, "current-level-buffers", &level_buffers, NULL);
+    guint64 queue_in = probe.queue_in.load();
+    guint64 drops = queue_in > queue_out + level_buffers ? queue_in - queue_out - level_buffers : 0;
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_bus_remove_signal_watch(bus);
+    gst_object_unref(bus);
+    gst_object_unref(pipeline);
+    g_main_loop_unref(loop);
+
+    std::lock_guard<std::mutex> lock(probe.mutex);
+    std::vector<gint64> &lat = probe.latency_us;
+    std::sort(lat.begin(), lat.end());
+    size_t n = lat.size();
+    double mean = 0.0, var = 0.0;
+    for (gint64 v : lat)
+        mean += v / 1000.0;
+    mean = n ? mean / n : 0.0;
+    for (gint64 v : lat)
+        var += (v / 1000.0 - mean) * (v / 1000.0 - mean);
+
+    g_print("%-10s %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT " %8.1f %8.1f %8.1f %8.1f %10.0f %10d\n",
+            abr ? "abr" : "fixed", queue_in, drops, probe.overruns.load(), n ? lat[n / 2] / 1000.0 : 0.0, n ? lat[n * 95 / 100] / 1000.0 : 0.0,
+            n ? lat[n - 1] / 1000.0 : 0.0, n ? std::sqrt(var / n) : 0.0, probe.bytes * 8 / 1000.0 / seconds,
+            controllers.empty() ? bitrate_kbps : controllers[0]->kbps());
+}
+
+static int run_abr_benchmark(const std::string &encoder_name, int bitrate_kbps, int throttle_kbps, int seconds)
+{
+    gst_init(nullptr, nullptr);
+
+    g_print("\n===== Adaptive bitrate benchmark: 720p25, encoder %s, target %d kbps, uplink throttled to %d kbps, %d s =====\n",
+            encoder_name.c_str(), bitrate_kbps, throttle_kbps, seconds);
+    g_print("%-10s %8s %8s %8s %8s %8s %8s %8s %10s %10s\n", "mode", "frames", "drops", "overruns", "p50 ms", "p95 ms", "max ms", "stdev",
+            "sent kbps", "end kbps");
+    run_abr_mode(false, encoder_name, bitrate_kbps, throttle_kbps, seconds);
+    run_abr_mode(true, encoder_name, bitrate_kbps, throttle_kbps, seconds);
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * 阶梯 benchmark：同一个文件、同样的档位，按时钟实时推到 fakesink
+ *   ladder：  1 个进程 --ladder 1080,720,360（读文件 / 颜色转换一次，级联缩放，每档一个编码线程）
+ *   separate：N 个进程，每个 --ladder <h> 只推一档（各自读文件、转换、缩放、编码）
+ * 子进程就是本程序（/proc/self/exe，--loop --duration S），CPU 用 RUSAGE_CHILDREN 统计
+ * --------------------------------------------------------- */
+static bool run_children(const std::vector<std::vector<std::string>> &commands, double &cpu_percent)
+{
+    struct rusage before, after;
+    getrusage(RUSAGE_CHILDREN, &before);
+    gint64 t0 = g_get_monotonic_time();
+
+    std::vector<pid_t> pids;
+    for (const auto &args : commands)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
         {
-            gst_buffer_unref(buffer);
-            g_printerr("push_buffer failed: %d\n", ret);
-            break;
+            // 子进程的统计输出太多，只保留 stderr
+            int devnull = open("/dev/null", O_WRONLY);
+            if (devnull >= 0)
+                dup2(devnull, STDOUT_FILENO);
+
+            std::vector<char *> argv;
+            for (const std::string &a : args)
+                argv.push_back(const_cast<char *>(a.c_str()));
+            argv.push_back(nullptr);
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
         }
+        if (pid > 0)
+            pids.push_back(pid);
+    }
 
-        g_usleep(40000); // 25fps , 实际上比25fps要慢一些，测试使用就不调了
+    bool ok = pids.size() == commands.size();
+    for (pid_t pid : pids)
+    {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = false;
     }
 
-    ctx->cap->release();
-    g_main_loop_quit(ctx->loop);
+    double wall = (g_get_monotonic_time() - t0) / 1e6;
+    getrusage(RUSAGE_CHILDREN, &after);
+    double cpu = (after.ru_utime.tv_sec - before.ru_utime.tv_sec) + (after.ru_utime.tv_usec - before.ru_utime.tv_usec) / 1e6 +
+                 (after.ru_stime.tv_sec - before.ru_stime.tv_sec) + (after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e6;
+    cpu_percent = wall > 0 ? cpu / wall * 100.0 : 0.0;
+    return ok;
+}
 
-    g_print("Push thread exited\n");
+static int run_ladder_benchmark(const std::string &input, const std::string &ladder_spec,
+                                const std::string &encoder_name, int bitrate_kbps, int seconds)
+{
+    auto command = [&](const std::string &ladder) {
+        return std::vector<std::string>{"push-rtsp", input, "fakesink", "--ladder", ladder, "--encoder", encoder_name,
+                                        "--bitrate", std::to_string(bitrate_kbps), "--loop",
+                                        "--duration", std::to_string(seconds)};
+    };
+
+    std::vector<std::string> rungs;
+    gchar **parts = g_strsplit(ladder_spec.c_str(), ",", -1);
+    for (gchar **p = parts; *p; p++)
+        if (**p)
+            rungs.push_back(*p);
+    g_strfreev(parts);
+
+    g_print("\n===== ABR ladder benchmark: %s, ladder %s, encoder %s, %d s realtime =====\n",
+            input.c_str(), ladder_spec.c_str(), encoder_name.c_str(), seconds);
+
+    double ladder_cpu = 0.0, separate_cpu = 0.0;
+    bool ladder_ok = run_children({command(ladder_spec)}, ladder_cpu);
+
+    std::vector<std::vector<std::string>> separate;
+    for (const std::string &rung : rungs)
+        separate.push_back(command(rung));
+    bool separate_ok = run_children(separate, separate_cpu);
+
+    g_print("%-34s %6s %9s\n", "mode", "procs", "CPU");
+    g_print("%-34s %6d %8.1f%%%s\n", "ladder (shared convert + scale)", 1, ladder_cpu, ladder_ok ? "" : "  (failed)");
+    g_print("%-34s %6zu %8.1f%%%s\n", "separate push processes", rungs.size(), separate_cpu,
+            separate_ok ? "" : "  (failed)");
+    if (separate_cpu > 0)
+        g_print("\nladder uses %.0f%% of the CPU of %zu separate pushes\n", ladder_cpu / separate_cpu * 100.0,
+                rungs.size());
+    return ladder_ok && separate_ok ? 0 : -1;
 }
 
 /* ---------------------------------------------------------
  * main()
- * opencv -> appsrc -> videoconvert -> mpph265enc -> queue -> h265parse -> rtspclientsink (rtsp://127.0.0.1:8554/live)
- * opencv -> appsrc -> videoconvert -> mpph265enc -> queue -> h265parse -> rtph265pay -> udpsink (host=127.0.0.1 port=1234)
- * g++ ./push-rtsp.cpp -o ./push-rtsp `pkg-config --cflags --libs gstreamer-1.0 gstreamer-rtsp-1.0 gstreamer-app-1.0 opencv4`
+ * opencv -> appsrc -> encoder -> parse -> queue -> rtspclientsink (rtsp://127.0.0.1:8554/live)
+ * opencv -> appsrc -> encoder -> parse -> queue -> rtph26xpay -> udpsink (udp://127.0.0.1:1234)
+ * encoder：--encoder auto|mpph265enc|x264enc|x265enc|openh264enc，auto 优先 RK3588 硬编
+ * g++ ./push-rtsp.cpp -o ./push-rtsp `pkg-config --cflags --libs gstreamer-1.0 gstreamer-rtsp-1.0 gstreamer-app-1.0 gstreamer-video-1.0 opencv4`
+ * 吞吐 benchmark（各阶段 fps + 队列占用）：./push-rtsp ./test.mp4 fakesink --max-throughput --convert-threads 4
+ * 多码率阶梯：./push-rtsp ./test.mp4 rtsp://127.0.0.1:8554/live --ladder 1080,720,360   → live_1080p / live_720p / live_360p
+ * 阶梯 vs N 个独立推流进程的 CPU：./push-rtsp ./test.mp4 fakesink --bench-ladder 30 --ladder 1080,720,360 --encoder x264enc
+ * 自适应码率：./push-rtsp ./test.mp4 rtsp://... --abr [--throttle 2500]（--throttle 在本地模拟受限上行）
+ * 固定码率 vs --abr 在限速上行下的丢帧 / 延迟：./push-rtsp --bench-abr [seconds] [--throttle 2500] [--bitrate 4000]
+ * 编码器对比（延迟 / 码率精度 / CPU）：./push-rtsp --bench-encoders [seconds] [--bitrate KBPS] [--size WxH]
+ * VFR 源 / 长时间漂移测试：./push-rtsp ./vfr.mp4 fakesink --pts source --loop   看 [pts] 行的 drift ms/hour
  * 查看 pad 、回调、参数等等 可以通过 `gst-inspect-1.0 + [管道插件](如: mpph265enc 、 rtspclientsink)` 查看情况
  * ---------------------------------------------------------
  * */
 int main(int argc, char *argv[])
 {
+    if (argc >= 2 && std::string(argv[1]) == "--bench-abr")
+    {
+        std::string encoder_name = "x264enc";
+        int seconds = 30, bitrate_kbps = 4000, throttle_kbps = 2500;
+        for (int i = 2; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--bitrate" && i + 1 < argc)
+                bitrate_kbps = atoi(argv[++i]);
+            else if (arg == "--throttle" && i + 1 < argc)
+                throttle_kbps = atoi(argv[++i]);
+            else if (arg == "--encoder" && i + 1 < argc)
+                encoder_name = argv[++i];
+            else if (g_ascii_isdigit(arg[0]))
+                seconds = std::max(5, atoi(arg.c_str()));
+        }
+        return run_abr_benchmark(encoder_name, bitrate_kbps, throttle_kbps, seconds);
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-encoders")
+    {
+        EncoderSettings settings;
+        int seconds = 10, width = 1920, height = 1080;
+        for (int i = 2; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--bitrate" && i + 1 < argc)
+                settings.bitrate_kbps = atoi(argv[++i]);
+            else if (arg == "--size" && i + 1 < argc)
+                sscanf(argv[++i], "%dx%d", &width, &height);
+            else if (arg == "--normal-latency")
+                settings.low_latency = false;
+            else if (g_ascii_isdigit(arg[0]))
+                seconds = std::max(3, atoi(arg.c_str()));
+        }
+        settings.max_kbps = settings.bitrate_kbps * 9 / 8;
+        settings.min_kbps = settings.bitrate_kbps * 7 / 8;
+        settings.gop = settings.fps * 2;
+        return run_encoder_benchmark(settings, width, height, seconds);
+    }
+
     if (argc < 3)
     {
         std::cout << "Usage: " << argv[0]
-                  << " ./test.mp4 rtsp://127.0.0.1:8554/live\n";
+                  << " ./test.mp4 rtsp://127.0.0.1:8554/live [--no-pool] [--max-throughput]"
+                  << " [--convert-threads N] [--queue-depth N] [--pts fixed|source] [--loop]"
+                  << " [--encoder auto|mpph265enc|x264enc|x265enc|openh264enc] [--bitrate KBPS]"
+                  << " [--ladder 1080,720,360] [--duration S] [--bench-ladder [seconds]] [--abr] [--throttle KBPS] [--drain-timeout MS]\n"
+                  << "       (use \"fakesink\" instead of the rtsp url for offline benchmark,"
+                  << " udp://host:port for raw RTP)\n"
+                  << "       " << argv[0] << " --bench-encoders [seconds] [--bitrate KBPS] [--size WxH]\n"
+                  << "       " << argv[0] << " --bench-abr [seconds] [--bitrate KBPS] [--throttle KBPS] [--encoder NAME]\n";
         return -1;
     }
 
+    bool use_pool = true;
+    bool max_throughput = false;
+    int convert_threads = 2;
+    int queue_depth = 8;
+    bool pts_source = false;
+    bool loop_input = false;
+    std::string encoder_name = "auto";
+    int bitrate_kbps = 4000;
+    std::string ladder_spec;
+    int duration_s = 0;
+    int bench_ladder_s = 0;
+    bool abr = false;
+    int throttle_kbps = 0;
+    guint drain_timeout_ms = 3000;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--no-pool")
+            use_pool = false; // 旧路径：逐帧分配 + memcpy，用于对比
+        else if (arg == "--max-throughput")
+            max_throughput = true; // 不按帧率等待，编码器能吃多快推多快
+        else if (arg == "--convert-threads" && i + 1 < argc)
+            convert_threads = std::max(1, atoi(argv[++i]));
+        else if (arg == "--queue-depth" && i + 1 < argc)
+            queue_depth = std::max(1, atoi(argv[++i]));
+        else if (arg == "--pts" && i + 1 < argc)
+            pts_source = std::string(argv[++i]) == "source"; // source: 保留源文件时间戳（VFR）
+        else if (arg == "--loop")
+            loop_input = true; // 循环推同一个文件，配合 [pts] 统计做长时间漂移测试
+        else if (arg == "--encoder" && i + 1 < argc)
+            encoder_name = argv[++i];
+        else if (arg == "--bitrate" && i + 1 < argc)
+            bitrate_kbps = std::max(100, atoi(argv[++i]));
+        else if (arg == "--ladder" && i + 1 < argc)
+            ladder_spec = argv[++i]; // 1080,720,360 或 1080:4000,720:2500,360:800
+        else if (arg == "--duration" && i + 1 < argc)
+            duration_s = atoi(argv[++i]); // 推流 N 秒后自动退出（benchmark 子进程用）
+        else if (arg == "--abr")
+            abr = true; // 按编码后 queue 水位 / 丢帧 / QoS 自适应调码率
+        else if (arg == "--throttle" && i + 1 < argc)
+            throttle_kbps = atoi(argv[++i]); // 模拟受限上行（kbps），不需要 tc
+        else if (arg == "--drain-timeout" && i + 1 < argc)
+            drain_timeout_ms = (guint)std::max(0, atoi(argv[++i])); // 退出时等 EOS 排空的上限（ms）
+        else if (arg == "--bench-ladder")
+            bench_ladder_s = (i + 1 < argc && g_ascii_isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 30;
+    }
+
+    if (bench_ladder_s > 0)
+        return run_ladder_benchmark(argv[1], ladder_spec.empty() ? "1080,720,360" : ladder_spec, encoder_name,
+                                    bitrate_kbps, bench_ladder_s);
+
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
 
@@ -202,15 +1937,22 @@ int main(int argc, char *argv[])
     g_print(" Resolution: %d x %d\r\n", width, height);
     g_print(" Total frames: %d\r\n", total_frames);
 
+    PushContext ctx;
+    ctx.pacer.configure(fps, max_throughput); // 帧率取自 CAP_PROP_FPS，非法时回退 25
+
+    /* ---------- 编码器：CBR 码率 / GOP / QP 统一设置，按后端映射 ---------- */
+    EncoderSettings enc_settings;
+    enc_settings.bitrate_kbps = bitrate_kbps; // >4Mbps(1080p)
+    enc_settings.max_kbps = bitrate_kbps * 9 / 8;
+    enc_settings.min_kbps = bitrate_kbps * 7 / 8;
+    enc_settings.fps = std::max(1, (int)std::lround((double)ctx.pacer.fps_n() / ctx.pacer.fps_d()));
+    enc_settings.gop = enc_settings.fps * 2; // 2 秒一个 IDR（RTSP 友好）
+
     /* ---------- GStreamer pipeline ---------- */
-    GstElement *pipeline = gst_pipeline_new("rk3588-pipeline");
+    GstElement *pipeline = gst_pipeline_new("push-pipeline");
     GstElement *appsrc = gst_element_factory_make("appsrc", "src");
-    GstElement *enc = gst_element_factory_make("mpph265enc", "enc");
-    GstElement *parse = gst_element_factory_make("h265parse", "parse");
-    GstElement *queue = gst_element_factory_make("queue", "queue");
-    GstElement *sink = gst_element_factory_make("rtspclientsink", "sink");
 
-    if (!pipeline || !appsrc || !enc || !parse || !queue || !sink)
+    if (!pipeline || !appsrc)
     {
         g_printerr("Create element failed\n");
         return -1;
@@ -218,7 +1960,7 @@ int main(int argc, char *argv[])
 
     /* ---------- appsrc ---------- */
     g_object_set(appsrc,
-                 "is-live", TRUE,
+                 "is-live", !max_throughput, // 离线转码不是实时源
                  "format", GST_FORMAT_TIME,
                  "do-timestamp", FALSE, // 使用外部时间戳，使流更加稳定
                  "block", TRUE,
@@ -232,78 +1974,81 @@ int main(int argc, char *argv[])
         "format", G_TYPE_STRING, "I420",
         "width", G_TYPE_INT, width,
         "height", G_TYPE_INT, height,
-        "framerate", GST_TYPE_FRACTION, (int)fps, 1,
+        "framerate", GST_TYPE_FRACTION, ctx.pacer.fps_n(), ctx.pacer.fps_d(), // 29.97 之类的帧率不再被截断
         NULL);
 
     g_object_set(appsrc, "caps", caps, NULL);
-    gst_caps_unref(caps);
-
-    /* ---------- mpph265enc（RK3588 推荐） ---------- */
-    g_object_set(enc,
-                 "rc-mode", 1, // CBR
-                 "bps", 4000000,  // >4Mbps(1080p)
-                 "bps-max", 4500000,
-                 "bps-min", 3500000,
-
-                 "gop", (int)fps * 2, // 2 秒一个 IDR（RTSP 友好）
-                 "header-mode", 1,    // SPS/PPS 每个 IDR
 
-                 "qp-init", 28,
-                 "qp-min", 22,
-                 "qp-max", 38,
-
-                 "qos", TRUE,
-                 "max-reenc", 1,   // 最多重编码 1 次
-
-                 NULL);
+    GstVideoInfo info;
+    gst_video_info_from_caps(&info, caps);
+    gst_caps_unref(caps);
 
-    /* ---------- h265parse ---------- */
-    g_object_set(parse,
-                 "config-interval", -1,  // 每个 IDR 注入 VPS/SPS/PPS
-                 NULL);
+    gst_bin_add(GST_BIN(pipeline), appsrc);
 
-    /* ---------- queue ---------- */
-    g_object_set(queue,
-                 "max-size-time", 500 * GST_MSECOND,
-                 "max-size-buffers", 0,
-                 "max-size-bytes", 0,
-                 "leaky",  2, // downstream（更适合推流）
-                 "silent", TRUE,
-                 NULL);
-    // g_object_set(queue,
-    //              "max-size-buffers", 5, // 最多 5 帧
-    //              "max-size-time", 0,
-    //              "max-size-bytes", 0,
-    //              "leaky", 2, // downstream（更适合推流）
-    //              "silent", TRUE,
-    //              NULL);
-
-    /* ---------- rtsp sink ---------- */
-    g_object_set(sink,
-                 "location", rtsp.c_str(),
-                 "protocols", GST_RTSP_LOWER_TRANS_TCP,
-                 "latency", 300,              // 200~500ms
-                 "tcp-timeout", 5 * 1000000,     // 5s
-                 "retry", 5,
-                 "do-rtsp-keep-alive", TRUE,
-                 NULL);
+    /* ---------- 输出：单路，或者多码率阶梯 ---------- */
+    std::vector<OutputBranch> outputs;
+    if (!ladder_spec.empty())
+    {
+        std::vector<Rendition> ladder = parse_ladder(ladder_spec, width, height, bitrate_kbps);
+        if (ladder.empty())
+        {
+            g_printerr("Invalid --ladder %s\n", ladder_spec.c_str());
+            return -1;
+        }
+        if (!build_ladder(pipeline, appsrc, ladder, height, rtsp, encoder_name, enc_settings,
+                          max_throughput, throttle_kbps, outputs))
+            return -1;
+    }
+    else
+    {
+        OutputBranch out;
+        out.target = rtsp;
+        out.throttle_kbps = throttle_kbps;
+        out.width = width;
+        out.height = height;
+        if (!add_output_branch(pipeline, appsrc, encoder_name, enc_settings, max_throughput, false, out))
+            return -1;
+        outputs.push_back(out);
+    }
 
-    gst_bin_add_many(GST_BIN(pipeline),
-                     appsrc, enc, parse, queue, sink, NULL);
+    for (const OutputBranch &out : outputs)
+        g_print("Output: %dx%d %s %d kbps CBR, GOP %d -> %s%s\n", out.width, out.height, out.backend->factory,
+                out.bitrate_kbps, enc_settings.gop, out.target.c_str(),
+                out.throttle_kbps > 0 ? (" (throttled to " + std::to_string(out.throttle_kbps) + " kbps)").c_str() : "");
 
-    gst_element_link_many(
-        appsrc, enc, parse, queue, sink, NULL);
+    /* ---------- 自适应码率：每个输出一个控制器，上限就是该档配置的码率 ---------- */
+    std::vector<std::unique_ptr<BitrateController>> controllers;
+    if (abr)
+    {
+        for (const OutputBranch &out : outputs)
+        {
+            BitrateController::Options options;
+            options.max_kbps = out.bitrate_kbps;
+            options.min_kbps = std::max(100, out.bitrate_kbps / 10);
+            controllers.emplace_back(new BitrateController(out.enc, out.backend, out.queue, out.settings, options));
+        }
+    }
 
     /* ---------- Bus ---------- */
     GMainLoop *loop = g_main_loop_new(nullptr, FALSE);
     GstBus *bus = gst_element_get_bus(pipeline);
     gst_bus_add_signal_watch(bus);
 
-    PushContext ctx;
     ctx.pipeline = pipeline;
     ctx.appsrc = appsrc;
     ctx.loop = loop;
     ctx.cap = &cap;
+    ctx.info = info;
+    ctx.use_pool = use_pool;
+    ctx.convert_threads = convert_threads;
+    ctx.queue_depth = queue_depth;
+    ctx.pts_source = pts_source;
+    ctx.loop_input = loop_input;
+
+    // 校验实际送进编码器的时间戳
+    GstPad *appsrc_pad = gst_element_get_static_pad(appsrc, "src");
+    ctx.validator.attach(pipeline, appsrc_pad);
+    gst_object_unref(appsrc_pad);
 
     g_signal_connect(bus, "message::error",
                      G_CALLBACK(bus_error_cb), &ctx);
@@ -313,6 +2058,10 @@ int main(int argc, char *argv[])
     g_signal_connect(bus, "message::state-changed",
                      G_CALLBACK(state_changed_cb), &ctx);
 
+    AbrContext abr_ctx{&outputs, &controllers};
+    if (abr)
+        g_signal_connect(bus, "message::qos", G_CALLBACK(abr_qos_cb), &abr_ctx);
+
     gst_object_unref(bus);
 
     /* ---------- Start ---------- */
@@ -320,20 +2069,44 @@ int main(int argc, char *argv[])
 
     worker = std::thread(push_thread, &ctx);
 
+    for (auto &c : controllers)
+        c->start();
+    if (abr)
+        g_timeout_add_seconds(5, abr_report_cb, &abr_ctx);
+
+    if (duration_s > 0)
+        g_timeout_add_seconds(duration_s, [](gpointer data) -> gboolean {
+            g_main_loop_quit(static_cast<GMainLoop *>(data));
+            return FALSE;
+        }, loop);
+
     g_main_loop_run(loop);
 
     /* ---------- Cleanup ---------- */
+    gint64 shutdown_us = g_get_monotonic_time();
+    for (auto &c : controllers)
+        c->stop();
+    abr_report_cb(&abr_ctx);
+
     running.store(false);
+    ctx.pacer.stop(); // 唤醒可能正在等时钟的推帧线程
     if (worker.joinable())
         worker.join();
 
-    g_print("Waiting...\n");
-    g_usleep(4000000);
+    gint64 drain_us = g_get_monotonic_time();
+    g_print("Draining (timeout %u ms)...\n", drain_timeout_ms);
+    const char *drained = drain_pipeline(&ctx, drain_timeout_ms);
 
+    gint64 teardown_us = g_get_monotonic_time();
     gst_element_set_state(pipeline, GST_STATE_NULL);
     gst_object_unref(pipeline);
     g_main_loop_unref(loop);
 
+    gint64 end_us = g_get_monotonic_time();
+    g_print("Shutdown: stop workers %.1f ms, drain %.1f ms (%s), teardown %.1f ms, total %.1f ms\n",
+            (drain_us - shutdown_us) / 1000.0, (teardown_us - drain_us) / 1000.0, drained,
+            (end_us - teardown_us) / 1000.0, (end_us - shutdown_us) / 1000.0);
+
     g_print("Exit clean\n");
     return 0;
 }
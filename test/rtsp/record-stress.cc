@@ -0,0 +1,377 @@
+#include <gst/gst.h>
+#include <gst/pbutils/pbutils.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include "proc_stats.h"
+#include "segment_recorder.h"
+
+/*
+ * 分段录像压力测试
+ * - 一路 videotestsrc → x264enc 编码一次，tee 出 N 个录像分支（每路一个 SegmentRecorder / I/O 线程，
+ *   各写各的目录），相当于 N 路摄像头同时录像，编码只算一次，CPU 不干扰写盘测量
+ * - tee 上另挂一个 "live" 分支（queue → fakesink sync=true）计数，代表解码 / 显示：
+ *   写盘再慢，live 帧率也应该保持在源帧率
+ * - 依次对 --dirs 里的每个目录跑一遍（例如 tmpfs 和真实磁盘），输出带宽、写延迟、队列、阻塞、丢帧
+ * - 结束后用 GstDiscoverer 检查每个写完的分段：有 duration、可 seek，mkv 还要有 Cues（索引），
+ *   确认 muxer 回写文件头的 seek 路径真的走到了，而不只是吞吐达标
+ * - 测试文件写在 <dir>/record-stress-<pid>/ 下，结束后删除（--keep 保留）
+ */
+
+struct StressOptions
+{
+    int streams = 32;
+    int seconds = 30;
+    int width = 1280;
+    int height = 720;
+    int fps = 25;
+    int bitrate_kbps = 4000;
+    guint segment_seconds = 10;
+    std::string container = "mkv";
+    bool direct_io = true;
+    bool keep = false;
+};
+
+struct StressResult
+{
+    double mb_per_s = 0.0;
+    double write_avg_ms = 0.0;
+    double write_max_ms = 0.0;
+    double queue_peak_mb = 0.0;
+    double blocked_ms = 0.0;
+    guint64 drops = 0;
+    guint64 segments = 0;
+    guint64 errors = 0;
+    guint64 checked = 0;    // 检查过的分段文件
+    guint64 indexed = 0;    // 其中有 duration / 索引、可 seek 的
+    int direct = 0;
+    double live_fps = 0.0;
+    double cpu = 0.0;
+};
+
+static GstPadProbeReturn live_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    static_cast<std::atomic<guint64> *>(user_data)->fetch_add(1, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+/* mkv 的 Cues（索引）元素：EBML ID 0x1C53BB6B；streamable 输出里没有 */
+static bool mkv_has_cues(const gchar *path)
+{
+    gchar *contents = nullptr;
+    gsize length = 0;
+    if (!g_file_get_contents(path, &contents, &length, nullptr))
+        return false;
+
+    static const guint8 cues_id[] = {0x1C, 0x53, 0xBB, 0x6B};
+    const guint8 *begin = (const guint8 *)contents;
+    bool found = std::search(begin, begin + length, cues_id, cues_id + sizeof(cues_id)) != begin + length;
+    g_free(contents);
+    return found;
+}
+
+/* 写完的分段要有 duration、能 seek；mkv 还要有 Cues */
+static bool check_segment(GstDiscoverer *discoverer, const gchar *path, bool mkv)
+{
+    gchar *uri = g_filename_to_uri(path, nullptr, nullptr);
+    GError *err = nullptr;
+    GstDiscovererInfo *info = gst_discoverer_discover_uri(discoverer, uri, &err);
+
+    bool ok = false;
+    if (info && gst_discoverer_info_get_result(info) == GST_DISCOVERER_OK)
+    {
+        GstClockTime duration = gst_discoverer_info_get_duration(info);
+        ok = GST_CLOCK_TIME_IS_VALID(duration) && duration > 0 && gst_discoverer_info_get_seekable(info);
+        if (ok && mkv)
+            ok = mkv_has_cues(path);
+        if (!ok)
+            g_printerr("  %s: duration %" GST_TIME_FORMAT ", seekable %d%s\n", path, GST_TIME_ARGS(duration),
+                       gst_discoverer_info_get_seekable(info), mkv ? (mkv_has_cues(path) ? ", cues" : ", no cues") : "");
+    }
+    else
+    {
+        g_printerr("  %s: %s\n", path, err ? err->message : "discover failed");
+    }
+
+    g_clear_error(&err);
+    if (info)
+        gst_discoverer_info_unref(info);
+    g_free(uri);
+    return ok;
+}
+
+/* 检查每路目录下的所有分段文件 */
+static void check_segments(const std::string &root_dir, bool mkv, StressResult &result)
+{
+    GError *err = nullptr;
+    GstDiscoverer *discoverer = gst_discoverer_new(10 * GST_SECOND, &err);
+    if (!discoverer)
+    {
+        g_printerr("Failed to create discoverer: %s\n", err ? err->message : "unknown");
+        g_clear_error(&err);
+        return;
+    }
+
+    GDir *root = g_dir_open(root_dir.c_str(), 0, nullptr);
+    const gchar *cam;
+    while (root && (cam = g_dir_read_name(root)))
+    {
+        gchar *cam_dir = g_build_filename(root_dir.c_str(), cam, NULL);
+        GDir *dir = g_dir_open(cam_dir, 0, nullptr);
+        const gchar *name;
+        while (dir && (name = g_dir_read_name(dir)))
+        {
+            gchar *path = g_build_filename(cam_dir, name, NULL);
+            result.checked++;
+            if (check_segment(discoverer, path, mkv))
+                result.indexed++;
+            g_free(path);
+        }
+        if (dir)
+            g_dir_close(dir);
+        g_free(cam_dir);
+    }
+    if (root)
+        g_dir_close(root);
+    gst_object_unref(discoverer);
+}
+
+/* 删除测试目录（只有一层子目录） */
+static void remove_tree(const std::string &path)
+{
+    GDir *dir = g_dir_open(path.c_str(), 0, nullptr);
+    if (!dir)
+        return;
+
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)))
+    {
+        gchar *child = g_build_filename(path.c_str(), name, NULL);
+        if (g_file_test(child, G_FILE_TEST_IS_DIR))
+            remove_tree(child);
+        else
+            g_unlink(child);
+        g_free(child);
+    }
+    g_dir_close(dir);
+    g_rmdir(path.c_str());
+}
+
+static bool run_stress(const StressOptions &options, const std::string &dir, StressResult &result)
+{
+    gchar *root_name = g_strdup_printf("record-stress-%d", getpid());
+    gchar *root = g_build_filename(dir.c_str(), root_name, NULL);
+    std::string root_dir = root;
+    g_free(root);
+    g_free(root_name);
+
+    gchar *desc = g_strdup_printf(
+        "videotestsrc is-live=true pattern=ball ! video/x-raw,width=%d,height=%d,framerate=%d/1 ! "
+        "x264enc tune=zerolatency speed-preset=ultrafast key-int-max=%d bitrate=%d ! "
+        "video/x-h264,stream-format=byte-stream ! tee name=t ! queue ! fakesink name=live sync=true",
+        options.width, options.height, options.fps, options.fps * 2, options.bitrate_kbps);
+
+    GError *err = nullptr;
+    GstElement *pipeline = gst_parse_launch(desc, &err);
+    g_free(desc);
+    if (!pipeline)
+    {
+        g_printerr("Failed to create source pipeline: %s\n", err ? err->message : "unknown");
+        g_clear_error(&err);
+        return false;
+    }
+
+    GstElement *tee = gst_bin_get_by_name(GST_BIN(pipeline), "t");
+    GstElement *live = gst_bin_get_by_name(GST_BIN(pipeline), "live");
+
+    std::atomic<guint64> live_frames{0};
+    GstPad *live_pad = gst_element_get_static_pad(live, "sink");
+    gst_pad_add_probe(live_pad, GST_PAD_PROBE_TYPE_BUFFER, live_probe_cb, &live_frames, nullptr);
+    gst_object_unref(live_pad);
+
+    std::vector<std::unique_ptr<SegmentRecorder>> recorders;
+    for (int i = 0; i < options.streams; i++)
+    {
+        SegmentRecorder::Options ro;
+        gchar *cam = g_strdup_printf("cam%02d", i);
+        gchar *cam_dir = g_build_filename(root_dir.c_str(), cam, NULL);
+        ro.dir = cam_dir;
+        ro.prefix = cam;
+        ro.container = options.container;
+        ro.segment_seconds = options.segment_seconds;
+        ro.direct_io = options.direct_io;
+        g_free(cam_dir);
+        g_free(cam);
+
+        recorders.emplace_back(new SegmentRecorder(ro));
+        if (!recorders.back()->attach(GST_BIN(pipeline), tee, VideoCodec::H264))
+            return false;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    // 预热：编码器起来、第一个分段打开
+    g_usleep(2 * 1000 * 1000);
+
+    guint64 frames_begin = live_frames.load();
+    std::vector<guint64> bytes_begin, writes_begin, ns_begin, blocked_begin;
+    for (auto &r : recorders)
+    {
+        const SegmentWriter::Stats &s = r->writer_stats();
+        bytes_begin.push_back(s.bytes_written);
+        writes_begin.push_back(s.writes);
+        ns_begin.push_back(s.write_ns);
+        blocked_begin.push_back(s.blocked_ns);
+    }
+    ProcSample begin = proc_sample_now();
+
+    // 期间每 5 秒打印一行汇总
+    for (int elapsed = 0; elapsed < options.seconds; elapsed += 5)
+    {
+        g_usleep((gulong)std::min(5, options.seconds - elapsed) * 1000 * 1000);
+
+        guint64 bytes = 0, queued = 0, drops = 0;
+        for (auto &r : recorders)
+        {
+            bytes += r->writer_stats().bytes_written;
+            queued += r->writer_stats().queued_bytes;
+            drops += r->drops();
+        }
+        g_print("  [%3d s] written %.0f MB, queued %.1f MB, drops %" G_GUINT64_FORMAT ", live frames %" G_GUINT64_FORMAT "\n",
+                std::min(elapsed + 5, options.seconds), bytes / 1048576.0, queued / 1048576.0, drops,
+                live_frames.load() - frames_begin);
+    }
+
+    ProcSample end = proc_sample_now();
+    double wall = (end.wall_us - begin.wall_us) / 1e6;
+    guint64 bytes = 0, writes = 0, write_ns = 0, blocked = 0;
+    for (size_t i = 0; i < recorders.size(); i++)
+    {
+        const SegmentWriter::Stats &s = recorders[i]->writer_stats();
+        bytes += s.bytes_written - bytes_begin[i];
+        writes += s.writes - writes_begin[i];
+        write_ns += s.write_ns - ns_begin[i];
+        blocked += s.blocked_ns - blocked_begin[i];
+        result.write_max_ms = std::max(result.write_max_ms, s.write_ns_max.load() / 1e6);
+        result.queue_peak_mb = std::max(result.queue_peak_mb, s.queued_peak.load() / 1048576.0);
+        result.drops += recorders[i]->drops();
+        result.direct += s.direct ? 1 : 0;
+    }
+
+    result.mb_per_s = bytes / wall / 1048576.0;
+    result.write_avg_ms = writes ? write_ns / 1e6 / writes : 0.0;
+    result.blocked_ms = blocked / 1e6;
+    result.live_fps = (live_frames.load() - frames_begin) / wall;
+    result.cpu = proc_cpu_percent(begin, end);
+
+    // 收尾：每路写完最后一个分段
+    for (auto &r : recorders)
+        r->finish();
+    for (auto &r : recorders)
+    {
+        result.segments += r->writer_stats().segments;
+        result.errors += r->writer_stats().errors;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(live);
+    gst_object_unref(tee);
+    gst_object_unref(pipeline);
+    recorders.clear();
+
+    check_segments(root_dir, options.container != "mp4", result);
+
+    if (options.keep)
+        g_print("  files kept in %s\n", root_dir.c_str());
+    else
+        remove_tree(root_dir);
+    return true;
+}
+
+/* ---------------------------------------------------------
+ * main()
+ * g++ record-stress.cc -o record-stress `pkg-config --cflags --libs gstreamer-1.0 gstreamer-pbutils-1.0` -pthread
+ * ./record-stress --streams 32 --seconds 30 --dirs /dev/shm,/var/tmp
+ * --------------------------------------------------------- */
+int main(int argc, char *argv[])
+{
+    gst_init(&argc, &argv);
+
+    StressOptions options;
+    std::vector<std::string> dirs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--streams" && i + 1 < argc)
+            options.streams = atoi(argv[++i]);
+        else if (arg == "--seconds" && i + 1 < argc)
+            options.seconds = atoi(argv[++i]);
+        else if (arg == "--size" && i + 1 < argc)
+            sscanf(argv[++i], "%dx%d", &options.width, &options.height);
+        else if (arg == "--bitrate" && i + 1 < argc)
+            options.bitrate_kbps = atoi(argv[++i]);
+        else if (arg == "--segment" && i + 1 < argc)
+            options.segment_seconds = atoi(argv[++i]);
+        else if (arg == "--mp4")
+            options.container = "mp4";
+        else if (arg == "--no-direct-io")
+            options.direct_io = false;
+        else if (arg == "--keep")
+            options.keep = true;
+        else if (arg == "--dirs" && i + 1 < argc)
+        {
+            gchar **parts = g_strsplit(argv[++i], ",", -1);
+            for (gchar **p = parts; *p; p++)
+                if (**p)
+                    dirs.push_back(*p);
+            g_strfreev(parts);
+        }
+        else
+        {
+            g_print("Usage: %s [--streams N] [--seconds S] [--dirs DIR1,DIR2] [--size WxH] [--bitrate KBPS]\n"
+                    "          [--segment S] [--mp4] [--no-direct-io] [--keep]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    if (dirs.empty())
+    {
+        dirs.push_back("/dev/shm"); // tmpfs
+        dirs.push_back(g_get_tmp_dir());
+    }
+
+    std::vector<StressResult> results(dirs.size());
+    for (size_t i = 0; i < dirs.size(); i++)
+    {
+        g_print("\n===== %d streams x %d kbps -> %s (%s, %u s segments) =====\n", options.streams,
+                options.bitrate_kbps, dirs[i].c_str(), options.container.c_str(), options.segment_seconds);
+        if (!run_stress(options, dirs[i], results[i]))
+            return -1;
+    }
+
+    bool all_indexed = true;
+    g_print("\n%-20s %8s %9s %9s %9s %10s %7s %8s %9s %8s %7s %6s\n", "dir", "MB/s", "write ms", "max ms",
+            "queue MB", "blocked ms", "drops", "segments", "indexed", "live fps", "cpu", "direct");
+    for (size_t i = 0; i < dirs.size(); i++)
+    {
+        const StressResult &r = results[i];
+        g_print("%-20s %8.2f %9.2f %9.2f %9.1f %10.0f %7" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT
+                " %4" G_GUINT64_FORMAT "/%-4" G_GUINT64_FORMAT " %8.1f %6.1f%% %3d/%d%s\n",
+                dirs[i].c_str(), r.mb_per_s, r.write_avg_ms, r.write_max_ms, r.queue_peak_mb, r.blocked_ms,
+                r.drops, r.segments, r.indexed, r.checked, r.live_fps, r.cpu, r.direct, options.streams,
+                r.errors ? "  ERRORS" : "");
+        all_indexed = all_indexed && r.checked > 0 && r.indexed == r.checked;
+    }
+    g_print("\nlive fps should stay at %d: slow disks show up as blocked ms / drops, never as live frame loss\n",
+            options.fps);
+    if (!all_indexed)
+        g_printerr("some segments have no index / duration: the muxer did not rewrite its headers\n");
+
+    return all_indexed ? 0 : 1;
+}
@@ -0,0 +1,726 @@
+#include <gst/gst.h>
+#include <gst/rtsp/gstrtsp.h>
+#include <gst/app/gstappsink.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "proc_stats.h"
+#include "decoder_select.h"
+#include "rtsp_test_server.h"
+
+/*
+ * RTSP Fan-out（一次拉流、一次解码，多个消费者）
+ *
+ * rtsp-hw.cpp（显示）和 rtsp-hw-opencv.cpp（appsink）各自开一个 RTSP 会话各自解码，
+ * 两个一起跑时网络和解码都是双份。这里只建一个会话，用 tee 分支（basic-tutorial-7 / 8 的写法）：
+ *
+ *   rtspsrc → depay → tee_es ─ queue → parse → dec → tee_raw ─ queue → videoconvert → 显示
+ *                           │                               └ queue → videoscale → videoconvert → BGR appsink（分析）
+ *                           └ queue → parse → matroskamux → filesink（录像，压缩域，不解码）
+ *
+ * - 每个分支第一个元素都是 leaky queue（丢旧数据），慢分支只会在自己的队列里丢帧，不会反压 tee 和其它分支
+ * - 每个分支有自己的 parser，tee 两边按各自需要的 stream-format 协商，互不牵制
+ * - 压缩域的队列（解码前、录像）丢帧会花屏到下一个关键帧，所以按时间给得比较宽（2 s / 3 s）
+ * - --bench：本地测试源上对比 "一个会话 fan-out" 与 "两个会话分别显示 / 分析" 的 CPU、线程和收包量
+ */
+
+struct FanoutOptions
+{
+    bool use_tcp = false;
+    bool display = true;          // 显示分支
+    bool headless = false;        // 显示分支用 fakesink（benchmark / 无桌面）
+    bool analytics = true;        // 缩小后的 BGR appsink 分支
+    int analytics_width = 640;
+    int analytics_height = 360;
+    int analytics_delay_ms = 0;   // 模拟慢的分析模块
+    std::string record_path;      // 空 = 不录像
+};
+
+/* 各分支计数，probe / 信号回调里累加 */
+struct FanoutCounters
+{
+    std::atomic<guint64> rtp_bytes{0};      // 会话收到的 RTP 负载
+    std::atomic<guint64> decoded{0};
+    std::atomic<guint64> displayed{0};
+    std::atomic<guint64> analyzed{0};
+    std::atomic<guint64> recorded_bytes{0};
+
+    std::atomic<guint64> decode_drops{0};   // queue overrun（leaky 丢帧）次数
+    std::atomic<guint64> display_drops{0};
+    std::atomic<guint64> analytics_drops{0};
+    std::atomic<guint64> record_drops{0};
+};
+
+class RTSPFanout
+{
+public:
+    RTSPFanout(const std::string &uri, const FanoutOptions &options);
+    ~RTSPFanout();
+
+    bool start();
+    void stop();
+
+    const FanoutCounters &counters() const { return counters_; }
+    bool linked() const { return linked_; }
+
+private:
+    std::string uri_;
+    FanoutOptions options_;
+    FanoutCounters counters_;
+
+    GstElement *pipeline_ = nullptr;
+    GstElement *src_ = nullptr;
+    guint bus_watch_id_ = 0;
+    std::atomic<bool> linked_{false};
+
+    bool build_decode_branch(GstElement *tee_es, VideoCodec codec);
+    bool build_record_branch(GstElement *tee_es, VideoCodec codec);
+    bool build_display_branch(GstElement *tee_raw);
+    bool build_analytics_branch(GstElement *tee_raw);
+    bool add_branch(GstElement *tee, const std::vector<GstElement *> &chain);
+
+    static GstElement *make_parser(VideoCodec codec);
+    static GstElement *make_leaky_queue(guint max_buffers, guint64 max_time, std::atomic<guint64> *drops);
+
+    static void pad_added_cb(GstElement *src, GstPad *pad, gpointer user_data);
+    static void overrun_cb(GstElement *queue, gpointer user_data);
+    static GstPadProbeReturn count_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static GstPadProbeReturn bytes_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static GstFlowReturn new_sample_cb(GstAppSink *sink, gpointer user_data);
+    static gboolean bus_callback(GstBus *bus, GstMessage *msg, gpointer user_data);
+};
+
+RTSPFanout::RTSPFanout(const std::string &uri, const FanoutOptions &options)
+    : uri_(uri), options_(options)
+{
+}
+
+RTSPFanout::~RTSPFanout()
+{
+    stop();
+}
+
+/* ---------------------------------------------------------
+ * 创建 Pipeline，分支在 rtspsrc 出 pad 之后按编码建立
+ * --------------------------------------------------------- */
+bool RTSPFanout::start()
+{
+    pipeline_ = gst_pipeline_new("fanout");
+    src_ = gst_element_factory_make("rtspsrc", nullptr);
+
+    if (!pipeline_ || !src_)
+    {
+        g_printerr("Failed to create basic GStreamer elements.\n");
+        if (src_)
+            gst_object_unref(src_);
+        if (pipeline_)
+            gst_object_unref(pipeline_);
+        pipeline_ = src_ = nullptr;
+        return false;
+    }
+
+    g_object_set(src_,
+                 "location", uri_.c_str(),
+                 "latency", 200,
+                 "protocols", options_.use_tcp ? GST_RTSP_LOWER_TRANS_TCP : GST_RTSP_LOWER_TRANS_UDP,
+                 NULL);
+
+    g_signal_connect(src_, "pad-added", G_CALLBACK(pad_added_cb), this);
+    gst_bin_add(GST_BIN(pipeline_), src_);
+
+    GstBus *bus = gst_element_get_bus(pipeline_);
+    bus_watch_id_ = gst_bus_add_watch(bus, bus_callback, this);
+    gst_object_unref(bus);
+
+    if (gst_element_set_state(pipeline_, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        g_printerr("Failed to start pipeline for %s\n", uri_.c_str());
+        return false;
+    }
+    return true;
+}
+
+void RTSPFanout::stop()
+{
+    if (!pipeline_)
+        return;
+
+    // 录像分支需要 EOS 才能写完 matroska 的索引
+    if (!options_.record_path.empty() && linked_)
+    {
+        gst_element_send_event(pipeline_, gst_event_new_eos());
+        GstBus *bus = gst_element_get_bus(pipeline_);
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, 3 * GST_SECOND,
+                                                     (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+        if (msg)
+            gst_message_unref(msg);
+        else
+            g_printerr("Timed out waiting for EOS, recording may be truncated\n");
+        gst_object_unref(bus);
+    }
+
+    if (bus_watch_id_)
+    {
+        g_source_remove(bus_watch_id_);
+        bus_watch_id_ = 0;
+    }
+
+    gst_element_set_state(pipeline_, GST_STATE_NULL);
+    gst_object_unref(pipeline_);
+    pipeline_ = src_ = nullptr;
+    linked_ = false;
+}
+
+GstElement *RTSPFanout::make_parser(VideoCodec codec)
+{
+    return gst_element_factory_make(codec == VideoCodec::H264 ? "h264parse" : "h265parse", nullptr);
+}
+
+/* 分支入口的 leaky queue：满了丢最旧的数据，overrun 计数即丢帧次数 */
+GstElement *RTSPFanout::make_leaky_queue(guint max_buffers, guint64 max_time, std::atomic<guint64> *drops)
+{
+    GstElement *queue = gst_element_factory_make("queue", nullptr);
+    if (!queue)
+        return nullptr;
+
+    g_object_set(queue,
+                 "leaky", 2, // downstream
+                 "max-size-buffers", max_buffers,
+                 "max-size-bytes", 0,
+                 "max-size-time", max_time,
+                 NULL);
+    g_signal_connect(queue, "overrun", G_CALLBACK(overrun_cb), drops);
+    return queue;
+}
+
+/* 把一条分支挂到 tee 的一个 request pad 上，chain[0] 是分支的 queue */
+bool RTSPFanout::add_branch(GstElement *tee, const std::vector<GstElement *> &chain)
+{
+    for (GstElement *element : chain)
+    {
+        if (!element)
+        {
+            g_printerr("Failed to create branch elements.\n");
+            for (GstElement *e : chain)
+                if (e && !GST_OBJECT_PARENT(e))
+                    gst_object_unref(e);
+            return false;
+        }
+    }
+
+    // 分支末尾可以是已经在 pipeline 里的元素（解码链的 tee_raw）
+    for (GstElement *element : chain)
+        if (!GST_OBJECT_PARENT(element))
+            gst_bin_add(GST_BIN(pipeline_), element);
+
+    for (size_t i = 0; i + 1 < chain.size(); i++)
+    {
+        if (!gst_element_link(chain[i], chain[i + 1]))
+        {
+            g_printerr("Failed to link branch: %s -> %s\n",
+                       GST_ELEMENT_NAME(chain[i]), GST_ELEMENT_NAME(chain[i + 1]));
+            return false;
+        }
+    }
+
+    // 先把下游跟上 pipeline 的状态，再接到 tee 上
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        gst_element_sync_state_with_parent(*it);
+
+    GstPad *tee_pad = gst_element_get_request_pad(tee, "src_%u");
+    GstPad *queue_pad = gst_element_get_static_pad(chain[0], "sink");
+    GstPadLinkReturn ret = gst_pad_link(tee_pad, queue_pad);
+    gst_object_unref(queue_pad);
+    gst_object_unref(tee_pad); // request pad 由 tee 持有，pipeline 销毁时一起释放
+
+    if (ret != GST_PAD_LINK_OK)
+    {
+        g_printerr("Failed to link tee branch: %d\n", ret);
+        return false;
+    }
+    return true;
+}
+
+/* 压缩流 → 解码 → tee_raw，解码后的消费者挂在 tee_raw 上 */
+bool RTSPFanout::build_decode_branch(GstElement *tee_es, VideoCodec codec)
+{
+    // 只录像的话不需要解码
+    if (!options_.display && !options_.analytics)
+        return true;
+
+    // 解码前丢压缩帧会花屏到下一个关键帧，所以这里按时间给 2 s，只在解码器严重跟不上时才丢
+    GstElement *queue = make_leaky_queue(0, 2 * GST_SECOND, &counters_.decode_drops);
+    GstElement *parse = make_parser(codec);
+    GstElement *dec = DecoderSelector::instance().make(codec, nullptr);
+    GstElement *tee_raw = gst_element_factory_make("tee", "tee_raw");
+
+    if (!queue || !parse || !dec || !tee_raw)
+    {
+        g_printerr("Failed to create decode elements.\n");
+        if (queue) gst_object_unref(queue);
+        if (parse) gst_object_unref(parse);
+        if (dec) gst_object_unref(dec);
+        if (tee_raw) gst_object_unref(tee_raw);
+        return false;
+    }
+
+    // 先把消费者挂到 tee_raw 上，再接上解码链，避免 tee_raw 没有下游时 not-linked
+    gst_bin_add(GST_BIN(pipeline_), tee_raw);
+
+    bool ok = true;
+    if (options_.display)
+        ok = build_display_branch(tee_raw) && ok;
+    if (options_.analytics)
+        ok = build_analytics_branch(tee_raw) && ok;
+
+    GstPad *dec_pad = gst_element_get_static_pad(dec, "src");
+    gst_pad_add_probe(dec_pad, GST_PAD_PROBE_TYPE_BUFFER, count_probe_cb, &counters_.decoded, nullptr);
+    gst_object_unref(dec_pad);
+
+    gst_element_sync_state_with_parent(tee_raw);
+    return add_branch(tee_es, {queue, parse, dec, tee_raw}) && ok;
+}
+
+bool RTSPFanout::build_record_branch(GstElement *tee_es, VideoCodec codec)
+{
+    GstElement *queue = make_leaky_queue(0, 3 * GST_SECOND, &counters_.record_drops);
+    GstElement *parse = make_parser(codec);
+    GstElement *mux = gst_element_factory_make("matroskamux", nullptr);
+    GstElement *sink = gst_element_factory_make("filesink", nullptr);
+
+    if (mux)
+        g_object_set(mux, "streamable", TRUE, NULL);
+    if (sink)
+    {
+        g_object_set(sink, "location", options_.record_path.c_str(), "async", FALSE, NULL);
+
+        GstPad *pad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, bytes_probe_cb, &counters_.recorded_bytes, nullptr);
+        gst_object_unref(pad);
+    }
+
+    return add_branch(tee_es, {queue, parse, mux, sink});
+}
+
+bool RTSPFanout::build_display_branch(GstElement *tee_raw)
+{
+    GstElement *queue = make_leaky_queue(2, 0, &counters_.display_drops);
+    GstElement *convert = gst_element_factory_make("videoconvert", nullptr);
+    GstElement *sink = gst_element_factory_make(options_.headless ? "fakesink" : "autovideosink", nullptr);
+
+    if (sink && convert)
+    {
+        g_object_set(sink, "sync", FALSE, NULL);
+
+        // autovideosink 是 bin，计数挂在 convert 的 src 上，两种 sink 都适用
+        GstPad *pad = gst_element_get_static_pad(convert, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, count_probe_cb, &counters_.displayed, nullptr);
+        gst_object_unref(pad);
+    }
+
+    return add_branch(tee_raw, {queue, convert, sink});
+}
+
+bool RTSPFanout::build_analytics_branch(GstElement *tee_raw)
+{
+    GstElement *queue = make_leaky_queue(1, 0, &counters_.analytics_drops);
+    GstElement *scale = gst_element_factory_make("videoscale", nullptr);
+    GstElement *convert = gst_element_factory_make("videoconvert", nullptr);
+    GstElement *filter = gst_element_factory_make("capsfilter", nullptr);
+    GstElement *sink = gst_element_factory_make("appsink", nullptr);
+
+    if (filter)
+    {
+        GstCaps *caps = gst_caps_new_simple("video/x-raw",
+                                            "format", G_TYPE_STRING, "BGR",
+                                            "width", G_TYPE_INT, options_.analytics_width,
+                                            "height", G_TYPE_INT, options_.analytics_height,
+                                            NULL);
+        g_object_set(filter, "caps", caps, NULL);
+        gst_caps_unref(caps);
+    }
+
+    if (sink)
+    {
+        g_object_set(sink, "sync", FALSE, "max-buffers", 1, "drop", TRUE, NULL);
+
+        GstAppSinkCallbacks callbacks = {};
+        callbacks.new_sample = new_sample_cb;
+        gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, this, nullptr);
+    }
+
+    return add_branch(tee_raw, {queue, scale, convert, filter, sink});
+}
+
+/* ---------------------------------------------------------
+ * rtspsrc dynamic pad added：depay → tee_es，再按选项挂分支
+ * --------------------------------------------------------- */
+void RTSPFanout::pad_added_cb(GstElement *src, GstPad *pad, gpointer user_data)
+{
+    RTSPFanout *self = reinterpret_cast<RTSPFanout *>(user_data);
+
+    if (self->linked_)
+        return;
+
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps)
+        return;
+
+    GstStructure *st = gst_caps_get_structure(caps, 0);
+    const gchar *media = gst_structure_get_string(st, "media");
+    VideoCodec codec = video_codec_from_encoding(gst_structure_get_string(st, "encoding-name"));
+    bool is_video = g_str_has_prefix(gst_structure_get_name(st), "application/x-rtp") &&
+                    (!media || g_strcmp0(media, "video") == 0);
+    gst_caps_unref(caps);
+
+    if (!is_video)
+        return;
+
+    if (codec != VideoCodec::H264 && codec != VideoCodec::H265)
+    {
+        g_print("Unsupported encoding: %s\n", video_codec_name(codec));
+        return;
+    }
+
+    GstElement *depay = gst_element_factory_make(codec == VideoCodec::H264 ? "rtph264depay" : "rtph265depay", nullptr);
+    GstElement *tee_es = gst_element_factory_make("tee", "tee_es");
+    if (!depay || !tee_es)
+    {
+        g_printerr("Failed to create depay / tee.\n");
+        if (depay) gst_object_unref(depay);
+        if (tee_es) gst_object_unref(tee_es);
+        return;
+    }
+
+    gst_bin_add_many(GST_BIN(self->pipeline_), depay, tee_es, NULL);
+    gst_element_link(depay, tee_es);
+
+    bool ok = self->build_decode_branch(tee_es, codec);
+    if (!self->options_.record_path.empty())
+        ok = self->build_record_branch(tee_es, codec) && ok;
+
+    if (!ok)
+    {
+        g_printerr("Failed to build fan-out branches\n");
+        return;
+    }
+
+    gst_element_sync_state_with_parent(tee_es);
+    gst_element_sync_state_with_parent(depay);
+
+    GstPad *sinkpad = gst_element_get_static_pad(depay, "sink");
+    gst_pad_add_probe(sinkpad, GST_PAD_PROBE_TYPE_BUFFER, bytes_probe_cb, &self->counters_.rtp_bytes, nullptr);
+
+    GstPadLinkReturn ret = gst_pad_link(pad, sinkpad);
+    if (ret != GST_PAD_LINK_OK)
+        g_printerr("Failed to link pad: %d\n", ret);
+    else
+        self->linked_ = true;
+
+    gst_object_unref(sinkpad);
+}
+
+void RTSPFanout::overrun_cb(GstElement *queue, gpointer user_data)
+{
+    reinterpret_cast<std::atomic<guint64> *>(user_data)->fetch_add(1, std::memory_order_relaxed);
+}
+
+GstPadProbeReturn RTSPFanout::count_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    reinterpret_cast<std::atomic<guint64> *>(user_data)->fetch_add(1, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn RTSPFanout::bytes_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    reinterpret_cast<std::atomic<guint64> *>(user_data)->fetch_add(gst_buffer_get_size(buffer),
+                                                                  std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+/* 分析分支：appsink 的流线程只属于这个分支，在这里处理得慢只会让它自己的队列丢帧 */
+GstFlowReturn RTSPFanout::new_sample_cb(GstAppSink *sink, gpointer user_data)
+{
+    RTSPFanout *self = reinterpret_cast<RTSPFanout *>(user_data);
+
+    GstSample *sample = gst_app_sink_pull_sample(sink);
+    if (!sample)
+        return GST_FLOW_ERROR;
+
+    // 分析模块接在这里（BGR，analytics_width x analytics_height）
+    if (self->options_.analytics_delay_ms > 0)
+        g_usleep((gulong)self->options_.analytics_delay_ms * 1000);
+
+    self->counters_.analyzed.fetch_add(1, std::memory_order_relaxed);
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+gboolean RTSPFanout::bus_callback(GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+    RTSPFanout *self = reinterpret_cast<RTSPFanout *>(user_data);
+
+    switch (GST_MESSAGE_TYPE(msg))
+    {
+    case GST_MESSAGE_ERROR:
+    {
+        GError *err = nullptr;
+        gchar *debug = nullptr;
+        gst_message_parse_error(msg, &err, &debug);
+        g_printerr("Error from %s (%s): %s\n", GST_OBJECT_NAME(msg->src), self->uri_.c_str(), err->message);
+        if (debug)
+            g_printerr("Debug info: %s\n", debug);
+        g_clear_error(&err);
+        g_free(debug);
+        break;
+    }
+    case GST_MESSAGE_EOS:
+        g_print("End of stream: %s\n", self->uri_.c_str());
+        break;
+    default:
+        break;
+    }
+    return TRUE;
+}
+
+/* ---------------------------------------------------------
+ * Benchmark：一个会话 fan-out vs 两个会话（显示 + 分析各开一个，
+ * 相当于同时跑 rtsp-hw 和 rtsp-hw-opencv）
+ * --------------------------------------------------------- */
+struct FanoutResult
+{
+    double cpu = 0.0;
+    long threads = 0;
+    double rtp_kbps = 0.0;
+    double decoded_fps = 0.0;
+    double display_fps = 0.0;
+    double analytics_fps = 0.0;
+    guint64 drops = 0;
+    int linked = 0;
+};
+
+static FanoutResult run_fanout_scenario(const std::vector<FanoutOptions> &sessions_options,
+                                        const std::string &uri, int seconds)
+{
+    std::vector<std::unique_ptr<RTSPFanout>> sessions;
+    for (const auto &options : sessions_options)
+    {
+        sessions.emplace_back(new RTSPFanout(uri, options));
+        sessions.back()->start();
+    }
+
+    auto total = [&](std::atomic<guint64> FanoutCounters::*field) {
+        guint64 sum = 0;
+        for (auto &s : sessions)
+            sum += (s->counters().*field).load();
+        return sum;
+    };
+
+    // 预热：等连接建立、解码器起来
+    g_usleep(5 * 1000 * 1000);
+
+    guint64 rtp0 = total(&FanoutCounters::rtp_bytes), dec0 = total(&FanoutCounters::decoded);
+    guint64 disp0 = total(&FanoutCounters::displayed), ana0 = total(&FanoutCounters::analyzed);
+    guint64 drop0 = total(&FanoutCounters::display_drops) + total(&FanoutCounters::analytics_drops);
+    ProcSample begin = proc_sample_now();
+
+    g_usleep((gulong)seconds * 1000 * 1000);
+
+    ProcSample end = proc_sample_now();
+    double wall = (end.wall_us - begin.wall_us) / 1e6;
+
+    FanoutResult r;
+    r.cpu = proc_cpu_percent(begin, end);
+    r.threads = proc_thread_count();
+    r.rtp_kbps = (total(&FanoutCounters::rtp_bytes) - rtp0) * 8 / 1000.0 / wall;
+    r.decoded_fps = (total(&FanoutCounters::decoded) - dec0) / wall;
+    r.display_fps = (total(&FanoutCounters::displayed) - disp0) / wall;
+    r.analytics_fps = (total(&FanoutCounters::analyzed) - ana0) / wall;
+    r.drops = total(&FanoutCounters::display_drops) + total(&FanoutCounters::analytics_drops) - drop0;
+    for (auto &s : sessions)
+        r.linked += s->linked() ? 1 : 0;
+
+    for (auto &s : sessions)
+        s->stop();
+    return r;
+}
+
+static void print_fanout_result(const char *name, const FanoutResult &r)
+{
+    g_print("%-22s %7.1f%% %8ld %10.0f %9.1f %9.1f %9.1f %7" G_GUINT64_FORMAT " %6d\n",
+            name, r.cpu, r.threads, r.rtp_kbps, r.decoded_fps, r.display_fps, r.analytics_fps, r.drops, r.linked);
+}
+
+static int run_benchmark(const FanoutOptions &base, const std::string &external_uri, int seconds)
+{
+    const char *service = "8554";
+    pid_t server = -1;
+    std::string uri = external_uri;
+
+    if (uri.empty())
+    {
+        server = spawn_test_server(service, 1920, 1080, 25);
+        if (server < 0)
+        {
+            g_printerr("fork failed\n");
+            return -1;
+        }
+        uri = std::string("rtsp://127.0.0.1:") + service + "/test";
+    }
+
+    gst_init(nullptr, nullptr);
+    g_usleep(1000 * 1000); // 等服务端就绪
+
+    FanoutOptions fanout = base;
+    fanout.headless = true;
+    fanout.display = true;
+    fanout.analytics = true;
+
+    FanoutOptions display_only = fanout;
+    display_only.analytics = false;
+    display_only.record_path.clear();
+
+    FanoutOptions analytics_only = fanout;
+    analytics_only.display = false;
+    analytics_only.record_path.clear();
+
+    g_print("\n===== Fan-out benchmark: %s, %s, %d s =====\n",
+            uri.c_str(), base.use_tcp ? "TCP" : "UDP", seconds);
+    g_print("%-22s %8s %8s %10s %9s %9s %9s %7s %6s\n",
+            "mode", "cpu", "threads", "rtp kb/s", "dec fps", "disp fps", "ana fps", "drops", "links");
+
+    FanoutResult one = run_fanout_scenario({fanout}, uri, seconds);
+    print_fanout_result("1 session (tee)", one);
+
+    FanoutResult two = run_fanout_scenario({display_only, analytics_only}, uri, seconds);
+    print_fanout_result("2 sessions", two);
+
+    if (two.cpu > 0)
+        g_print("\nfan-out uses %.0f%% of the CPU and %.0f%% of the network of two separate sessions\n",
+                one.cpu / two.cpu * 100.0, two.rtp_kbps > 0 ? one.rtp_kbps / two.rtp_kbps * 100.0 : 0.0);
+
+    if (server > 0)
+    {
+        kill(server, SIGTERM);
+        waitpid(server, nullptr, 0);
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * main()
+ * --------------------------------------------------------- */
+static GMainLoop *main_loop = nullptr;
+
+static void handle_signal(int)
+{
+    if (main_loop)
+        g_main_loop_quit(main_loop);
+}
+
+struct StatsContext
+{
+    RTSPFanout *fanout;
+    ProcSample last;
+    guint64 last_decoded, last_displayed, last_analyzed, last_rtp;
+};
+
+static gboolean print_stats(gpointer data)
+{
+    StatsContext *ctx = reinterpret_cast<StatsContext *>(data);
+    const FanoutCounters &c = ctx->fanout->counters();
+    ProcSample now = proc_sample_now();
+    double wall = (now.wall_us - ctx->last.wall_us) / 1e6;
+
+    guint64 decoded = c.decoded, displayed = c.displayed, analyzed = c.analyzed, rtp = c.rtp_bytes;
+    g_print("[stats] rtp %.0f kb/s | decode %.1f fps | display %.1f fps (drops %" G_GUINT64_FORMAT
+            ") | analytics %.1f fps (drops %" G_GUINT64_FORMAT ") | record %" G_GUINT64_FORMAT
+            " kB (drops %" G_GUINT64_FORMAT ") | CPU %.1f%%\n",
+            (rtp - ctx->last_rtp) * 8 / 1000.0 / wall,
+            (decoded - ctx->last_decoded) / wall,
+            (displayed - ctx->last_displayed) / wall, c.display_drops.load(),
+            (analyzed - ctx->last_analyzed) / wall, c.analytics_drops.load(),
+            c.recorded_bytes.load() / 1024, c.record_drops.load(),
+            proc_cpu_percent(ctx->last, now));
+
+    ctx->last = now;
+    ctx->last_decoded = decoded;
+    ctx->last_displayed = displayed;
+    ctx->last_analyzed = analyzed;
+    ctx->last_rtp = rtp;
+    return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+    FanoutOptions options;
+    int bench_seconds = 0;
+    std::string uri;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--tcp")
+            options.use_tcp = true;
+        else if (arg == "--record" && i + 1 < argc)
+            options.record_path = argv[++i];
+        else if (arg == "--no-display")
+            options.display = false;
+        else if (arg == "--headless")
+            options.headless = true;
+        else if (arg == "--no-analytics")
+            options.analytics = false;
+        else if (arg == "--analytics-size" && i + 1 < argc)
+            sscanf(argv[++i], "%dx%d", &options.analytics_width, &options.analytics_height);
+        else if (arg == "--analytics-delay" && i + 1 < argc)
+            options.analytics_delay_ms = atoi(argv[++i]);
+        else if (arg == "--decoder" && i + 1 < argc)
+            DecoderSelector::instance().set_forced(argv[++i]);
+        else if (arg == "--bench")
+            bench_seconds = (i + 1 < argc && g_ascii_isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 10;
+        else
+            uri = arg;
+    }
+
+    if (bench_seconds > 0)
+        return run_benchmark(options, uri, bench_seconds);
+
+    if (uri.empty())
+    {
+        g_print("Usage: %s rtsp://xxx [--tcp] [--record out.mkv] [--no-display | --headless] [--no-analytics]\n"
+                "          [--analytics-size WxH] [--analytics-delay MS] [--decoder NAME]\n", argv[0]);
+        g_print("       %s --bench [seconds] [--tcp] [rtsp://xxx]   (no uri: local test server)\n", argv[0]);
+        return 0;
+    }
+
+    gst_init(&argc, &argv);
+
+    signal(SIGINT, handle_signal);
+
+    RTSPFanout fanout(uri, options);
+    if (!fanout.start())
+        return -1;
+
+    main_loop = g_main_loop_new(nullptr, FALSE);
+
+    StatsContext stats{&fanout, proc_sample_now(), 0, 0, 0, 0};
+    g_timeout_add_seconds(5, print_stats, &stats);
+
+    g_main_loop_run(main_loop);
+
+    fanout.stop();
+    g_main_loop_unref(main_loop);
+
+    g_print("Exit\n");
+    return 0;
+}
+
+// g++ rtsp-fanout.cpp -o rtsp-fanout `pkg-config --cflags --libs gstreamer-1.0 gstreamer-rtsp-1.0 gstreamer-rtsp-server-1.0 gstreamer-app-1.0`
+// ./rtsp-fanout rtsp://xxx --record cam.mkv --analytics-delay 200
+// ./rtsp-fanout --bench 20
@@ -5,10 +5,22 @@
 #include <iostream>
 #include <signal.h>
 #include <mutex>
+#include <thread>
+#include <queue>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
 
 #include <opencv2/opencv.hpp>   // 引入 OpenCV 头文件
 #include <gst/app/gstappsink.h> // 引入 appsink 头文件
 
+#include "frame_handle.h"       // 零拷贝帧句柄 + SPSC 队列
+#include "frame_mailbox.h"      // 最新帧信箱（三缓冲）
+#include "decoder_select.h"     // 解码器自动选择
+#include "latency_tracer.h"     // 分阶段延迟统计
+#include "frame_skip.h"         // 解码前跳帧
+#include "proc_stats.h"         // CPU 占用
+
 GMainLoop *loop;
 
 void handle_signal(int signum)
@@ -27,12 +39,55 @@ void handle_signal(int signum)
                                                                                      : "UNKNOWN")
 #endif
 
+/* 解码输出到 BGR 的转换放在哪里
+ *   VideoConvert  pipeline 里单线程 videoconvert 转 BGR（原来的做法）
+ *   MultiThread   videoconvert n-threads = CPU 核数
+ *   Lazy          appsink 直接收 NV12 / I420，消费者对真正要处理的帧调用 FrameHandle::bgr()，
+ *                 SIMD 转换；被丢弃 / 跳过的帧完全不转换 */
+enum class ConvertMode
+{
+    VideoConvert,
+    MultiThread,
+    Lazy
+};
+
+/* 拉流参数，pipeline 在构造函数里就启动，所以要一次性传进去 */
+struct PlayerOptions
+{
+    // latency_ms：rtspsrc jitterbuffer；queue_buffers：解码后 queue 的 max-size-buffers；
+    // appsink_buffers：appsink 的 max-buffers。用 --stats-interval 的输出来调这三个值
+    guint latency_ms = 200;
+    guint queue_buffers = 5;
+    guint appsink_buffers = 1;
+
+    // 解码前跳帧：decode_fps > 0 按帧率丢非参考帧；keyframes_only 只解关键帧
+    double decode_fps = 0.0;
+    bool keyframes_only = false;
+
+    ConvertMode convert = ConvertMode::Lazy;
+};
+
 class Gstreamer_HW
 {
 public:
-    Gstreamer_HW(const std::string &rtsp_url_, gboolean use_tcp_);
+    Gstreamer_HW(const std::string &rtsp_url_, gboolean use_tcp_, const PlayerOptions &options_ = PlayerOptions());
     ~Gstreamer_HW();
 
+    // 消费者接口：取出最新一帧（零拷贝句柄），自上次取之后没有新帧时返回 false
+    // 句柄析构 / reset() 即释放，持有期间解码器不能复用这块内存，不要长期囤积
+    bool acquire_frame(FrameHandle &frame) { return frame_mailbox.take(frame); }
+    guint64 dropped_frames() const { return frame_mailbox.overwritten(); }
+
+    // 打印 appsink → 显示的生产 / 消费速率和覆盖丢帧（主线程周期调用）
+    void report_display() { display_meter.report("display", frame_mailbox); }
+
+    // 打印实际解码帧率和跳帧统计（主线程周期调用）
+    void report_decoder();
+
+    // 打印本周期分阶段延迟（主线程周期调用）
+    void report_latency(double interval_s) { tracer.report(interval_s); }
+    bool open_latency_json(const std::string &path) { return tracer.open_json(path); }
+
 private:
     typedef struct _CustomData
     {
@@ -49,6 +104,15 @@ private:
 
         gboolean video_linked = FALSE; // 表示是否已经链接视频流
 
+        FrameMailbox<FrameHandle> *frame_mailbox = nullptr; // appsink → 显示线程
+
+        DecodeFpsMeter *dec_meter = nullptr;
+        LatencyTracer *tracer = nullptr;
+
+        FrameSkipper *skipper = nullptr;
+
+        PlayerOptions options;
+
     } CustomData;
 
     std::string rtsp_url;
@@ -56,6 +120,19 @@ private:
 
     CustomData data;
 
+    // 只在 appsink 线程 publish、显示线程 take；只保留最新帧，被覆盖的旧帧立即释放
+    FrameMailbox<FrameHandle> frame_mailbox;
+    MailboxRateMeter display_meter;
+
+    DecodeFpsMeter dec_meter;
+    LatencyTracer tracer;
+    FrameSkipper skipper;
+
+    // 跳帧统计的上一次采样
+    ProcSample last_proc;
+    guint64 last_frames_in = 0;
+    guint64 last_frames_passed = 0;
+
     // 静态变量，用于确保 gst_init 只调用一次
     static std::once_flag gstreamer_initialized;
 
@@ -81,39 +158,655 @@ private:
     static void state_changed_cb(GstBus *bus, GstMessage *msg, CustomData *data);
 };
 
+/* ---------------------------------------------------------
+ * 主线程显示：从信箱里取最新的一帧
+ * imshow / waitKey 必须在 GUI（主）线程调用，appsink 的流线程里不做任何显示
+ * --------------------------------------------------------- */
+static gboolean display_frames(gpointer user_data)
+{
+    Gstreamer_HW *player = (Gstreamer_HW *)user_data;
+
+    FrameHandle latest;
+    player->acquire_frame(latest);
+
+    // 只有显示的这一帧才转换 BGR（Lazy 模式下），被覆盖的帧不付出转换开销
+    if (latest.valid() && !latest.bgr().empty())
+        cv::imshow("GStreamer - OpenCV", latest.bgr());
+
+    // 非阻塞等待，1ms 允许 UI 刷新
+    cv::waitKey(1);
+
+    return TRUE;
+}
+
+/* 周期打印实际解码帧率和显示信箱的速率 / 覆盖丢帧 */
+static gboolean report_decoder(gpointer user_data)
+{
+    Gstreamer_HW *player = (Gstreamer_HW *)user_data;
+    player->report_decoder();
+    player->report_display();
+    return TRUE;
+}
+
+/* 周期打印 / 写出分阶段延迟，间隔由 --stats-interval 指定 */
+static guint latency_interval_s = 5;
+
+static gboolean report_latency(gpointer user_data)
+{
+    Gstreamer_HW *player = (Gstreamer_HW *)user_data;
+    player->report_latency(latency_interval_s);
+    return TRUE;
+}
+
+/* ---------------------------------------------------------
+ * 交付方式微基准：零拷贝句柄 + SPSC  vs  clone() + 加锁队列
+ * 统计生产到消费的延迟和每帧拷贝次数，不需要 RTSP 源
+ * --------------------------------------------------------- */
+struct HandoffResult
+{
+    std::vector<gint64> latency_us;
+    guint64 copies = 0;
+    guint64 bytes_copied = 0;
+    double seconds = 0.0;
+};
+
+static void print_handoff_result(const char *mode, HandoffResult &r)
+{
+    std::sort(r.latency_us.begin(), r.latency_us.end());
+    size_t n = r.latency_us.size();
+    if (n == 0)
+        return;
+
+    g_print("%-8s %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT " %13.2f %15.0f %10.1f\n",
+            mode,
+            r.latency_us[n / 2], r.latency_us[n * 99 / 100], r.latency_us[n - 1],
+            (double)r.copies / n, (double)r.bytes_copied / n, n / r.seconds);
+}
+
+static int run_handoff_benchmark(int n_frames, int width, int height)
+{
+    gst_init(nullptr, nullptr);
+
+    GstCaps *caps = gst_caps_new_simple("video/x-raw",
+                                        "format", G_TYPE_STRING, "BGR",
+                                        "width", G_TYPE_INT, width,
+                                        "height", G_TYPE_INT, height,
+                                        "framerate", GST_TYPE_FRACTION, 25, 1,
+                                        NULL);
+    GstVideoInfo info;
+    gst_video_info_from_caps(&info, caps);
+
+    // 模拟解码器的 buffer pool
+    std::vector<GstBuffer *> pool;
+    for (int i = 0; i < 8; i++)
+    {
+        GstBuffer *buf = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&info), nullptr);
+        gst_buffer_memset(buf, 0, i * 16, GST_VIDEO_INFO_SIZE(&info));
+        pool.push_back(buf);
+    }
+
+    g_print("\n===== Frame handoff benchmark: %dx%d BGR, %d frames =====\n", width, height, n_frames);
+    g_print("%-8s %9s %9s %9s %13s %15s %10s\n",
+            "mode", "p50(us)", "p99(us)", "max(us)", "copies/frame", "bytes/frame", "frames/s");
+
+    /* 1. 零拷贝句柄 + 无锁 SPSC */
+    {
+        HandoffResult r;
+        SpscRing<FrameHandle> ring(4);
+        volatile guint8 sink = 0;
+        gint64 t0 = g_get_monotonic_time();
+
+        std::thread consumer([&]() {
+            FrameHandle frame;
+            for (int i = 0; i < n_frames;)
+            {
+                if (!ring.try_pop(frame))
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                r.latency_us.push_back(g_get_monotonic_time() - frame.created_us());
+                sink = sink + frame.mat().at<cv::Vec3b>(0, 0)[0];
+                frame.reset();
+                i++;
+            }
+        });
+
+        for (int i = 0; i < n_frames; i++)
+        {
+            GstSample *sample = gst_sample_new(pool[i % pool.size()], caps, nullptr, nullptr);
+            FrameHandle frame = FrameHandle::from_sample(sample);
+            while (!ring.try_push(std::move(frame)))
+                std::this_thread::yield();
+        }
+
+        consumer.join();
+        r.seconds = (g_get_monotonic_time() - t0) / 1e6;
+        print_handoff_result("handle", r);
+    }
+
+    /* 2. 零拷贝句柄 + 最新帧信箱：生产者不等消费者，消费者只拿最新帧，其余被覆盖 */
+    {
+        HandoffResult r;
+        FrameMailbox<FrameHandle> mailbox;
+        std::atomic<bool> done{false};
+        volatile guint8 sink = 0;
+        gint64 t0 = g_get_monotonic_time();
+
+        std::thread consumer([&]() {
+            FrameHandle frame;
+            while (true)
+            {
+                bool finished = done.load(std::memory_order_acquire);
+                if (!mailbox.take(frame))
+                {
+                    if (finished)
+                        break;
+                    std::this_thread::yield();
+                    continue;
+                }
+                r.latency_us.push_back(g_get_monotonic_time() - frame.created_us());
+                sink = sink + frame.mat().at<cv::Vec3b>(0, 0)[0];
+                frame.reset();
+            }
+        });
+
+        for (int i = 0; i < n_frames; i++)
+        {
+            GstSample *sample = gst_sample_new(pool[i % pool.size()], caps, nullptr, nullptr);
+            mailbox.publish(FrameHandle::from_sample(sample));
+        }
+        done.store(true, std::memory_order_release);
+
+        consumer.join();
+        r.seconds = (g_get_monotonic_time() - t0) / 1e6;
+        print_handoff_result("mailbox", r);
+        g_print("%-8s producer never waited; %" G_GUINT64_FORMAT " of %d frames overwritten and released early\n", "",
+                mailbox.overwritten(), n_frames);
+    }
+
+    /* 3. 旧做法：map → clone() → 加锁队列交给另一个线程 */
+    {
+        HandoffResult r;
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::queue<std::pair<cv::Mat, gint64>> queue;
+        volatile guint8 sink = 0;
+        gint64 t0 = g_get_monotonic_time();
+
+        std::thread consumer([&]() {
+            for (int i = 0; i < n_frames; i++)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]() { return !queue.empty(); });
+                auto item = std::move(queue.front());
+                queue.pop();
+                lock.unlock();
+
+                r.latency_us.push_back(g_get_monotonic_time() - item.second);
+                sink = sink + item.first.at<cv::Vec3b>(0, 0)[0];
+            }
+        });
+
+        for (int i = 0; i < n_frames; i++)
+        {
+            gint64 ts = g_get_monotonic_time();
+            GstBuffer *buffer = pool[i % pool.size()];
+            GstMapInfo map;
+            gst_buffer_map(buffer, &map, GST_MAP_READ);
+            cv::Mat view(height, width, CV_8UC3, map.data, GST_VIDEO_INFO_PLANE_STRIDE(&info, 0));
+            cv::Mat copy = view.clone();
+            gst_buffer_unmap(buffer, &map);
+
+            r.copies++;
+            r.bytes_copied += copy.total() * copy.elemSize();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.emplace(std::move(copy), ts);
+            }
+            cond.notify_one();
+        }
+
+        consumer.join();
+        r.seconds = (g_get_monotonic_time() - t0) / 1e6;
+        print_handoff_result("clone", r);
+    }
+
+    for (GstBuffer *buf : pool)
+        gst_buffer_unref(buf);
+    gst_caps_unref(caps);
+
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * 跳帧微基准：同一段 1080p H.264（IBBP，B 帧不作参考）按不同跳帧模式解码，
+ * 统计实际解码帧率和"实时播放这段码流"需要的 CPU
+ * --------------------------------------------------------- */
+static GstPadProbeReturn bench_count_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    ((std::atomic<guint64> *)user_data)->fetch_add(1, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+static bool run_skip_mode(const std::vector<GstSample *> &clip, double decode_fps, bool keyframes_only,
+                          guint64 &decoded, double &cpu_s)
+{
+    GstElement *pipeline = gst_pipeline_new("skip-bench");
+    GstElement *src = gst_element_factory_make("appsrc", nullptr);
+    GstElement *parse = gst_element_factory_make("h264parse", nullptr);
+    GstElement *dec = DecoderSelector::instance().make(VideoCodec::H264, nullptr);
+    GstElement *sink = gst_element_factory_make("fakesink", nullptr);
+
+    if (!pipeline || !src || !parse || !dec || !sink)
+    {
+        g_printerr("Failed to create skip benchmark elements\n");
+        return false;
+    }
+
+    g_object_set(src, "caps", gst_sample_get_caps(clip[0]), "format", GST_FORMAT_TIME, "block", TRUE, NULL);
+    g_object_set(sink, "sync", FALSE, NULL);
+
+    gst_bin_add_many(GST_BIN(pipeline), src, parse, dec, sink, NULL);
+    gst_element_link_many(src, parse, dec, sink, NULL);
+
+    FrameSkipper skipper;
+    skipper.configure(VideoCodec::H264, decode_fps, keyframes_only);
+    GstPad *parse_src = gst_element_get_static_pad(parse, "src");
+    skipper.attach(parse_src);
+    gst_object_unref(parse_src);
+
+    std::atomic<guint64> frames{0};
+    GstPad *dec_src = gst_element_get_static_pad(dec, "src");
+    gst_pad_add_probe(dec_src, GST_PAD_PROBE_TYPE_BUFFER, bench_count_cb, &frames, nullptr);
+    gst_object_unref(dec_src);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    ProcSample t0 = proc_sample_now();
+
+    for (GstSample *sample : clip)
+        gst_app_src_push_sample(GST_APP_SRC(src), sample);
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, 60 * GST_SECOND,
+                                                 (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    ProcSample t1 = proc_sample_now();
+
+    bool ok = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (msg)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    decoded = frames.load();
+    cpu_s = t1.cpu_s - t0.cpu_s;
+    return ok;
+}
+
+static int run_skip_benchmark(int seconds)
+{
+    gst_init(nullptr, nullptr);
+
+    const int fps = 25;
+    std::vector<GstSample *> clip;
+    if (!encode_test_clip("x264enc speed-preset=veryfast bframes=2 b-pyramid=false key-int-max=50 bitrate=4000",
+                          "h264parse", seconds * fps, 1920, 1080, fps, clip))
+    {
+        g_printerr("x264enc not available, cannot build benchmark clip\n");
+        return -1;
+    }
+
+    double clip_s = (double)clip.size() / fps;
+    g_print("\n===== Frame skip benchmark: 1080p H.264 IBBP, %zu frames (%.0f s @ %d fps), GOP 50 =====\n",
+            clip.size(), clip_s, fps);
+    g_print("%-28s %9s %12s %10s %16s %9s\n",
+            "mode", "decoded", "fps(real)", "cpu(s)", "CPU%@realtime", "saving");
+
+    struct Mode
+    {
+        const char *name;
+        double decode_fps;
+        bool keyframes_only;
+    };
+    const Mode modes[] = {
+        {"all frames", 0.0, false},
+        {"--decode-fps 5", 5.0, false},
+        {"--decode-fps 2", 2.0, false},
+        {"--keyframes-only", 0.0, true},
+    };
+
+    double base_cpu = 0.0;
+    for (const Mode &m : modes)
+    {
+        guint64 decoded = 0;
+        double cpu_s = 0.0;
+        if (!run_skip_mode(clip, m.decode_fps, m.keyframes_only, decoded, cpu_s))
+        {
+            g_print("%-28s failed\n", m.name);
+            continue;
+        }
+        if (base_cpu == 0.0)
+            base_cpu = cpu_s;
+
+        g_print("%-28s %9" G_GUINT64_FORMAT " %12.1f %10.2f %15.1f%% %8.1fx\n",
+                m.name, decoded, decoded / clip_s, cpu_s, cpu_s / clip_s * 100.0,
+                cpu_s > 0 ? base_cpu / cpu_s : 0.0);
+    }
+
+    for (GstSample *sample : clip)
+        gst_sample_unref(sample);
+
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * BGR 转换微基准：同一帧 1080p NV12 反复转换成 BGR
+ *   videoconvert n-threads=1 / n-threads=核数：appsrc -> videoconvert -> BGR -> fakesink
+ *   lazy：FrameHandle::bgr()（SIMD + 按行分块并行），以及单线程 SIMD / 标量 / cv::cvtColor 作参考
+ * 统计每帧的墙钟时间和 CPU 时间；lazy 的开销只发生在真正被消费的帧上
+ * --------------------------------------------------------- */
+struct ConvertResult
+{
+    double wall_ms = 0.0; // 每帧
+    double cpu_ms = 0.0;  // 每帧，所有线程合计
+};
+
+static void print_convert_result(const char *mode, const ConvertResult &r, double base_wall)
+{
+    g_print("%-34s %12.2f %12.2f %10.1fx\n", mode, r.wall_ms, r.cpu_ms,
+            r.wall_ms > 0 ? base_wall / r.wall_ms : 0.0);
+}
+
+static bool run_videoconvert_mode(GstBuffer *frame, GstCaps *caps, int n_frames, int n_threads, ConvertResult &r)
+{
+    GstElement *pipeline = gst_pipeline_new("convert-bench");
+    GstElement *src = gst_element_factory_make("appsrc", nullptr);
+    GstElement *conv = gst_element_factory_make("videoconvert", nullptr);
+    GstElement *filter = gst_element_factory_make("capsfilter", nullptr);
+    GstElement *sink = gst_element_factory_make("fakesink", nullptr);
+
+    if (!pipeline || !src || !conv || !filter || !sink)
+    {
+        g_printerr("Failed to create convert benchmark elements\n");
+        return false;
+    }
+
+    if (!g_object_class_find_property(G_OBJECT_GET_CLASS(conv), "n-threads"))
+    {
+        gst_object_unref(pipeline);
+        return false;
+    }
+
+    GstCaps *bgr_caps = gst_caps_from_string("video/x-raw, format=BGR");
+    g_object_set(src, "caps", caps, "format", GST_FORMAT_TIME, "block", TRUE, "max-bytes", (guint64)0, NULL);
+    g_object_set(conv, "n-threads", n_threads, NULL);
+    g_object_set(filter, "caps", bgr_caps, NULL);
+    g_object_set(sink, "sync", FALSE, NULL);
+    gst_caps_unref(bgr_caps);
+
+    gst_bin_add_many(GST_BIN(pipeline), src, conv, filter, sink, NULL);
+    gst_element_link_many(src, conv, filter, sink, NULL);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    ProcSample t0 = proc_sample_now();
+
+    for (int i = 0; i < n_frames; i++)
+    {
+        // 只复制 buffer 头，像素内存共享；videoconvert 只读输入
+        GstBuffer *buffer = gst_buffer_copy(frame);
+        GST_BUFFER_PTS(buffer) = gst_util_uint64_scale(i, GST_SECOND, 25);
+        GST_BUFFER_DURATION(buffer) = GST_SECOND / 25;
+        gst_app_src_push_buffer(GST_APP_SRC(src), buffer);
+    }
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, 120 * GST_SECOND,
+                                                 (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    ProcSample t1 = proc_sample_now();
+
+    bool ok = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (msg)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    r.wall_ms = (t1.wall_us - t0.wall_us) / 1000.0 / n_frames;
+    r.cpu_ms = (t1.cpu_s - t0.cpu_s) * 1000.0 / n_frames;
+    return ok;
+}
+
+template <typename F>
+static ConvertResult time_convert(int n_frames, F &&convert)
+{
+    ProcSample t0 = proc_sample_now();
+    for (int i = 0; i < n_frames; i++)
+        convert();
+    ProcSample t1 = proc_sample_now();
+
+    ConvertResult r;
+    r.wall_ms = (t1.wall_us - t0.wall_us) / 1000.0 / n_frames;
+    r.cpu_ms = (t1.cpu_s - t0.cpu_s) * 1000.0 / n_frames;
+    return r;
+}
+
+static int run_convert_benchmark(int n_frames, int width, int height)
+{
+    gst_init(nullptr, nullptr);
+
+    GstCaps *caps = gst_caps_new_simple("video/x-raw",
+                                        "format", G_TYPE_STRING, "NV12",
+                                        "width", G_TYPE_INT, width,
+                                        "height", G_TYPE_INT, height,
+                                        "framerate", GST_TYPE_FRACTION, 25, 1,
+                                        NULL);
+    GstVideoInfo info;
+    gst_video_info_from_caps(&info, caps);
+
+    // 渐变 + 色块，避免全 0 帧让某些路径走捷径
+    GstBuffer *frame = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&info), nullptr);
+    GstMapInfo map;
+    gst_buffer_map(frame, &map, GST_MAP_WRITE);
+    for (int y = 0; y < height; y++)
+    {
+        guint8 *row = map.data + GST_VIDEO_INFO_PLANE_OFFSET(&info, 0) + y * GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+        for (int x = 0; x < width; x++)
+            row[x] = (guint8)(16 + (x + y) * 219 / (width + height));
+    }
+    for (int y = 0; y < height / 2; y++)
+    {
+        guint8 *row = map.data + GST_VIDEO_INFO_PLANE_OFFSET(&info, 1) + y * GST_VIDEO_INFO_PLANE_STRIDE(&info, 1);
+        for (int x = 0; x < width / 2; x++)
+        {
+            row[2 * x] = (guint8)(x * 8 / width * 32 + 16);
+            row[2 * x + 1] = (guint8)(y * 8 / height * 32 + 16);
+        }
+    }
+    gst_buffer_unmap(frame, &map);
+
+    int n_cpu = g_get_num_processors();
+    g_print("\n===== BGR conversion benchmark: %dx%d NV12 -> BGR, %d frames, %d CPUs, kernel %s =====\n",
+            width, height, n_frames, n_cpu, yuv_simd_name());
+    g_print("%-34s %12s %12s %11s\n", "mode", "wall ms/frame", "cpu ms/frame", "speedup");
+
+    ConvertResult base;
+    if (!run_videoconvert_mode(frame, caps, n_frames, 1, base))
+        g_print("%-34s unavailable\n", "videoconvert n-threads=1");
+    else
+        print_convert_result("videoconvert n-threads=1", base, base.wall_ms);
+
+    ConvertResult mt;
+    gchar *mt_name = g_strdup_printf("videoconvert n-threads=%d", n_cpu);
+    if (run_videoconvert_mode(frame, caps, n_frames, n_cpu, mt))
+        print_convert_result(mt_name, mt, base.wall_ms);
+    else
+        g_print("%-34s unavailable\n", mt_name);
+    g_free(mt_name);
+
+    // lazy：每帧一个新句柄（与 appsink 交付的情况一致），bgr() 触发转换
+    GstSample *sample = gst_sample_new(frame, caps, nullptr, nullptr);
+    volatile guint8 sink = 0;
+    ConvertResult lazy = time_convert(n_frames, [&]() {
+        FrameHandle handle = FrameHandle::from_sample(gst_sample_ref(sample));
+        sink = sink + handle.bgr().data[0];
+    });
+    print_convert_result("lazy FrameHandle::bgr()", lazy, base.wall_ms);
+
+    FrameHandle handle = FrameHandle::from_sample(gst_sample_ref(sample));
+    YuvView view = yuv_view(handle.info(), handle.data());
+    cv::Mat simd(height, width, CV_8UC3), scalar(height, width, CV_8UC3);
+
+    ConvertResult simd_1t = time_convert(n_frames, [&]() { yuv_to_bgr(view, simd.data, (int)simd.step); });
+    gchar *simd_name = g_strdup_printf("%s, 1 thread", yuv_simd_name());
+    print_convert_result(simd_name, simd_1t, base.wall_ms);
+    g_free(simd_name);
+
+    ConvertResult scalar_1t = time_convert(n_frames, [&]() {
+        yuv_to_bgr(view, scalar.data, (int)scalar.step, 0, -1, false);
+    });
+    print_convert_result("scalar, 1 thread", scalar_1t, base.wall_ms);
+
+    // cv::cvtColor 要求 Y / UV 平面连续，这里的测试帧满足
+    cv::Mat nv12(height * 3 / 2, width, CV_8UC1, (void *)handle.data(), GST_VIDEO_INFO_PLANE_STRIDE(&info, 0));
+    cv::Mat ref;
+    ConvertResult opencv = time_convert(n_frames, [&]() { cv::cvtColor(nv12, ref, cv::COLOR_YUV2BGR_NV12); });
+    print_convert_result("cv::cvtColor (reference)", opencv, base.wall_ms);
+
+    bool identical = cv::norm(simd, scalar, cv::NORM_INF) == 0 && cv::norm(simd, handle.bgr(), cv::NORM_INF) == 0;
+    g_print("SIMD vs scalar: %s, max diff vs cv::cvtColor: %.0f\n",
+            identical ? "identical" : "MISMATCH", cv::norm(simd, ref, cv::NORM_INF));
+    g_print("lazy: cost is paid only for frames a consumer calls bgr() on, e.g. 5 of 25 fps -> %.2f ms per source frame\n",
+            lazy.wall_ms * 5 / 25);
+
+    handle.reset();
+    gst_sample_unref(sample);
+    gst_buffer_unref(frame);
+    gst_caps_unref(caps);
+
+    return identical ? 0 : -1;
+}
+
 /* ---------------------------------------------------------
  * main()
  * rtspsrc -> depay -> (parse) -> dec -> appsink -> opencv
- * g++ ./rtsp-hw-opencv.cpp -o ./rtsp-hw-opencv `pkg-config --cflags --libs gstreamer-1.0 gstreamer-rtsp-1.0 gstreamer-app-1.0 opencv4`
+ * g++ ./rtsp-hw-opencv.cpp -o ./rtsp-hw-opencv `pkg-config --cflags --libs gstreamer-1.0 gstreamer-rtsp-1.0 gstreamer-app-1.0 gstreamer-video-1.0 opencv4`
+ * ./rtsp-hw-opencv --bench-handoff [frames]   交付方式微基准
+ * ./rtsp-hw-opencv rtsp://... --decoder avdec_h264   强制解码器
+ * ./rtsp-hw-opencv rtsp://... --bench-decoders       先对该编码的候选解码器跑微基准，选最快的
+ * ./rtsp-hw-opencv rtsp://... --stats-interval 2 --stats-json lat.jsonl --latency 100 --queue-buffers 2
+ *                                                    分阶段延迟 p50/p95/p99 + 丢帧，调参用
+ * ./rtsp-hw-opencv rtsp://... --decode-fps 5 [--keyframes-only]   解码前跳帧，只给分析用 N fps
+ * ./rtsp-hw-opencv --bench-skip [seconds]                          跳帧模式 CPU / 帧率对比
+ * ./rtsp-hw-opencv rtsp://... --convert videoconvert|mt|lazy       BGR 转换方式（默认 lazy）
+ * ./rtsp-hw-opencv --bench-convert [frames]                        三种转换方式的每帧开销对比
  * --------------------------------------------------------- */
 int main(int argc, char *argv[])
 {
     // 注册 SIGINT 信号（Ctrl+C）处理函数
     signal(SIGINT, handle_signal);
 
+    if (argc >= 2 && std::string(argv[1]) == "--bench-handoff")
+    {
+        int frames = argc >= 3 ? atoi(argv[2]) : 2000;
+        return run_handoff_benchmark(frames, 1920, 1080);
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-skip")
+    {
+        int seconds = argc >= 3 ? atoi(argv[2]) : 10;
+        return run_skip_benchmark(seconds);
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-convert")
+    {
+        int frames = argc >= 3 ? atoi(argv[2]) : 300;
+        return run_convert_benchmark(frames, 1920, 1080);
+    }
+
     if (argc < 2)
     {
-        g_print("Usage: %s rtsp://xxx.xxx.xxx.xxx [--tcp]\n", argv[0]);
+        g_print("Usage: %s rtsp://xxx.xxx.xxx.xxx [--tcp] [--decoder NAME] [--bench-decoders]\n"
+                "          [--latency MS] [--queue-buffers N] [--appsink-buffers N]\n"
+                "          [--stats-interval S] [--stats-json FILE]\n"
+                "          [--decode-fps N] [--keyframes-only]\n"
+                "          [--convert videoconvert|mt|lazy]\n", argv[0]);
+        g_print("       %s --bench-handoff [frames]\n", argv[0]);
+        g_print("       %s --bench-skip [seconds]\n", argv[0]);
+        g_print("       %s --bench-convert [frames]\n", argv[0]);
         return 0;
     }
 
     std::string url = argv[1];
-    // bool tcp = false;
+    gboolean tcp = FALSE;
+    std::string forced_decoder;
+    bool bench_decoders = false;
+    PlayerOptions options;
+    std::string stats_json;
 
-    // if (argc >= 3 && std::string(argv[2]) == "--tcp")
-    //     tcp = true;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--tcp")
+            tcp = TRUE;
+        else if (arg == "--decoder" && i + 1 < argc)
+            forced_decoder = argv[++i];
+        else if (arg == "--bench-decoders")
+            bench_decoders = true;
+        else if (arg == "--latency" && i + 1 < argc)
+            options.latency_ms = atoi(argv[++i]);
+        else if (arg == "--queue-buffers" && i + 1 < argc)
+            options.queue_buffers = atoi(argv[++i]);
+        else if (arg == "--appsink-buffers" && i + 1 < argc)
+            options.appsink_buffers = atoi(argv[++i]);
+        else if (arg == "--stats-interval" && i + 1 < argc)
+            latency_interval_s = atoi(argv[++i]);
+        else if (arg == "--stats-json" && i + 1 < argc)
+            stats_json = argv[++i];
+        else if (arg == "--decode-fps" && i + 1 < argc)
+            options.decode_fps = atof(argv[++i]);
+        else if (arg == "--keyframes-only")
+            options.keyframes_only = true;
+        else if (arg == "--convert" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            if (mode == "videoconvert")
+                options.convert = ConvertMode::VideoConvert;
+            else if (mode == "mt")
+                options.convert = ConvertMode::MultiThread;
+            else if (mode == "lazy")
+                options.convert = ConvertMode::Lazy;
+            else
+                g_printerr("Unknown --convert mode %s, using lazy\n", mode.c_str());
+        }
+    }
 
-    gboolean tcp = (argc >= 3 && std::string(argv[2]) == "--tcp");
+    DecoderSelector::instance().set_forced(forced_decoder);
+    DecoderSelector::instance().set_benchmark(bench_decoders);
 
     g_print("Link to %s, use tcp %s\n", url.c_str(), tcp ? "true" : "false");
 
     cv::namedWindow("GStreamer - OpenCV", cv::WINDOW_AUTOSIZE);
 
-    Gstreamer_HW gst_rtsp_play(url, tcp);
+    Gstreamer_HW gst_rtsp_play(url, tcp, options);
+
+    if (!stats_json.empty())
+        gst_rtsp_play.open_latency_json(stats_json);
 
     // GStreamer 的 Bus 信号依赖 GLib 的主循环（GMainLoop）分发事件，如果没有启动主循环，信号永远不会触发
     loop = g_main_loop_new(NULL, FALSE);
 
+    // 显示放在主线程，appsink 线程只负责交付帧句柄
+    g_timeout_add(10, display_frames, &gst_rtsp_play);
+    g_timeout_add_seconds(5, report_decoder, &gst_rtsp_play);
+    if (latency_interval_s > 0)
+        g_timeout_add_seconds(latency_interval_s, report_latency, &gst_rtsp_play);
+
     g_main_loop_run(loop); // 阻塞运行，直到调用 g_main_loop_quit
 
     // 退出时清理
@@ -135,7 +828,8 @@ void Gstreamer_HW::initialize_gstreamer()
     std::cout << "GStreamer initialized.\n";
 }
 
-Gstreamer_HW::Gstreamer_HW(const std::string &rtsp_url_, gboolean use_tcp_)
+Gstreamer_HW::Gstreamer_HW(const std::string &rtsp_url_, gboolean use_tcp_,
+                           const PlayerOptions &options_)
 {
     // 确保 gst_init 只调用一次
     std::call_once(gstreamer_initialized, &Gstreamer_HW::initialize_gstreamer);
@@ -146,6 +840,14 @@ Gstreamer_HW::Gstreamer_HW(const std::string &rtsp_url_, gboolean use_tcp_)
     memset(&data, 0, sizeof(data));
 
     data.video_linked = FALSE;
+    data.frame_mailbox = &frame_mailbox;
+    data.dec_meter = &dec_meter;
+    data.tracer = &tracer;
+
+    data.skipper = &skipper;
+    data.options = options_;
+
+    last_proc = proc_sample_now();
 
     create_pipeline();
 }
@@ -155,6 +857,32 @@ Gstreamer_HW::~Gstreamer_HW()
     destroy_pipeline();
 }
 
+void Gstreamer_HW::report_decoder()
+{
+    dec_meter.report();
+
+    if (!skipper.enabled())
+        return;
+
+    // 进入解码器前后的帧率对比 + 进程 CPU，用来看跳帧省了多少
+    ProcSample now = proc_sample_now();
+    double seconds = (now.wall_us - last_proc.wall_us) / 1e6;
+    const FrameSkipper::Stats &st = skipper.stats();
+    guint64 frames_in = st.frames_in.load();
+    guint64 frames_passed = st.frames_passed.load();
+
+    if (seconds > 0)
+        g_print("[skip] stream %.1f fps -> decode %.1f fps | dropped non-ref %" G_GUINT64_FORMAT
+                " delta %" G_GUINT64_FORMAT " key %" G_GUINT64_FORMAT " | CPU %.1f%%\n",
+                (frames_in - last_frames_in) / seconds, (frames_passed - last_frames_passed) / seconds,
+                st.dropped_nonref.load(), st.dropped_delta.load(), st.dropped_key.load(),
+                proc_cpu_percent(last_proc, now));
+
+    last_proc = now;
+    last_frames_in = frames_in;
+    last_frames_passed = frames_passed;
+}
+
 void Gstreamer_HW::on_sdp_received(GstElement *element, GstSDPMessage *sdp, gpointer user_data)
 {
     CustomData *ctx = (CustomData *)user_data;
@@ -261,11 +989,14 @@ void Gstreamer_HW::on_pad_added(GstElement *element, GstPad *pad, gpointer user_
     GstStructure *structure = gst_caps_get_structure(caps, 0);
 
     gboolean is_vp = FALSE;
+    VideoCodec codec = VideoCodec::Unknown;
 
     // Check for video encoding type
     const gchar *encoding_type = gst_structure_get_string(structure, "encoding-name");
     if (encoding_type != NULL)
     {
+        codec = video_codec_from_encoding(encoding_type);
+
         if (g_str_has_prefix(encoding_type, "H264") || g_str_has_prefix(encoding_type, "AVC"))
         {
             ctx->depay = gst_element_factory_make("rtph264depay", "h264-depay");
@@ -302,7 +1033,12 @@ void Gstreamer_HW::on_pad_added(GstElement *element, GstPad *pad, gpointer user_
     gst_caps_unref(caps);
     g_free(caps_str);
 
-    ctx->dec = gst_element_factory_make("mppvideodec", "mppdec");
+    // 之前固定用 mppvideodec；现在按排序表选择，RK 平台上 mppvideodec 仍排在最前，
+    // 没有 MPP / GPU 的机器自动回落到软件解码
+    DecoderCandidate dec_info;
+    ctx->dec = DecoderSelector::instance().make(codec, "video-dec", &dec_info);
+    if (ctx->dec)
+        g_print("  -> Decoder %s (%s)\n", dec_info.factory.c_str(), dec_info.hardware ? "hardware" : "software");
 
     // // 当需要使用 OpenCV 或者 AI 推理的时候不建议开启这两项
     // // 启用 ARM 帧缓冲压缩, 只在 直连显示 / Mali GPU pipeline 时打开
@@ -347,8 +1083,8 @@ void Gstreamer_HW::on_pad_added(GstElement *element, GstPad *pad, gpointer user_
                         flags: 可读, 可写, 可以在NULL、READY、PAUSED或PLAYING状态下改变
                         Unsigned Integer. Range: 0 - 4294967295 Default: 200
      */
-    // 设置 queue 的最大缓冲区数为 5（限制最多缓存 5 帧）
-    g_object_set(ctx->queue, "max-size-buffers", 5, NULL);
+    // 设置 queue 的最大缓冲区数（默认 5，限制最多缓存 5 帧）
+    g_object_set(ctx->queue, "max-size-buffers", ctx->options.queue_buffers, NULL);
     // 设置 queue 为 "downstream"，当队列满时丢弃最旧的帧
     g_object_set(ctx->queue, "leaky", 2, NULL); // 2: downstream
     // 在接收到 EOS（结束）信号时，队列中的所有数据会被丢弃
@@ -356,7 +1092,12 @@ void Gstreamer_HW::on_pad_added(GstElement *element, GstPad *pad, gpointer user_
     // 不需要队列信号, 禁用队列信号
     g_object_set(ctx->queue, "silent", TRUE, NULL);
 
+    // Lazy 模式下 videoconvert 仍然保留：解码器输出 NV12 / I420 时是 passthrough，零开销；
+    // 输出其他格式（如 NV16）时才真正转换，保证协商一定能成功
     GstElement *conv = gst_element_factory_make("videoconvert", "conv");
+    if (conv && ctx->options.convert == ConvertMode::MultiThread &&
+        g_object_class_find_property(G_OBJECT_GET_CLASS(conv), "n-threads"))
+        g_object_set(conv, "n-threads", g_get_num_processors(), NULL);
     // ctx->sink = gst_element_factory_make("autovideosink", "app-sink");
     ctx->sink = gst_element_factory_make("appsink", "app-sink");
 
@@ -364,10 +1105,12 @@ void Gstreamer_HW::on_pad_added(GstElement *element, GstPad *pad, gpointer user_
     g_signal_connect(ctx->sink, "new-sample", G_CALLBACK(on_new_sample), ctx);
 
     g_object_set(ctx->sink, "drop", TRUE, NULL);          // 如果处理慢了，允许丢弃旧帧
-    g_object_set(ctx->sink, "max-buffers", 1, NULL);      // 缓冲区只保留 1 帧，保证实时性
+    g_object_set(ctx->sink, "max-buffers", ctx->options.appsink_buffers, NULL); // 默认只保留 1 帧，保证实时性
 
-    // 强制要求 BGR 格式
-    GstCaps *caps2 = gst_caps_from_string("video/x-raw, format=BGR");
+    // 强制要求 BGR 格式；Lazy 模式直接收解码器的 YUV
+    GstCaps *caps2 = gst_caps_from_string(ctx->options.convert == ConvertMode::Lazy
+                                              ? "video/x-raw, format=(string){ NV12, I420 }"
+                                              : "video/x-raw, format=BGR");
     g_object_set(ctx->sink, "caps", caps2, NULL);
     gst_caps_unref(caps2);
 
@@ -421,6 +1164,33 @@ void Gstreamer_HW::on_pad_added(GstElement *element, GstPad *pad, gpointer user_
         }
     }
 
+    ctx->dec_meter->attach(ctx->dec, dec_info);
+
+    // 延迟打点：rtspsrc pad → depay 输出 → 解码输出 →（on_new_sample）
+    ctx->tracer->set_pipeline(ctx->pipeline);
+    ctx->tracer->attach(pad, LatencyTracer::STAGE_SRC);
+
+    GstPad *depay_src = gst_element_get_static_pad(ctx->depay, "src");
+    ctx->tracer->attach(depay_src, LatencyTracer::STAGE_DEPAY);
+    gst_object_unref(depay_src);
+
+    GstPad *dec_src = gst_element_get_static_pad(ctx->dec, "src");
+    ctx->tracer->attach(dec_src, LatencyTracer::STAGE_DECODE);
+    gst_object_unref(dec_src);
+
+    // 解码前跳帧：H.264 / H.265 挂在 parser 后面（按帧对齐），VP8 / VP9 挂在 depay 后面
+    ctx->skipper->configure(codec, ctx->options.decode_fps, ctx->options.keyframes_only);
+    if (ctx->skipper->enabled())
+    {
+        GstPad *skip_pad = gst_element_get_static_pad(is_vp ? ctx->depay : ctx->parse, "src");
+        ctx->skipper->attach(skip_pad);
+        gst_object_unref(skip_pad);
+
+        g_print("  -> Frame skip before decode: %s, target %.1f fps\n",
+                ctx->options.keyframes_only ? "keyframes only" : "non-reference frames",
+                ctx->options.decode_fps);
+    }
+
     /* Now link dynamic pad */
     GstPad *sinkpad = gst_element_get_static_pad(ctx->depay, "sink");
     GstPadLinkReturn ret = gst_pad_link(pad, sinkpad);
@@ -440,64 +1210,25 @@ void Gstreamer_HW::on_pad_added(GstElement *element, GstPad *pad, gpointer user_
 
 GstFlowReturn Gstreamer_HW::on_new_sample(GstElement *appsink, gpointer user_data)
 {
+    CustomData *ctx = (CustomData *)user_data;
+
     // 1. 从 appsink 中拉取 sample
     GstSample *sample = gst_app_sink_pull_sample(GST_APP_SINK(appsink));
     if (!sample) {
         return GST_FLOW_ERROR;
     }
 
-    // 2. 获取缓冲区 (Buffer) 和 格式信息 (Caps)
-    GstBuffer *buffer = gst_sample_get_buffer(sample);
-    GstCaps *caps = gst_sample_get_caps(sample);
-
-    if (!buffer || !caps) {
-        gst_sample_unref(sample);
-        return GST_FLOW_ERROR;
-    }
-
-    // 3. 动态解析当前帧的分辨率和格式
-    // 注意：RTSP流在播放中途可能会改变分辨率
-    GstStructure *s = gst_caps_get_structure(caps, 0);
-    int width, height;
-    if (!gst_structure_get_int(s, "width", &width) || !gst_structure_get_int(s, "height", &height)) {
-        gst_sample_unref(sample);
+    // 2. 包装成零拷贝句柄：sample 引用和内存映射一直保持到最后一个句柄释放
+    //    分辨率 / stride 每帧从 caps 解析，RTSP 流中途改分辨率也没问题
+    FrameHandle frame = FrameHandle::from_sample(sample);
+    if (!frame.valid()) {
         return GST_FLOW_ERROR;
     }
 
-    // g_print("width: %d, height: %d\n", width, height);
-
-    // static int i = 0;
-
-    // g_print("\n%d\n", i++);
-
-    // 4. 映射内存以供 OpenCV 读取
-    GstMapInfo map;
-    if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
-
-        try {
-            // 创建 Mat。注意：这里是零拷贝映射，Mat 指向的是 GStreamer 的内存
-            // CV_8UC3 对应 BGR 格式
-            cv::Mat frame(cv::Size(width, height), CV_8UC3, (void *)map.data);
+    ctx->tracer->mark(LatencyTracer::STAGE_SINK, frame.pts());
 
-            if (!frame.empty()) {
-                // 如果需要对图像进行耗时处理，建议 cv::Mat processed = frame.clone() 后丢到另一个线程
-                // 这里仅做简单的显示
-                cv::imshow("GStreamer - OpenCV", frame);
-
-                // // 关键：必须是非阻塞等待，1ms 允许 UI 刷新
-                // // 如果在回调里 waitKey(0)，整个管道会因为被此线程阻塞而停止接收新帧
-                // cv::waitKey(1);
-            }
-        } catch (const cv::Exception& e) {
-            g_printerr("OpenCV Exception: %s\n", e.what());
-        }
-
-        // 5. 解锁内存映射
-        gst_buffer_unmap(buffer, &map);
-    }
-
-    // 6. 释放 sample 引用计数
-    gst_sample_unref(sample);
+    // 3. 放进信箱交给显示线程；显示还没取走的上一帧被覆盖并立即释放，绝不阻塞解码
+    ctx->frame_mailbox->publish(std::move(frame));
 
     return GST_FLOW_OK;
 }
@@ -600,7 +1331,7 @@ gboolean Gstreamer_HW::create_pipeline()
      */
     g_object_set(data.src, "buffer-mode", 3, NULL);        // 自动调整缓冲区大小
     g_object_set(data.src, "drop-on-latency", TRUE, NULL); // 缓冲区满时丢弃旧数据
-    g_object_set(data.src, "latency", 200, NULL);          // RTSP 接收缓冲区
+    g_object_set(data.src, "latency", data.options.latency_ms, NULL); // RTSP 接收缓冲区
 
     if (use_tcp)
     {
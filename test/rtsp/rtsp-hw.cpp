@@ -1,11 +1,16 @@
 #include <gst/gst.h>
 #include <gst/rtsp/rtsp.h>
 #include <gst/sdp/gstsdpmessage.h>
+#include <glib-unix.h>
 // #include <string>
 #include <iostream>
+#include <memory>
 #include <signal.h>
+#include <unistd.h>
 #include <mutex>
 
+#include "event_recorder.h"
+
 GMainLoop *loop;
 
 void handle_signal(int signum)
@@ -27,7 +32,7 @@ void handle_signal(int signum)
 class Gstreamer_HW
 {
 public:
-    Gstreamer_HW(const std::string &rtsp_url_, gboolean use_tcp_);
+    Gstreamer_HW(const std::string &rtsp_url_, gboolean use_tcp_, EventRecorder *recorder_ = nullptr);
     ~Gstreamer_HW();
 
 private:
@@ -45,6 +50,8 @@ private:
 
         gboolean video_linked = FALSE; // 表示是否已经链接视频流
 
+        EventRecorder *recorder = nullptr; // 事件录像，挂在 parse 后面（可选）
+
     } CustomData;
 
     std::string rtsp_url;
@@ -75,10 +82,25 @@ private:
     static void state_changed_cb(GstBus *bus, GstMessage *msg, CustomData *data);
 };
 
+/* SIGUSR1 触发 / 延长事件，SIGUSR2 立即结束（在主循环里执行，不在信号上下文里） */
+static gboolean on_event_trigger(gpointer user_data)
+{
+    static_cast<EventRecorder *>(user_data)->trigger();
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean on_event_end(gpointer user_data)
+{
+    static_cast<EventRecorder *>(user_data)->end_event();
+    return G_SOURCE_CONTINUE;
+}
+
 /* ---------------------------------------------------------
  * main()
  * rtspsrc -> depay -> (parse) -> dec -> sink
- * g++ ./rtsp-hw.cpp -o ./rtsp-hw `pkg-config --cflags --libs gstreamer-1.0 gstreamer-rtsp-1.0`
+ *                        └ [event recorder: AU ring -> appsrc -> mux -> filesink]
+ * g++ ./rtsp-hw.cpp -o ./rtsp-hw `pkg-config --cflags --libs gstreamer-1.0 gstreamer-rtsp-1.0 gstreamer-app-1.0`
+ * ./rtsp-hw rtsp://xxx --tcp --event-dir /data/events --pre 10 --post 10    然后 kill -USR1 <pid> 触发
  * --------------------------------------------------------- */
 int main(int argc, char *argv[])
 {
@@ -87,7 +109,7 @@ int main(int argc, char *argv[])
 
     if (argc < 2)
     {
-        g_print("Usage: %s rtsp://xxx.xxx.xxx.xxx [--tcp]\n", argv[0]);
+        g_print("Usage: %s rtsp://xxx.xxx.xxx.xxx [--tcp] [--event-dir DIR [--pre S] [--post S] [--event-mb MB] [--mp4]]\n", argv[0]);
         return 0;
     }
 
@@ -97,11 +119,43 @@ int main(int argc, char *argv[])
     // if (argc >= 3 && std::string(argv[2]) == "--tcp")
     //     tcp = true;
 
-    gboolean tcp = (argc >= 3 && std::string(argv[2]) == "--tcp");
+    gboolean tcp = FALSE;
+    bool event_recording = false;
+    EventRecorder::Options event_options;
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--tcp")
+            tcp = TRUE;
+        else if (arg == "--event-dir" && i + 1 < argc)
+        {
+            event_recording = true;
+            event_options.dir = argv[++i];
+        }
+        else if (arg == "--pre" && i + 1 < argc)
+            event_options.pre_seconds = atoi(argv[++i]);
+        else if (arg == "--post" && i + 1 < argc)
+            event_options.post_seconds = atoi(argv[++i]);
+        else if (arg == "--event-mb" && i + 1 < argc)
+            event_options.max_bytes = (gsize)atoi(argv[++i]) * 1024 * 1024;
+        else if (arg == "--mp4")
+            event_options.container = "mp4";
+    }
 
     g_print("Link to %s, use tcp %s\n", url.c_str(), tcp ? "true" : "false");
 
-    Gstreamer_HW gst_rtsp_play(url, tcp);
+    // 录像器要比 pipeline 活得久（probe 里会用到），所以先创建
+    std::unique_ptr<EventRecorder> recorder;
+    if (event_recording)
+    {
+        recorder.reset(new EventRecorder(event_options));
+        g_unix_signal_add(SIGUSR1, on_event_trigger, recorder.get());
+        g_unix_signal_add(SIGUSR2, on_event_end, recorder.get());
+        g_print("Event recording enabled: kill -USR1 %d to trigger, kill -USR2 %d to stop\n", getpid(), getpid());
+    }
+
+    Gstreamer_HW gst_rtsp_play(url, tcp, recorder.get());
 
     // GStreamer 的 Bus 信号依赖 GLib 的主循环（GMainLoop）分发事件，如果没有启动主循环，信号永远不会触发
     loop = g_main_loop_new(NULL, FALSE);
@@ -125,7 +179,7 @@ void Gstreamer_HW::initialize_gstreamer()
     std::cout << "GStreamer initialized.\n";
 }
 
-Gstreamer_HW::Gstreamer_HW(const std::string &rtsp_url_, gboolean use_tcp_)
+Gstreamer_HW::Gstreamer_HW(const std::string &rtsp_url_, gboolean use_tcp_, EventRecorder *recorder_)
 {
     // 确保 gst_init 只调用一次
     std::call_once(gstreamer_initialized, &Gstreamer_HW::initialize_gstreamer);
@@ -136,6 +190,7 @@ Gstreamer_HW::Gstreamer_HW(const std::string &rtsp_url_, gboolean use_tcp_)
     memset(&data, 0, sizeof(data));
 
     data.video_linked = FALSE;
+    data.recorder = recorder_;
 
     create_pipeline();
 }
@@ -254,6 +309,7 @@ void Gstreamer_HW::on_pad_added(GstElement *element, GstPad *pad, gpointer user_
 
     // Check for video encoding type
     const gchar *encoding_type = gst_structure_get_string(structure, "encoding-name");
+    VideoCodec codec = video_codec_from_encoding(encoding_type); // caps 释放后 encoding_type 就失效了
     if (encoding_type != NULL)
     {
         if (g_str_has_prefix(encoding_type, "H264") || g_str_has_prefix(encoding_type, "AVC"))
@@ -365,6 +421,10 @@ void Gstreamer_HW::on_pad_added(GstElement *element, GstPad *pad, gpointer user_
 
     g_print("\nVideo stream successfully linked to the pipeline\n");
 
+    // 事件录像：压缩域，从 parser 出来的 AU 进内存环，触发时写文件
+    if (ctx->recorder && !is_vp)
+        ctx->recorder->attach(ctx->parse, codec);
+
     ctx->video_linked = TRUE;
 }
 
@@ -0,0 +1,659 @@
+#include <gst/gst.h>
+#include <gst/rtsp/gstrtsp.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <iostream>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "proc_stats.h"
+#include "decoder_select.h"
+#include "rtsp_test_server.h"
+
+/*
+ * RTSP Ingest Engine (Multi Stream)
+ * - 一个进程内拉 N 路 RTSP（仅视频），depay/parse/decode 选择与 rtsp.cc 的 pad_added_cb 一致
+ * - 固定数量的 worker 线程，每个 worker 拥有独立的 GMainContext，
+ *   负责其名下所有流的 Bus 消息与重连定时器（不再是一路一个 GMainLoop）
+ * - 每路流独立的重连状态（指数退避）
+ * - 解码后的帧进 fakesink，只做计数，供上层分析模块接入
+ *
+ * 注意：rtspsrc / jitterbuffer / 解码器自身的 streaming 线程仍由 GStreamer 创建，
+ *      worker 线程池只替代了 "每路一个进程 + 一个主循环" 的控制面开销。
+ *      大量路数时务必限制 avdec 的 max-threads，否则每路都会按核数起解码线程。
+ */
+
+class RTSPIngestEngine;
+
+struct IngestStream
+{
+    int id = 0;
+    std::string uri;
+
+    RTSPIngestEngine *engine = nullptr;
+    GMainContext *context = nullptr; // 所属 worker 的 context
+
+    GstElement *pipeline = nullptr;
+    GstElement *src = nullptr;
+
+    GSource *bus_source = nullptr;
+    GSource *reconnect_source = nullptr;
+    int retry_count = 0;
+
+    std::atomic<bool> linked{false};
+    std::atomic<guint64> frames{0};
+    std::atomic<guint64> reconnects{0};
+};
+
+struct IngestWorker
+{
+    std::thread thread;
+    GMainContext *context = nullptr;
+    GMainLoop *loop = nullptr;
+};
+
+class RTSPIngestEngine
+{
+public:
+    RTSPIngestEngine(int n_workers, bool use_tcp, int dec_threads);
+    ~RTSPIngestEngine();
+
+    int add_stream(const std::string &uri);
+
+    void start();
+    void stop();
+
+    size_t stream_count() const { return streams_.size(); }
+    const IngestStream &stream(size_t i) const { return *streams_[i]; }
+
+private:
+    bool use_tcp_;
+    int dec_threads_;
+    std::atomic<bool> running_{false};
+
+    std::vector<std::unique_ptr<IngestWorker>> workers_;
+    std::vector<std::unique_ptr<IngestStream>> streams_;
+
+    bool create_pipeline(IngestStream *s);
+    void destroy_pipeline(IngestStream *s);
+    void schedule_reconnect(IngestStream *s);
+
+    static gboolean start_stream_cb(gpointer data);
+    static gboolean stop_stream_cb(gpointer data);
+    static gboolean reconnect_callback(gpointer data);
+
+    static void pad_added_cb(GstElement *src, GstPad *pad, gpointer user_data);
+    static GstPadProbeReturn frame_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static gboolean bus_callback(GstBus *bus, GstMessage *msg, gpointer user_data);
+};
+
+/* ---------------------------------------------------------
+ * Constructor / Destructor
+ * --------------------------------------------------------- */
+RTSPIngestEngine::RTSPIngestEngine(int n_workers, bool use_tcp, int dec_threads)
+    : use_tcp_(use_tcp), dec_threads_(dec_threads)
+{
+    if (n_workers <= 0)
+        n_workers = (int)g_get_num_processors();
+
+    for (int i = 0; i < n_workers; i++)
+    {
+        auto w = std::make_unique<IngestWorker>();
+        w->context = g_main_context_new();
+        w->loop = g_main_loop_new(w->context, FALSE);
+        workers_.push_back(std::move(w));
+    }
+}
+
+RTSPIngestEngine::~RTSPIngestEngine()
+{
+    stop();
+
+    for (auto &w : workers_)
+    {
+        g_main_loop_unref(w->loop);
+        g_main_context_unref(w->context);
+    }
+}
+
+/* 仅允许在 start() 之前添加 */
+int RTSPIngestEngine::add_stream(const std::string &uri)
+{
+    if (running_)
+    {
+        g_printerr("Cannot add stream while engine is running\n");
+        return -1;
+    }
+
+    auto s = std::make_unique<IngestStream>();
+    s->id = (int)streams_.size();
+    s->uri = uri;
+    s->engine = this;
+    // round-robin 分配到 worker
+    s->context = workers_[s->id % workers_.size()]->context;
+
+    streams_.push_back(std::move(s));
+    return (int)streams_.size() - 1;
+}
+
+/* ---------------------------------------------------------
+ * Start / Stop
+ * --------------------------------------------------------- */
+void RTSPIngestEngine::start()
+{
+    if (running_)
+        return;
+    running_ = true;
+
+    for (auto &w : workers_)
+    {
+        IngestWorker *worker = w.get();
+        worker->thread = std::thread([worker]() {
+            g_main_context_push_thread_default(worker->context);
+            g_main_loop_run(worker->loop);
+            g_main_context_pop_thread_default(worker->context);
+        });
+    }
+
+    // 在各自 worker 线程里创建 pipeline，保证同一路流的所有控制操作都在同一个线程
+    for (auto &s : streams_)
+        g_main_context_invoke(s->context, start_stream_cb, s.get());
+
+    g_print("Ingest engine started: %zu streams on %zu workers\n",
+            streams_.size(), workers_.size());
+}
+
+void RTSPIngestEngine::stop()
+{
+    if (!running_)
+        return;
+    running_ = false;
+
+    for (auto &s : streams_)
+        g_main_context_invoke(s->context, stop_stream_cb, s.get());
+
+    for (auto &w : workers_)
+    {
+        // quit 通过 context 派发，排在 stop_stream_cb 之后执行
+        g_main_context_invoke(w->context, [](gpointer loop) -> gboolean {
+            g_main_loop_quit((GMainLoop *)loop);
+            return FALSE;
+        }, w->loop);
+    }
+
+    for (auto &w : workers_)
+    {
+        if (w->thread.joinable())
+            w->thread.join();
+    }
+
+    g_print("Ingest engine stopped\n");
+}
+
+gboolean RTSPIngestEngine::start_stream_cb(gpointer data)
+{
+    IngestStream *s = reinterpret_cast<IngestStream *>(data);
+
+    if (s->engine->create_pipeline(s))
+        gst_element_set_state(s->pipeline, GST_STATE_PLAYING);
+    else
+        s->engine->schedule_reconnect(s);
+
+    return FALSE; // once only
+}
+
+gboolean RTSPIngestEngine::stop_stream_cb(gpointer data)
+{
+    IngestStream *s = reinterpret_cast<IngestStream *>(data);
+
+    if (s->reconnect_source)
+    {
+        g_source_destroy(s->reconnect_source);
+        g_source_unref(s->reconnect_source);
+        s->reconnect_source = nullptr;
+    }
+
+    s->engine->destroy_pipeline(s);
+
+    return FALSE;
+}
+
+/* ---------------------------------------------------------
+ * 创建 Pipeline
+ * rtspsrc → depay → parse → decode → fakesink
+ * --------------------------------------------------------- */
+bool RTSPIngestEngine::create_pipeline(IngestStream *s)
+{
+    gchar *name = g_strdup_printf("ingest-%d", s->id);
+    s->pipeline = gst_pipeline_new(name);
+    g_free(name);
+
+    s->src = gst_element_factory_make("rtspsrc", nullptr);
+
+    if (!s->pipeline || !s->src)
+    {
+        g_printerr("[%d] Failed to create basic GStreamer elements.\n", s->id);
+        if (s->src)
+            gst_object_unref(s->src);
+        if (s->pipeline)
+            gst_object_unref(s->pipeline);
+        s->pipeline = nullptr;
+        s->src = nullptr;
+        return false;
+    }
+
+    g_object_set(s->src,
+                 "location", s->uri.c_str(),
+                 "latency", 200,
+                 "timeout", (guint64)2 * 1000 * 1000, // 2 秒没数据就报错
+                 NULL);
+
+    if (use_tcp_)
+    {
+        g_object_set(s->src,
+                     "protocols", GST_RTSP_LOWER_TRANS_TCP,
+                     "tcp-timeout", (guint64)3 * 1000 * 1000,
+                     NULL);
+    }
+    else
+    {
+        g_object_set(s->src, "protocols", GST_RTSP_LOWER_TRANS_UDP, NULL);
+    }
+
+    s->linked = false;
+    g_signal_connect(s->src, "pad-added", G_CALLBACK(pad_added_cb), s);
+
+    gst_bin_add(GST_BIN(s->pipeline), s->src);
+
+    /* Bus 消息派发到所属 worker 的 context，而不是默认主循环 */
+    GstBus *bus = gst_element_get_bus(s->pipeline);
+    s->bus_source = gst_bus_create_watch(bus);
+    g_source_set_callback(s->bus_source, (GSourceFunc)bus_callback, s, nullptr);
+    g_source_attach(s->bus_source, s->context);
+    gst_object_unref(bus);
+
+    return true;
+}
+
+/* ---------------------------------------------------------
+ * Destroy pipeline
+ * --------------------------------------------------------- */
+void RTSPIngestEngine::destroy_pipeline(IngestStream *s)
+{
+    if (s->bus_source)
+    {
+        g_source_destroy(s->bus_source);
+        g_source_unref(s->bus_source);
+        s->bus_source = nullptr;
+    }
+
+    if (!s->pipeline)
+        return;
+
+    gst_element_set_state(s->pipeline, GST_STATE_NULL);
+    gst_object_unref(s->pipeline);
+
+    s->pipeline = nullptr;
+    s->src = nullptr;
+    s->linked = false;
+}
+
+/* ---------------------------------------------------------
+ * rtspsrc dynamic pad added (identify H264 / H265)
+ * 与 RTSPPlayer::pad_added_cb 相同的选择逻辑，sink 换成 fakesink
+ * --------------------------------------------------------- */
+void RTSPIngestEngine::pad_added_cb(GstElement *src, GstPad *pad, gpointer user_data)
+{
+    IngestStream *s = reinterpret_cast<IngestStream *>(user_data);
+    RTSPIngestEngine *self = s->engine;
+
+    if (s->linked)
+        return;
+
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps)
+        return;
+
+    GstStructure *st = gst_caps_get_structure(caps, 0);
+    const gchar *name = gst_structure_get_name(st);
+
+    if (!g_str_has_prefix(name, "application/x-rtp"))
+    {
+        gst_caps_unref(caps);
+        return;
+    }
+
+    const gchar *media = gst_structure_get_string(st, "media");
+    if (media && g_strcmp0(media, "video") != 0)
+    {
+        gst_caps_unref(caps);
+        return;
+    }
+
+    const gchar *encoding = gst_structure_get_string(st, "encoding-name");
+
+    GstElement *depay = nullptr, *parse = nullptr, *dec = nullptr;
+
+    if (g_strcmp0(encoding, "H264") == 0)
+    {
+        depay = gst_element_factory_make("rtph264depay", nullptr);
+        parse = gst_element_factory_make("h264parse", nullptr);
+        dec = DecoderSelector::instance().make(VideoCodec::H264, nullptr);
+    }
+    else if (g_strcmp0(encoding, "H265") == 0 || g_strcmp0(encoding, "HEVC") == 0)
+    {
+        depay = gst_element_factory_make("rtph265depay", nullptr);
+        parse = gst_element_factory_make("h265parse", nullptr);
+        dec = DecoderSelector::instance().make(VideoCodec::H265, nullptr);
+    }
+    else
+    {
+        g_print("[%d] Unknown encoding: %s\n", s->id, encoding ? encoding : "none");
+        gst_caps_unref(caps);
+        return;
+    }
+
+    gst_caps_unref(caps);
+
+    GstElement *sink = gst_element_factory_make("fakesink", nullptr);
+
+    if (!depay || !parse || !dec || !sink)
+    {
+        g_printerr("[%d] Failed to create some pipeline elements.\n", s->id);
+        if (depay) gst_object_unref(depay);
+        if (parse) gst_object_unref(parse);
+        if (dec) gst_object_unref(dec);
+        if (sink) gst_object_unref(sink);
+        return;
+    }
+
+    // 路数多时每路只给少量解码线程，避免 N × 核数 个线程
+    if (self->dec_threads_ > 0 && g_object_class_find_property(G_OBJECT_GET_CLASS(dec), "max-threads"))
+        g_object_set(dec, "max-threads", self->dec_threads_, NULL);
+
+    g_object_set(sink, "sync", FALSE, "async", FALSE, NULL);
+
+    gst_bin_add_many(GST_BIN(s->pipeline), depay, parse, dec, sink, NULL);
+    gst_element_link_many(depay, parse, dec, sink, NULL);
+
+    gst_element_sync_state_with_parent(depay);
+    gst_element_sync_state_with_parent(parse);
+    gst_element_sync_state_with_parent(dec);
+    gst_element_sync_state_with_parent(sink);
+
+    /* 解码后帧计数 */
+    GstPad *count_pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(count_pad, GST_PAD_PROBE_TYPE_BUFFER, frame_probe_cb, s, nullptr);
+    gst_object_unref(count_pad);
+
+    GstPad *sinkpad = gst_element_get_static_pad(depay, "sink");
+    GstPadLinkReturn ret = gst_pad_link(pad, sinkpad);
+    if (ret != GST_PAD_LINK_OK)
+        g_printerr("[%d] Failed to link pad: %d\n", s->id, ret);
+    else
+        s->linked = true;
+
+    gst_object_unref(sinkpad);
+}
+
+GstPadProbeReturn RTSPIngestEngine::frame_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    IngestStream *s = reinterpret_cast<IngestStream *>(user_data);
+    s->frames.fetch_add(1, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+/* ---------------------------------------------------------
+ * Bus callback（在 worker 线程中执行）
+ * --------------------------------------------------------- */
+gboolean RTSPIngestEngine::bus_callback(GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+    IngestStream *s = reinterpret_cast<IngestStream *>(user_data);
+
+    switch (GST_MESSAGE_TYPE(msg))
+    {
+    case GST_MESSAGE_ERROR:
+    {
+        GError *err = nullptr;
+        gchar *debug_info = nullptr;
+        gst_message_parse_error(msg, &err, &debug_info);
+        g_printerr("[%d] Error from %s: %s\n", s->id, GST_OBJECT_NAME(msg->src), err->message);
+        g_clear_error(&err);
+        g_free(debug_info);
+
+        s->engine->schedule_reconnect(s);
+        // bus_source 已在 destroy_pipeline 中销毁
+        return FALSE;
+    }
+    case GST_MESSAGE_EOS:
+        g_print("[%d] End-Of-Stream reached.\n", s->id);
+        s->engine->schedule_reconnect(s);
+        return FALSE;
+    case GST_MESSAGE_STATE_CHANGED:
+        if (GST_MESSAGE_SRC(msg) == GST_OBJECT(s->pipeline))
+        {
+            GstState old_state, new_state, pending_state;
+            gst_message_parse_state_changed(msg, &old_state, &new_state, &pending_state);
+            if (new_state == GST_STATE_PLAYING)
+                s->retry_count = 0;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return TRUE;
+}
+
+/* ---------------------------------------------------------
+ * Schedule auto reconnection（每路独立的退避状态）
+ * --------------------------------------------------------- */
+void RTSPIngestEngine::schedule_reconnect(IngestStream *s)
+{
+    if (s->reconnect_source || !running_)
+        return;
+
+    destroy_pipeline(s);
+
+    int delay = (1 << s->retry_count) * 1000;
+    if (s->retry_count < 5) s->retry_count++;
+
+    g_print("[%d] Connection lost. Reconnecting in %d ms ...\n", s->id, delay);
+
+    s->reconnect_source = g_timeout_source_new(delay);
+    g_source_set_callback(s->reconnect_source, reconnect_callback, s, nullptr);
+    g_source_attach(s->reconnect_source, s->context);
+}
+
+gboolean RTSPIngestEngine::reconnect_callback(gpointer data)
+{
+    IngestStream *s = reinterpret_cast<IngestStream *>(data);
+
+    g_source_unref(s->reconnect_source);
+    s->reconnect_source = nullptr;
+    s->reconnects++;
+
+    start_stream_cb(s);
+
+    return FALSE; // once only
+}
+
+static int run_benchmark(int n_streams, int n_workers, bool use_tcp, int dec_threads, int seconds)
+{
+    const char *service = "8554";
+    pid_t server = spawn_test_server(service, 1920, 1080, 25);
+    if (server < 0)
+    {
+        g_printerr("fork failed\n");
+        return -1;
+    }
+
+    gst_init(nullptr, nullptr);
+    g_usleep(1000 * 1000); // 等服务端就绪
+
+    long rss_before = proc_rss_kb();
+    long threads_before = proc_thread_count();
+
+    RTSPIngestEngine engine(n_workers, use_tcp, dec_threads);
+    for (int i = 0; i < n_streams; i++)
+        engine.add_stream(std::string("rtsp://127.0.0.1:") + service + "/test");
+
+    engine.start();
+
+    // 预热：等连接建立、解码器起来
+    g_usleep(5 * 1000 * 1000);
+
+    guint64 frames_begin = 0;
+    for (size_t i = 0; i < engine.stream_count(); i++)
+        frames_begin += engine.stream(i).frames.load();
+    ProcSample begin = proc_sample_now();
+
+    g_usleep((gulong)seconds * 1000 * 1000);
+
+    ProcSample end = proc_sample_now();
+    guint64 frames_end = 0;
+    int alive = 0;
+    for (size_t i = 0; i < engine.stream_count(); i++)
+    {
+        frames_end += engine.stream(i).frames.load();
+        if (engine.stream(i).linked)
+            alive++;
+    }
+
+    long rss_after = proc_rss_kb();
+    long threads_after = proc_thread_count();
+
+    double wall = (end.wall_us - begin.wall_us) / 1e6;
+    double fps = (frames_end - frames_begin) / wall;
+    double cpu = proc_cpu_percent(begin, end);
+
+    g_print("\n===== Ingest benchmark: %d x 1080p H.264, %d workers, %s =====\n",
+            n_streams, n_workers, use_tcp ? "TCP" : "UDP");
+    g_print("Streams linked     : %d / %d\n", alive, n_streams);
+    g_print("Total frames/s     : %.1f (%.2f per stream)\n", fps, fps / n_streams);
+    g_print("CPU                : %.1f%% (%.2f%% per stream, 100%% = 1 core)\n", cpu, cpu / n_streams);
+    g_print("Memory (RSS)       : %ld kB total, %.1f kB per stream\n",
+            rss_after, (double)(rss_after - rss_before) / n_streams);
+    g_print("Threads            : %ld (%.1f per stream)\n",
+            threads_after, (double)(threads_after - threads_before) / n_streams);
+    g_print("Context switches   : %ld voluntary, %ld involuntary\n",
+            end.vol_cs - begin.vol_cs, end.invol_cs - begin.invol_cs);
+
+    engine.stop();
+
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * main()
+ * --------------------------------------------------------- */
+static GMainLoop *main_loop = nullptr;
+
+static void handle_signal(int)
+{
+    if (main_loop)
+        g_main_loop_quit(main_loop);
+}
+
+struct StatsContext
+{
+    RTSPIngestEngine *engine;
+    ProcSample last;
+    guint64 last_frames;
+};
+
+static gboolean print_stats(gpointer data)
+{
+    StatsContext *ctx = reinterpret_cast<StatsContext *>(data);
+    ProcSample now = proc_sample_now();
+
+    guint64 frames = 0;
+    int alive = 0;
+    for (size_t i = 0; i < ctx->engine->stream_count(); i++)
+    {
+        frames += ctx->engine->stream(i).frames.load();
+        if (ctx->engine->stream(i).linked)
+            alive++;
+    }
+
+    double wall = (now.wall_us - ctx->last.wall_us) / 1e6;
+    g_print("[stats] linked %d/%zu, %.1f frames/s, CPU %.1f%%, RSS %ld kB, threads %ld\n",
+            alive, ctx->engine->stream_count(), (frames - ctx->last_frames) / wall,
+            proc_cpu_percent(ctx->last, now), proc_rss_kb(), proc_thread_count());
+
+    ctx->last = now;
+    ctx->last_frames = frames;
+    return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+    bool tcp = false;
+    int workers = 0;      // 0 = 核数
+    int dec_threads = 1;  // 每路解码线程
+    int bench_streams = 0;
+    int bench_seconds = 10;
+    std::vector<std::string> uris;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--tcp")
+            tcp = true;
+        else if (arg == "--workers" && i + 1 < argc)
+            workers = atoi(argv[++i]);
+        else if (arg == "--dec-threads" && i + 1 < argc)
+            dec_threads = atoi(argv[++i]);
+        else if (arg == "--bench" && i + 1 < argc)
+            bench_streams = atoi(argv[++i]);
+        else if (arg == "--seconds" && i + 1 < argc)
+            bench_seconds = atoi(argv[++i]);
+        else if (arg == "--decoder" && i + 1 < argc)
+            DecoderSelector::instance().set_forced(argv[++i]);
+        else
+            uris.push_back(arg);
+    }
+
+    if (bench_streams > 0)
+        return run_benchmark(bench_streams, workers > 0 ? workers : (int)g_get_num_processors(),
+                             tcp, dec_threads, bench_seconds);
+
+    if (uris.empty())
+    {
+        g_print("Usage: %s [--tcp] [--workers N] [--dec-threads N] [--decoder NAME] rtsp://cam1 rtsp://cam2 ...\n", argv[0]);
+        g_print("       %s --bench N [--seconds S] [--tcp] [--workers N]\n", argv[0]);
+        return 0;
+    }
+
+    gst_init(&argc, &argv);
+
+    signal(SIGINT, handle_signal);
+
+    RTSPIngestEngine engine(workers, tcp, dec_threads);
+    for (const auto &uri : uris)
+        engine.add_stream(uri);
+
+    engine.start();
+
+    main_loop = g_main_loop_new(nullptr, FALSE);
+
+    StatsContext stats{&engine, proc_sample_now(), 0};
+    g_timeout_add_seconds(5, print_stats, &stats);
+
+    g_main_loop_run(main_loop);
+
+    engine.stop();
+    g_main_loop_unref(main_loop);
+
+    return 0;
+}
+
+// g++ rtsp-multi.cc -o rtsp-multi `pkg-config --cflags --libs gstreamer-1.0 gstreamer-rtsp-1.0 gstreamer-rtsp-server-1.0 gstreamer-app-1.0`
+// ./rtsp-multi --bench 200 --tcp --seconds 20
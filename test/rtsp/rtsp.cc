@@ -2,6 +2,15 @@
 #include <gst/rtsp/gstrtsp.h>
 #include <string>
 #include <iostream>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <sys/wait.h>
+
+#include "decoder_select.h"     // 解码器自动选择 + 解码帧率统计
+#include "segment_recorder.h"   // 7x24 分段录像
+#include "rtsp_test_server.h"   // --bench-reconnect 用的本地测试源
 
 /* 外加的一个宏定义, 用于在低版本也能够通过编译情况*/
 #ifndef GST_STATE_GET_NAME
@@ -17,8 +26,12 @@
  * RTSP Player (Single Stream)
  * - 仅拉视频（忽略音频）
  * - 自动识别 H264 / H265
- * - 自动重连（指数退避）
+ * - 解码器自动选择（硬件优先，不可用时回落软件，可选微基准）
+ * - 自动重连（带抖动的指数退避，上限可配）
+ * - 快速重连：只替换 rtspsrc，depay / parse / decoder / sink 保持 PLAYING 不重建
+ * - 统计重连后的首帧时间（time-to-first-frame）
  * - 支持 TCP / UDP
+ * - 可选 7x24 分段录像：depay 之后插 tee，录像分支在压缩域按关键帧切文件，写盘在独立 I/O 线程
  */
 
 class RTSPPlayer
@@ -29,10 +42,26 @@ public:
 
     void start();
 
+    void set_fast_reconnect(bool enable) { fast_reconnect_ = enable; }
+    void set_max_backoff(guint ms) { max_backoff_ms_ = ms; }
+    void set_latency(guint ms) { latency_ms_ = ms; }
+    void set_recorder(SegmentRecorder *recorder) { recorder_ = recorder; }
+
+    void stop() { g_main_loop_quit(loop_); }
+
+    /* 给 --bench-reconnect 用：解码输出的帧数、完成的恢复次数、最近一次恢复后首帧的时刻 */
+    guint64 frames() const { return frames_.load(); }
+    int recoveries() const { return recoveries_.load(); }
+    gint64 last_first_frame_us() const { return first_frame_us_.load(); }
+
 private:
     std::string uri_;
     bool use_tcp_;
 
+    bool fast_reconnect_ = false;
+    guint max_backoff_ms_ = 32000;
+    guint latency_ms_ = 200;
+
     GstElement *pipeline_ = nullptr;
     GstElement *src_ = nullptr;
 
@@ -42,18 +71,45 @@ private:
     GMainLoop *loop_ = nullptr;
 
     GstElement *depay_ = nullptr;
+    GstElement *tee_ = nullptr;    // 录像时 depay 与 parse 之间的 tee
     GstElement *parse_ = nullptr;
     GstElement *dec_ = nullptr;
     GstElement *conv_ = nullptr;
     GstElement *sink_ = nullptr;
 
+    SegmentRecorder *recorder_ = nullptr;
+
+    DecodeFpsMeter dec_meter_;
+    guint stats_timer_ = 0;
+
+    VideoCodec codec_ = VideoCodec::Unknown; // 当前解码链对应的编码
+
+    /* 首帧时间统计 */
+    gint64 outage_us_ = 0;                 // 检测到断流的时刻
+    gint64 connect_us_ = 0;                // 新 rtspsrc 开始连接的时刻
+    std::atomic<bool> awaiting_frame_{false};
+    std::atomic<guint64> frames_{0};
+    std::atomic<gint64> first_frame_us_{0};
+    std::atomic<int> recoveries_{0};
+    double recovery_sum_ms_ = 0.0;
+    double recovery_max_ms_ = 0.0;
+
     GstElement *create_pipeline();
     void destroy_pipeline();
 
-    void schedule_reconnect();
+    gboolean create_source();
+    void detach_source();
+
+    guint next_backoff_ms();
+    void schedule_reconnect(bool full_rebuild = false);
     static gboolean reconnect_callback(gpointer data);
+    static gboolean source_eos_callback(gpointer data);
+    static gboolean rebuild_callback(gpointer data);
+    static gboolean stats_callback(gpointer data);
 
     static void pad_added_cb(GstElement *src, GstPad *pad, gpointer user_data);
+    static GstPadProbeReturn depay_event_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static GstPadProbeReturn first_frame_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
     static gboolean bus_callback(GstBus *bus, GstMessage *msg, gpointer user_data);
 };
 
@@ -71,6 +127,9 @@ RTSPPlayer::RTSPPlayer(const std::string &uri, bool use_tcp)
  * --------------------------------------------------------- */
 RTSPPlayer::~RTSPPlayer()
 {
+    if (stats_timer_)
+        g_source_remove(stats_timer_);
+
     destroy_pipeline();
 }
 
@@ -80,17 +139,33 @@ GstElement *RTSPPlayer::create_pipeline()
     // rtspsrc → depay → parse → decode → convert → autovideosink
 
     pipeline_ = gst_pipeline_new("rtsp-pipeline");
-    src_ = gst_element_factory_make("rtspsrc", "rtspsrc");
 
-    if (!pipeline_ || !src_)
+    if (!pipeline_ || !create_source())
     {
         g_printerr("Failed to create basic GStreamer elements.\n");
         return nullptr;
     }
 
+    /* 监听 Bus 消息 */
+    GstBus *bus = gst_element_get_bus(pipeline_);
+    gst_bus_add_watch(bus, bus_callback, this);
+    gst_object_unref(bus);
+
+    return pipeline_;
+}
+
+/* ---------------------------------------------------------
+ * 创建 rtspsrc 并加入 pipeline（首次建链和快速重连共用）
+ * --------------------------------------------------------- */
+gboolean RTSPPlayer::create_source()
+{
+    src_ = gst_element_factory_make("rtspsrc", nullptr);
+    if (!src_)
+        return FALSE;
+
     /* 配置 RTSP 源 */
     g_object_set(src_, "location", uri_.c_str(), NULL);
-    g_object_set(src_, "latency", 200, NULL);
+    g_object_set(src_, "latency", latency_ms_, NULL);
     // g_object_set(src_, "media-types", GST_RTSP_MEDIA_TYPE_VIDEO, NULL); // 只拉取视频流忽略音频   没有这个参数
 
     // 设置 2 秒超时（单位：微秒）2秒没数据就报错
@@ -122,12 +197,24 @@ GstElement *RTSPPlayer::create_pipeline()
     /* 将 rtspsrc 添加进 pipeline */
     gst_bin_add(GST_BIN(pipeline_), src_);
 
-    /* 监听 Bus 消息 */
-    GstBus *bus = gst_element_get_bus(pipeline_);
-    gst_bus_add_watch(bus, bus_callback, this);
-    gst_object_unref(bus);
+    return TRUE;
+}
 
-    return pipeline_;
+/* ---------------------------------------------------------
+ * 快速重连：只把旧的 rtspsrc 摘掉，下游保持 PLAYING
+ * --------------------------------------------------------- */
+void RTSPPlayer::detach_source()
+{
+    if (!src_)
+        return;
+
+    GstElement *old = src_;
+    src_ = nullptr;
+
+    // 先锁住状态，避免 pipeline 的状态变化再把它拉起来
+    gst_element_set_locked_state(old, TRUE);
+    gst_element_set_state(old, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pipeline_), old); // 同时断开与 depay 的链接
 }
 
 /* ---------------------------------------------------------
@@ -163,26 +250,43 @@ void RTSPPlayer::pad_added_cb(GstElement *src, GstPad *pad, gpointer user_data)
         return;
     }
 
+    VideoCodec codec = video_codec_from_encoding(encoding);
+
+    /* 快速重连：解码链还在，直接把新 rtspsrc 的 pad 接到原来的 depay 上 */
+    if (self->depay_ && codec != VideoCodec::Unknown)
+    {
+        gst_caps_unref(caps);
+
+        if (codec != self->codec_)
+        {
+            // 编码变了，原解码链不能复用，走完整重建
+            g_print("Codec changed after reconnect, rebuilding whole pipeline.\n");
+            g_idle_add(rebuild_callback, self);
+            return;
+        }
+
+        GstPad *sinkpad = gst_element_get_static_pad(self->depay_, "sink");
+        GstPadLinkReturn ret = gst_pad_link(pad, sinkpad);
+        if (ret != GST_PAD_LINK_OK)
+            g_printerr("Failed to relink pad: %d\n", ret);
+        gst_object_unref(sinkpad);
+
+        self->retry_count_ = 0;
+        return;
+    }
+
     /* Create RTP chain */
     if (g_strcmp0(encoding, "H264") == 0)
     {
         g_print("[Detected] H264 stream\n");
         self->depay_ = gst_element_factory_make("rtph264depay", nullptr);
         self->parse_ = gst_element_factory_make("h264parse", nullptr);
-
-        self->dec_ = gst_element_factory_make("avdec_h264", nullptr);
-        if (!self->dec_)
-            self->dec_ = gst_element_factory_make("v4l2h264dec", nullptr);
     }
     else if (g_strcmp0(encoding, "H265") == 0 || g_strcmp0(encoding, "HEVC") == 0)
     {
         g_print("[Detected] H265 stream\n");
         self->depay_ = gst_element_factory_make("rtph265depay", nullptr);
         self->parse_ = gst_element_factory_make("h265parse", nullptr);
-
-        self->dec_ = gst_element_factory_make("avdec_h265", nullptr);
-        if (!self->dec_)
-            self->dec_ = gst_element_factory_make("v4l2h265dec", nullptr);
     }
     else
     {
@@ -193,6 +297,12 @@ void RTSPPlayer::pad_added_cb(GstElement *src, GstPad *pad, gpointer user_data)
 
     gst_caps_unref(caps);  // ← 统一释放
 
+    /* 按排序表选择解码器（硬件优先，结果缓存，重连时不再重新扫描） */
+    DecoderCandidate dec_info;
+    self->dec_ = DecoderSelector::instance().make(codec, nullptr, &dec_info);
+    if (self->dec_)
+        g_print("[Decoder] %s (%s)\n", dec_info.factory.c_str(), dec_info.hardware ? "hardware" : "software");
+
     /* Create remaining elements */
     self->conv_ = gst_element_factory_make("videoconvert", nullptr);
     self->sink_ = gst_element_factory_make("autovideosink", nullptr);
@@ -215,11 +325,38 @@ void RTSPPlayer::pad_added_cb(GstElement *src, GstPad *pad, gpointer user_data)
     gst_element_sync_state_with_parent(self->conv_);
     gst_element_sync_state_with_parent(self->sink_);
 
-    gst_element_link_many(
-        self->depay_, self->parse_, self->dec_, self->conv_, self->sink_, NULL);
+    /* 录像：depay → tee → parse → ...，tee 的另一路是录像分支（自带 parser 和 leaky queue） */
+    if (self->recorder_)
+    {
+        self->tee_ = gst_element_factory_make("tee", nullptr);
+        gst_bin_add(GST_BIN(self->pipeline_), self->tee_);
+        gst_element_sync_state_with_parent(self->tee_);
+
+        gst_element_link_many(self->depay_, self->tee_, self->parse_, NULL);
+        self->recorder_->attach(GST_BIN(self->pipeline_), self->tee_, codec);
+    }
+    else
+    {
+        gst_element_link(self->depay_, self->parse_);
+    }
+
+    gst_element_link_many(self->parse_, self->dec_, self->conv_, self->sink_, NULL);
+
+    self->dec_meter_.attach(self->dec_, dec_info);
+    self->codec_ = codec;
+
+    /* 首帧时间：解码器输出的第一帧 */
+    GstPad *decpad = gst_element_get_static_pad(self->dec_, "src");
+    gst_pad_add_probe(decpad, GST_PAD_PROBE_TYPE_BUFFER, first_frame_probe_cb, self, nullptr);
+    gst_object_unref(decpad);
 
     /* Now link dynamic pad */
     GstPad *sinkpad = gst_element_get_static_pad(self->depay_, "sink");
+
+    // 快速重连模式下吞掉 rtspsrc 的 EOS，下游 sink 不进入 EOS 状态，换源后可以直接继续
+    if (self->fast_reconnect_)
+        gst_pad_add_probe(sinkpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, depay_event_probe_cb, self, nullptr);
+
     GstPadLinkReturn ret = gst_pad_link(pad, sinkpad);
     if (ret != GST_PAD_LINK_OK)
         g_printerr("Failed to link pad: %d\n", ret);
@@ -253,6 +390,23 @@ gboolean RTSPPlayer::bus_callback(GstBus *bus, GstMessage *msg, gpointer user_da
         g_clear_error(&err);
         g_free(debug_info);
 
+        if (self->fast_reconnect_)
+        {
+            if (self->src_ && (GST_MESSAGE_SRC(msg) == GST_OBJECT(self->src_) ||
+                               gst_object_has_as_ancestor(GST_MESSAGE_SRC(msg), GST_OBJECT(self->src_))))
+            {
+                // rtspsrc 出错：只换源
+                self->schedule_reconnect();
+            }
+            else if (self->pipeline_ && gst_object_has_as_ancestor(GST_MESSAGE_SRC(msg), GST_OBJECT(self->pipeline_)))
+            {
+                // 下游元素出错：解码链不可信，完整重建
+                self->schedule_reconnect(true);
+            }
+            // 否则是已经摘掉的旧 rtspsrc 迟到的消息，忽略
+            break;
+        }
+
         // start reconnect timer
         self->schedule_reconnect();
 
@@ -261,7 +415,8 @@ gboolean RTSPPlayer::bus_callback(GstBus *bus, GstMessage *msg, gpointer user_da
         g_print("End-Of-Stream reached.\n");
 
         // start reconnect timer
-        self->schedule_reconnect();
+        // 能走到 bus 的 EOS 说明 sink 已经 EOS，快速重连模式也只能完整重建
+        self->schedule_reconnect(self->fast_reconnect_);
 
         break;
     case GST_MESSAGE_STATE_CHANGED:
@@ -275,6 +430,10 @@ gboolean RTSPPlayer::bus_callback(GstBus *bus, GstMessage *msg, gpointer user_da
                     gst_state_get_name(old_state), gst_state_get_name(new_state));
         }
 
+        break;
+    case GST_MESSAGE_LATENCY:
+        // 换源后新的 jitterbuffer 会重新上报延迟
+        gst_bin_recalculate_latency(GST_BIN(self->pipeline_));
         break;
     case GST_MESSAGE_BUFFERING:
     {
@@ -334,27 +493,60 @@ void RTSPPlayer::destroy_pipeline()
     if (!pipeline_)
         return;
 
+    // 先让当前分段写完索引，否则置 NULL 后最后一个文件不完整
+    if (recorder_ && tee_)
+        recorder_->finish();
+
     gst_element_set_state(pipeline_, GST_STATE_NULL);
 
     gst_object_unref(pipeline_);
     pipeline_ = nullptr;
+
+    // 元素归 pipeline 所有，随 pipeline 一起释放
+    src_ = nullptr;
+    depay_ = tee_ = parse_ = dec_ = conv_ = sink_ = nullptr;
+}
+
+/* ---------------------------------------------------------
+ * Jittered exponential backoff
+ * 退避窗口每次翻倍，上限 max_backoff_ms_；实际延时在 [窗口/2, 窗口] 之间随机，
+ * 避免多路摄像头 / 多个客户端在服务端恢复的瞬间同时涌上去
+ * --------------------------------------------------------- */
+guint RTSPPlayer::next_backoff_ms()
+{
+    // 快速重连第一次只等 100 ms，完整重建沿用原来的 1 s 起步
+    guint base = fast_reconnect_ ? 100 : 1000;
+    guint window = std::min<guint64>((guint64)base << std::min(retry_count_, 16), max_backoff_ms_);
+
+    if (retry_count_ < 16 && ((guint64)base << retry_count_) < max_backoff_ms_)
+        retry_count_++;
+
+    return window / 2 + g_random_int_range(0, window / 2 + 1);
 }
 
 /* ---------------------------------------------------------
  * Schedule auto reconnection
  * --------------------------------------------------------- */
-void RTSPPlayer::schedule_reconnect()
+void RTSPPlayer::schedule_reconnect(bool full_rebuild)
 {
     if (reconnect_timer_)
         return;
 
-    destroy_pipeline();
+    // 只在第一次断流时记时间，连续失败的重试都算在同一次恢复里
+    if (!awaiting_frame_.load())
+        outage_us_ = g_get_monotonic_time();
+    awaiting_frame_ = false;
+
+    bool fast = fast_reconnect_ && !full_rebuild && pipeline_ && depay_;
+    if (fast)
+        detach_source();
+    else
+        destroy_pipeline();
 
-    int delay = (1 << retry_count_) * 1000;
-    if (retry_count_ < 5) retry_count_++;    // 控制延时，最多加5次
+    guint delay = next_backoff_ms();
 
     // std::cout << "Connection lost. Reconnecting in " << delay << " ms ..." << std::endl;
-    g_print("Connection lost. Reconnecting in %d ms ...\n", delay);
+    g_print("Connection lost. Reconnecting in %u ms (%s) ...\n", delay, fast ? "swap rtspsrc" : "full rebuild");
 
     reconnect_timer_ = g_timeout_add(delay, reconnect_callback, this);
 }
@@ -370,12 +562,95 @@ gboolean RTSPPlayer::reconnect_callback(gpointer data)
     // std::cout << "Reconnecting now..." << std::endl;
     g_print("Reconnecting now...\n");
 
+    self->connect_us_ = g_get_monotonic_time();
+    self->awaiting_frame_ = true;
+
+    if (self->pipeline_)
+    {
+        // 快速重连：解码链还在 PLAYING，新 rtspsrc 跟随父状态启动即可
+        if (!self->create_source() || !gst_element_sync_state_with_parent(self->src_))
+            self->schedule_reconnect(true);
+        return FALSE;
+    }
+
     self->pipeline_ = self->create_pipeline();
     gst_element_set_state(self->pipeline_, GST_STATE_PLAYING);
 
     return FALSE; // once only
 }
 
+/* rtspsrc 发出 EOS（在 depay 的 probe 里被吞掉）后切回主线程换源 */
+gboolean RTSPPlayer::source_eos_callback(gpointer data)
+{
+    RTSPPlayer *self = reinterpret_cast<RTSPPlayer *>(data);
+    if (self->src_)
+        self->schedule_reconnect();
+    return FALSE;
+}
+
+gboolean RTSPPlayer::rebuild_callback(gpointer data)
+{
+    RTSPPlayer *self = reinterpret_cast<RTSPPlayer *>(data);
+    self->schedule_reconnect(true);
+    return FALSE;
+}
+
+/* ---------------------------------------------------------
+ * depay sink pad probe：吞掉 rtspsrc 的 EOS，改为触发换源
+ * --------------------------------------------------------- */
+GstPadProbeReturn RTSPPlayer::depay_event_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    RTSPPlayer *self = reinterpret_cast<RTSPPlayer *>(user_data);
+
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) != GST_EVENT_EOS)
+        return GST_PAD_PROBE_OK;
+
+    g_print("End-Of-Stream from rtspsrc, swapping source.\n");
+    g_idle_add(source_eos_callback, self);
+    return GST_PAD_PROBE_DROP;
+}
+
+/* ---------------------------------------------------------
+ * 解码器 src pad probe：重连后的第一帧
+ * --------------------------------------------------------- */
+GstPadProbeReturn RTSPPlayer::first_frame_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    RTSPPlayer *self = reinterpret_cast<RTSPPlayer *>(user_data);
+    self->frames_.fetch_add(1, std::memory_order_relaxed);
+
+    bool expected = true;
+    if (!self->awaiting_frame_.compare_exchange_strong(expected, false))
+        return GST_PAD_PROBE_OK;
+
+    gint64 now = g_get_monotonic_time();
+    double recovery_ms = (now - self->outage_us_) / 1000.0;
+    double connect_ms = (now - self->connect_us_) / 1000.0;
+
+    self->recovery_sum_ms_ += recovery_ms;
+    self->recovery_max_ms_ = std::max(self->recovery_max_ms_, recovery_ms);
+    self->first_frame_us_.store(now);
+    int recoveries = self->recoveries_.fetch_add(1) + 1;
+
+    g_print("[Reconnect] first frame %.0f ms after outage (%.0f ms after connect), "
+            "recoveries %d, avg %.0f ms, max %.0f ms\n",
+            recovery_ms, connect_ms, recoveries,
+            self->recovery_sum_ms_ / recoveries, self->recovery_max_ms_);
+
+    return GST_PAD_PROBE_OK;
+}
+
+/* ---------------------------------------------------------
+ * Periodic decode fps report
+ * --------------------------------------------------------- */
+gboolean RTSPPlayer::stats_callback(gpointer data)
+{
+    RTSPPlayer *self = reinterpret_cast<RTSPPlayer *>(data);
+    self->dec_meter_.report();
+    if (self->recorder_)
+        self->recorder_->report("rtsp");
+    return TRUE;
+}
+
 /* ---------------------------------------------------------
  * Start playing
  * --------------------------------------------------------- */
@@ -389,9 +664,183 @@ void RTSPPlayer::start()
     // std::cout << "Start playing RTSP: " << uri_ << std::endl;
     g_print("Start playing RTSP: %s\n", uri_.c_str());
 
+    stats_timer_ = g_timeout_add_seconds(5, stats_callback, this);
+
     g_main_loop_run(loop_);
 }
 
+/* ---------------------------------------------------------
+ * 重连 benchmark：本地测试 RTSP 服务端反复 kill -9 / 重启，统计每次恢复的首帧时间
+ * - 服务端是本程序的子进程（/proc/self/exe --test-server PORT）：
+ *   拉流端已经有 GStreamer 线程在跑，fork 后不 exec 直接用 GLib 可能死锁
+ * - 每轮：收到首帧 → 保持 hold_ms → SIGKILL → 停 down_ms → 重启
+ * - TTFF = 重启服务端到解码出第一帧（目标 500 ms）；另外给出从 kill 算起的总中断时间
+ * --------------------------------------------------------- */
+static pid_t exec_test_server(const std::string &port)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        execl("/proc/self/exe", "rtsp", "--test-server", port.c_str(), (char *)nullptr);
+        _exit(127);
+    }
+    if (pid < 0)
+        g_printerr("fork failed\n");
+    return pid;
+}
+
+class ReconnectBench
+{
+public:
+    ReconnectBench(RTSPPlayer &player, const std::string &port, int cycles, guint hold_ms, guint down_ms)
+        : player_(player), port_(port), cycles_(cycles), hold_ms_(hold_ms), down_ms_(down_ms)
+    {
+    }
+
+    ~ReconnectBench()
+    {
+        if (timer_)
+            g_source_remove(timer_);
+        stop_server();
+    }
+
+    void start()
+    {
+        server_ = exec_test_server(port_);
+        restart_us_ = g_get_monotonic_time();
+        timer_ = g_timeout_add(10, tick_cb, this);
+    }
+
+    void print_summary() const
+    {
+        g_print("\n===== Reconnect benchmark: %d restarts, hold %u ms, server down %u ms =====\n",
+                (int)ttff_ms_.size() + failures_, hold_ms_, down_ms_);
+        if (ttff_ms_.empty())
+        {
+            g_print("no recovery measured (failures %d)\n", failures_);
+            return;
+        }
+
+        double ttff_sum = 0.0, ttff_max = 0.0, outage_sum = 0.0, outage_max = 0.0;
+        for (size_t i = 0; i < ttff_ms_.size(); i++)
+        {
+            ttff_sum += ttff_ms_[i];
+            ttff_max = std::max(ttff_max, ttff_ms_[i]);
+            outage_sum += outage_ms_[i];
+            outage_max = std::max(outage_max, outage_ms_[i]);
+        }
+        size_t n = ttff_ms_.size();
+        g_print("TTFF after restart: avg %.0f ms, max %.0f ms  (target %d ms: %s)\n", ttff_sum / n, ttff_max,
+                TARGET_MS, failures_ == 0 && ttff_max <= TARGET_MS ? "PASS" : "FAIL");
+        g_print("outage from kill:   avg %.0f ms, max %.0f ms\n", outage_sum / n, outage_max);
+        g_print("failures (no frame within %d s): %d\n", TIMEOUT_MS / 1000, failures_);
+    }
+
+private:
+    static constexpr int TARGET_MS = 500;
+    static constexpr int TIMEOUT_MS = 10000;
+
+    enum class State { WaitFrame, Hold, Down };
+
+    void stop_server()
+    {
+        if (server_ <= 0)
+            return;
+        kill(server_, SIGKILL);
+        waitpid(server_, nullptr, 0);
+        server_ = -1;
+    }
+
+    static gboolean tick_cb(gpointer data)
+    {
+        return static_cast<ReconnectBench *>(data)->tick();
+    }
+
+    gboolean tick()
+    {
+        gint64 now = g_get_monotonic_time();
+
+        switch (state_)
+        {
+        case State::WaitFrame:
+        {
+            bool up = cycle_ == 0 ? player_.frames() > 0 : player_.recoveries() > recoveries_at_kill_;
+            if (up)
+            {
+                if (cycle_ > 0)
+                {
+                    gint64 frame_us = player_.last_first_frame_us();
+                    ttff_ms_.push_back((frame_us - restart_us_) / 1000.0);
+                    outage_ms_.push_back((frame_us - kill_us_) / 1000.0);
+                    g_print("[bench] restart %d/%d: first frame %.0f ms after server restart (%.0f ms after kill)\n",
+                            cycle_, cycles_, ttff_ms_.back(), outage_ms_.back());
+                }
+            }
+            else if (now - restart_us_ > (gint64)TIMEOUT_MS * 1000)
+            {
+                failures_++;
+                g_printerr("[bench] restart %d/%d: no frame within %d s\n", cycle_, cycles_, TIMEOUT_MS / 1000);
+                if (cycle_ == 0)
+                {
+                    player_.stop(); // 首次就连不上，服务端或拉流参数有问题
+                    timer_ = 0;
+                    return FALSE;
+                }
+            }
+            else
+                break;
+
+            if (cycle_ >= cycles_)
+            {
+                player_.stop();
+                timer_ = 0;
+                return FALSE;
+            }
+            state_ = State::Hold;
+            deadline_us_ = now + (gint64)hold_ms_ * 1000;
+            break;
+        }
+        case State::Hold:
+            if (now < deadline_us_)
+                break;
+            recoveries_at_kill_ = player_.recoveries();
+            stop_server();
+            kill_us_ = g_get_monotonic_time();
+            cycle_++;
+            state_ = State::Down;
+            deadline_us_ = kill_us_ + (gint64)down_ms_ * 1000;
+            break;
+        case State::Down:
+            if (now < deadline_us_)
+                break;
+            server_ = exec_test_server(port_);
+            restart_us_ = g_get_monotonic_time();
+            state_ = State::WaitFrame;
+            break;
+        }
+        return TRUE;
+    }
+
+    RTSPPlayer &player_;
+    std::string port_;
+    int cycles_;
+    guint hold_ms_;
+    guint down_ms_;
+
+    pid_t server_ = -1;
+    guint timer_ = 0;
+    State state_ = State::WaitFrame;
+    int cycle_ = 0;
+    int recoveries_at_kill_ = 0;
+    int failures_ = 0;
+    gint64 deadline_us_ = 0;
+    gint64 kill_us_ = 0;
+    gint64 restart_us_ = 0;
+    std::vector<double> ttff_ms_;
+    std::vector<double> outage_ms_;
+};
+
 /* ---------------------------------------------------------
  * main()
  * --------------------------------------------------------- */
@@ -400,22 +849,132 @@ int main(int argc, char *argv[])
     if (argc < 2)
     {
         // printf("Usage: %s rtsp://xxx.xxx.xxx.xxx [--tcp]\n", argv[0]);
-        g_print("Usage: %s rtsp://xxx.xxx.xxx.xxx [--tcp]\n", argv[0]);
+        g_print("Usage: %s rtsp://xxx.xxx.xxx.xxx [--tcp] [--decoder NAME] [--bench-decoders]\n"
+                "          [--fast-reconnect] [--max-backoff MS] [--latency MS]\n"
+                "          [--record DIR [--segment S] [--mp4] [--no-direct-io]]\n", argv[0]);
+        g_print("       %s --list-decoders [--bench-decoders]\n", argv[0]);
+        g_print("       %s --bench-reconnect N [--fast-reconnect] [--port P] [--hold MS] [--down MS]\n", argv[0]);
         return 0;
     }
 
-    std::string uri = argv[1];
-    // bool tcp = false;
+    std::string uri;
+    bool tcp = false;
+    bool list_decoders = false;
+    bool bench_decoders = false;
+    std::string forced_decoder;
+    bool fast_reconnect = false;
+    guint max_backoff_ms = 32000;
+    guint latency_ms = 200;
+    bool record = false;
+    SegmentRecorder::Options record_options;
+    int bench_reconnect = 0;
+    std::string bench_port = "8556";
+    guint bench_hold_ms = 2000;
+    guint bench_down_ms = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--tcp")
+            tcp = true;
+        else if (arg == "--decoder" && i + 1 < argc)
+            forced_decoder = argv[++i];
+        else if (arg == "--bench-decoders")
+            bench_decoders = true;
+        else if (arg == "--list-decoders")
+            list_decoders = true;
+        else if (arg == "--fast-reconnect")
+            fast_reconnect = true;
+        else if (arg == "--max-backoff" && i + 1 < argc)
+            max_backoff_ms = atoi(argv[++i]);
+        else if (arg == "--latency" && i + 1 < argc)
+            latency_ms = atoi(argv[++i]);
+        else if (arg == "--record" && i + 1 < argc)
+        {
+            record = true;
+            record_options.dir = argv[++i];
+        }
+        else if (arg == "--segment" && i + 1 < argc)
+            record_options.segment_seconds = atoi(argv[++i]);
+        else if (arg == "--mp4")
+            record_options.container = "mp4";
+        else if (arg == "--no-direct-io")
+            record_options.direct_io = false;
+        else if (arg == "--test-server" && i + 1 < argc)
+        {
+            // --bench-reconnect 拉起的子进程
+            run_test_server(argv[i + 1], 1280, 720, 25);
+            return 0;
+        }
+        else if (arg == "--bench-reconnect" && i + 1 < argc)
+            bench_reconnect = std::max(1, atoi(argv[++i]));
+        else if (arg == "--port" && i + 1 < argc)
+            bench_port = argv[++i];
+        else if (arg == "--hold" && i + 1 < argc)
+            bench_hold_ms = atoi(argv[++i]); // 每轮恢复后稳定播放多久再 kill
+        else if (arg == "--down" && i + 1 < argc)
+            bench_down_ms = atoi(argv[++i]); // kill 之后隔多久重启服务端
+        else
+            uri = arg;
+    }
+
+    if (bench_reconnect > 0)
+    {
+        // 服务端被 kill 时 TCP 连接立即断开；UDP 要等 rtspsrc 的 2 s 超时，测不出重连本身
+        uri = "rtsp://127.0.0.1:" + bench_port + "/test";
+        tcp = true;
+    }
 
-    // if (argc >= 3 && std::string(argv[2]) == "--tcp")
-    //     tcp = true;
+    gst_init(&argc, &argv);
 
-    bool tcp = (argc >= 3 && std::string(argv[2]) == "--tcp");
+    DecoderSelector &selector = DecoderSelector::instance();
+    selector.set_forced(forced_decoder);
+    selector.set_benchmark(bench_decoders);
+
+    /* 只列出本机的解码器排序表（可带微基准），不拉流 */
+    if (list_decoders)
+    {
+        const VideoCodec codecs[] = {VideoCodec::H264, VideoCodec::H265, VideoCodec::VP8, VideoCodec::VP9};
+        for (VideoCodec codec : codecs)
+        {
+            if (bench_decoders)
+                selector.benchmark(codec);
+            selector.print_table(codec);
+        }
+        return 0;
+    }
+
+    // 写线程跨重连保留，要比 player 活得久
+    std::unique_ptr<SegmentRecorder> recorder;
+    if (record)
+        recorder.reset(new SegmentRecorder(record_options));
 
     RTSPPlayer player(uri, tcp);
+    player.set_fast_reconnect(fast_reconnect);
+    player.set_max_backoff(max_backoff_ms);
+    player.set_latency(latency_ms);
+    player.set_recorder(recorder.get());
+
+    std::unique_ptr<ReconnectBench> bench;
+    if (bench_reconnect > 0)
+    {
+        bench.reset(new ReconnectBench(player, bench_port, bench_reconnect, bench_hold_ms, bench_down_ms));
+        bench->start();
+        g_usleep(300 * 1000); // 等服务端开始监听，首次连接失败也会按退避重试
+    }
+
     player.start();
 
+    if (bench)
+        bench->print_summary();
+
     return 0;
 }
 
-// g++ rtsp.cc -o rtsp `pkg-config --cflags --libs gstreamer-1.0 gstreamer-rtsp-1.0`
+// g++ rtsp.cc -o rtsp `pkg-config --cflags --libs gstreamer-1.0 gstreamer-rtsp-1.0 gstreamer-rtsp-server-1.0 gstreamer-app-1.0`
+// ./rtsp --list-decoders --bench-decoders
+// ./rtsp rtsp://127.0.0.1:8554/test --tcp --fast-reconnect --max-backoff 2000 --latency 100
+// ./rtsp rtsp://127.0.0.1:8554/test --record /data/rec --segment 60
+//   （本地起一个测试 RTSP 服务端，循环 kill / 重启，看 [Reconnect] 行的恢复时间）
+// ./rtsp --bench-reconnect 20 --fast-reconnect --max-backoff 500 --latency 0
+//   （自动完成上面的流程：子进程服务端 kill -9 / 重启 20 次，打印 TTFF 平均 / 最大值和 500 ms 目标对比）
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <gst/rtsp-server/rtsp-server.h>
+#include <sys/prctl.h>
+#include <signal.h>
+#include <unistd.h>
+
+/* ---------------------------------------------------------
+ * Benchmark: 本地 RTSP 测试源 rtsp://127.0.0.1:<service>/test
+ * 在子进程里跑 gst-rtsp-server（共享同一路编码），父进程的 CPU / 内存统计只包含拉流端
+ * --------------------------------------------------------- */
+/* 在当前进程里跑服务端，阻塞直到进程退出 */
+static inline void run_test_server(const char *service, int width, int height, int fps)
+{
+    gst_init(nullptr, nullptr);
+
+    GMainLoop *loop = g_main_loop_new(nullptr, FALSE);
+    GstRTSPServer *server = gst_rtsp_server_new();
+    gst_rtsp_server_set_service(server, service);
+
+    GstRTSPMountPoints *mounts = gst_rtsp_server_get_mount_points(server);
+    GstRTSPMediaFactory *factory = gst_rtsp_media_factory_new();
+
+    gchar *launch = g_strdup_printf(
+        "( videotestsrc is-live=true pattern=ball ! "
+        "video/x-raw,width=%d,height=%d,framerate=%d/1 ! "
+        "x264enc tune=zerolatency speed-preset=ultrafast key-int-max=%d bitrate=4000 ! "
+        "rtph264pay name=pay0 pt=96 config-interval=-1 )",
+        width, height, fps, fps * 2);
+    gst_rtsp_media_factory_set_launch(factory, launch);
+    g_free(launch);
+
+    // 所有客户端共享同一个 media，服务端只编码一次
+    gst_rtsp_media_factory_set_shared(factory, TRUE);
+
+    gst_rtsp_mount_points_add_factory(mounts, "/test", factory);
+    g_object_unref(mounts);
+
+    gst_rtsp_server_attach(server, nullptr);
+    g_main_loop_run(loop);
+}
+
+static inline pid_t spawn_test_server(const char *service, int width, int height, int fps)
+{
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+
+    // 父进程退出时子进程跟着退出
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+    run_test_server(service, width, height, fps);
+    _exit(0);
+}
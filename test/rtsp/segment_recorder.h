@@ -0,0 +1,577 @@
+#pragma once
+
+/*
+ * 7x24 分段录像（压缩域，关键帧处切分，异步大块写盘）
+ *
+ *   tee → queue(leaky) → parse → splitmuxsink(muxer = mp4mux / matroskamux, sink = fakesink)
+ *                                                                     │ sink pad probe
+ *                                                                     ▼
+ *                                   SegmentWriter：命令队列 → 专用 I/O 线程 → 1 MiB 对齐块 pwrite
+ *
+ * - splitmuxsink 按 max-size-time 在关键帧处切文件；文件名由 format-location 回调给出，
+ *   sink 换成 fakesink，muxer 输出的字节流（含 muxer 回写文件头时的 BYTES segment）在 fakesink 的
+ *   sink pad 上截下来，按顺序变成 open / write / seek / close 命令交给 I/O 线程；
+ *   fakesink 上的 BYTES SEEKING 查询由 probe 回答 seekable，muxer 才会写索引 / duration 并回写文件头
+ * - I/O 线程把数据攒成 block_bytes 的对齐块，用 O_DIRECT 写盘，不占 page cache，
+ *   也不会在 dirty page 回写时突然卡住；文件系统不支持 O_DIRECT（tmpfs 等）时退回普通写，块大小不变。
+ *   muxer 收尾时回写文件头（seek）或文件尾不足一块时，关掉 O_DIRECT 用普通 pwrite
+ * - 背压隔离：命令队列超过 max_queue_bytes 时写入方阻塞，只阻塞 splitmuxsink 的线程，
+ *   数据堆在分支入口的 leaky queue 里，满了丢压缩帧（计数），tee 和解码 / 显示分支不受影响
+ * - 每路统计：写盘带宽、单次写延迟（平均 / 最大）、队列峰值、写入方被阻塞的时间、丢帧、分段数
+ */
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "decoder_select.h" // VideoCodec
+
+/* ---------------------------------------------------------
+ * SegmentWriter：一路摄像头一个 I/O 线程
+ * --------------------------------------------------------- */
+class SegmentWriter
+{
+public:
+    struct Stats
+    {
+        std::atomic<guint64> bytes_written{0};
+        std::atomic<guint64> writes{0};
+        std::atomic<guint64> write_ns{0};       // 所有 pwrite 的耗时之和
+        std::atomic<guint64> write_ns_max{0};   // 周期内最大，report 时清零
+        std::atomic<guint64> queued_bytes{0};
+        std::atomic<guint64> queued_peak{0};
+        std::atomic<guint64> blocked_ns{0};     // 写入方因队列满被阻塞的时间
+        std::atomic<guint64> segments{0};
+        std::atomic<guint64> errors{0};
+        std::atomic<bool> direct{false};        // 当前文件是否用 O_DIRECT
+    };
+
+    SegmentWriter(size_t block_bytes, size_t max_queue_bytes, bool direct_io)
+        : block_bytes_(block_bytes), max_queue_bytes_(max_queue_bytes), direct_io_(direct_io)
+    {
+        if (posix_memalign(&block_, 4096, block_bytes_) != 0)
+            block_ = nullptr;
+        thread_ = std::thread(&SegmentWriter::run, this);
+    }
+
+    ~SegmentWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            commands_.push_back({Command::Close, std::string(), nullptr, 0});
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+        free(block_);
+    }
+
+    const Stats &stats() const { return stats_; }
+    void reset_write_max() { stats_.write_ns_max = 0; }
+
+    void open(const std::string &path) { enqueue({Command::Open, path, nullptr, 0}); }
+    void seek(guint64 offset) { enqueue({Command::Seek, std::string(), nullptr, offset}); }
+    void close() { enqueue({Command::Close, std::string(), nullptr, 0}); }
+
+    /* 持有 buffer 引用直到写完；队列满时阻塞调用线程 */
+    void write(GstBuffer *buffer)
+    {
+        gsize size = gst_buffer_get_size(buffer);
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (queued_ + size > max_queue_bytes_ && queued_ > 0)
+        {
+            gint64 start = g_get_monotonic_time();
+            space_.wait(lock, [&] { return stopping_ || queued_ + size <= max_queue_bytes_ || queued_ == 0; });
+            stats_.blocked_ns.fetch_add((g_get_monotonic_time() - start) * 1000, std::memory_order_relaxed);
+        }
+
+        queued_ += size;
+        stats_.queued_bytes = queued_;
+        if (queued_ > stats_.queued_peak.load())
+            stats_.queued_peak = queued_;
+
+        commands_.push_back({Command::Write, std::string(), gst_buffer_ref(buffer), 0});
+        lock.unlock();
+        cond_.notify_one();
+    }
+
+    /* 等队列清空（文件都关掉），超时返回 false */
+    bool drain(guint timeout_ms)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return idle_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                              [&] { return commands_.empty() && !busy_; });
+    }
+
+private:
+    struct Command
+    {
+        enum Kind
+        {
+            Open,
+            Write,
+            Seek,
+            Close
+        } kind;
+        std::string path;
+        GstBuffer *buffer;
+        guint64 offset;
+    };
+
+    size_t block_bytes_;
+    size_t max_queue_bytes_;
+    bool direct_io_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;   // 有新命令
+    std::condition_variable space_;  // 队列有空间
+    std::condition_variable idle_;   // 队列清空
+    std::deque<Command> commands_;
+    size_t queued_ = 0;
+    bool busy_ = false;
+    bool stopping_ = false;
+    std::thread thread_;
+
+    Stats stats_;
+
+    /* 以下只在 I/O 线程访问 */
+    int fd_ = -1;
+    void *block_ = nullptr;
+    size_t fill_ = 0;           // block_ 中待写的字节
+    guint64 block_pos_ = 0;     // block_ 在文件中的偏移（按块对齐）
+    bool tail_mode_ = false;    // 回写 / 收尾阶段：普通 pwrite，不再攒块
+    guint64 pos_ = 0;           // tail_mode_ 下的写位置
+    std::string path_;
+
+    void enqueue(Command command)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            commands_.push_back(std::move(command));
+        }
+        cond_.notify_one();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            cond_.wait(lock, [&] { return stopping_ || !commands_.empty(); });
+            if (commands_.empty())
+                break;
+
+            Command command = std::move(commands_.front());
+            commands_.pop_front();
+            busy_ = true;
+            lock.unlock();
+
+            execute(command);
+
+            lock.lock();
+            busy_ = false;
+            if (command.kind == Command::Write)
+            {
+                queued_ -= gst_buffer_get_size(command.buffer);
+                stats_.queued_bytes = queued_;
+                space_.notify_all();
+            }
+            if (command.buffer)
+                gst_buffer_unref(command.buffer);
+            if (commands_.empty())
+                idle_.notify_all();
+        }
+    }
+
+    void execute(const Command &command)
+    {
+        switch (command.kind)
+        {
+        case Command::Open:
+            do_close();
+            do_open(command.path);
+            break;
+        case Command::Write:
+        {
+            GstMapInfo map;
+            if (fd_ >= 0 && gst_buffer_map(command.buffer, &map, GST_MAP_READ))
+            {
+                do_write(map.data, map.size);
+                gst_buffer_unmap(command.buffer, &map);
+            }
+            break;
+        }
+        case Command::Seek:
+            // 每个文件开头的 segment（offset 0）不算回写，只有真正往回跳才切到普通写
+            if (fd_ >= 0 && command.offset != position())
+            {
+                enter_tail_mode();
+                pos_ = command.offset;
+            }
+            break;
+        case Command::Close:
+            do_close();
+            break;
+        }
+    }
+
+    void do_open(const std::string &path)
+    {
+        path_ = path;
+        fd_ = -1;
+        if (direct_io_ && block_)
+            fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        stats_.direct = fd_ >= 0;
+        if (fd_ < 0)
+            fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0)
+        {
+            g_printerr("[record] Failed to open %s: %s\n", path.c_str(), g_strerror(errno));
+            stats_.errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        fill_ = 0;
+        block_pos_ = 0;
+        tail_mode_ = !block_;
+        pos_ = 0;
+    }
+
+    void do_close()
+    {
+        if (fd_ < 0)
+            return;
+
+        enter_tail_mode();
+        ::close(fd_);
+        fd_ = -1;
+        stats_.segments.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void do_write(const guint8 *data, size_t size)
+    {
+        if (tail_mode_)
+        {
+            timed_pwrite(data, size, pos_);
+            pos_ += size;
+            return;
+        }
+
+        while (size > 0)
+        {
+            size_t n = std::min(size, block_bytes_ - fill_);
+            memcpy((guint8 *)block_ + fill_, data, n);
+            fill_ += n;
+            data += n;
+            size -= n;
+
+            if (fill_ == block_bytes_)
+            {
+                timed_pwrite(block_, block_bytes_, block_pos_);
+                block_pos_ += block_bytes_;
+                fill_ = 0;
+            }
+        }
+    }
+
+    guint64 position() const
+    {
+        return tail_mode_ ? pos_ : block_pos_ + fill_;
+    }
+
+    /* 写出不足一块的尾巴，之后都用普通写（O_DIRECT 要求长度和偏移对齐） */
+    void enter_tail_mode()
+    {
+        if (tail_mode_)
+            return;
+
+        if (stats_.direct)
+        {
+            int flags = fcntl(fd_, F_GETFL);
+            fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+        }
+        if (fill_ > 0)
+            timed_pwrite(block_, fill_, block_pos_);
+
+        pos_ = block_pos_ + fill_;
+        fill_ = 0;
+        tail_mode_ = true;
+    }
+
+    void timed_pwrite(const void *data, size_t size, guint64 offset)
+    {
+        gint64 start = g_get_monotonic_time();
+        const guint8 *p = (const guint8 *)data;
+        size_t done = 0;
+        while (done < size)
+        {
+            ssize_t n = pwrite(fd_, p + done, size - done, offset + done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                g_printerr("[record] write to %s failed: %s\n", path_.c_str(), g_strerror(errno));
+                stats_.errors.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            done += n;
+        }
+
+        guint64 ns = (g_get_monotonic_time() - start) * 1000;
+        stats_.bytes_written.fetch_add(done, std::memory_order_relaxed);
+        stats_.writes.fetch_add(1, std::memory_order_relaxed);
+        stats_.write_ns.fetch_add(ns, std::memory_order_relaxed);
+        if (ns > stats_.write_ns_max.load())
+            stats_.write_ns_max = ns;
+    }
+};
+
+/* ---------------------------------------------------------
+ * SegmentRecorder：挂在 tee 上的录像分支 + 它的 SegmentWriter
+ * 写线程跨 pipeline 重建保留，每次重建调用 attach() 重新挂分支
+ * --------------------------------------------------------- */
+class SegmentRecorder
+{
+public:
+    struct Options
+    {
+        std::string dir = ".";
+        std::string prefix = "cam";
+        std::string container = "mkv";             // mkv / mp4；断电时 mkv 损失更小
+        guint segment_seconds = 60;
+        guint queue_seconds = 4;                   // 分支入口 leaky queue 的时长
+        size_t block_bytes = 1 << 20;
+        size_t max_queue_bytes = 32 << 20;
+        bool direct_io = true;
+    };
+
+    explicit SegmentRecorder(const Options &options)
+        : options_(options),
+          writer_(options.block_bytes, options.max_queue_bytes, options.direct_io)
+    {
+        g_mkdir_with_parents(options_.dir.c_str(), 0755);
+    }
+
+    const SegmentWriter::Stats &writer_stats() const { return writer_.stats(); }
+    guint64 drops() const { return drops_.load(); }
+
+    /* 在 bin 里建录像分支并接到 tee 的一个 request pad 上（tee 在 parser 之前，分支自带 parser） */
+    bool attach(GstBin *bin, GstElement *tee, VideoCodec codec)
+    {
+        if (codec != VideoCodec::H264 && codec != VideoCodec::H265)
+        {
+            g_print("[record] %s is not supported, recording disabled\n", video_codec_name(codec));
+            return false;
+        }
+
+        bool mp4 = options_.container == "mp4";
+        GstElement *queue = gst_element_factory_make("queue", nullptr);
+        GstElement *parse = gst_element_factory_make(codec == VideoCodec::H264 ? "h264parse" : "h265parse", nullptr);
+        GstElement *split = gst_element_factory_make("splitmuxsink", nullptr);
+        GstElement *mux = gst_element_factory_make(mp4 ? "mp4mux" : "matroskamux", nullptr);
+        GstElement *sink = gst_element_factory_make("fakesink", nullptr);
+
+        if (!queue || !parse || !split || !mux || !sink)
+        {
+            g_printerr("[record] Failed to create recording elements\n");
+            if (queue) gst_object_unref(queue);
+            if (parse) gst_object_unref(parse);
+            if (split) gst_object_unref(split);
+            if (mux) gst_object_unref(mux);
+            if (sink) gst_object_unref(sink);
+            return false;
+        }
+
+        // 写盘慢时在这里丢压缩帧，不反压 tee
+        g_object_set(queue,
+                     "leaky", 2, // downstream
+                     "max-size-buffers", 0,
+                     "max-size-bytes", 0,
+                     "max-size-time", (guint64)options_.queue_seconds * GST_SECOND,
+                     NULL);
+        g_signal_connect(queue, "overrun", G_CALLBACK(overrun_cb), this);
+
+        g_object_set(sink, "sync", FALSE, "async", FALSE, NULL);
+        GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_add_probe(sink_pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                          sink_probe_cb, this, nullptr);
+        gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM, seeking_query_cb, nullptr, nullptr);
+        gst_object_unref(sink_pad);
+
+        g_object_set(split,
+                     "max-size-time", (guint64)options_.segment_seconds * GST_SECOND,
+                     "muxer", mux,
+                     "sink", sink,
+                     NULL);
+        g_signal_connect(split, "format-location", G_CALLBACK(format_location_cb), this);
+
+        gst_bin_add_many(bin, queue, parse, split, NULL);
+        if (!gst_element_link_many(queue, parse, split, NULL))
+        {
+            g_printerr("[record] Failed to link recording branch\n");
+            return false;
+        }
+
+        gst_element_sync_state_with_parent(split);
+        gst_element_sync_state_with_parent(parse);
+        gst_element_sync_state_with_parent(queue);
+
+        GstPad *tee_pad = gst_element_get_request_pad(tee, "src_%u");
+        GstPad *queue_pad = gst_element_get_static_pad(queue, "sink");
+        GstPadLinkReturn ret = gst_pad_link(tee_pad, queue_pad);
+        gst_object_unref(queue_pad);
+        gst_object_unref(tee_pad);
+
+        if (ret != GST_PAD_LINK_OK)
+        {
+            g_printerr("[record] Failed to link tee: %d\n", ret);
+            return false;
+        }
+
+        queue_ = queue;
+        g_print("[record] %s/%s-*.%s, %u s segments, %s writes of %zu KiB\n", options_.dir.c_str(),
+                options_.prefix.c_str(), mp4 ? "mp4" : "mkv", options_.segment_seconds,
+                options_.direct_io ? "O_DIRECT" : "buffered", options_.block_bytes >> 10);
+        return true;
+    }
+
+    /* pipeline 销毁前调用：EOS 让 splitmuxsink 写完当前分段的索引，等写线程落盘 */
+    void finish(guint timeout_ms = 3000)
+    {
+        if (!queue_)
+            return;
+
+        closed_ = false;
+        GstPad *pad = gst_element_get_static_pad(queue_, "sink");
+        gst_pad_send_event(pad, gst_event_new_eos());
+        gst_object_unref(pad);
+        queue_ = nullptr;
+
+        gint64 deadline = g_get_monotonic_time() + timeout_ms * 1000;
+        while (!closed_ && g_get_monotonic_time() < deadline)
+            g_usleep(10 * 1000);
+        if (!closed_ || !writer_.drain(std::max<gint64>(0, (deadline - g_get_monotonic_time()) / 1000)))
+            g_printerr("[record] Timed out finishing the last segment\n");
+    }
+
+    /* 周期统计，tag 为摄像头名 */
+    void report(const char *tag)
+    {
+        const SegmentWriter::Stats &s = writer_.stats();
+        gint64 now = g_get_monotonic_time();
+        double seconds = last_report_us_ ? (now - last_report_us_) / 1e6 : 0.0;
+        guint64 bytes = s.bytes_written, writes = s.writes, write_ns = s.write_ns, blocked = s.blocked_ns;
+
+        g_print("[record %s] %.2f MB/s | write avg %.2f ms max %.2f ms | queue %.1f MB peak %.1f MB | "
+                "blocked %.0f ms | drops %" G_GUINT64_FORMAT " | segments %" G_GUINT64_FORMAT "%s%s\n",
+                tag,
+                seconds > 0 ? (bytes - last_bytes_) / seconds / 1048576.0 : 0.0,
+                writes > last_writes_ ? (write_ns - last_write_ns_) / 1e6 / (writes - last_writes_) : 0.0,
+                s.write_ns_max.load() / 1e6,
+                s.queued_bytes.load() / 1048576.0, s.queued_peak.load() / 1048576.0,
+                (blocked - last_blocked_ns_) / 1e6, drops_.load(), s.segments.load(),
+                s.direct ? " | O_DIRECT" : "", s.errors ? " | ERRORS" : "");
+
+        last_report_us_ = now;
+        last_bytes_ = bytes;
+        last_writes_ = writes;
+        last_write_ns_ = write_ns;
+        last_blocked_ns_ = blocked;
+        writer_.reset_write_max();
+    }
+
+private:
+    Options options_;
+    SegmentWriter writer_;
+    GstElement *queue_ = nullptr;
+    std::atomic<guint64> drops_{0};
+    std::atomic<bool> closed_{false};
+
+    gint64 last_report_us_ = 0;
+    guint64 last_bytes_ = 0, last_writes_ = 0, last_write_ns_ = 0, last_blocked_ns_ = 0;
+
+    static void overrun_cb(GstElement *queue, gpointer user_data)
+    {
+        static_cast<SegmentRecorder *>(user_data)->drops_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /* splitmuxsink 开新分段时调用；返回 NULL，不让它去设 fakesink 的 location */
+    static gchar *format_location_cb(GstElement *split, guint fragment_id, gpointer user_data)
+    {
+        SegmentRecorder *self = static_cast<SegmentRecorder *>(user_data);
+
+        GDateTime *now = g_date_time_new_now_local();
+        gchar *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+        gchar *name = g_strdup_printf("%s-%s-%05u.%s", self->options_.prefix.c_str(), stamp, fragment_id,
+                                      self->options_.container == "mp4" ? "mp4" : "mkv");
+        gchar *path = g_build_filename(self->options_.dir.c_str(), name, NULL);
+
+        self->writer_.open(path);
+
+        g_free(path);
+        g_free(name);
+        g_free(stamp);
+        g_date_time_unref(now);
+        return nullptr;
+    }
+
+    /*
+     * fakesink 不回答 SEEKING 查询，muxer 会认为下游不能 seek：matroskamux 退成 streamable
+     * （没有 Cues、没有 duration），mp4mux 没法回写 moov。文件实际由 SegmentWriter 写，能 seek，这里替它回答
+     */
+    static GstPadProbeReturn seeking_query_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        GstQuery *query = GST_PAD_PROBE_INFO_QUERY(info);
+        if (GST_QUERY_TYPE(query) != GST_QUERY_SEEKING)
+            return GST_PAD_PROBE_OK;
+
+        GstFormat format;
+        gst_query_parse_seeking(query, &format, nullptr, nullptr, nullptr);
+        if (format != GST_FORMAT_BYTES)
+            return GST_PAD_PROBE_OK;
+
+        gst_query_set_seeking(query, GST_FORMAT_BYTES, TRUE, 0, -1);
+        return GST_PAD_PROBE_HANDLED;
+    }
+
+    /* muxer 输出：buffer → write，BYTES segment → seek（回写文件头），EOS → close */
+    static GstPadProbeReturn sink_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        SegmentRecorder *self = static_cast<SegmentRecorder *>(user_data);
+
+        if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+        {
+            self->writer_.write(GST_PAD_PROBE_INFO_BUFFER(info));
+            return GST_PAD_PROBE_OK;
+        }
+
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT)
+        {
+            const GstSegment *segment = nullptr;
+            gst_event_parse_segment(event, &segment);
+            if (segment->format == GST_FORMAT_BYTES)
+                self->writer_.seek(segment->start);
+        }
+        else if (GST_EVENT_TYPE(event) == GST_EVENT_EOS)
+        {
+            self->writer_.close();
+            self->closed_ = true;
+        }
+        return GST_PAD_PROBE_OK;
+    }
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+/*
+ * NV12 / I420 → BGR24 转换（按需调用，代替 pipeline 里单线程的 videoconvert）
+ *
+ * - 定点运算，系数放大 64 倍；支持 BT.601 / BT.709、limited / full range
+ * - x86：SSSE3（运行时检测，不需要额外的编译参数），每次 16 像素，pshufb 交织成 BGR
+ * - ARM：NEON，vld2 拆 UV、vst3 直接交织写出
+ * - 其他平台或行尾不足 16 像素的部分走标量实现；SIMD 和标量结果逐字节一致
+ * - 按行区间转换，调用者可以自己切块多线程
+ */
+
+#include <glib.h>
+
+#include <algorithm>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YUV2BGR_NEON 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define YUV2BGR_SSSE3 1
+#endif
+
+enum class YuvMatrix
+{
+    BT601,
+    BT709
+};
+
+/* 定点系数（×64）：Y' = Y*y_mul (+ Y/2) - y_off，已含 +32 的舍入 */
+struct YuvCoeffs
+{
+    gint16 y_mul;
+    gint16 y_half; // 1：再加 Y>>1，limited range 的 1.164 = 74.5 / 64
+    gint16 y_off;
+    gint16 rv, gu, gv, bu;
+};
+
+static inline YuvCoeffs yuv_coeffs(YuvMatrix matrix, bool full_range)
+{
+    if (full_range)
+    {
+        if (matrix == YuvMatrix::BT709)
+            return {64, 0, -32, 101, 12, 30, 119};
+        return {64, 0, -32, 90, 22, 46, 113};
+    }
+
+    // (Y - 16) * 74.5 + 32 = Y*74 + Y/2 - 1160
+    if (matrix == YuvMatrix::BT709)
+        return {74, 1, 1160, 115, 14, 34, 135};
+    return {74, 1, 1160, 102, 25, 52, 129};
+}
+
+/* 一帧 YUV 的平面指针；NV12 时 u 指向交织的 UV 平面，v = u + 1 */
+struct YuvView
+{
+    const guint8 *y = nullptr;
+    const guint8 *u = nullptr;
+    const guint8 *v = nullptr;
+    int y_stride = 0;
+    int uv_stride = 0;
+    bool nv12 = true;
+    int width = 0;
+    int height = 0;
+    YuvCoeffs coeffs = yuv_coeffs(YuvMatrix::BT601, false);
+};
+
+static inline guint8 yuv_clamp(int v)
+{
+    return (guint8)std::min(255, std::max(0, v));
+}
+
+/* 标量实现，同时用于 SIMD 的行尾 */
+static inline void yuv_row_scalar(const guint8 *y, const guint8 *u, const guint8 *v, int step,
+                                  guint8 *dst, int x_begin, int width, const YuvCoeffs &k)
+{
+    for (int x = x_begin; x < width; x++)
+    {
+        int yy = y[x] * k.y_mul + (k.y_half ? (y[x] >> 1) : 0) - k.y_off;
+        int uu = u[(x >> 1) * step] - 128;
+        int vv = v[(x >> 1) * step] - 128;
+
+        guint8 *p = dst + x * 3;
+        p[0] = yuv_clamp((yy + k.bu * uu) >> 6);
+        p[1] = yuv_clamp((yy - k.gu * uu - k.gv * vv) >> 6);
+        p[2] = yuv_clamp((yy + k.rv * vv) >> 6);
+    }
+}
+
+#if defined(YUV2BGR_SSSE3)
+__attribute__((target("ssse3")))
+static inline void yuv_row_ssse3(const guint8 *y, const guint8 *u, const guint8 *v, bool nv12,
+                                 guint8 *dst, int width, const YuvCoeffs &k)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i lo_mask = _mm_set1_epi16(0x00ff);
+    const __m128i y_mul = _mm_set1_epi16(k.y_mul);
+    const __m128i y_off = _mm_set1_epi16(k.y_off);
+    const __m128i rv = _mm_set1_epi16(k.rv);
+    const __m128i gu = _mm_set1_epi16(k.gu);
+    const __m128i gv = _mm_set1_epi16(k.gv);
+    const __m128i bu = _mm_set1_epi16(k.bu);
+
+    // 48 字节 BGR 输出 = 3 个 16 字节块，每块由 B/G/R 三个通道各 shuffle 一次再 OR
+    const __m128i m0b = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+    const __m128i m0g = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+    const __m128i m0r = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i m1b = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+    const __m128i m1g = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+    const __m128i m1r = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+    const __m128i m2b = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m128i m2g = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m128i m2r = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i yv = _mm_loadu_si128((const __m128i *)(y + x));
+        __m128i ylo = _mm_unpacklo_epi8(yv, zero);
+        __m128i yhi = _mm_unpackhi_epi8(yv, zero);
+
+        __m128i ylo_s = _mm_mullo_epi16(ylo, y_mul);
+        __m128i yhi_s = _mm_mullo_epi16(yhi, y_mul);
+        if (k.y_half)
+        {
+            ylo_s = _mm_add_epi16(ylo_s, _mm_srli_epi16(ylo, 1));
+            yhi_s = _mm_add_epi16(yhi_s, _mm_srli_epi16(yhi, 1));
+        }
+        ylo = _mm_sub_epi16(ylo_s, y_off);
+        yhi = _mm_sub_epi16(yhi_s, y_off);
+
+        // 8 个色度样本，扩成 16 位并减 128
+        __m128i u16, v16;
+        if (nv12)
+        {
+            __m128i uv = _mm_loadu_si128((const __m128i *)(u + x));
+            u16 = _mm_and_si128(uv, lo_mask);
+            v16 = _mm_srli_epi16(uv, 8);
+        }
+        else
+        {
+            u16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + x / 2)), zero);
+            v16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v + x / 2)), zero);
+        }
+        u16 = _mm_sub_epi16(u16, c128);
+        v16 = _mm_sub_epi16(v16, c128);
+
+        // 每个色度样本对应两个像素
+        __m128i ulo = _mm_unpacklo_epi16(u16, u16), uhi = _mm_unpackhi_epi16(u16, u16);
+        __m128i vlo = _mm_unpacklo_epi16(v16, v16), vhi = _mm_unpackhi_epi16(v16, v16);
+
+        __m128i b_lo = _mm_srai_epi16(_mm_adds_epi16(ylo, _mm_mullo_epi16(ulo, bu)), 6);
+        __m128i b_hi = _mm_srai_epi16(_mm_adds_epi16(yhi, _mm_mullo_epi16(uhi, bu)), 6);
+        __m128i g_lo = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(ylo, _mm_mullo_epi16(ulo, gu)),
+                                                     _mm_mullo_epi16(vlo, gv)), 6);
+        __m128i g_hi = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(yhi, _mm_mullo_epi16(uhi, gu)),
+                                                     _mm_mullo_epi16(vhi, gv)), 6);
+        __m128i r_lo = _mm_srai_epi16(_mm_adds_epi16(ylo, _mm_mullo_epi16(vlo, rv)), 6);
+        __m128i r_hi = _mm_srai_epi16(_mm_adds_epi16(yhi, _mm_mullo_epi16(vhi, rv)), 6);
+
+        __m128i b = _mm_packus_epi16(b_lo, b_hi);
+        __m128i g = _mm_packus_epi16(g_lo, g_hi);
+        __m128i r = _mm_packus_epi16(r_lo, r_hi);
+
+        __m128i o0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, m0b), _mm_shuffle_epi8(g, m0g)),
+                                  _mm_shuffle_epi8(r, m0r));
+        __m128i o1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, m1b), _mm_shuffle_epi8(g, m1g)),
+                                  _mm_shuffle_epi8(r, m1r));
+        __m128i o2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, m2b), _mm_shuffle_epi8(g, m2g)),
+                                  _mm_shuffle_epi8(r, m2r));
+
+        _mm_storeu_si128((__m128i *)(dst + x * 3), o0);
+        _mm_storeu_si128((__m128i *)(dst + x * 3 + 16), o1);
+        _mm_storeu_si128((__m128i *)(dst + x * 3 + 32), o2);
+    }
+
+    yuv_row_scalar(y, u, v, nv12 ? 2 : 1, dst, x, width, k);
+}
+
+static inline bool yuv_cpu_has_ssse3()
+{
+    static const bool has = __builtin_cpu_supports("ssse3");
+    return has;
+}
+#endif
+
+#if defined(YUV2BGR_NEON)
+static inline void yuv_row_neon(const guint8 *y, const guint8 *u, const guint8 *v, bool nv12,
+                                guint8 *dst, int width, const YuvCoeffs &k)
+{
+    const int16x8_t c128 = vdupq_n_s16(128);
+    const int16x8_t y_off = vdupq_n_s16(k.y_off);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t yv = vld1q_u8(y + x);
+        int16x8_t ylo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(yv)));
+        int16x8_t yhi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(yv)));
+
+        int16x8_t ylo_s = vmulq_n_s16(ylo, k.y_mul);
+        int16x8_t yhi_s = vmulq_n_s16(yhi, k.y_mul);
+        if (k.y_half)
+        {
+            ylo_s = vaddq_s16(ylo_s, vshrq_n_s16(ylo, 1));
+            yhi_s = vaddq_s16(yhi_s, vshrq_n_s16(yhi, 1));
+        }
+        ylo = vsubq_s16(ylo_s, y_off);
+        yhi = vsubq_s16(yhi_s, y_off);
+
+        uint8x8_t u8, v8;
+        if (nv12)
+        {
+            uint8x8x2_t uv = vld2_u8(u + x);
+            u8 = uv.val[0];
+            v8 = uv.val[1];
+        }
+        else
+        {
+            u8 = vld1_u8(u + x / 2);
+            v8 = vld1_u8(v + x / 2);
+        }
+        int16x8_t u16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), c128);
+        int16x8_t v16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), c128);
+
+        int16x8x2_t uz = vzipq_s16(u16, u16);
+        int16x8x2_t vz = vzipq_s16(v16, v16);
+
+        int16x8_t b_lo = vqaddq_s16(ylo, vmulq_n_s16(uz.val[0], k.bu));
+        int16x8_t b_hi = vqaddq_s16(yhi, vmulq_n_s16(uz.val[1], k.bu));
+        int16x8_t g_lo = vqsubq_s16(vqsubq_s16(ylo, vmulq_n_s16(uz.val[0], k.gu)), vmulq_n_s16(vz.val[0], k.gv));
+        int16x8_t g_hi = vqsubq_s16(vqsubq_s16(yhi, vmulq_n_s16(uz.val[1], k.gu)), vmulq_n_s16(vz.val[1], k.gv));
+        int16x8_t r_lo = vqaddq_s16(ylo, vmulq_n_s16(vz.val[0], k.rv));
+        int16x8_t r_hi = vqaddq_s16(yhi, vmulq_n_s16(vz.val[1], k.rv));
+
+        uint8x16x3_t bgr;
+        bgr.val[0] = vcombine_u8(vqshrun_n_s16(b_lo, 6), vqshrun_n_s16(b_hi, 6));
+        bgr.val[1] = vcombine_u8(vqshrun_n_s16(g_lo, 6), vqshrun_n_s16(g_hi, 6));
+        bgr.val[2] = vcombine_u8(vqshrun_n_s16(r_lo, 6), vqshrun_n_s16(r_hi, 6));
+        vst3q_u8(dst + x * 3, bgr);
+    }
+
+    yuv_row_scalar(y, u, v, nv12 ? 2 : 1, dst, x, width, k);
+}
+#endif
+
+/* 当前使用的实现名，benchmark 打印用 */
+static inline const char *yuv_simd_name()
+{
+#if defined(YUV2BGR_NEON)
+    return "NEON";
+#elif defined(YUV2BGR_SSSE3)
+    return yuv_cpu_has_ssse3() ? "SSSE3" : "scalar";
+#else
+    return "scalar";
+#endif
+}
+
+/* 转换 [row_begin, row_end) 行；row_end < 0 表示到最后一行。dst 为 BGR24 */
+static inline void yuv_to_bgr(const YuvView &src, guint8 *dst, int dst_stride,
+                              int row_begin = 0, int row_end = -1, bool allow_simd = true)
+{
+    if (row_end < 0 || row_end > src.height)
+        row_end = src.height;
+
+    for (int row = row_begin; row < row_end; row++)
+    {
+        const guint8 *y = src.y + (size_t)row * src.y_stride;
+        const guint8 *u = src.u + (size_t)(row / 2) * src.uv_stride;
+        const guint8 *v = src.nv12 ? u + 1 : src.v + (size_t)(row / 2) * src.uv_stride;
+        guint8 *out = dst + (size_t)row * dst_stride;
+
+#if defined(YUV2BGR_NEON)
+        if (allow_simd)
+        {
+            yuv_row_neon(y, u, v, src.nv12, out, src.width, src.coeffs);
+            continue;
+        }
+#elif defined(YUV2BGR_SSSE3)
+        if (allow_simd && yuv_cpu_has_ssse3())
+        {
+            yuv_row_ssse3(y, u, v, src.nv12, out, src.width, src.coeffs);
+            continue;
+        }
+#endif
+        yuv_row_scalar(y, u, v, src.nv12 ? 2 : 1, out, 0, src.width, src.coeffs);
+    }
+}
@@ -1,8 +1,171 @@
 #include <gst/gst.h>
 #include <glib.h>
+#include <pthread.h>
+#include <sched.h>
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include "../rtsp/proc_stats.h"  // 线程数 / 上下文切换 / CPU
+
+/* ------------------------------------------------------------------
+ * 共享 GstTaskPool
+ *   默认每个 GstTask（queue、解复用、udpsrc ...）都从 GStreamer 默认线程池取线程，
+ *   64 路时进程里有几百个线程。--shared-pool 模式下所有 pipeline 的 task 都放进这一个池：
+ *   - 容量按核数，工作线程首次运行时绑定到一个核（轮流分配）
+ *   - 空闲线程保留复用，断线重连 / 暂停恢复不再反复创建线程；
+ *     GThreadPool 用独占模式：线程只属于这个池，绑过核的线程不会回到 GLib 全局空闲线程列表
+ *     被别的非独占池（包括 GStreamer 默认的 GstTaskPool）拿去用
+ *   - 流任务是长期运行的循环（停止前不返回），一个任务始终占着一个线程；
+ *     池满时如果只排队，新 task 永远等不到线程，pipeline 直接卡死。
+ *     所以容量只是软上限：超出时扩容并计数（overflow），由统计告诉你需要多少线程
+ * ------------------------------------------------------------------ */
+struct SharedTaskPool {
+    GstTaskPool parent;
+    GThreadPool* workers;
+    guint capacity;   // 软上限，默认核数
+    GMutex lock;      // 串行化 push 里的 "比较 + 扩容"
+    gint outstanding; // 已 push 还没返回的 task（含排队中 / 刚被取走还没开始跑的）
+    gint active;      // 正在运行的 task
+    gint peak;
+    gint threads;     // 创建过的工作线程
+    gint overflow;    // 超出容量的次数
+    gint next_cpu;
+};
+
+struct SharedTaskPoolClass {
+    GstTaskPoolClass parent_class;
+};
+
+G_DEFINE_TYPE(SharedTaskPool, shared_task_pool, GST_TYPE_TASK_POOL)
+
+struct SharedTaskJob {
+    GstTaskPoolFunction func;
+    gpointer data;
+};
+
+static void shared_task_pool_pin(gint cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        g_printerr("Failed to pin task thread to cpu %d\n", cpu);
+}
+
+static void shared_task_pool_worker(gpointer data, gpointer pool_data)
+{
+    SharedTaskPool* self = (SharedTaskPool*)pool_data;
+    SharedTaskJob* job = (SharedTaskJob*)data;
+
+    // 工作线程第一次跑任务时绑核，之后复用时保持不变
+    static thread_local bool pinned = false;
+    if (!pinned) {
+        pinned = true;
+        g_atomic_int_inc(&self->threads);
+        shared_task_pool_pin(g_atomic_int_add(&self->next_cpu, 1) % g_get_num_processors());
+    }
+
+    gint active = g_atomic_int_add(&self->active, 1) + 1;
+    gint peak = g_atomic_int_get(&self->peak);
+    while (active > peak && !g_atomic_int_compare_and_exchange(&self->peak, peak, active))
+        peak = g_atomic_int_get(&self->peak);
+
+    job->func(job->data);
+
+    g_atomic_int_add(&self->active, -1);
+    g_atomic_int_add(&self->outstanding, -1);
+    g_free(job);
+}
+
+static void shared_task_pool_prepare(GstTaskPool* pool, GError** error)
+{
+    SharedTaskPool* self = (SharedTaskPool*)pool;
+    // 独占：空闲线程留在本池里等下一个 task，不放回全局列表（不用改进程级的 max_unused_threads）
+    self->workers = g_thread_pool_new(shared_task_pool_worker, self, self->capacity, TRUE, error);
+}
+
+static void shared_task_pool_cleanup(GstTaskPool* pool)
+{
+    SharedTaskPool* self = (SharedTaskPool*)pool;
+    if (self->workers) {
+        g_thread_pool_free(self->workers, FALSE, TRUE);
+        self->workers = nullptr;
+    }
+}
+
+static gpointer shared_task_pool_push(GstTaskPool* pool, GstTaskPoolFunction func, gpointer data, GError** error)
+{
+    SharedTaskPool* self = (SharedTaskPool*)pool;
+    if (!self->workers) {
+        g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED, "task pool not prepared");
+        return nullptr;
+    }
+
+    SharedTaskJob* job = g_new(SharedTaskJob, 1);
+    job->func = func;
+    job->data = data;
+
+    // 未返回的 task 在 push 前计数、func 返回后才减：被取走还没开始跑的 task 也算在内。
+    // 线程数不够每个 task 一个时扩容，不能让长期任务排在永远不返回的 worker 后面；
+    // 加锁保证并发 push 不会读到同一个计数而都不扩
+    g_mutex_lock(&self->lock);
+    gint outstanding = g_atomic_int_add(&self->outstanding, 1) + 1;
+    gint max_threads = g_thread_pool_get_max_threads(self->workers);
+    if (outstanding > max_threads) {
+        g_thread_pool_set_max_threads(self->workers, outstanding, nullptr);
+        g_atomic_int_inc(&self->overflow);
+    }
+    gboolean pushed = g_thread_pool_push(self->workers, job, error);
+    if (!pushed)
+        g_atomic_int_add(&self->outstanding, -1);
+    g_mutex_unlock(&self->lock);
+
+    if (!pushed) {
+        g_free(job);
+        return nullptr;
+    }
+    // task 停止时自己退出循环，不需要 join 句柄
+    return nullptr;
+}
+
+static void shared_task_pool_join(GstTaskPool* pool, gpointer id)
+{
+}
+
+static void shared_task_pool_finalize(GObject* object)
+{
+    SharedTaskPool* self = (SharedTaskPool*)object;
+    g_mutex_clear(&self->lock);
+    G_OBJECT_CLASS(shared_task_pool_parent_class)->finalize(object);
+}
+
+static void shared_task_pool_class_init(SharedTaskPoolClass* klass)
+{
+    G_OBJECT_CLASS(klass)->finalize = shared_task_pool_finalize;
+    GstTaskPoolClass* pool_class = GST_TASK_POOL_CLASS(klass);
+    pool_class->prepare = shared_task_pool_prepare;
+    pool_class->cleanup = shared_task_pool_cleanup;
+    pool_class->push = shared_task_pool_push;
+    pool_class->join = shared_task_pool_join;
+}
+
+static void shared_task_pool_init(SharedTaskPool* self)
+{
+    self->workers = nullptr;
+    self->capacity = g_get_num_processors();
+    g_mutex_init(&self->lock);
+    self->outstanding = 0;
+    self->active = self->peak = self->threads = self->overflow = self->next_cpu = 0;
+}
+
+static GstTaskPool* shared_task_pool_new(guint capacity)
+{
+    SharedTaskPool* self = (SharedTaskPool*)g_object_new(shared_task_pool_get_type(), nullptr);
+    if (capacity > 0)
+        self->capacity = capacity;
+    return GST_TASK_POOL(self);
+}
 
 class MultiStreamPlayer {
 private:
@@ -17,8 +180,55 @@ private:
     GMainLoop* main_loop_;
     gint stream_count_;
 
+    GstTaskPool* task_pool_;   // --shared-pool 时所有 pipeline 共用
+    bool use_queue_;
+    bool headless_;
+    guint stats_interval_s_;
+    guint duration_s_;
+    ProcSample start_sample_;
+    ProcSample last_sample_;
+    long peak_threads_;
+
 public:
-    MultiStreamPlayer() : main_loop_(nullptr), stream_count_(0) {}
+    MultiStreamPlayer() : main_loop_(nullptr), stream_count_(0), task_pool_(nullptr),
+                         use_queue_(true), headless_(false), stats_interval_s_(5), duration_s_(0),
+                         peak_threads_(0) {}
+
+    // 所有 pipeline 的流线程放进一个共享池，capacity 为 0 时按核数；要在 addStream 之前调用
+    bool enableSharedPool(guint capacity) {
+        task_pool_ = shared_task_pool_new(capacity);
+        GError* error = nullptr;
+        gst_task_pool_prepare(task_pool_, &error);
+        if (error) {
+            g_printerr("Failed to prepare shared task pool: %s\n", error->message);
+            g_error_free(error);
+            gst_object_unref(task_pool_);
+            task_pool_ = nullptr;
+            return false;
+        }
+        g_print("Shared task pool: capacity %u, threads pinned round-robin over %u cpus\n",
+                ((SharedTaskPool*)task_pool_)->capacity, g_get_num_processors());
+        return true;
+    }
+
+    // 去掉每路的 queue（少一个流线程，解码和渲染在同一个线程里）
+    void setUseQueue(bool use_queue) {
+        use_queue_ = use_queue;
+    }
+
+    // 用 fakesink 代替窗口，测几十路时不开窗口
+    void setHeadless(bool headless) {
+        headless_ = headless;
+    }
+
+    void setStatsInterval(guint seconds) {
+        stats_interval_s_ = seconds;
+    }
+
+    // 运行 seconds 秒后退出并打印汇总，0 表示一直运行
+    void setDuration(guint seconds) {
+        duration_s_ = seconds;
+    }
 
     ~MultiStreamPlayer() {
         cleanup();
@@ -31,14 +241,17 @@ public:
 
         // 创建管道
         std::string pipeline_str;
-        if (window_id.empty()) {
+        std::string queue = use_queue_ ? " ! queue" : "";
+        if (headless_) {
+            pipeline_str = "uridecodebin uri=" + uri + " ! videoconvert ! videoscale" + queue + " ! fakesink sync=true";
+        } else if (window_id.empty()) {
             // 自动分配窗口
             // pipeline_str = "uridecodebin uri=" + uri + " ! videoconvert ! videoscale ! queue ! autovideosink sync=false";            // 这边不同步
-            pipeline_str = "uridecodebin uri=" + uri + " ! videoconvert ! videoscale ! queue ! autovideosink sync=true";                // 默认是 true 不加也行
+            pipeline_str = "uridecodebin uri=" + uri + " ! videoconvert ! videoscale" + queue + " ! autovideosink sync=true";          // 默认是 true 不加也行
         } else {
             // 指定窗口ID（适用于X11）
             // pipeline_str = "uridecodebin uri=" + uri + " ! videoconvert ! videoscale ! queue ! xvimagesink window-id=" + window_id + " sync=false";
-            pipeline_str = "uridecodebin uri=" + uri + " ! videoconvert ! videoscale ! queue ! xvimagesink window-id=" + window_id + " sync=true";
+            pipeline_str = "uridecodebin uri=" + uri + " ! videoconvert ! videoscale" + queue + " ! xvimagesink window-id=" + window_id + " sync=true";
         }
 
         g_print("Creating pipeline: %s\n", pipeline_str.c_str());
@@ -65,6 +278,10 @@ public:
 
         // 设置总线监视
         GstBus* bus = gst_element_get_bus(stream_info.pipeline);
+        if (task_pool_) {
+            // STREAM_STATUS 是在要创建线程的流线程 / 调用线程里同步发出的，只能在 sync handler 里换池
+            gst_bus_set_sync_handler(bus, syncHandler, this, nullptr);
+        }
         stream_info.bus_watch_id = gst_bus_add_watch(bus, busWatchHandler, this);
         gst_object_unref(bus);
 
@@ -94,12 +311,20 @@ public:
         // 创建主循环
         main_loop_ = g_main_loop_new(nullptr, FALSE);
 
-        g_print("Starting %d video streams...\n", stream_count_);
+        start_sample_ = last_sample_ = proc_sample_now();
+        if (stats_interval_s_ > 0)
+            g_timeout_add_seconds(stats_interval_s_, reportStats, this);
+        if (duration_s_ > 0)
+            g_timeout_add_seconds(duration_s_, onDuration, this);
+
+        g_print("Starting %d video streams (%s task pool, %s)...\n", stream_count_,
+                task_pool_ ? "shared" : "default", use_queue_ ? "queue per stream" : "no queue");
         g_print("Press Ctrl+C to stop\n");
 
         // 运行主循环
         g_main_loop_run(main_loop_);
 
+        printSummary();
         return true;
     }
 
@@ -125,6 +350,72 @@ public:
     }
 
 private:
+    // 新建 GstTask 时把它的线程池换成共享池（总线同步回调，在发消息的线程里执行）
+    static GstBusSyncReply syncHandler(GstBus* bus, GstMessage* msg, gpointer user_data) {
+        MultiStreamPlayer* player = static_cast<MultiStreamPlayer*>(user_data);
+        if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_STREAM_STATUS)
+            return GST_BUS_PASS;
+
+        GstStreamStatusType type;
+        GstElement* owner;
+        gst_message_parse_stream_status(msg, &type, &owner);
+        if (type == GST_STREAM_STATUS_TYPE_CREATE) {
+            const GValue* value = gst_message_get_stream_status_object(msg);
+            if (value && G_VALUE_TYPE(value) == GST_TYPE_TASK) {
+                GstTask* task = GST_TASK(g_value_get_object(value));
+                gst_task_set_pool(task, player->task_pool_);
+            }
+        }
+        return GST_BUS_PASS;
+    }
+
+    // 周期打印线程数、上下文切换和 CPU 占用
+    static gboolean reportStats(gpointer user_data) {
+        MultiStreamPlayer* player = static_cast<MultiStreamPlayer*>(user_data);
+        ProcSample now = proc_sample_now();
+        double seconds = (now.wall_us - player->last_sample_.wall_us) / 1e6;
+        long threads = proc_thread_count();
+        player->peak_threads_ = std::max(player->peak_threads_, threads);
+
+        g_print("[stats] threads %ld | cpu %.1f%% | ctx switches %.0f/s voluntary, %.0f/s involuntary",
+                threads, proc_cpu_percent(player->last_sample_, now),
+                seconds > 0 ? (now.vol_cs - player->last_sample_.vol_cs) / seconds : 0.0,
+                seconds > 0 ? (now.invol_cs - player->last_sample_.invol_cs) / seconds : 0.0);
+        if (player->task_pool_) {
+            SharedTaskPool* pool = (SharedTaskPool*)player->task_pool_;
+            g_print(" | pool tasks %d (peak %d), workers %d, overflow %d",
+                    g_atomic_int_get(&pool->active), g_atomic_int_get(&pool->peak),
+                    g_atomic_int_get(&pool->threads), g_atomic_int_get(&pool->overflow));
+        }
+        g_print("\n");
+
+        player->last_sample_ = now;
+        return G_SOURCE_CONTINUE;
+    }
+
+    static gboolean onDuration(gpointer user_data) {
+        MultiStreamPlayer* player = static_cast<MultiStreamPlayer*>(user_data);
+        g_main_loop_quit(player->main_loop_);
+        return G_SOURCE_REMOVE;
+    }
+
+    // 整个运行期间的汇总，便于 --shared-pool 前后对比
+    void printSummary() {
+        ProcSample now = proc_sample_now();
+        double seconds = (now.wall_us - start_sample_.wall_us) / 1e6;
+        long threads = proc_thread_count();
+        peak_threads_ = std::max(peak_threads_, threads);
+        if (seconds <= 0)
+            return;
+
+        g_print("[summary] %d streams, %s task pool, %.1f s: threads %ld (peak %ld), cpu %.1f%%, "
+                "ctx switches %.0f/s voluntary, %.0f/s involuntary\n",
+                stream_count_, task_pool_ ? "shared" : "default", seconds, threads, peak_threads_,
+                proc_cpu_percent(start_sample_, now),
+                (now.vol_cs - start_sample_.vol_cs) / seconds,
+                (now.invol_cs - start_sample_.invol_cs) / seconds);
+    }
+
     // 总线消息处理
     static gboolean busWatchHandler(GstBus* bus, GstMessage* msg, gpointer user_data) {
         MultiStreamPlayer* player = static_cast<MultiStreamPlayer*>(user_data);
@@ -222,6 +513,13 @@ private:
         }
         streams_.clear();
 
+        // pipeline 都停了，task 已经退出，这时才能回收共享池
+        if (task_pool_) {
+            gst_task_pool_cleanup(task_pool_);
+            gst_object_unref(task_pool_);
+            task_pool_ = nullptr;
+        }
+
         if (main_loop_) {
             g_main_loop_unref(main_loop_);
             main_loop_ = nullptr;
@@ -237,17 +535,53 @@ int main(int argc, char* argv[]) {
     // 创建多流播放器
     MultiStreamPlayer player;
 
-    // 添加多个视频流
-    // 这里使用测试流，你可以替换为实际的RTSP、HTTP等流媒体地址
-
-    // 测试流1:  Big Buck Bunny 测试视频
-    player.addStream("https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm");
+    // --shared-pool [N]  所有 pipeline 共用一个绑核的 GstTaskPool（N 默认核数）
+    // --no-queue         去掉每路的 queue
+    // --streams N        命令行的 uri 循环使用，凑够 N 路
+    // --headless         fakesink，不开窗口
+    // --stats S / --duration S
+    // 对比：./mul_pull --headless --streams 64 --duration 60 <uri>
+    //      ./mul_pull --headless --streams 64 --duration 60 --shared-pool <uri>
+    bool shared_pool = false;
+    guint pool_capacity = 0;
+    guint stream_target = 0;
+    std::vector<std::string> uris;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--shared-pool") {
+            shared_pool = true;
+            if (i + 1 < argc && g_ascii_isdigit(argv[i + 1][0]))
+                pool_capacity = (guint)atoi(argv[++i]);
+        } else if (arg == "--no-queue") {
+            player.setUseQueue(false);
+        } else if (arg == "--headless") {
+            player.setHeadless(true);
+        } else if (arg == "--streams" && i + 1 < argc) {
+            stream_target = (guint)atoi(argv[++i]);
+        } else if (arg == "--stats" && i + 1 < argc) {
+            player.setStatsInterval((guint)atoi(argv[++i]));
+        } else if (arg == "--duration" && i + 1 < argc) {
+            player.setDuration((guint)atoi(argv[++i]));
+        } else {
+            uris.push_back(arg);
+        }
+    }
 
-    // 测试流2: Sintel 测试视频
-    player.addStream("https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm");
+    if (shared_pool && !player.enableSharedPool(pool_capacity))
+        return -1;
 
-    // 测试流3: 另一个测试视频
-    player.addStream("https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm");
+    // 添加多个视频流
+    // 这里使用测试流，你可以替换为实际的RTSP、HTTP等流媒体地址
+    if (uris.empty()) {
+        // 测试流1:  Big Buck Bunny 测试视频
+        // 测试流2: Sintel 测试视频
+        // 测试流3: 另一个测试视频
+        for (int i = 0; i < 3; i++)
+            uris.push_back("https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm");
+    }
+    guint total = std::max<guint>(stream_target, uris.size());
+    for (guint i = 0; i < total; i++)
+        player.addStream(uris[i % uris.size()]);
 
     // 实际应用中可以使用RTSP流:
     // player.addStream("rtsp://your-camera-ip:554/stream1");
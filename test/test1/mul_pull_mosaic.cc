@@ -0,0 +1,865 @@
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
+#include <glib.h>
+#include <signal.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include "tile_scale.h"          // SIMD 缩放 + 贴图、任务池
+#include "../rtsp/proc_stats.h"  // CPU 占用
+
+/*
+ * 不用 compositor 的多路拼接（纯 CPU）
+ *
+ * mul_pull_place.cc 每路流 videoscale + videoconvert，再由 compositor 混合到 1920x1080，
+ * 一帧要完整遍历三次，CPU 机器上十几路就跑不动了。这里：
+ *   每路：uridecodebin -> queue(leaky) -> videoconvert(I420/NV12 时直通) -> appsink
+ *         appsink 回调只保存最新的 sample，不做任何像素处理
+ *   输出：独立线程按固定帧率从 buffer pool 取一块 I420 画布，
+ *         每个 tile 直接从解码帧缩放写入画布对应区域（多线程 + SIMD），
+ *         然后 appsrc -> videoconvert -> autovideosink
+ * 没有新帧的 tile 重复上一帧，没有任何帧的 tile 填黑
+ */
+
+/* ---------------------------------------------------------
+ * 拼接引擎：布局 + 每个 tile 的缩放表 + 任务切分
+ * --------------------------------------------------------- */
+class MosaicCompositor {
+public:
+    MosaicCompositor(int width, int height, int cols, int rows, int threads)
+        : width_(width), height_(height), pool_(threads) {
+        setLayout(cols, rows);
+    }
+
+    void setLayout(int cols, int rows) {
+        cols_ = std::max(1, cols);
+        rows_ = std::max(1, rows);
+
+        // tile 边界取偶数，保证色度平面对齐；除不尽的余量分给各列 / 行，画布全部覆盖
+        tiles_.assign(cols_ * rows_, Tile());
+        for (int i = 0; i < cols_ * rows_; i++) {
+            int col = i % cols_;
+            int row = i / cols_;
+            tiles_[i].x = (col * width_ / cols_) & ~1;
+            tiles_[i].y = (row * height_ / rows_) & ~1;
+            tiles_[i].width = (((col + 1) * width_ / cols_) & ~1) - tiles_[i].x;
+            tiles_[i].height = (((row + 1) * height_ / rows_) & ~1) - tiles_[i].y;
+        }
+    }
+
+    int tiles() const { return (int)tiles_.size(); }
+    int threads() const { return pool_.threads(); }
+
+    /* out 为 I420 画布；inputs[i] 为第 i 个 tile 的 I420 / NV12 帧，空表示填黑 */
+    void compose(GstVideoFrame* out, GstVideoFrame* const* inputs, int n_inputs) {
+        jobs_.clear();
+
+        for (int i = 0; i < (int)tiles_.size(); i++) {
+            Tile& tile = tiles_[i];
+            GstVideoFrame* in = i < n_inputs ? inputs[i] : nullptr;
+
+            if (!in) {
+                jobs_.push_back({i, -1, 0, tile.height});
+                continue;
+            }
+
+            int src_w = GST_VIDEO_FRAME_WIDTH(in);
+            int src_h = GST_VIDEO_FRAME_HEIGHT(in);
+            int step = GST_VIDEO_FRAME_FORMAT(in) == GST_VIDEO_FORMAT_NV12 ? 2 : 1;
+            if (!tile.luma.matches(src_w, src_h, tile.width, tile.height, 1))
+                tile.luma.build(src_w, src_h, tile.width, tile.height, 1);
+            if (!tile.chroma.matches((src_w + 1) / 2, (src_h + 1) / 2, tile.width / 2, tile.height / 2, step))
+                tile.chroma.build((src_w + 1) / 2, (src_h + 1) / 2, tile.width / 2, tile.height / 2, step);
+
+            // 按行切块：亮度 64 行一块，两个色度平面各 32 行一块
+            for (int r = 0; r < tile.height; r += 64)
+                jobs_.push_back({i, 0, r, std::min(tile.height, r + 64)});
+            for (int plane = 1; plane <= 2; plane++) {
+                for (int r = 0; r < tile.height / 2; r += 32)
+                    jobs_.push_back({i, plane, r, std::min(tile.height / 2, r + 32)});
+            }
+        }
+
+        pool_.run((int)jobs_.size(), [&](int index, TileScratch& scratch) {
+            const Job& job = jobs_[index];
+            runJob(job, out, job.tile < n_inputs ? inputs[job.tile] : nullptr, scratch);
+        });
+    }
+
+private:
+    struct Tile {
+        int x = 0, y = 0, width = 0, height = 0;
+        TilePlaneMap luma;
+        TilePlaneMap chroma;
+    };
+
+    struct Job {
+        int tile;
+        int plane; // -1：填黑
+        int row_begin;
+        int row_end;
+    };
+
+    int width_;
+    int height_;
+    int cols_ = 1;
+    int rows_ = 1;
+    TileBlitPool pool_;
+    std::vector<Tile> tiles_;
+    std::vector<Job> jobs_;
+
+    static TileDstPlane dstPlane(GstVideoFrame* out, int plane, const Tile& tile) {
+        int shift = plane == 0 ? 0 : 1;
+        int stride = GST_VIDEO_FRAME_PLANE_STRIDE(out, plane);
+        guint8* data = (guint8*)GST_VIDEO_FRAME_PLANE_DATA(out, plane);
+        return {data + (size_t)(tile.y >> shift) * stride + (tile.x >> shift), stride,
+                tile.width >> shift, tile.height >> shift};
+    }
+
+    void runJob(const Job& job, GstVideoFrame* out, GstVideoFrame* in, TileScratch& scratch) {
+        const Tile& tile = tiles_[job.tile];
+
+        if (job.plane < 0) {
+            for (int plane = 0; plane < 3; plane++) {
+                TileDstPlane dst = dstPlane(out, plane, tile);
+                for (int r = 0; r < dst.height; r++)
+                    memset(dst.data + (size_t)r * dst.stride, plane == 0 ? 16 : 128, dst.width);
+            }
+            return;
+        }
+
+        TileSrcPlane src;
+        if (job.plane == 0) {
+            src = {(const guint8*)GST_VIDEO_FRAME_PLANE_DATA(in, 0), GST_VIDEO_FRAME_PLANE_STRIDE(in, 0),
+                   GST_VIDEO_FRAME_WIDTH(in), GST_VIDEO_FRAME_HEIGHT(in), 1};
+        } else if (GST_VIDEO_FRAME_FORMAT(in) == GST_VIDEO_FORMAT_NV12) {
+            // NV12：U / V 都在平面 1，交织存放
+            src = {(const guint8*)GST_VIDEO_FRAME_PLANE_DATA(in, 1) + (job.plane - 1),
+                   GST_VIDEO_FRAME_PLANE_STRIDE(in, 1),
+                   (GST_VIDEO_FRAME_WIDTH(in) + 1) / 2, (GST_VIDEO_FRAME_HEIGHT(in) + 1) / 2, 2};
+        } else {
+            src = {(const guint8*)GST_VIDEO_FRAME_PLANE_DATA(in, job.plane), GST_VIDEO_FRAME_PLANE_STRIDE(in, job.plane),
+                   (GST_VIDEO_FRAME_WIDTH(in) + 1) / 2, (GST_VIDEO_FRAME_HEIGHT(in) + 1) / 2, 1};
+        }
+
+        tile_scale_rows(src, dstPlane(out, job.plane, tile), job.plane == 0 ? tile.luma : tile.chroma,
+                        job.row_begin, job.row_end, scratch);
+    }
+};
+
+/* 输出画布的 buffer pool（I420，带 GstVideoMeta） */
+static GstBufferPool* createCanvasPool(GstCaps* caps, const GstVideoInfo& info) {
+    GstBufferPool* pool = gst_video_buffer_pool_new();
+    GstStructure* config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(&info), 3, 8);
+    gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+    if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE)) {
+        g_printerr("Failed to configure canvas buffer pool\n");
+        gst_object_unref(pool);
+        return nullptr;
+    }
+    return pool;
+}
+
+class MosaicPlayer {
+private:
+    struct StreamInfo {
+        GstElement* src = nullptr;
+        GstElement* queue = nullptr;
+        GstElement* convert = nullptr;
+        GstElement* sink = nullptr;
+        std::string uri;
+
+        std::mutex mutex;
+        GstSample* latest = nullptr; // 只保存最新一帧
+        std::atomic<guint64> frames{0};
+        guint64 last_frames = 0;
+
+        ~StreamInfo() {
+            if (latest)
+                gst_sample_unref(latest);
+        }
+    };
+
+    GstElement* pipeline_;
+    GstElement* appsrc_;
+    std::vector<std::unique_ptr<StreamInfo>> streams_;
+    GMainLoop* main_loop_;
+    gint grid_cols_;
+    gint grid_rows_;
+    gint out_width_;
+    gint out_height_;
+    gint out_fps_;
+    gint threads_;
+
+    std::unique_ptr<MosaicCompositor> mosaic_;
+    GstBufferPool* canvas_pool_;
+    GstVideoInfo canvas_info_;
+    std::thread compose_thread_;
+    std::atomic<bool> running_;
+
+    // 统计（compose 线程写，主线程读）
+    std::atomic<guint64> composed_;
+    std::atomic<gint64> compose_us_;
+    guint64 last_composed_;
+    gint64 last_compose_us_;
+    ProcSample last_proc_;
+
+public:
+    MosaicPlayer() : pipeline_(nullptr), appsrc_(nullptr), main_loop_(nullptr), grid_cols_(0), grid_rows_(0),
+                     out_width_(1920), out_height_(1080), out_fps_(25), threads_(0), canvas_pool_(nullptr),
+                     running_(false), composed_(0), compose_us_(0), last_composed_(0), last_compose_us_(0) {}
+
+    ~MosaicPlayer() {
+        cleanup();
+    }
+
+    // 设置网格布局；不设置时按流数自动取接近正方形的网格
+    void setGridLayout(int cols, int rows) {
+        grid_cols_ = cols;
+        grid_rows_ = rows;
+    }
+
+    void setOutput(int width, int height, int fps) {
+        out_width_ = width & ~1;
+        out_height_ = height & ~1;
+        out_fps_ = std::max(1, fps);
+    }
+
+    // 拼接线程数，0 = CPU 核数
+    void setThreads(int threads) {
+        threads_ = threads;
+    }
+
+    bool addStream(const std::string& uri) {
+        auto stream = std::make_unique<StreamInfo>();
+        stream->uri = uri;
+
+        stream->src = gst_element_factory_make("uridecodebin", nullptr);
+        stream->queue = gst_element_factory_make("queue", nullptr);
+        stream->convert = gst_element_factory_make("videoconvert", nullptr);
+        stream->sink = gst_element_factory_make("appsink", nullptr);
+
+        if (!stream->src || !stream->queue || !stream->convert || !stream->sink) {
+            g_printerr("Failed to create elements for stream: %s\n", uri.c_str());
+            return false;
+        }
+
+        g_object_set(G_OBJECT(stream->src), "uri", uri.c_str(), nullptr);
+
+        // 只留最新一帧，拼接线程跟不上时丢旧帧，不反压解码
+        g_object_set(stream->queue, "max-size-buffers", 1, "max-size-bytes", 0, "max-size-time", (guint64)0,
+                     "leaky", 2, nullptr);
+
+        // 解码器输出 I420 / NV12 时 videoconvert 直通，其他格式才真正转换
+        GstCaps* caps = gst_caps_from_string("video/x-raw, format=(string){ I420, NV12 }");
+        g_object_set(stream->sink, "caps", caps, "sync", FALSE, "max-buffers", 1, "drop", TRUE,
+                     "emit-signals", TRUE, nullptr);
+        gst_caps_unref(caps);
+
+        g_signal_connect(stream->sink, "new-sample", G_CALLBACK(onNewSample), stream.get());
+
+        streams_.push_back(std::move(stream));
+
+        g_print("Successfully added stream: %s\n", uri.c_str());
+        return true;
+    }
+
+    bool buildPipeline() {
+        if (streams_.empty()) {
+            g_printerr("No streams to play\n");
+            return false;
+        }
+
+        if (grid_cols_ <= 0 || grid_rows_ <= 0) {
+            grid_cols_ = (int)std::ceil(std::sqrt((double)streams_.size()));
+            grid_rows_ = ((int)streams_.size() + grid_cols_ - 1) / grid_cols_;
+        }
+        if ((int)streams_.size() > grid_cols_ * grid_rows_) {
+            g_printerr("Too many streams for %dx%d grid\n", grid_cols_, grid_rows_);
+            return false;
+        }
+
+        pipeline_ = gst_pipeline_new("mosaic-pipeline");
+        appsrc_ = gst_element_factory_make("appsrc", "mosaic-src");
+        GstElement* queue = gst_element_factory_make("queue", nullptr);
+        GstElement* convert = gst_element_factory_make("videoconvert", nullptr);
+        GstElement* sink = gst_element_factory_make("autovideosink", "sink");
+
+        if (!pipeline_ || !appsrc_ || !queue || !convert || !sink) {
+            g_printerr("Failed to create output elements\n");
+            return false;
+        }
+
+        GstCaps* caps = gst_caps_new_simple("video/x-raw",
+                                            "format", G_TYPE_STRING, "I420",
+                                            "width", G_TYPE_INT, out_width_,
+                                            "height", G_TYPE_INT, out_height_,
+                                            "framerate", GST_TYPE_FRACTION, out_fps_, 1,
+                                            nullptr);
+        gst_video_info_from_caps(&canvas_info_, caps);
+
+        // live + do-timestamp：按推入时刻打时间戳
+        g_object_set(appsrc_, "caps", caps, "is-live", TRUE, "do-timestamp", TRUE, "format", GST_FORMAT_TIME,
+                     "max-bytes", (guint64)(GST_VIDEO_INFO_SIZE(&canvas_info_) * 2), nullptr);
+
+        canvas_pool_ = createCanvasPool(caps, canvas_info_);
+        gst_caps_unref(caps);
+        if (!canvas_pool_)
+            return false;
+
+        gst_bin_add_many(GST_BIN(pipeline_), appsrc_, queue, convert, sink, nullptr);
+        if (!gst_element_link_many(appsrc_, queue, convert, sink, nullptr)) {
+            g_printerr("Failed to link output elements\n");
+            return false;
+        }
+
+        for (auto& stream : streams_) {
+            gst_bin_add_many(GST_BIN(pipeline_), stream->src, stream->queue, stream->convert, stream->sink, nullptr);
+            if (!gst_element_link_many(stream->queue, stream->convert, stream->sink, nullptr)) {
+                g_printerr("Failed to link stream elements for %s\n", stream->uri.c_str());
+                return false;
+            }
+            g_signal_connect(stream->src, "pad-added", G_CALLBACK(onPadAdded), stream.get());
+        }
+
+        int threads = threads_ > 0 ? threads_ : (int)g_get_num_processors();
+        mosaic_ = std::make_unique<MosaicCompositor>(out_width_, out_height_, grid_cols_, grid_rows_, threads);
+
+        g_print("Mosaic %dx%d grid, output %dx%d@%d, %d threads, kernel %s\n",
+                grid_cols_, grid_rows_, out_width_, out_height_, out_fps_, threads, tile_simd_name());
+        return true;
+    }
+
+    bool startAll() {
+        if (!buildPipeline()) {
+            g_printerr("Failed to build pipeline\n");
+            return false;
+        }
+
+        GstStateChangeReturn ret = gst_element_set_state(pipeline_, GST_STATE_PLAYING);
+        if (ret == GST_STATE_CHANGE_FAILURE) {
+            g_printerr("Failed to start pipeline\n");
+            return false;
+        }
+
+        GstBus* bus = gst_element_get_bus(pipeline_);
+        gst_bus_add_watch(bus, busWatchHandler, this);
+        gst_object_unref(bus);
+
+        main_loop_ = g_main_loop_new(nullptr, FALSE);
+
+        running_ = true;
+        compose_thread_ = std::thread(&MosaicPlayer::composeLoop, this);
+
+        last_proc_ = proc_sample_now();
+        g_timeout_add_seconds(5, reportStats, this);
+
+        g_print("Starting %zu video streams...\n", streams_.size());
+        g_print("Press Ctrl+C to stop\n");
+
+        g_main_loop_run(main_loop_);
+
+        return true;
+    }
+
+    void stop() {
+        if (main_loop_)
+            g_main_loop_quit(main_loop_);
+    }
+
+private:
+    static void onPadAdded(GstElement* src, GstPad* new_pad, gpointer user_data) {
+        StreamInfo* stream = static_cast<StreamInfo*>(user_data);
+
+        GstCaps* new_pad_caps = gst_pad_get_current_caps(new_pad);
+        if (!new_pad_caps)
+            new_pad_caps = gst_pad_query_caps(new_pad, nullptr);
+        GstStructure* new_pad_struct = gst_caps_get_structure(new_pad_caps, 0);
+        const gchar* new_pad_type = gst_structure_get_name(new_pad_struct);
+
+        if (g_str_has_prefix(new_pad_type, "video/x-raw")) {
+            GstPad* sink_pad = gst_element_get_static_pad(stream->queue, "sink");
+            if (!gst_pad_is_linked(sink_pad) && GST_PAD_LINK_FAILED(gst_pad_link(new_pad, sink_pad)))
+                g_printerr("Failed to link video pad of %s\n", stream->uri.c_str());
+            gst_object_unref(sink_pad);
+        }
+
+        gst_caps_unref(new_pad_caps);
+    }
+
+    // appsink 线程：只替换最新帧的引用
+    static GstFlowReturn onNewSample(GstElement* appsink, gpointer user_data) {
+        StreamInfo* stream = static_cast<StreamInfo*>(user_data);
+
+        GstSample* sample = gst_app_sink_pull_sample(GST_APP_SINK(appsink));
+        if (!sample)
+            return GST_FLOW_ERROR;
+
+        GstSample* old;
+        {
+            std::lock_guard<std::mutex> lock(stream->mutex);
+            old = stream->latest;
+            stream->latest = sample;
+        }
+        if (old)
+            gst_sample_unref(old);
+
+        stream->frames.fetch_add(1, std::memory_order_relaxed);
+        return GST_FLOW_OK;
+    }
+
+    // 拼接线程：固定帧率输出
+    void composeLoop() {
+        const gint64 interval = G_USEC_PER_SEC / out_fps_;
+        gint64 next = g_get_monotonic_time();
+
+        size_t n = streams_.size();
+        std::vector<GstSample*> samples(n, nullptr);
+        std::vector<GstVideoFrame> frames(n);
+        std::vector<GstVideoFrame*> inputs(n, nullptr);
+
+        while (running_) {
+            next += interval;
+            gint64 now = g_get_monotonic_time();
+            if (next > now)
+                g_usleep(next - now);
+            else if (now - next > interval)
+                next = now; // 落后太多就不追了
+
+            gint64 t0 = g_get_monotonic_time();
+
+            for (size_t i = 0; i < n; i++) {
+                {
+                    std::lock_guard<std::mutex> lock(streams_[i]->mutex);
+                    samples[i] = streams_[i]->latest ? gst_sample_ref(streams_[i]->latest) : nullptr;
+                }
+                inputs[i] = nullptr;
+                if (!samples[i])
+                    continue;
+
+                GstVideoInfo info;
+                if (gst_video_info_from_caps(&info, gst_sample_get_caps(samples[i])) &&
+                    gst_video_frame_map(&frames[i], &info, gst_sample_get_buffer(samples[i]), GST_MAP_READ))
+                    inputs[i] = &frames[i];
+            }
+
+            GstBuffer* canvas = nullptr;
+            GstVideoFrame out;
+            bool ok = gst_buffer_pool_acquire_buffer(canvas_pool_, &canvas, nullptr) == GST_FLOW_OK &&
+                      gst_video_frame_map(&out, &canvas_info_, canvas, GST_MAP_WRITE);
+            if (ok) {
+                mosaic_->compose(&out, inputs.data(), (int)n);
+                gst_video_frame_unmap(&out);
+            }
+
+            for (size_t i = 0; i < n; i++) {
+                if (inputs[i])
+                    gst_video_frame_unmap(&frames[i]);
+                if (samples[i])
+                    gst_sample_unref(samples[i]);
+            }
+
+            if (!ok) {
+                if (canvas)
+                    gst_buffer_unref(canvas);
+                continue;
+            }
+
+            compose_us_.fetch_add(g_get_monotonic_time() - t0, std::memory_order_relaxed);
+            composed_.fetch_add(1, std::memory_order_relaxed);
+
+            if (gst_app_src_push_buffer(GST_APP_SRC(appsrc_), canvas) != GST_FLOW_OK && running_) {
+                g_printerr("Mosaic output stopped\n");
+                break;
+            }
+        }
+    }
+
+    static gboolean reportStats(gpointer user_data) {
+        MosaicPlayer* player = static_cast<MosaicPlayer*>(user_data);
+
+        ProcSample now = proc_sample_now();
+        double seconds = (now.wall_us - player->last_proc_.wall_us) / 1e6;
+        guint64 composed = player->composed_.load();
+        gint64 compose_us = player->compose_us_.load();
+        guint64 frames = composed - player->last_composed_;
+
+        g_print("[mosaic] out %.1f fps, compose %.2f ms/frame, CPU %.0f%%, input fps:",
+                seconds > 0 ? frames / seconds : 0.0,
+                frames ? (compose_us - player->last_compose_us_) / 1000.0 / frames : 0.0,
+                proc_cpu_percent(player->last_proc_, now));
+        for (auto& stream : player->streams_) {
+            guint64 in = stream->frames.load();
+            g_print(" %.1f", seconds > 0 ? (in - stream->last_frames) / seconds : 0.0);
+            stream->last_frames = in;
+        }
+        g_print("\n");
+
+        player->last_proc_ = now;
+        player->last_composed_ = composed;
+        player->last_compose_us_ = compose_us;
+        return TRUE;
+    }
+
+    static gboolean busWatchHandler(GstBus* bus, GstMessage* msg, gpointer user_data) {
+        MosaicPlayer* player = static_cast<MosaicPlayer*>(user_data);
+
+        switch (GST_MESSAGE_TYPE(msg)) {
+            case GST_MESSAGE_EOS: {
+                g_print("End of stream reached\n");
+                g_main_loop_quit(player->main_loop_);
+                break;
+            }
+
+            case GST_MESSAGE_ERROR: {
+                GError* error;
+                gchar* debug_info;
+                gst_message_parse_error(msg, &error, &debug_info);
+                g_printerr("Error: %s\n", error->message);
+                if (debug_info) {
+                    g_printerr("Debug info: %s\n", debug_info);
+                }
+                g_error_free(error);
+                g_free(debug_info);
+                g_main_loop_quit(player->main_loop_);
+                break;
+            }
+
+            case GST_MESSAGE_WARNING: {
+                GError* warning;
+                gchar* debug_info;
+                gst_message_parse_warning(msg, &warning, &debug_info);
+                g_printerr("Warning: %s\n", warning->message);
+                if (debug_info) {
+                    g_printerr("Debug info: %s\n", debug_info);
+                }
+                g_error_free(warning);
+                g_free(debug_info);
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        return TRUE;
+    }
+
+    void cleanup() {
+        running_ = false;
+        if (compose_thread_.joinable())
+            compose_thread_.join();
+
+        if (pipeline_) {
+            gst_element_set_state(pipeline_, GST_STATE_NULL);
+            gst_object_unref(pipeline_);
+            pipeline_ = nullptr;
+        }
+
+        if (canvas_pool_) {
+            gst_buffer_pool_set_active(canvas_pool_, FALSE);
+            gst_object_unref(canvas_pool_);
+            canvas_pool_ = nullptr;
+        }
+
+        if (main_loop_) {
+            g_main_loop_unref(main_loop_);
+            main_loop_ = nullptr;
+        }
+    }
+};
+
+/* ---------------------------------------------------------
+ * 基准：4 / 9 / 16 / 25 路 1080p NV12 输入拼成 1920x1080
+ *   compositor：appsrc -> queue -> videoscale -> videoconvert -> compositor -> fakesink
+ *              （与 mul_pull_place.cc 相同的链路，只是把解码换成预先生成的帧）
+ *   mosaic：    MosaicCompositor 直接缩放贴图
+ * 两边都不限速，统计输出帧率和 CPU（100% = 一个核）
+ * --------------------------------------------------------- */
+static GstBuffer* makeBenchFrame(const GstVideoInfo& info, int seed) {
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&info), nullptr);
+    GstVideoFrame frame;
+    GstVideoInfo copy = info;
+    gst_video_frame_map(&frame, &copy, buffer, GST_MAP_WRITE);
+
+    int width = GST_VIDEO_INFO_WIDTH(&info);
+    int height = GST_VIDEO_INFO_HEIGHT(&info);
+    for (int y = 0; y < height; y++) {
+        guint8* row = (guint8*)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0) + y * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+        for (int x = 0; x < width; x++)
+            row[x] = (guint8)(16 + ((x + y + seed * 97) % 220));
+    }
+    for (int y = 0; y < height / 2; y++) {
+        guint8* row = (guint8*)GST_VIDEO_FRAME_PLANE_DATA(&frame, 1) + y * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 1);
+        for (int x = 0; x < width; x++)
+            row[x] = (guint8)(64 + ((x / 64 + y / 64 + seed) % 8) * 16);
+    }
+
+    gst_video_frame_unmap(&frame);
+    return buffer;
+}
+
+struct BenchSource {
+    GstBuffer* frame;
+    int pushed;
+    int total;
+};
+
+static void benchNeedData(GstAppSrc* src, guint length, gpointer user_data) {
+    BenchSource* source = static_cast<BenchSource*>(user_data);
+    if (source->pushed >= source->total) {
+        gst_app_src_end_of_stream(src);
+        return;
+    }
+
+    // 只复制 buffer 头，像素内存共享
+    GstBuffer* buffer = gst_buffer_copy(source->frame);
+    GST_BUFFER_PTS(buffer) = gst_util_uint64_scale(source->pushed, GST_SECOND, 25);
+    GST_BUFFER_DURATION(buffer) = GST_SECOND / 25;
+    source->pushed++;
+    gst_app_src_push_buffer(src, buffer);
+}
+
+static GstPadProbeReturn benchCountProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data) {
+    static_cast<std::atomic<guint64>*>(user_data)->fetch_add(1, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+static bool runCompositorBench(const std::vector<GstBuffer*>& frames, GstCaps* in_caps, int n_tiles, int cols,
+                               int n_frames, double& fps, double& cpu) {
+    int rows = (n_tiles + cols - 1) / cols;
+    int cell_width = 1920 / cols;
+    int cell_height = 1080 / rows;
+
+    GstElement* pipeline = gst_pipeline_new("compositor-bench");
+    GstElement* compositor = gst_element_factory_make("compositor", nullptr);
+    GstElement* filter = gst_element_factory_make("capsfilter", nullptr);
+    GstElement* sink = gst_element_factory_make("fakesink", nullptr);
+    if (!pipeline || !compositor || !filter || !sink) {
+        g_printerr("Failed to create compositor benchmark elements\n");
+        return false;
+    }
+
+    GstCaps* out_caps = gst_caps_from_string("video/x-raw, format=I420, width=1920, height=1080, framerate=25/1");
+    g_object_set(filter, "caps", out_caps, nullptr);
+    gst_caps_unref(out_caps);
+    g_object_set(sink, "sync", FALSE, nullptr);
+
+    gst_bin_add_many(GST_BIN(pipeline), compositor, filter, sink, nullptr);
+    gst_element_link_many(compositor, filter, sink, nullptr);
+
+    std::vector<BenchSource> sources(n_tiles);
+    for (int i = 0; i < n_tiles; i++) {
+        sources[i] = {frames[i % frames.size()], 0, n_frames};
+
+        GstElement* src = gst_element_factory_make("appsrc", nullptr);
+        GstElement* queue = gst_element_factory_make("queue", nullptr);
+        GstElement* scale = gst_element_factory_make("videoscale", nullptr);
+        GstElement* convert = gst_element_factory_make("videoconvert", nullptr);
+
+        g_object_set(src, "caps", in_caps, "format", GST_FORMAT_TIME, nullptr);
+        GstAppSrcCallbacks callbacks = {};
+        callbacks.need_data = benchNeedData;
+        gst_app_src_set_callbacks(GST_APP_SRC(src), &callbacks, &sources[i], nullptr);
+
+        gst_bin_add_many(GST_BIN(pipeline), src, queue, scale, convert, nullptr);
+        gst_element_link_many(src, queue, scale, convert, nullptr);
+
+        GstPad* convert_pad = gst_element_get_static_pad(convert, "src");
+        GstPad* compositor_sink_pad = gst_element_get_request_pad(compositor, "sink_%u");
+        g_object_set(compositor_sink_pad,
+                     "xpos", (i % cols) * cell_width,
+                     "ypos", (i / cols) * cell_height,
+                     "width", cell_width,
+                     "height", cell_height,
+                     nullptr);
+        gst_pad_link(convert_pad, compositor_sink_pad);
+        gst_object_unref(convert_pad);
+        gst_object_unref(compositor_sink_pad);
+    }
+
+    std::atomic<guint64> out_frames{0};
+    GstPad* sink_pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, benchCountProbe, &out_frames, nullptr);
+    gst_object_unref(sink_pad);
+
+    ProcSample t0 = proc_sample_now();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    GstBus* bus = gst_element_get_bus(pipeline);
+    GstMessage* msg = gst_bus_timed_pop_filtered(bus, 300 * GST_SECOND,
+                                                 (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    ProcSample t1 = proc_sample_now();
+
+    bool ok = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (msg)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    double seconds = (t1.wall_us - t0.wall_us) / 1e6;
+    fps = seconds > 0 ? out_frames.load() / seconds : 0.0;
+    cpu = proc_cpu_percent(t0, t1);
+    return ok;
+}
+
+static bool runMosaicBench(const std::vector<GstBuffer*>& frames, const GstVideoInfo& in_info, int n_tiles, int cols,
+                           int threads, int n_frames, double& fps, double& cpu) {
+    int rows = (n_tiles + cols - 1) / cols;
+
+    GstCaps* caps = gst_caps_from_string("video/x-raw, format=I420, width=1920, height=1080, framerate=25/1");
+    GstVideoInfo out_info;
+    gst_video_info_from_caps(&out_info, caps);
+    GstBufferPool* pool = createCanvasPool(caps, out_info);
+    gst_caps_unref(caps);
+    if (!pool)
+        return false;
+
+    // 与运行时一样，每个 tile 一帧已解码的 NV12（映射一次，反复使用）
+    std::vector<GstVideoFrame> in_frames(n_tiles);
+    std::vector<GstVideoFrame*> inputs(n_tiles);
+    for (int i = 0; i < n_tiles; i++) {
+        GstVideoInfo info = in_info;
+        gst_video_frame_map(&in_frames[i], &info, frames[i % frames.size()], GST_MAP_READ);
+        inputs[i] = &in_frames[i];
+    }
+
+    MosaicCompositor mosaic(1920, 1080, cols, rows, threads);
+
+    ProcSample t0 = proc_sample_now();
+    for (int f = 0; f < n_frames; f++) {
+        GstBuffer* canvas = nullptr;
+        GstVideoFrame out;
+        if (gst_buffer_pool_acquire_buffer(pool, &canvas, nullptr) != GST_FLOW_OK)
+            break;
+        if (gst_video_frame_map(&out, &out_info, canvas, GST_MAP_WRITE)) {
+            mosaic.compose(&out, inputs.data(), n_tiles);
+            gst_video_frame_unmap(&out);
+        }
+        gst_buffer_unref(canvas);
+    }
+    ProcSample t1 = proc_sample_now();
+
+    for (auto& frame : in_frames)
+        gst_video_frame_unmap(&frame);
+    gst_buffer_pool_set_active(pool, FALSE);
+    gst_object_unref(pool);
+
+    double seconds = (t1.wall_us - t0.wall_us) / 1e6;
+    fps = seconds > 0 ? n_frames / seconds : 0.0;
+    cpu = proc_cpu_percent(t0, t1);
+    return true;
+}
+
+static int runBenchmark(int n_frames, int threads) {
+    GstCaps* in_caps = gst_caps_from_string("video/x-raw, format=NV12, width=1920, height=1080, framerate=25/1");
+    GstVideoInfo in_info;
+    gst_video_info_from_caps(&in_info, in_caps);
+
+    std::vector<GstBuffer*> frames;
+    for (int i = 0; i < 4; i++)
+        frames.push_back(makeBenchFrame(in_info, i));
+
+    if (threads <= 0)
+        threads = (int)g_get_num_processors();
+
+    g_print("\n===== Mosaic benchmark: 1080p NV12 inputs -> 1920x1080 I420, %d frames, %d threads, kernel %s =====\n",
+            n_frames, threads, tile_simd_name());
+    g_print("%-6s %16s %14s %14s %12s %9s\n", "tiles", "compositor fps", "compositor CPU", "mosaic fps", "mosaic CPU",
+            "speedup");
+
+    const int grids[] = {2, 3, 4, 5};
+    for (int cols : grids) {
+        int n_tiles = cols * cols;
+        double c_fps = 0, c_cpu = 0, m_fps = 0, m_cpu = 0;
+
+        bool c_ok = runCompositorBench(frames, in_caps, n_tiles, cols, n_frames, c_fps, c_cpu);
+        bool m_ok = runMosaicBench(frames, in_info, n_tiles, cols, threads, n_frames, m_fps, m_cpu);
+
+        char c_fps_str[32];
+        g_snprintf(c_fps_str, sizeof(c_fps_str), c_ok ? "%.1f" : "failed", c_fps);
+        g_print("%-6d %16s %13.0f%% %14.1f %11.0f%% %8.1fx\n", n_tiles, c_fps_str, c_cpu,
+                m_ok ? m_fps : 0.0, m_cpu, c_ok && c_fps > 0 ? m_fps / c_fps : 0.0);
+    }
+
+    for (GstBuffer* buffer : frames)
+        gst_buffer_unref(buffer);
+    gst_caps_unref(in_caps);
+    return 0;
+}
+
+static MosaicPlayer* active_player = nullptr;
+
+static void handleSignal(int signum) {
+    if (active_player)
+        active_player->stop();
+}
+
+// 使用示例
+int main(int argc, char* argv[]) {
+    gst_init(&argc, &argv);
+
+    if (argc < 2) {
+        g_print("Usage: %s [--grid COLSxROWS] [--threads N] [--fps N] uri1 [uri2 ...]\n", argv[0]);
+        g_print("       %s --bench [frames] [--threads N]\n", argv[0]);
+        return 0;
+    }
+
+    int threads = 0;
+    int cols = 0, rows = 0;
+    int fps = 25;
+    bool bench = false;
+    int bench_frames = 250;
+    std::vector<std::string> uris;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bench") {
+            bench = true;
+            if (i + 1 < argc && g_ascii_isdigit(argv[i + 1][0]))
+                bench_frames = atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (arg == "--grid" && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &cols, &rows);
+        } else if (arg == "--fps" && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+        } else {
+            uris.push_back(arg);
+        }
+    }
+
+    if (bench)
+        return runBenchmark(bench_frames, threads);
+
+    MosaicPlayer player;
+    player.setGridLayout(cols, rows);
+    player.setOutput(1920, 1080, fps);
+    player.setThreads(threads);
+
+    for (const auto& uri : uris)
+        player.addStream(uri);
+
+    active_player = &player;
+    signal(SIGINT, handleSignal);
+
+    player.startAll();
+
+    active_player = nullptr;
+    return 0;
+}
+
+// g++ mul_pull_mosaic.cc -o mul_pull_mosaic -pthread `pkg-config --cflags --libs gstreamer-1.0 gstreamer-app-1.0 gstreamer-video-1.0`
+// ./mul_pull_mosaic rtsp://... rtsp://... rtsp://... rtsp://...
+// ./mul_pull_mosaic --bench 250          4 / 9 / 16 / 25 路 compositor 与 mosaic 的输出帧率、CPU 对比